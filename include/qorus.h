@@ -46,6 +46,59 @@ void q_free_memory(q_context* restrict ctx);
 // Returns: Pointer to static string (do not free)
 const char* q_strerror(q_error_code err);
 
+// ============================================================================
+// Profiling API (per-op x per-layer timers, build with make PROFILE=1)
+// ============================================================================
+// rdtsc timers around each op of llama_attention_forward, llama_mlp_forward,
+// the LM head and the sampling stages of q_generate. Without Q_PROFILE the
+// timers compile to nothing and q_profile_enable reports Q_ERR_INVALID_CONFIG.
+// Stats belong to the context: one context per thread, no locking.
+
+// Allocate stats, calibrate the TSC and attach them to ctx (resets if already enabled)
+// Returns: Q_OK, Q_ERR_INVALID_CONFIG (built without Q_PROFILE), Q_ERR_ALLOC_FAILED
+q_error_code q_profile_enable(q_context* restrict ctx);
+
+// Detach and free stats (also done by q_free_memory)
+void q_profile_disable(q_context* restrict ctx);
+
+// Zero all counters (keeps calibration)
+void q_profile_reset(q_context* restrict ctx);
+
+// Stats attached to ctx, or NULL when profiling is off
+// entries[layer][op]; layer = Q_PROFILE_GLOBAL for LM head / sampling stages
+const q_profile_stats* q_profile_get(const q_context* restrict ctx);
+
+// Ticks -> nanoseconds with the calibration of stats
+double q_profile_ticks_to_ns(const q_profile_stats* restrict stats, uint64_t ticks);
+
+// Short op name ("qkv_proj", "sampler", ...); "unknown" if out of range
+const char* q_profile_op_name(q_profile_op op);
+
+// Human-readable report: per-op totals across layers + per-layer totals
+void q_profile_print(const q_context* restrict ctx, FILE* out);
+
+// Timeline trace: the same timers as complete events (begin + duration) in a
+// process-wide lock-free ring buffer, tagged with layer and thread. Adds
+// "layer", "prefill" and "decode" spans. The oldest events are overwritten when full.
+// Enable, disable and dump are safe while forwards run on other threads: a ring
+// is never freed once published (one retained per capacity, reused on re-enable),
+// so an event in flight across a disable/enable lands in the old or new session.
+
+// Start a new session (capacity in events, rounded up to a power of 2; 0 = default)
+// Allocates the ring on first use of a capacity; previous events are discarded
+// Returns: Q_OK, Q_ERR_INVALID_CONFIG (built without Q_PROFILE), Q_ERR_INVALID_SIZE, Q_ERR_ALLOC_FAILED
+q_error_code q_trace_enable(uint32_t capacity);
+
+// Stop recording (the ring stays allocated for in-flight emitters and reuse)
+void q_trace_disable(void);
+
+// Events recorded since q_trace_enable (may exceed capacity: older ones are gone)
+uint64_t q_trace_event_count(void);
+
+// Dump the ring as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+// Returns: Q_OK, Q_ERR_INVALID_CONFIG (trace not enabled), Q_ERR_INVALID_ARG, Q_ERR_FILE_WRITE
+q_error_code q_trace_write_json(FILE* out);
+
 // ============================================================================
 // Mathematical Operations API (AVX2 Optimized)
 // ============================================================================
@@ -88,6 +141,25 @@ q_error_code q_matmul_f32_avx2(
     q_context* restrict ctx
 );
 
+// LM Head + Top-k FP32: top-k of (W @ x) without materializing the logits
+// Streams W in 8-row blocks and keeps the running top-k (k == 1: argmax) in
+// registers; per-row arithmetic is identical to q_matmul_f32_avx2
+// Preconditions:
+// - x: FP32 vector [dim], 32-byte aligned (normalized hidden state)
+// - weights: FP32 matrix [vocab_size, dim] (LM head / output embedding)
+// - k: 1 <= k <= vocab_size
+// - top_ids, top_logits: Output buffers [k]; sorted by logit descending, ties -> lower id
+// - logits: Optional output [vocab_size] (NULL = full logits are never written)
+// Returns: Q_OK on success, negative q_error_code on validation failure
+q_error_code q_lm_head_topk_f32_avx2(
+    const float* restrict x,            // [dim]
+    const q_tensor* restrict weights,   // [vocab_size, dim]
+    uint32_t k,                         // Number of candidates
+    uint32_t* restrict top_ids,         // [k] output
+    float* restrict top_logits,         // [k] output
+    float* restrict logits              // [vocab_size] optional output (NULL = skip)
+);
+
 // Causal Masking FP32: Set upper triangular elements to mask_value
 // Critical operation for attention (prevent future tokens from attending to past tokens)
 // Preconditions:
@@ -99,6 +171,38 @@ q_error_code q_causal_mask_f32_avx2(
     float mask_value            // Value to set masked positions
 );
 
+// Token Mask FP32: Set logits of disallowed tokens to mask_value
+// Used by constrained decoding (q_grammar) before softmax/sampling
+// Preconditions:
+// - logits: FP32 array [vocab_size] (modified in-place, no alignment required)
+// - allowed: Bitmask [ceil(vocab_size / 32)], bit i set = token i allowed
+// - mask_value: typically -INFINITY (probability 0 after softmax)
+// Returns: Q_OK on success, negative q_error_code on validation failure
+q_error_code q_token_mask_f32_avx2(
+    float* restrict logits,             // [vocab_size] (modified in-place)
+    const uint32_t* restrict allowed,   // [ceil(vocab_size / 32)] bitmask
+    uint32_t vocab_size,                // Number of logits
+    float mask_value                    // Value for disallowed tokens
+);
+
+// Penalties FP32: repetition / frequency / presence on previously generated tokens
+// Gathers only the logits listed in counts (O(n_unique), independent of vocab_size)
+// Preconditions:
+// - logits: FP32 array [vocab_size] (modified in-place, no alignment required)
+// - counts: Token histogram (q_token_counts_add), all ids < vocab_size
+// - repetition_penalty: >= 0 (0 or 1 = disabled); logit / p if > 0, logit * p otherwise
+// - frequency_penalty: logit -= count * frequency_penalty (0 = disabled)
+// - presence_penalty: logit -= presence_penalty for every listed token (0 = disabled)
+// Returns: Q_OK on success, negative q_error_code on validation failure
+q_error_code q_apply_penalties_f32_avx2(
+    float* restrict logits,                 // [vocab_size] (modified in-place)
+    uint32_t vocab_size,                    // Number of logits
+    const q_token_counts* restrict counts,  // Sparse token histogram
+    float repetition_penalty,
+    float frequency_penalty,
+    float presence_penalty
+);
+
 // Tensor Add FP32: output = a + b
 // Critical operation for residual connections in Transformer blocks
 // Preconditions:
@@ -218,17 +322,89 @@ q_error_code llama_forward(
     float* restrict logits
 );
 
+// Forward pass with fused LM head + top-k selection (greedy / small-k decoding)
+// Same as llama_forward, but the vocab projection is reduced on the fly to the
+// k best tokens; the [vocab_size] logits buffer is only written if requested
+// Preconditions:
+// - model, ctx, tokens, seq_len, pos: Same as llama_forward
+// - k: 1 <= k <= vocab_size (k == 1: greedy argmax)
+// - top_ids, top_logits: Output buffers [k], sorted by logit descending (ties -> lower id)
+// - logits: Optional output buffer [vocab_size] (NULL = not materialized)
+// Returns: Q_OK on success, negative q_error_code on validation failure
+// Note: top_ids[0] with k == 1 equals q_sample_token(logits, ..., temperature = 0)
+q_error_code llama_forward_topk(
+    q_llama_model* restrict model,
+    q_context* restrict ctx,
+    const uint32_t* restrict tokens,
+    uint32_t seq_len,
+    uint32_t pos,
+    uint32_t k,
+    uint32_t* restrict top_ids,
+    float* restrict top_logits,
+    float* restrict logits
+);
+
+// Score a full sequence: log-probability of each token given its prefix
+// One prefill over all positions + LM head in [row tile x vocab chunk] GEMMs
+// with a fused online log-softmax gather ([seq_len, vocab_size] is never materialized)
+// Preconditions:
+// - model, ctx: Same as llama_forward (KV cache positions [pos, pos+seq_len) are overwritten)
+// - tokens: Token IDs [seq_len], all < vocab_size
+// - seq_len: 2 <= seq_len <= max_seq_len
+// - logprobs: Output buffer [seq_len - 1]; logprobs[i] = log p(tokens[i+1] | tokens[0..i])
+// Returns: Q_OK on success, negative q_error_code on validation failure
+// Note: Uses arena for temporaries; caller resets arena (q_arena_reset) after use
+// Note: Perplexity = exp(-mean(logprobs))
+q_error_code llama_score_tokens(
+    q_llama_model* restrict model,
+    q_context* restrict ctx,
+    const uint32_t* restrict tokens,
+    uint32_t seq_len,
+    uint32_t pos,
+    float* restrict logprobs
+);
+
+// Sentence embeddings: pooled + L2-normalized final hidden states
+// Skips the LM head entirely (no vocab projection). Each sequence is run as
+// one prefill (all positions batched); sequences never attend to each other.
+// Preconditions:
+// - model, ctx: Same as llama_forward (KV cache positions [0, seq_lens[i]) are overwritten)
+// - tokens: Concatenated token IDs of all sequences [sum(seq_lens)]
+// - seq_lens: Length of each sequence [n_seqs], 0 < seq_lens[i] <= max_seq_len
+// - n_seqs: Number of sequences (> 0)
+// - pooling: Q_POOL_MEAN or Q_POOL_LAST
+// - embeddings: Output buffer [n_seqs, dim]; each row has unit L2 norm
+// Returns: Q_OK on success, negative q_error_code on validation failure
+// Note: Arena temporaries are released after each sequence (arena head restored)
+q_error_code llama_embed(
+    q_llama_model* restrict model,
+    q_context* restrict ctx,
+    const uint32_t* restrict tokens,
+    const uint32_t* restrict seq_lens,
+    uint32_t n_seqs,
+    q_pooling_type pooling,
+    float* restrict embeddings
+);
+
 // ============================================================================
 // Tokenizer API (BPE - Byte Pair Encoding)
 // ============================================================================
 
 // Load tokenizer from binary file
+// v1: parse sequencial; v2: mmap read-only, strings e tabela de merges usadas in-place
 // Preconditions:
 // - tok: Uninitialized tokenizer structure
-// - tokenizer_path: Path to tokenizer binary file
+// - tokenizer_path: Path to tokenizer binary file (QTKR v1 or v2)
 // Returns: Q_OK on success, negative q_error_code on error
 q_error_code q_tokenizer_load(q_tokenizer* restrict tok, const char* tokenizer_path);
 
+// Save tokenizer in v2 format (string blob, offset table, prebuilt merge table)
+// Converte tokenizers v1 para o formato mmap; mesmo layout de tools/convert_llama.py
+// Preconditions:
+// - tok: Initialized tokenizer, all vocab strings non-NULL
+// Returns: Q_OK on success, Q_ERR_FILE_OPEN/Q_ERR_FILE_WRITE on I/O error
+q_error_code q_tokenizer_save(const q_tokenizer* restrict tok, const char* path);
+
 // Encode text into token IDs
 // Preconditions:
 // - tok: Initialized tokenizer (from q_tokenizer_load)
@@ -249,6 +425,63 @@ q_error_code q_tokenizer_encode(
     bool add_eos
 );
 
+// Encode text with an explicit length (no null terminator or strlen needed)
+// Same contract as q_tokenizer_encode; text[0..text_len) may contain any bytes.
+// With max_tokens >= text_len + 2 the encode writes straight into tokens_out
+// (no allocation)
+// Preconditions:
+// - text: UTF-8 bytes [text_len] (NULL allowed if text_len == 0; invalid UTF-8
+//   is encoded byte by byte and counted in q_tokenizer_stats.invalid_utf8_texts)
+// Returns: Q_OK on success, Q_ERR_ARENA_OOM if buffer too small or text_len > 1MB
+q_error_code q_tokenizer_encode_len(
+    q_tokenizer* restrict tok,
+    const char* restrict text,
+    size_t text_len,
+    uint32_t* restrict tokens_out,
+    uint32_t* restrict num_tokens_out,
+    uint32_t max_tokens,
+    bool add_bos,
+    bool add_eos
+);
+
+// Encode many texts across threads into a ragged output buffer
+// Documentos são distribuídos em faixas contíguas (balanceadas por bytes); cada thread
+// usa uma arena de scratch reutilizada entre documentos (sem malloc por documento)
+// Preconditions:
+// - tok: Initialized tokenizer
+// - inputs: (text, len) pairs [num_inputs]; text need not be null-terminated (len <= 1MB)
+// - tokens_out: Ragged buffer [tokens_capacity] (worst case: sum(len) + 2 × num_inputs)
+// - offsets_out: [num_inputs + 1]; tokens of input i = tokens_out[offsets_out[i] .. offsets_out[i + 1])
+// - num_threads: 0 = auto (online CPUs, ≥ 32KB of text per thread)
+// Returns: Q_OK on success; Q_ERR_ARENA_OOM if tokens_capacity is too small
+//          (offsets_out[num_inputs] = required capacity), negative on error
+q_error_code q_tokenizer_encode_batch(
+    q_tokenizer* restrict tok,
+    const q_text_span* restrict inputs,
+    uint32_t num_inputs,
+    uint32_t* restrict tokens_out,
+    size_t tokens_capacity,
+    size_t* restrict offsets_out,
+    bool add_bos,
+    bool add_eos,
+    uint32_t num_threads
+);
+
+// Pre-tokenizer (Llama-3 split pattern): end of the pre-token starting at pos
+// BPE merges are applied per pre-token and never cross its boundaries
+// Preconditions:
+// - text: UTF-8 bytes [len] (need not be null-terminated; invalid UTF-8 tolerated)
+// - pos < len must be a pre-token boundary (0 or a previous return value)
+// Returns: end offset in (pos, len]; len if pos >= len
+size_t q_pretokenize_next(const char* text, size_t len, size_t pos);
+
+// Validate UTF-8 (RFC 3629: no overlong forms, surrogates or code points > U+10FFFF)
+// AVX2: 32-byte strides; pure-ASCII blocks cost one movemask
+// Preconditions:
+// - text: bytes [len] (need not be null-terminated; NULL allowed if len == 0)
+// Returns: true if text[0..len) is well-formed UTF-8
+bool q_utf8_validate(const char* text, size_t len);
+
 // Decode token IDs into text
 // Preconditions:
 // - tok: Initialized tokenizer
@@ -265,6 +498,48 @@ q_error_code q_tokenizer_decode(
     size_t text_buf_size
 );
 
+// Streaming detokenizer: inicializa estado (sem alocação)
+// Preconditions:
+// - dec: Decoder state (owned by caller; one per stream)
+// - tok: Initialized tokenizer (must outlive dec)
+// Returns: Q_OK on success, Q_ERR_INVALID_ARG on invalid input
+q_error_code q_detokenizer_init(q_detokenizer* restrict dec, const q_tokenizer* restrict tok);
+
+// Decode one token, emitting only newly completed bytes (null-terminated)
+// Bytes of a UTF-8 sequence that is still incomplete are held back until a later
+// token completes it; special tokens (BOS/EOS/PAD) and invalid IDs emit nothing.
+// Concatenated push + flush output equals q_tokenizer_decode of the whole sequence.
+// Preconditions:
+// - out_size >= token length + 4 (held-back bytes + '\0')
+// Returns: Q_OK on success, Q_ERR_ARENA_OOM if out is too small (state unchanged)
+q_error_code q_detokenizer_push(
+    q_detokenizer* restrict dec,
+    uint32_t token_id,
+    char* restrict out,
+    size_t out_size,
+    size_t* restrict out_len
+);
+
+// End of stream: emit held-back bytes as-is (truncated UTF-8) and reset state
+// Preconditions:
+// - out_size >= 4
+// Returns: Q_OK on success, Q_ERR_ARENA_OOM if out is too small
+q_error_code q_detokenizer_flush(
+    q_detokenizer* restrict dec,
+    char* restrict out,
+    size_t out_size,
+    size_t* restrict out_len
+);
+
+// Encode cache statistics (hit rate do cache por palavra)
+// Preconditions:
+// - tok: Tokenizer (cache ausente => stats zeradas, capacity = 0)
+// Returns: Q_OK on success, Q_ERR_INVALID_ARG if tok/stats is NULL
+q_error_code q_tokenizer_get_stats(const q_tokenizer* restrict tok, q_tokenizer_stats* restrict stats);
+
+// Reset hit/miss counters (cache contents are kept)
+void q_tokenizer_reset_stats(q_tokenizer* restrict tok);
+
 // Free tokenizer resources
 // Preconditions:
 // - tok: Initialized tokenizer
@@ -276,8 +551,42 @@ void q_tokenizer_free(q_tokenizer* restrict tok);
 // Generation API (FASE 4.2: Main Application)
 // ============================================================================
 
+// Seed a Philox4x32-10 stream (counter-based: no hidden state, no locks)
+// Distinct (seed, stream) pairs give statistically independent sequences;
+// use stream = request/sequence index to decorrelate parallel samplers
+void q_rng_init(q_rng* restrict rng, uint64_t seed, uint64_t stream);
+
+// Next uniform float in [0, 1) (24-bit resolution); advances the stream by one word
+float q_rng_uniform(q_rng* restrict rng);
+
+// Fill out[0..n) with uniform floats in [0, 1); AVX2, 8 Philox blocks per step
+// Same values as n successive q_rng_uniform calls (batch size does not change the stream)
+// Returns: Q_OK on success, Q_ERR_INVALID_ARG on invalid input
+q_error_code q_rng_uniform_f32(q_rng* restrict rng, float* restrict out, size_t n);
+
+// Sparse token histogram for penalties (see q_token_counts)
+// Preconditions:
+// - max_unique: Upper bound on distinct tokens (e.g. max_tokens), > 0
+// Returns: Q_OK on success, Q_ERR_ALLOC_FAILED on allocation failure
+q_error_code q_token_counts_init(q_token_counts* restrict tc, uint32_t max_unique);
+
+// Count one occurrence of token_id (O(1) amortized)
+// Returns: Q_OK on success, Q_ERR_INVALID_SIZE if more than max_unique distinct tokens
+q_error_code q_token_counts_add(q_token_counts* restrict tc, uint32_t token_id);
+
+// Occurrences of token_id (0 if never added)
+uint32_t q_token_counts_get(const q_token_counts* restrict tc, uint32_t token_id);
+
+// Forget all counts (O(n_unique); storage is kept)
+void q_token_counts_reset(q_token_counts* restrict tc);
+
+// Free histogram storage (safe on zero-initialized struct)
+void q_token_counts_free(q_token_counts* restrict tc);
+
 // Sample token from logits distribution
-// Uses partial sort O(V + k log k) for top-k/top-p, not full sort O(V log V)
+// Top-k-first: selects top-k candidates with a SIMD threshold/heap pass over the
+// logits; softmax renormalization, top-p and the CDF run only on the candidates
+// (no probs[V] buffer). Same token as a full-vocabulary softmax for the same RNG state
 // Preconditions:
 // - logits: Array of logits [vocab_size], 32-byte aligned
 // - vocab_size: Size of vocabulary (> 0)
@@ -299,6 +608,47 @@ q_error_code q_sample_token(
     q_context* restrict ctx              // [in] Contexto para arena (opcional, NULL = usar malloc)
 );
 
+// Sample token drawing the uniform from an explicit RNG stream
+// Same as q_sample_token, but reproducible per request: the draw comes from rng
+// (one q_rng_uniform per non-greedy call) instead of the thread-local generator
+// Preconditions: Same as q_sample_token; rng NULL = thread-local generator
+q_error_code q_sample_token_rng(
+    const float* restrict logits,        // [vocab_size] - logits do modelo
+    uint32_t vocab_size,                 // Tamanho do vocabulário
+    float temperature,                    // Temperatura (0.0 = greedy, >0.0 = sampling)
+    uint32_t top_k,                      // Top-k sampling (0 = desabilitado)
+    float top_p,                         // Nucleus sampling (0.0 = desabilitado)
+    q_rng* restrict rng,                 // [in/out] Stream (NULL = thread-local)
+    uint32_t* restrict token_id_out,     // [out] Token ID selecionado
+    q_context* restrict ctx              // [in] Contexto para arena (opcional, NULL = usar malloc)
+);
+
+// Sample token with min-p and locally typical filtering
+// Filters run in order top-k -> top-p -> min-p -> typical, each on the candidate
+// set left by the previous one (renormalized after every stage):
+// - min_p: keep p >= min_p * p_max. On descending candidates this is a prefix
+//   (binary search); without top-k/top-p the SIMD filter e >= min_p * e_max runs
+//   inside the normalizer pass and collects candidates in index order (no sort)
+// - typical_p: keep tokens by increasing |-log p - H| until mass >= typical_p;
+//   on descending candidates this is a contiguous window grown from the pivot
+//   (no sort). Typical alone collects and radix-sorts the whole vocabulary,
+//   so pair it with top_k or min_p for large vocabularies
+// Preconditions: Same as q_sample_token_rng; 0 <= min_p <= 1 (0 = disabled),
+// 0 <= typical_p <= 1 (0 or 1 = disabled)
+// Note: q_sample_token_rng(...) == q_sample_token_ext(..., 0.0f, 0.0f, ...)
+q_error_code q_sample_token_ext(
+    const float* restrict logits,        // [vocab_size] - logits do modelo
+    uint32_t vocab_size,                 // Tamanho do vocabulário
+    float temperature,                    // Temperatura (0.0 = greedy, >0.0 = sampling)
+    uint32_t top_k,                      // Top-k sampling (0 = desabilitado)
+    float top_p,                         // Nucleus sampling (0.0 = desabilitado)
+    float min_p,                         // Min-p (0.0 = desabilitado)
+    float typical_p,                     // Typical sampling (0.0 ou 1.0 = desabilitado)
+    q_rng* restrict rng,                 // [in/out] Stream (NULL = thread-local)
+    uint32_t* restrict token_id_out,     // [out] Token ID selecionado
+    q_context* restrict ctx              // [in] Contexto para arena (opcional, NULL = usar malloc)
+);
+
 // Generate text autoregressively
 // Preconditions:
 // - state: Initialized generation state (model, tokenizer, prompt_tokens set)
@@ -306,18 +656,113 @@ q_error_code q_sample_token(
 // - state->model: Valid model (from llama_build_graph)
 // - state->tokenizer: Valid tokenizer (from q_tokenizer_load)
 // - state->prompt_tokens: Array of prompt token IDs [num_prompt_tokens]
+//   (with resume: only the new tokens, appended after current_pos)
+// - state->resume: false = prefill from pos 0; true = continue from state->current_pos
+//   (restored by q_session_load or left by a previous q_generate on the same ctx)
+// - current_pos (if resume) + num_prompt_tokens <= config.max_seq_len
 // - state->generated_tokens: Pre-allocated buffer [max_tokens]
 // - state->temperature >= 0.0f && isfinite(temperature)
 // - state->max_tokens > 0
+// - state->grammar: NULL, or initialized grammar (reset at start, masks applied before sampling)
+// - state->on_token: NULL, or callback invoked per generated token (return false to stop)
+// - state->rng: NULL (thread-local generator), or seeded q_rng (reproducible per request)
+// - state->repetition/frequency/presence_penalty: finite, repetition >= 0 (0 = all disabled)
+// - state->min_p, state->typical_p: in [0, 1] (see q_sample_token_ext; 0 = disabled)
 // Returns: Q_OK on success, negative q_error_code on error
 // Postconditions:
 // - state->generated_tokens contains generated token IDs [0..num_generated_tokens-1]
 // - state->num_generated_tokens <= state->max_tokens
-// - KV Cache updated with all tokens (prompt + generated)
+// - KV Cache updated with all tokens (prompt + generated); state->current_pos = end of KV cache
 // - ctx->scratch_head reset after each token generation
+// - state->token_counts freed (histogram only lives during the call)
+// Note: Greedy without grammar or penalties uses llama_forward_topk (k = 1): no logits buffer
+// Note: Penalties run on generated tokens only, before the grammar mask
+// Note: A stop on EOS/on_token leaves the last generated token out of the KV cache; to
+//       resume after it, pass it first in the next call's prompt_tokens
 q_error_code q_generate(
     q_generation_state* restrict state    // [in/out] Generation state
 );
 
+// ============================================================================
+// Constrained Decoding API (JSON grammar)
+// ============================================================================
+
+// Initialize JSON grammar (RFC 8259, any root value) over tokenizer vocabulary
+// Per-state vocab bitmasks are built on first visit and cached
+// Special tokens: EOS allowed only when the document is complete; BOS/PAD never
+// Preconditions:
+// - tok: Loaded tokenizer (must outlive the grammar)
+// Returns: Q_OK on success
+//          Q_ERR_ALLOC_FAILED on allocation failure
+//          Q_ERR_INVALID_CONFIG if no token can start a JSON value
+q_error_code q_grammar_init_json(
+    q_grammar* restrict g,              // [out] Grammar state
+    const q_tokenizer* restrict tok     // [in] Vocabulary
+);
+
+// Reset automaton to the initial state (cached masks are kept)
+void q_grammar_reset(q_grammar* restrict g);
+
+// Mask logits of tokens not allowed in the current state (set to -INFINITY)
+// Call between llama_forward and q_sample_token
+// Preconditions:
+// - logits: [vocab_size], vocab_size >= tokenizer vocab_size (extra entries masked)
+// Returns: Q_OK on success, Q_ERR_INVALID_CONFIG if no token is allowed
+q_error_code q_grammar_apply(
+    q_grammar* restrict g,              // [in/out] Grammar (mask cache updated)
+    float* restrict logits,             // [in/out] Logits [vocab_size]
+    uint32_t vocab_size                 // Model vocabulary size
+);
+
+// Advance automaton with a sampled token
+// Returns: Q_OK on success, Q_ERR_INVALID_ARG if token is not allowed (state unchanged)
+q_error_code q_grammar_accept_token(
+    q_grammar* restrict g,              // [in/out] Grammar state
+    uint32_t token_id                   // Sampled token
+);
+
+// True if the tokens accepted so far form a complete JSON document
+bool q_grammar_is_complete(const q_grammar* restrict g);
+
+// Free mask cache and buffers (safe to call on zeroed struct)
+void q_grammar_free(q_grammar* restrict g);
+
+// ============================================================================
+// Session Snapshot API (KV Cache persistence)
+// ============================================================================
+
+// Save used KV cache range [0, current_pos) + generation position to file
+// File layout: 64-byte header + packed KV blocks per (layer, kv_head), same
+// element order as the in-memory KV cache (load = mmap + memcpy, no parsing)
+// The header carries a model fingerprint (full config + checksum of sampled
+// windows of the mapped weights) checked by q_session_load
+// Preconditions:
+// - state->ctx: KV cache allocated (q_alloc_kv_cache)
+// - state->model: Valid model (from llama_build_graph)
+// - state->current_pos <= config.max_seq_len
+// Returns: Q_OK on success, Q_ERR_FILE_OPEN/Q_ERR_FILE_WRITE on I/O failure
+q_error_code q_session_save(
+    const q_generation_state* restrict state,  // [in] Generation state (ctx, model, current_pos)
+    const char* path                           // [in] Output file path
+);
+
+// Restore KV cache range and generation position from a q_session_save file
+// Preconditions:
+// - state->ctx: KV cache allocated with the same geometry as the saved session
+// - state->model: Same model the session was saved with
+// Returns: Q_OK on success
+//          Q_ERR_INVALID_MAGIC if file is not a session snapshot
+//          Q_ERR_INVALID_CONFIG if KV geometry does not match the model
+//          Q_ERR_MODEL_MISMATCH if geometry matches but the model fingerprint differs
+//          Q_ERR_FILE_TOO_SMALL if file is truncated
+// Postconditions:
+// - KV cache positions [0, current_pos) restored; positions beyond untouched
+// - state->current_pos set; resume with q_generate (state->resume = true) or
+//   llama_forward(..., pos = current_pos)
+q_error_code q_session_load(
+    q_generation_state* restrict state,        // [in/out] Generation state
+    const char* path                           // [in] Session file path
+);
+
 #endif // QORUS_H
 
@@ -44,7 +44,9 @@ typedef enum {
     Q_ERR_OVERFLOW = -12,         // Integer overflow detected
     Q_ERR_MISALIGNED = -13,       // Pointer not properly aligned
     Q_ERR_INVALID_DTYPE = -14,    // Wrong data type
-    Q_ERR_INVALID_SIZE = -15      // Invalid size (zero, not multiple of N, etc.)
+    Q_ERR_INVALID_SIZE = -15,     // Invalid size (zero, not multiple of N, etc.)
+    Q_ERR_FILE_WRITE = -16,       // Failed to write file (short write, disk full)
+    Q_ERR_MODEL_MISMATCH = -17    // Snapshot saved with a different model (fingerprint mismatch)
 } q_error_code;
 
 // ============================================================================
@@ -137,6 +139,12 @@ typedef enum {
     Q_Q4_0 = 2  // Weights (Dense Layers)
 } q_dtype;
 
+// Pooling para embeddings de sentença (llama_embed)
+typedef enum {
+    Q_POOL_MEAN = 0,  // Média dos hidden states finais de todas as posições
+    Q_POOL_LAST = 1   // Hidden state final da última posição (modelos causais)
+} q_pooling_type;
+
 // ============================================================================
 // Tokenizer Types (BPE)
 // ============================================================================
@@ -148,8 +156,11 @@ typedef struct {
     uint32_t merged_id;   // Resulting merged token ID
 } q_bpe_merge;
 
-// Forward declaration for hash table (internal to bpe.c)
+// Forward declarations for hash table and encode cache (internal to bpe.c)
 struct bpe_hash_table;
+struct bpe_word_cache;
+struct bpe_merge_group;
+struct bpe_vocab_trie;
 
 // Tokenizer Structure (BPE - Byte Pair Encoding)
 typedef struct {
@@ -161,9 +172,30 @@ typedef struct {
     q_bpe_merge* merges;      // Array of BPE merge rules [num_merges]
     uint32_t num_merges;       // Number of BPE merges
     
-    // Hash table for fast merge lookup (O(1) instead of O(m))
+    // Merge table construída no load (v1): dona de merge_groups
     // Internal implementation in bpe.c, opaque pointer here
-    struct bpe_hash_table* merge_hash_table;  // NULL if num_merges == 0
+    struct bpe_hash_table* merge_hash_table;  // NULL if num_merges == 0 or v2
+    
+    // v2 (mmap zero-parse): strings, merges e tabela de merges usados in-place
+    // vocab[i] aponta para o blob mapeado (read-only); NULL/0 em v1 e tokenizers montados à mão
+    void* mapped;                                // Arquivo mapeado (munmap em q_tokenizer_free)
+    size_t mapped_size;
+    const uint32_t* vocab_index;                 // (offset, length) por token [vocab_size * 2]
+    
+    // Comprimento (bytes) de cada token, calculado no load v1 (v2 usa vocab_index)
+    uint32_t* token_lens;                        // [vocab_size]; NULL => strlen
+    
+    // Merge lookup: tabela open-addressing em grupos de 4 slots (v1: merge_hash_table, v2: arquivo)
+    const struct bpe_merge_group* merge_groups;  // NULL em tokenizers montados à mão
+    uint32_t merge_groups_mask;                  // num_groups - 1
+    
+    // Word-level encode cache: pré-token -> token IDs (LRU, leitura lock-free)
+    struct bpe_word_cache* word_cache;        // NULL if num_merges == 0
+    
+    // Vocab trie (double-array): encode por longest-prefix, saída idêntica aos merges
+    // Construído no primeiro encode (o load não paga a construção)
+    _Atomic(struct bpe_vocab_trie*) vocab_trie;  // NULL => merges a partir dos bytes
+    _Atomic uint32_t vocab_trie_state;        // Construção lazy (estados internos de bpe.c; 0 = nunca)
     
     // Special Tokens
     uint32_t bos_token_id;     // Beginning of sequence token ID
@@ -174,6 +206,76 @@ typedef struct {
     bool initialized;          // True if tokenizer loaded successfully
 } q_tokenizer;
 
+// Texto de entrada do encode em batch: (ptr, len), sem exigir '\0'
+typedef struct {
+    const char* text;
+    size_t len;
+} q_text_span;
+
+// Detokenizer incremental (streaming): um token por chamada, O(1) por token
+// Sequência UTF-8 incompleta no fim do texto fica retida até o próximo token
+typedef struct {
+    const q_tokenizer* tok;
+    uint8_t pending[4];        // Bytes retidos (lead byte + continuações, <= 3)
+    uint32_t pending_len;
+} q_detokenizer;
+
+// Tokenizer statistics (q_tokenizer_get_stats)
+typedef struct {
+    uint64_t cache_hits;       // Pré-tokens servidos pelo encode cache
+    uint64_t cache_misses;     // Pré-tokens cacheáveis que executaram merges
+    uint32_t cache_entries;    // Entradas ocupadas
+    uint32_t cache_capacity;   // Total de entradas (0 = cache desativado)
+    double cache_hit_rate;     // hits / (hits + misses); 0.0 sem consultas
+    uint64_t merges_applied;   // Merges executados (palavras fora do cache e do trie)
+    uint64_t trie_words;       // Palavras resolvidas pelo vocab trie (sem merges)
+    uint64_t invalid_utf8_texts; // Textos com UTF-8 inválido (codificados byte a byte)
+} q_tokenizer_stats;
+
+// ============================================================================
+// Profiling (timers por op x camada; gravados só em builds com Q_PROFILE)
+// ============================================================================
+
+// Ops cronometradas no forward (por camada) e na geração (slot Q_PROFILE_GLOBAL)
+typedef enum {
+    Q_PROF_ATTN_NORM = 0,     // RMSNorm pré-atenção
+    Q_PROF_QKV_PROJ,          // Projeções Q/K/V (GEMV Q4_0)
+    Q_PROF_ROPE,              // RoPE em Q e K
+    Q_PROF_KV_STORE,          // Escrita no KV cache + reshape por head
+    Q_PROF_ATTN_SCORES,       // Transposição de K + Q @ K^T (todas as heads)
+    Q_PROF_ATTN_SOFTMAX,      // Escala + máscara causal + softmax
+    Q_PROF_ATTN_VALUE,        // probs @ V + concatenação das heads
+    Q_PROF_ATTN_OUT_PROJ,     // Projeção de saída (wo)
+    Q_PROF_RESIDUAL_NORM,     // Residuais + RMSNorm pré-MLP
+    Q_PROF_MLP_GATE_UP,       // Projeções gate/up
+    Q_PROF_MLP_SILU_MUL,      // SiLU(gate) * up
+    Q_PROF_MLP_DOWN,          // Projeção down
+    Q_PROF_LM_HEAD,           // Projeção LM head / top-k fundido (global)
+    Q_PROF_PENALTIES,         // Penalties (global)
+    Q_PROF_GRAMMAR,           // Máscara de gramática (global)
+    Q_PROF_SAMPLER,           // q_sample_token_ext (global)
+    Q_PROF_OP_COUNT
+} q_profile_op;
+
+#define Q_PROFILE_MAX_LAYERS 128                   // Camadas >= limite agregam no último slot
+#define Q_PROFILE_GLOBAL Q_PROFILE_MAX_LAYERS      // Slot de ops fora das camadas
+#define Q_TRACE_DEFAULT_CAPACITY (1U << 20)        // Eventos no ring do trace (40 bytes cada)
+#define Q_TRACE_MAX_CAPACITY (1U << 26)
+
+// Agregado por (camada, op), em ticks do TSC
+typedef struct {
+    uint64_t count;
+    uint64_t total_ticks;
+    uint64_t min_ticks;        // UINT64_MAX enquanto count == 0
+    uint64_t max_ticks;
+} q_profile_entry;
+
+typedef struct {
+    q_profile_entry entries[Q_PROFILE_MAX_LAYERS + 1][Q_PROF_OP_COUNT];
+    uint32_t n_layers;         // Maior camada registrada + 1
+    double ticks_per_ns;       // Calibrado em q_profile_enable
+} q_profile_stats;
+
 // ============================================================================
 // Tensor Types
 // ============================================================================
@@ -228,6 +330,9 @@ typedef struct {
     size_t          scratch_size;
     size_t          scratch_head;
     size_t          scratch_base_offset;  // Watermark: onde o scratchpad começa (modelo antes disso)
+
+    // Profiling (NULL = desligado; ver q_profile_enable)
+    q_profile_stats* profile;
 } q_context;
 
 // ============================================================================
@@ -251,14 +356,15 @@ typedef struct {
 typedef struct {
     uint32_t layer_idx;       // Layer index (0..n_layers-1)
     q_tensor* attn_norm;      // [dim] (FP32)
+    // Projeções em layout GEMV [out, in] (ne[0] = saída, ne[1] = entrada)
     q_tensor* wq;             // [dim, dim] (Q4_0)
-    q_tensor* wk;             // [dim, n_kv_heads*head_dim] (Q4_0)
-    q_tensor* wv;             // [dim, n_kv_heads*head_dim] (Q4_0)
+    q_tensor* wk;             // [n_kv_heads*head_dim, dim] (Q4_0)
+    q_tensor* wv;             // [n_kv_heads*head_dim, dim] (Q4_0)
     q_tensor* wo;             // [dim, dim] (Q4_0)
     q_tensor* ffn_norm;       // [dim] (FP32)
-    q_tensor* w_gate;         // [dim, hidden_dim] (Q4_0)
-    q_tensor* w_up;           // [dim, hidden_dim] (Q4_0)
-    q_tensor* w_down;        // [hidden_dim, dim] (Q4_0)
+    q_tensor* w_gate;         // [hidden_dim, dim] (Q4_0)
+    q_tensor* w_up;           // [hidden_dim, dim] (Q4_0)
+    q_tensor* w_down;         // [dim, hidden_dim] (Q4_0)
 } q_llama_layer;
 
 // Transformer Model Graph (tensor views pointing to mmap)
@@ -285,10 +391,81 @@ typedef struct {
     q_context* ctx;           // Memory context (for arena allocations)
 } q_llama_model;
 
+// ============================================================================
+// Constrained Decoding (Grammar-guided sampling)
+// ============================================================================
+
+#define Q_GRAMMAR_MAX_DEPTH 32       // Profundidade máxima de aninhamento JSON
+#define Q_GRAMMAR_CACHE_SLOTS 512    // Slots do cache de máscaras (potência de 2)
+
+// Autômato de gramática + máscaras de vocabulário por estado
+// Estado = estado léxico + pilha de containers (empacotado em uint64_t),
+// então a máscara de um estado é exata (tokens que fecham vários níveis
+// são validados contra a pilha completa). Máscaras são construídas na
+// primeira visita ao estado e reutilizadas (cache open-addressing).
+typedef struct {
+    uint64_t state;                      // Estado atual do autômato
+    const q_tokenizer* tokenizer;        // Vocabulário (deve sobreviver à gramática)
+    uint32_t vocab_size;
+    uint32_t mask_words;                 // ceil(vocab_size / 32)
+    uint32_t* token_lens;                // [vocab_size] strlen pré-calculado
+
+    // Cache de máscaras: keys[i] = estado, masks[i] = bitmask [mask_words]
+    uint64_t* cache_keys;                // [Q_GRAMMAR_CACHE_SLOTS]
+    uint32_t** cache_masks;              // [Q_GRAMMAR_CACHE_SLOTS] (alocadas sob demanda)
+    uint32_t cache_used;
+
+    // Estatísticas
+    uint64_t masks_built;                // Cache misses (máscara construída)
+    uint64_t mask_hits;                  // Cache hits
+
+    bool initialized;
+} q_grammar;
+
+// ============================================================================
+// Token Counts (histograma esparso para repetition/frequency/presence penalties)
+// ============================================================================
+
+// Mapa token -> contagem com iteração densa: ids/counts em SoA (gather/scatter
+// AVX2 direto sobre os logits) + índice open-addressing token -> posição densa.
+// Custo por token gerado: add O(1) amortizado, penalties O(n_unique).
+typedef struct {
+    uint32_t* ids;            // [max_unique] tokens distintos (ordem de inserção)
+    uint32_t* counts;         // [max_unique] ocorrências de ids[i]
+    uint32_t* index;          // [capacity] posição densa + 1 (0 = slot vazio)
+    uint32_t n_unique;
+    uint32_t max_unique;
+    uint32_t capacity;        // Potência de 2 >= 2 * max_unique
+    uint32_t shift;           // 32 - log2(capacity) (hash multiplicativo)
+    uint32_t max_id;          // Maior token inserido (validação do gather)
+} q_token_counts;
+
+// ============================================================================
+// Random Number Generation (Philox4x32-10, counter-based)
+// ============================================================================
+
+// Gerador por contador: cada bloco Philox(key = seed, counter = {block, stream})
+// produz 4 palavras de 32 bits, consumidas em ordem. O mesmo (seed, stream,
+// block, word) sempre produz a mesma sequência, em qualquer thread e independente
+// de quantas palavras são pedidas por chamada. lanes só guarda o bloco já
+// calculado (um Philox a cada 4 sorteios); reposicionar block/word o invalida.
+typedef struct {
+    uint32_t key[2];          // Seed (64 bits)
+    uint64_t stream;          // Stream id (metade alta do contador de 128 bits)
+    uint64_t block;           // Bloco atual (metade baixa do contador)
+    uint32_t word;            // Próxima palavra do bloco atual (0..3)
+    uint32_t lanes[4];        // Saída Philox do bloco lanes_tag - 1
+    uint64_t lanes_tag;       // block + 1 do bloco em lanes (0 = vazio)
+} q_rng;
+
 // ============================================================================
 // Generation State (FASE 4.2: Main Application)
 // ============================================================================
 
+// Callback de streaming: chamado para cada token gerado (incluindo EOS)
+// Retornar false interrompe a geração (ex.: cliente desconectou)
+typedef bool (*q_token_callback)(uint32_t token_id, void* user_data);
+
 // Estrutura de estado do loop de geração
 typedef struct {
     q_context* ctx;           // Contexto de memória
@@ -302,7 +479,18 @@ typedef struct {
     float temperature;        // Temperatura para sampling (0.0 = greedy)
     uint32_t top_k;           // Top-k sampling (0 = desabilitado)
     float top_p;              // Nucleus sampling (0.0 = desabilitado)
+    float min_p;              // Min-p: p >= min_p * p_max (0.0 = desabilitado)
+    float typical_p;          // Locally typical sampling (0.0 ou 1.0 = desabilitado)
     uint32_t current_pos;     // Posição atual no contexto (prompt + generated)
+    bool resume;              // true: continuar de current_pos (q_session_load ou chamada anterior); prompt_tokens = só tokens novos
+    q_grammar* grammar;       // Constrained decoding (NULL = sem restrição)
+    q_token_callback on_token; // Streaming (NULL = desabilitado)
+    void* user_data;          // Passado para on_token
+    q_rng* rng;               // Stream de sampling (NULL = gerador thread-local padrão)
+    float repetition_penalty; // Logits de tokens gerados: /p se > 0, *p se <= 0 (0 ou 1 = desabilitado)
+    float frequency_penalty;  // logit -= count * frequency_penalty (0 = desabilitado)
+    float presence_penalty;   // logit -= presence_penalty se count > 0 (0 = desabilitado)
+    q_token_counts token_counts; // Histograma dos tokens gerados (mantido por q_generate)
 } q_generation_state;
 
 #endif // QORUS_TYPES_H
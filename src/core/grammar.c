@@ -0,0 +1,433 @@
+#include "qorus.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// ============================================================================
+// Constrained Decoding: autômato JSON (RFC 8259) + máscaras de vocabulário
+// ============================================================================
+//
+// Pipeline por token gerado:
+//   llama_forward -> q_grammar_apply (máscara AVX2) -> q_sample_token
+//                 -> q_grammar_accept_token (avança autômato)
+//
+// Estado empacotado em uint64_t (chave do cache de máscaras):
+//   bits  0..7   estado léxico (json_lex)
+//   bit   8      string atual é chave de objeto
+//   bits 16..23  profundidade da pilha
+//   bits 32..63  pilha de containers (bit k = 1: objeto, 0: array)
+//
+// Como a pilha completa faz parte do estado, a máscara é exata: tokens que
+// fecham vários níveis ("}]") são simulados contra a pilha real.
+// Custo: hit no cache = lookup O(1) + máscara AVX2 O(V/8);
+//        miss = simulação de todos os tokens (uma vez por estado).
+
+typedef enum {
+    J_VALUE = 0,        // Esperando valor
+    J_ARR_FIRST,        // Após '[': valor ou ']'
+    J_OBJ_FIRST,        // Após '{': chave ou '}'
+    J_OBJ_KEY,          // Após ',' em objeto: chave
+    J_OBJ_COLON,        // Após chave: ':'
+    J_AFTER_VALUE,      // Valor completo: ',' / fechamento / fim
+    J_STR,              // Dentro de string
+    J_STR_ESC,          // Após '\'
+    J_STR_HEX1,         // \uXXXX
+    J_STR_HEX2,
+    J_STR_HEX3,
+    J_STR_HEX4,
+    J_STR_CONT1,        // UTF-8: bytes de continuação restantes
+    J_STR_CONT2,
+    J_STR_CONT3,
+    J_STR_E0,           // Após E0: A0..BF (sem overlong de 3 bytes)
+    J_STR_ED,           // Após ED: 80..9F (sem surrogates U+D800..DFFF)
+    J_STR_F0,           // Após F0: 90..BF (sem overlong de 4 bytes)
+    J_STR_F4,           // Após F4: 80..8F (máximo U+10FFFF)
+    J_NUM_MINUS,        // '-'
+    J_NUM_ZERO,         // '0' inicial
+    J_NUM_INT,          // Dígitos inteiros
+    J_NUM_DOT,          // '.'
+    J_NUM_FRAC,         // Dígitos fracionários
+    J_NUM_EXP,          // 'e' / 'E'
+    J_NUM_EXP_SIGN,     // Sinal do expoente
+    J_NUM_EXP_DIGITS,   // Dígitos do expoente
+    J_TRUE_R, J_TRUE_U, J_TRUE_E,
+    J_FALSE_A, J_FALSE_L, J_FALSE_S, J_FALSE_E,
+    J_NULL_U, J_NULL_L1, J_NULL_L2,
+    J_LEX_COUNT
+} json_lex;
+
+#define J_REJECT         UINT64_MAX
+#define J_EMPTY_SLOT     UINT64_MAX   // Nunca é estado válido (bits 9..15 sempre 0)
+#define J_KEY_FLAG       (1ULL << 8)
+#define J_CACHE_SHIFT    55           // 64 - log2(Q_GRAMMAR_CACHE_SLOTS)
+
+_Static_assert((Q_GRAMMAR_CACHE_SLOTS & (Q_GRAMMAR_CACHE_SLOTS - 1)) == 0,
+               "Q_GRAMMAR_CACHE_SLOTS must be a power of 2");
+_Static_assert((1ULL << (64 - J_CACHE_SHIFT)) == Q_GRAMMAR_CACHE_SLOTS,
+               "J_CACHE_SHIFT must match Q_GRAMMAR_CACHE_SLOTS");
+_Static_assert(Q_GRAMMAR_MAX_DEPTH <= 32, "stack is packed in 32 bits");
+
+// Literais: (caractere esperado, próximo estado)
+static const struct { char expected; uint8_t next; } json_literal_table[J_LEX_COUNT] = {
+    [J_TRUE_R]  = {'r', J_TRUE_U},  [J_TRUE_U]  = {'u', J_TRUE_E},  [J_TRUE_E]  = {'e', J_AFTER_VALUE},
+    [J_FALSE_A] = {'a', J_FALSE_L}, [J_FALSE_L] = {'l', J_FALSE_S}, [J_FALSE_S] = {'s', J_FALSE_E},
+    [J_FALSE_E] = {'e', J_AFTER_VALUE},
+    [J_NULL_U]  = {'u', J_NULL_L1}, [J_NULL_L1] = {'l', J_NULL_L2}, [J_NULL_L2] = {'l', J_AFTER_VALUE},
+};
+
+static inline uint32_t j_lex(uint64_t s) { return (uint32_t)(s & 0xFF); }
+static inline uint32_t j_depth(uint64_t s) { return (uint32_t)((s >> 16) & 0xFF); }
+static inline uint64_t j_set_lex(uint64_t s, uint32_t lex) { return (s & ~0xFFULL) | lex; }
+static inline bool j_is_ws(uint8_t c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+static inline bool j_is_digit(uint8_t c) { return c >= '0' && c <= '9'; }
+
+static inline bool j_is_hex(uint8_t c) {
+    return j_is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static inline bool j_top_is_object(uint64_t s) {
+    uint32_t depth = j_depth(s);
+    return ((s >> (32 + depth - 1)) & 1ULL) != 0;
+}
+
+static inline uint64_t j_push(uint64_t s, bool is_object, uint32_t lex) {
+    uint32_t depth = j_depth(s);
+    if (depth >= Q_GRAMMAR_MAX_DEPTH) {
+        return J_REJECT;
+    }
+    uint64_t bit = 1ULL << (32 + depth);
+    s = is_object ? (s | bit) : (s & ~bit);
+    s = (s & ~(0xFFULL << 16)) | ((uint64_t)(depth + 1) << 16);
+    return j_set_lex(s, lex);
+}
+
+static inline uint64_t j_pop(uint64_t s) {
+    uint32_t depth = j_depth(s) - 1;
+    s &= ~(1ULL << (32 + depth));  // Mantém bits acima de depth zerados (chave canônica)
+    s = (s & ~(0xFFULL << 16)) | ((uint64_t)depth << 16);
+    return j_set_lex(s, J_AFTER_VALUE);
+}
+
+static uint64_t j_begin_value(uint64_t s, uint8_t c) {
+    switch (c) {
+        case '{': return j_push(s, true, J_OBJ_FIRST);
+        case '[': return j_push(s, false, J_ARR_FIRST);
+        case '"': return j_set_lex(s & ~J_KEY_FLAG, J_STR);
+        case '-': return j_set_lex(s, J_NUM_MINUS);
+        case '0': return j_set_lex(s, J_NUM_ZERO);
+        case 't': return j_set_lex(s, J_TRUE_R);
+        case 'f': return j_set_lex(s, J_FALSE_A);
+        case 'n': return j_set_lex(s, J_NULL_U);
+        default:
+            return (c >= '1' && c <= '9') ? j_set_lex(s, J_NUM_INT) : J_REJECT;
+    }
+}
+
+static uint64_t j_after_value(uint64_t s, uint8_t c) {
+    if (j_is_ws(c)) return j_set_lex(s, J_AFTER_VALUE);
+    if (j_depth(s) == 0) return J_REJECT;  // Valor raiz completo: só whitespace
+
+    if (j_top_is_object(s)) {
+        if (c == ',') return j_set_lex(s, J_OBJ_KEY);
+        if (c == '}') return j_pop(s);
+    } else {
+        if (c == ',') return j_set_lex(s, J_VALUE);
+        if (c == ']') return j_pop(s);
+    }
+    return J_REJECT;
+}
+
+// Transição de um byte. Returns J_REJECT se o byte é inválido no estado s
+static uint64_t json_step(uint64_t s, uint8_t c) {
+    const uint32_t lex = j_lex(s);
+
+    switch (lex) {
+        case J_VALUE:
+            return j_is_ws(c) ? s : j_begin_value(s, c);
+        case J_ARR_FIRST:
+            if (j_is_ws(c)) return s;
+            if (c == ']') return j_pop(s);
+            return j_begin_value(s, c);
+        case J_OBJ_FIRST:
+            if (c == '}') return j_pop(s);
+            // fallthrough
+        case J_OBJ_KEY:
+            if (j_is_ws(c)) return s;
+            return (c == '"') ? j_set_lex(s | J_KEY_FLAG, J_STR) : J_REJECT;
+        case J_OBJ_COLON:
+            if (j_is_ws(c)) return s;
+            return (c == ':') ? j_set_lex(s, J_VALUE) : J_REJECT;
+        case J_AFTER_VALUE:
+            return j_after_value(s, c);
+
+        case J_STR:
+            if (c == '"') {
+                return (s & J_KEY_FLAG) ? j_set_lex(s & ~J_KEY_FLAG, J_OBJ_COLON)
+                                        : j_set_lex(s, J_AFTER_VALUE);
+            }
+            if (c == '\\') return j_set_lex(s, J_STR_ESC);
+            if (c < 0x20) return J_REJECT;              // Controle precisa de escape
+            if (c < 0x80) return s;
+            // RFC 3629 (mesma tabela de q_utf8_validate): E0/ED/F0/F4 restringem o 2º byte
+            if (c >= 0xC2 && c <= 0xDF) return j_set_lex(s, J_STR_CONT1);
+            if (c == 0xE0) return j_set_lex(s, J_STR_E0);
+            if (c == 0xED) return j_set_lex(s, J_STR_ED);
+            if (c >= 0xE1 && c <= 0xEF) return j_set_lex(s, J_STR_CONT2);
+            if (c == 0xF0) return j_set_lex(s, J_STR_F0);
+            if (c == 0xF4) return j_set_lex(s, J_STR_F4);
+            if (c >= 0xF1 && c <= 0xF3) return j_set_lex(s, J_STR_CONT3);
+            return J_REJECT;
+        case J_STR_E0:
+            return (c >= 0xA0 && c <= 0xBF) ? j_set_lex(s, J_STR_CONT1) : J_REJECT;
+        case J_STR_ED:
+            return (c >= 0x80 && c <= 0x9F) ? j_set_lex(s, J_STR_CONT1) : J_REJECT;
+        case J_STR_F0:
+            return (c >= 0x90 && c <= 0xBF) ? j_set_lex(s, J_STR_CONT2) : J_REJECT;
+        case J_STR_F4:
+            return (c >= 0x80 && c <= 0x8F) ? j_set_lex(s, J_STR_CONT2) : J_REJECT;
+        case J_STR_CONT3:
+        case J_STR_CONT2:
+        case J_STR_CONT1:
+            if ((c & 0xC0) != 0x80) return J_REJECT;
+            return j_set_lex(s, lex == J_STR_CONT1 ? (uint32_t)J_STR : lex - 1);
+        case J_STR_ESC:
+            if (c == 'u') return j_set_lex(s, J_STR_HEX1);
+            return (strchr("\"\\/bfnrt", c) != NULL && c != 0) ? j_set_lex(s, J_STR) : J_REJECT;
+        case J_STR_HEX1:
+        case J_STR_HEX2:
+        case J_STR_HEX3:
+        case J_STR_HEX4:
+            if (!j_is_hex(c)) return J_REJECT;
+            return j_set_lex(s, lex == J_STR_HEX4 ? (uint32_t)J_STR : lex + 1);
+
+        case J_NUM_MINUS:
+            if (c == '0') return j_set_lex(s, J_NUM_ZERO);
+            return (c >= '1' && c <= '9') ? j_set_lex(s, J_NUM_INT) : J_REJECT;
+        case J_NUM_INT:
+            if (j_is_digit(c)) return s;
+            // fallthrough
+        case J_NUM_ZERO:
+            if (c == '.') return j_set_lex(s, J_NUM_DOT);
+            if (c == 'e' || c == 'E') return j_set_lex(s, J_NUM_EXP);
+            return j_after_value(s, c);  // Número terminou: re-despacha o byte
+        case J_NUM_DOT:
+            return j_is_digit(c) ? j_set_lex(s, J_NUM_FRAC) : J_REJECT;
+        case J_NUM_FRAC:
+            if (j_is_digit(c)) return s;
+            if (c == 'e' || c == 'E') return j_set_lex(s, J_NUM_EXP);
+            return j_after_value(s, c);
+        case J_NUM_EXP:
+            if (c == '+' || c == '-') return j_set_lex(s, J_NUM_EXP_SIGN);
+            // fallthrough
+        case J_NUM_EXP_SIGN:
+            return j_is_digit(c) ? j_set_lex(s, J_NUM_EXP_DIGITS) : J_REJECT;
+        case J_NUM_EXP_DIGITS:
+            return j_is_digit(c) ? s : j_after_value(s, c);
+
+        default:
+            if (lex < J_LEX_COUNT && json_literal_table[lex].expected == (char)c) {
+                return j_set_lex(s, json_literal_table[lex].next);
+            }
+            return J_REJECT;
+    }
+}
+
+// Documento completo: valor raiz terminado (números terminam implicitamente no EOS)
+static bool json_is_accepting(uint64_t s) {
+    if (j_depth(s) != 0) return false;
+    switch (j_lex(s)) {
+        case J_AFTER_VALUE:
+        case J_NUM_ZERO:
+        case J_NUM_INT:
+        case J_NUM_FRAC:
+        case J_NUM_EXP_DIGITS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Estado após consumir token_id a partir de s (J_REJECT se inválido)
+static uint64_t grammar_token_transition(const q_grammar* g, uint64_t s, uint32_t token_id) {
+    const q_tokenizer* tok = g->tokenizer;
+    if (token_id == tok->eos_token_id) {
+        return json_is_accepting(s) ? s : J_REJECT;
+    }
+    if (token_id == tok->bos_token_id || token_id == tok->pad_token_id) {
+        return J_REJECT;
+    }
+
+    const uint32_t len = g->token_lens[token_id];
+    if (len == 0) {
+        return J_REJECT;  // Token vazio não avança o autômato (evita loops)
+    }
+
+    const uint8_t* bytes = (const uint8_t*)tok->vocab[token_id];
+    for (uint32_t i = 0; i < len && s != J_REJECT; i++) {
+        s = json_step(s, bytes[i]);
+    }
+    return s;
+}
+
+// Constrói máscara para o estado s. Returns false se nenhum token é permitido
+static bool grammar_build_mask(const q_grammar* g, uint64_t s, uint32_t* restrict mask) {
+    memset(mask, 0, (size_t)g->mask_words * sizeof(uint32_t));
+    uint32_t any = 0;
+    for (uint32_t t = 0; t < g->vocab_size; t++) {
+        if (grammar_token_transition(g, s, t) != J_REJECT) {
+            mask[t >> 5] |= 1U << (t & 31);
+            any = 1;
+        }
+    }
+    return any != 0;
+}
+
+// Lookup/insert no cache de máscaras (open addressing, linear probing)
+static const uint32_t* grammar_get_mask(q_grammar* g) {
+    const uint64_t s = g->state;
+    const uint32_t slot_mask = Q_GRAMMAR_CACHE_SLOTS - 1;
+    uint32_t idx = (uint32_t)((s * 0x9E3779B97F4A7C15ULL) >> J_CACHE_SHIFT);
+
+    while (g->cache_keys[idx] != J_EMPTY_SLOT) {
+        if (g->cache_keys[idx] == s) {
+            g->mask_hits++;
+            return g->cache_masks[idx];
+        }
+        idx = (idx + 1) & slot_mask;
+    }
+
+    // Miss: cache cheio (load factor 3/4) -> flush (buffers de máscara são reutilizados)
+    if (g->cache_used >= (Q_GRAMMAR_CACHE_SLOTS / 4) * 3) {
+        for (uint32_t i = 0; i < Q_GRAMMAR_CACHE_SLOTS; i++) {
+            g->cache_keys[i] = J_EMPTY_SLOT;
+        }
+        g->cache_used = 0;
+        idx = (uint32_t)((s * 0x9E3779B97F4A7C15ULL) >> J_CACHE_SHIFT);
+    }
+
+    if (g->cache_masks[idx] == NULL) {
+        size_t mask_bytes = Q_ALIGN_SIZE((size_t)g->mask_words * sizeof(uint32_t));
+        g->cache_masks[idx] = (uint32_t*)aligned_alloc(Q_ALIGN, mask_bytes);
+        if (g->cache_masks[idx] == NULL) {
+            return NULL;
+        }
+    }
+
+    if (!grammar_build_mask(g, s, g->cache_masks[idx])) {
+        return NULL;
+    }
+
+    g->cache_keys[idx] = s;
+    g->cache_used++;
+    g->masks_built++;
+    return g->cache_masks[idx];
+}
+
+// ============================================================================
+// API pública
+// ============================================================================
+
+q_error_code q_grammar_init_json(q_grammar* restrict g, const q_tokenizer* restrict tok) {
+    Q_VALIDATE_PTR_OR_RETURN(g, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
+
+    if (!tok->initialized || tok->vocab == NULL || tok->vocab_size == 0) {
+        return Q_ERR_INVALID_ARG;
+    }
+
+    memset(g, 0, sizeof(*g));
+    g->tokenizer = tok;
+    g->vocab_size = tok->vocab_size;
+    g->mask_words = (tok->vocab_size + 31) / 32;
+
+    g->token_lens = (uint32_t*)malloc((size_t)tok->vocab_size * sizeof(uint32_t));
+    g->cache_keys = (uint64_t*)malloc(Q_GRAMMAR_CACHE_SLOTS * sizeof(uint64_t));
+    g->cache_masks = (uint32_t**)calloc(Q_GRAMMAR_CACHE_SLOTS, sizeof(uint32_t*));
+    if (g->token_lens == NULL || g->cache_keys == NULL || g->cache_masks == NULL) {
+        free(g->token_lens);
+        free(g->cache_keys);
+        free(g->cache_masks);
+        memset(g, 0, sizeof(*g));
+        return Q_ERR_ALLOC_FAILED;
+    }
+
+    // strlen uma vez por token (construção de máscara não toca strings inteiras de novo)
+    for (uint32_t i = 0; i < tok->vocab_size; i++) {
+        g->token_lens[i] = (tok->vocab[i] != NULL) ? (uint32_t)strlen(tok->vocab[i]) : 0;
+    }
+    for (uint32_t i = 0; i < Q_GRAMMAR_CACHE_SLOTS; i++) {
+        g->cache_keys[i] = J_EMPTY_SLOT;
+    }
+
+    g->state = J_VALUE;
+    g->initialized = true;
+
+    // Pré-construir máscara do estado inicial (primeiro token sem custo de miss)
+    if (grammar_get_mask(g) == NULL) {
+        q_grammar_free(g);
+        return Q_ERR_INVALID_CONFIG;  // Vocabulário não consegue iniciar um valor JSON
+    }
+    return Q_OK;
+}
+
+void q_grammar_reset(q_grammar* restrict g) {
+    if (g == NULL) return;
+    g->state = J_VALUE;
+}
+
+q_error_code q_grammar_apply(q_grammar* restrict g, float* restrict logits, uint32_t vocab_size) {
+    Q_VALIDATE_PTR_OR_RETURN(g, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(logits, Q_ERR_INVALID_ARG);
+
+    if (!g->initialized) {
+        return Q_ERR_INVALID_ARG;
+    }
+    // Modelo pode ter vocab maior que o tokenizer (padding): tokens extras ficam mascarados
+    if (vocab_size < g->vocab_size) {
+        return Q_ERR_INVALID_SIZE;
+    }
+
+    const uint32_t* mask = grammar_get_mask(g);
+    if (mask == NULL) {
+        return Q_ERR_INVALID_CONFIG;  // Nenhum token permitido (ou OOM)
+    }
+
+    q_error_code ret = q_token_mask_f32_avx2(logits, mask, g->vocab_size, -INFINITY);
+    for (uint32_t i = g->vocab_size; i < vocab_size; i++) {
+        logits[i] = -INFINITY;
+    }
+    return ret;
+}
+
+q_error_code q_grammar_accept_token(q_grammar* restrict g, uint32_t token_id) {
+    Q_VALIDATE_PTR_OR_RETURN(g, Q_ERR_INVALID_ARG);
+
+    if (!g->initialized || token_id >= g->vocab_size) {
+        return Q_ERR_INVALID_ARG;
+    }
+
+    uint64_t next = grammar_token_transition(g, g->state, token_id);
+    if (next == J_REJECT) {
+        return Q_ERR_INVALID_ARG;  // Estado inalterado
+    }
+    g->state = next;
+    return Q_OK;
+}
+
+bool q_grammar_is_complete(const q_grammar* restrict g) {
+    return g != NULL && g->initialized && json_is_accepting(g->state);
+}
+
+void q_grammar_free(q_grammar* restrict g) {
+    if (g == NULL) return;
+
+    if (g->cache_masks != NULL) {
+        for (uint32_t i = 0; i < Q_GRAMMAR_CACHE_SLOTS; i++) {
+            free(g->cache_masks[i]);
+        }
+    }
+    free(g->cache_masks);
+    free(g->cache_keys);
+    free(g->token_lens);
+    memset(g, 0, sizeof(*g));
+}
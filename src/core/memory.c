@@ -352,4 +352,7 @@ void q_free_memory(q_context* restrict ctx) {
         // Security: Clear header pointer (it points into the unmapped memory)
         ctx->header = NULL;
     }
+    
+    // 4. Free profiling stats (q_profile_enable)
+    q_profile_disable(ctx);
 }
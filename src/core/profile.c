@@ -0,0 +1,355 @@
+#include "qorus.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// ============================================================================
+// Profiling: stats por contexto (op x camada) alimentados pelas macros de profile.h
+// ============================================================================
+
+// Calibração TSC -> ns: ~2ms de espera ativa contra CLOCK_MONOTONIC
+// (TSC invariante nos x86 com AVX2: frequência constante entre estados de energia)
+#ifdef Q_PROFILE
+#define PROFILE_CALIBRATION_NS 2000000LL
+
+static long long profile_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double profile_calibrate_tsc(void) {
+    const long long ns0 = profile_now_ns();
+    const uint64_t tsc0 = __rdtsc();
+    long long ns1 = ns0;
+    while (ns1 - ns0 < PROFILE_CALIBRATION_NS) {
+        ns1 = profile_now_ns();
+    }
+    const uint64_t tsc1 = __rdtsc();
+    return (double)(tsc1 - tsc0) / (double)(ns1 - ns0);
+}
+#endif
+
+const char* q_profile_op_name(q_profile_op op) {
+    switch (op) {
+        case Q_PROF_ATTN_NORM: return "attn_norm";
+        case Q_PROF_QKV_PROJ: return "qkv_proj";
+        case Q_PROF_ROPE: return "rope";
+        case Q_PROF_KV_STORE: return "kv_store";
+        case Q_PROF_ATTN_SCORES: return "attn_scores";
+        case Q_PROF_ATTN_SOFTMAX: return "attn_softmax";
+        case Q_PROF_ATTN_VALUE: return "attn_value";
+        case Q_PROF_ATTN_OUT_PROJ: return "attn_out_proj";
+        case Q_PROF_RESIDUAL_NORM: return "residual_norm";
+        case Q_PROF_MLP_GATE_UP: return "mlp_gate_up";
+        case Q_PROF_MLP_SILU_MUL: return "mlp_silu_mul";
+        case Q_PROF_MLP_DOWN: return "mlp_down";
+        case Q_PROF_LM_HEAD: return "lm_head";
+        case Q_PROF_PENALTIES: return "penalties";
+        case Q_PROF_GRAMMAR: return "grammar";
+        case Q_PROF_SAMPLER: return "sampler";
+        case Q_PROF_OP_COUNT: break;
+    }
+    return "unknown";
+}
+
+void q_profile_reset(q_context* restrict ctx) {
+    if (ctx == NULL || ctx->profile == NULL) {
+        return;
+    }
+    q_profile_stats* stats = ctx->profile;
+    memset(stats->entries, 0, sizeof(stats->entries));
+    for (uint32_t l = 0; l <= Q_PROFILE_MAX_LAYERS; l++) {
+        for (uint32_t op = 0; op < Q_PROF_OP_COUNT; op++) {
+            stats->entries[l][op].min_ticks = UINT64_MAX;
+        }
+    }
+    stats->n_layers = 0;
+}
+
+q_error_code q_profile_enable(q_context* restrict ctx) {
+    Q_VALIDATE_PTR_OR_RETURN(ctx, Q_ERR_INVALID_ARG);
+#ifdef Q_PROFILE
+    if (ctx->profile == NULL) {
+        ctx->profile = (q_profile_stats*)calloc(1, sizeof(q_profile_stats));
+        if (ctx->profile == NULL) {
+            return Q_ERR_ALLOC_FAILED;
+        }
+        ctx->profile->ticks_per_ns = profile_calibrate_tsc();
+    }
+    q_profile_reset(ctx);
+    return Q_OK;
+#else
+    return Q_ERR_INVALID_CONFIG;  // Timers não compilados (make PROFILE=1)
+#endif
+}
+
+void q_profile_disable(q_context* restrict ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    free(ctx->profile);
+    ctx->profile = NULL;
+}
+
+const q_profile_stats* q_profile_get(const q_context* restrict ctx) {
+    return (ctx != NULL) ? ctx->profile : NULL;
+}
+
+double q_profile_ticks_to_ns(const q_profile_stats* restrict stats, uint64_t ticks) {
+    if (stats == NULL || !(stats->ticks_per_ns > 0.0)) {
+        return 0.0;
+    }
+    return (double)ticks / stats->ticks_per_ns;
+}
+
+void q_profile_print(const q_context* restrict ctx, FILE* out) {
+    const q_profile_stats* stats = q_profile_get(ctx);
+    if (stats == NULL || out == NULL) {
+        return;
+    }
+
+    // Por op: soma sobre camadas + slot global
+    uint64_t op_ticks[Q_PROF_OP_COUNT] = {0};
+    uint64_t op_count[Q_PROF_OP_COUNT] = {0};
+    uint64_t op_min[Q_PROF_OP_COUNT];
+    uint64_t op_max[Q_PROF_OP_COUNT] = {0};
+    uint64_t grand_total = 0;
+    for (uint32_t op = 0; op < Q_PROF_OP_COUNT; op++) {
+        op_min[op] = UINT64_MAX;
+    }
+    for (uint32_t l = 0; l <= Q_PROFILE_MAX_LAYERS; l++) {
+        if (l >= stats->n_layers && l != Q_PROFILE_GLOBAL) {
+            continue;
+        }
+        for (uint32_t op = 0; op < Q_PROF_OP_COUNT; op++) {
+            const q_profile_entry* e = &stats->entries[l][op];
+            if (e->count == 0) {
+                continue;
+            }
+            op_ticks[op] += e->total_ticks;
+            op_count[op] += e->count;
+            op_min[op] = (e->min_ticks < op_min[op]) ? e->min_ticks : op_min[op];
+            op_max[op] = (e->max_ticks > op_max[op]) ? e->max_ticks : op_max[op];
+            grand_total += e->total_ticks;
+        }
+    }
+
+    fprintf(out, "%-15s %10s %12s %10s %10s %10s %7s\n",
+            "op", "count", "total(ms)", "mean(us)", "min(us)", "max(us)", "%");
+    for (uint32_t op = 0; op < Q_PROF_OP_COUNT; op++) {
+        if (op_count[op] == 0) {
+            continue;
+        }
+        fprintf(out, "%-15s %10llu %12.3f %10.2f %10.2f %10.2f %6.1f%%\n",
+                q_profile_op_name((q_profile_op)op),
+                (unsigned long long)op_count[op],
+                q_profile_ticks_to_ns(stats, op_ticks[op]) / 1e6,
+                q_profile_ticks_to_ns(stats, op_ticks[op]) / 1e3 / (double)op_count[op],
+                q_profile_ticks_to_ns(stats, op_min[op]) / 1e3,
+                q_profile_ticks_to_ns(stats, op_max[op]) / 1e3,
+                grand_total > 0 ? 100.0 * (double)op_ticks[op] / (double)grand_total : 0.0);
+    }
+
+    // Por camada: total de todas as ops
+    fprintf(out, "%-15s %12s\n", "layer", "total(ms)");
+    for (uint32_t l = 0; l < stats->n_layers; l++) {
+        uint64_t layer_ticks = 0;
+        for (uint32_t op = 0; op < Q_PROF_OP_COUNT; op++) {
+            layer_ticks += stats->entries[l][op].total_ticks;
+        }
+        fprintf(out, "%-15u %12.3f\n", l, q_profile_ticks_to_ns(stats, layer_ticks) / 1e6);
+    }
+}
+
+// ============================================================================
+// Trace: ring buffer global de eventos completos (Chrome trace JSON)
+// ============================================================================
+// Escritores: fetch_add no head reserva o slot, seqlock por slot (mesmo esquema
+// do cache de palavras do BPE). Leitor descarta slots em escrita ou já
+// sobrescritos por uma volta seguinte do ring.
+// Ring publicado nunca é liberado: um q_trace_emit que carregou o ponteiro antes
+// do disable pode ainda estar escrevendo nele (e o dump lendo). Disable só
+// despublica; enable reusa o ring da mesma capacidade (no máximo um por potência
+// de 2 até Q_TRACE_MAX_CAPACITY) e descarta a sessão anterior movendo `start`.
+
+#ifdef Q_PROFILE
+
+typedef struct {
+    _Atomic uint64_t seq;       // 2*idx + 1 = escrevendo, 2*idx + 2 = evento idx completo
+    _Atomic uint64_t t_begin;
+    _Atomic uint64_t t_end;
+    _Atomic uint64_t meta;      // tid | (layer << 32)
+    _Atomic uintptr_t name;     // String estática (nome da op ou do span)
+} trace_slot;
+
+struct q_trace_ring {
+    trace_slot* slots;
+    uint64_t mask;              // capacity - 1 (imutável após publicado)
+    double ticks_per_ns;
+    struct q_trace_ring* next;  // Lista de rings já alocados (trace_rings)
+    _Atomic uint64_t base_tsc;  // Origem da timeline (q_trace_enable)
+    _Atomic uint64_t start;     // head no q_trace_enable: eventos anteriores são de outra sessão
+    _Alignas(64) _Atomic uint64_t head;  // Próximo índice de evento (monotônico entre sessões)
+};
+
+_Atomic(struct q_trace_ring*) q_trace_ring_global = NULL;
+
+// Rings alocados (retidos até o fim do processo); q_trace_enable serializado pelo lock
+static struct q_trace_ring* trace_rings = NULL;
+static pthread_mutex_t trace_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// IDs de thread pequenos e estáveis (1, 2, ...) para as trilhas do Perfetto
+static _Atomic uint32_t trace_next_tid = 0;
+static _Thread_local uint32_t trace_tid = 0;
+
+void q_trace_emit(uint32_t layer, const char* name, uint64_t t_begin, uint64_t t_end) {
+    struct q_trace_ring* ring = atomic_load_explicit(&q_trace_ring_global, memory_order_acquire);
+    if (ring == NULL) {
+        return;
+    }
+    if (trace_tid == 0) {
+        trace_tid = atomic_fetch_add_explicit(&trace_next_tid, 1U, memory_order_relaxed) + 1U;
+    }
+    const uint64_t idx = atomic_fetch_add_explicit(&ring->head, 1U, memory_order_relaxed);
+    trace_slot* slot = &ring->slots[idx & ring->mask];
+    atomic_store_explicit(&slot->seq, 2 * idx + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&slot->t_begin, t_begin, memory_order_relaxed);
+    atomic_store_explicit(&slot->t_end, t_end, memory_order_relaxed);
+    atomic_store_explicit(&slot->meta, (uint64_t)trace_tid | ((uint64_t)layer << 32), memory_order_relaxed);
+    atomic_store_explicit(&slot->name, (uintptr_t)name, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, 2 * idx + 2, memory_order_release);
+}
+
+#endif // Q_PROFILE
+
+q_error_code q_trace_enable(uint32_t capacity) {
+#ifdef Q_PROFILE
+    if (capacity == 0) {
+        capacity = Q_TRACE_DEFAULT_CAPACITY;
+    }
+    Q_VALIDATE_OR_RETURN(capacity <= Q_TRACE_MAX_CAPACITY, Q_ERR_INVALID_SIZE);
+    uint64_t cap = 1;
+    while (cap < capacity) {
+        cap <<= 1;
+    }
+
+    pthread_mutex_lock(&trace_rings_lock);
+    struct q_trace_ring* ring = trace_rings;
+    while (ring != NULL && ring->mask != cap - 1) {
+        ring = ring->next;
+    }
+    if (ring == NULL) {
+        ring = (struct q_trace_ring*)aligned_alloc(64, sizeof(struct q_trace_ring));
+        trace_slot* slots = (ring != NULL) ? (trace_slot*)calloc(cap, sizeof(trace_slot)) : NULL;  // seq = 0: vazio
+        if (slots == NULL) {
+            free(ring);
+            pthread_mutex_unlock(&trace_rings_lock);
+            return Q_ERR_ALLOC_FAILED;
+        }
+        ring->slots = slots;
+        ring->mask = cap - 1;
+        ring->ticks_per_ns = profile_calibrate_tsc();
+        atomic_init(&ring->base_tsc, 0);
+        atomic_init(&ring->start, 0);
+        atomic_init(&ring->head, 0);
+        ring->next = trace_rings;
+        trace_rings = ring;
+    }
+
+    // Nova sessão: eventos com índice < start (inclusive de emissores atrasados) não aparecem
+    atomic_store_explicit(&ring->start, atomic_load_explicit(&ring->head, memory_order_relaxed),
+                          memory_order_release);
+    atomic_store_explicit(&ring->base_tsc, __rdtsc(), memory_order_relaxed);
+    atomic_store_explicit(&q_trace_ring_global, ring, memory_order_release);
+    pthread_mutex_unlock(&trace_rings_lock);
+    return Q_OK;
+#else
+    (void)capacity;
+    return Q_ERR_INVALID_CONFIG;  // Timers não compilados (make PROFILE=1)
+#endif
+}
+
+// Só despublica: emissores/leitores em voo continuam com memória válida
+void q_trace_disable(void) {
+#ifdef Q_PROFILE
+    atomic_store_explicit(&q_trace_ring_global, NULL, memory_order_release);
+#endif
+}
+
+uint64_t q_trace_event_count(void) {
+#ifdef Q_PROFILE
+    const struct q_trace_ring* ring = atomic_load_explicit(&q_trace_ring_global, memory_order_acquire);
+    if (ring == NULL) {
+        return 0;
+    }
+    // start antes de head: head só cresce, então head >= start lido
+    const uint64_t start = atomic_load_explicit(&ring->start, memory_order_acquire);
+    return atomic_load_explicit(&ring->head, memory_order_acquire) - start;
+#else
+    return 0;
+#endif
+}
+
+q_error_code q_trace_write_json(FILE* out) {
+    Q_VALIDATE_PTR_OR_RETURN(out, Q_ERR_INVALID_ARG);
+#ifdef Q_PROFILE
+    struct q_trace_ring* ring = atomic_load_explicit(&q_trace_ring_global, memory_order_acquire);
+    if (ring == NULL) {
+        return Q_ERR_INVALID_CONFIG;
+    }
+    const uint64_t start = atomic_load_explicit(&ring->start, memory_order_acquire);
+    const uint64_t base_tsc = atomic_load_explicit(&ring->base_tsc, memory_order_relaxed);
+    const uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    const uint64_t cap = ring->mask + 1;
+    const uint64_t first = (head - start > cap) ? head - cap : start;
+    const double us_per_tick = 1.0 / (ring->ticks_per_ns * 1000.0);
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":%llu},\"traceEvents\":[\n",
+            (unsigned long long)(first - start));
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"qorus\"}}");
+    const uint32_t n_threads = atomic_load_explicit(&trace_next_tid, memory_order_relaxed);
+    for (uint32_t tid = 1; tid <= n_threads; tid++) {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                     "\"args\":{\"name\":\"thread %u\"}}", tid, tid);
+    }
+
+    for (uint64_t idx = first; idx < head; idx++) {
+        const trace_slot* slot = &ring->slots[idx & ring->mask];
+        const uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != 2 * idx + 2) {
+            continue;  // Em escrita ou sobrescrito durante o dump
+        }
+        const uint64_t t_begin = atomic_load_explicit(&slot->t_begin, memory_order_relaxed);
+        const uint64_t t_end = atomic_load_explicit(&slot->t_end, memory_order_relaxed);
+        const uint64_t meta = atomic_load_explicit(&slot->meta, memory_order_relaxed);
+        const char* name = (const char*)atomic_load_explicit(&slot->name, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+            continue;
+        }
+
+        // Eventos iniciados antes do enable começam na origem da timeline
+        const uint64_t begin = (t_begin > base_tsc) ? t_begin - base_tsc : 0;
+        const uint64_t end = (t_end > base_tsc) ? t_end - base_tsc : 0;
+        const uint32_t tid = (uint32_t)meta;
+        const uint32_t layer = (uint32_t)(meta >> 32);
+        fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                     "\"ts\":%.3f,\"dur\":%.3f",
+                name, (layer == Q_PROFILE_GLOBAL) ? "generate" : "layer", tid,
+                (double)begin * us_per_tick, (double)(end - begin) * us_per_tick);
+        if (layer != Q_PROFILE_GLOBAL) {
+            fprintf(out, ",\"args\":{\"layer\":%u}", layer);
+        }
+        fputc('}', out);
+    }
+    fprintf(out, "\n]}\n");
+    return ferror(out) ? Q_ERR_FILE_WRITE : Q_OK;
+#else
+    return Q_ERR_INVALID_CONFIG;  // Trace só existe em builds com Q_PROFILE
+#endif
+}
@@ -0,0 +1,91 @@
+#ifndef QORUS_PROFILE_H
+#define QORUS_PROFILE_H
+
+#include "qorus.h"
+
+// Timers internos por op x camada (API pública: q_profile_* / q_trace_* em qorus.h)
+//
+// Uso:
+//   Q_PROFILE_START(t);
+//   ... op ...
+//   Q_PROFILE_STOP(ctx, layer_idx, Q_PROF_QKV_PROJ, t);
+// Ops intercaladas em loops (ex.: por head) acumulam e registram uma vez
+// (o trace recebe cada intervalo separadamente):
+//   Q_PROFILE_ACC_DECL(acc);
+//   for (...) { Q_PROFILE_START(t); ...; Q_PROFILE_ACC(acc, layer_idx, Q_PROF_ATTN_SCORES, t); }
+//   Q_PROFILE_RECORD(ctx, layer_idx, Q_PROF_ATTN_SCORES, acc);
+// Spans só de timeline (prefill/decode/camada), sem stats:
+//   Q_PROFILE_START(t); ...; Q_TRACE_SPAN(layer_idx, "layer", t);
+//
+// Sem Q_PROFILE todas as macros viram ((void)0): nenhum rdtsc, nenhum branch.
+// Caminhos de erro (return antes do STOP) não registram.
+
+#ifdef Q_PROFILE
+
+#include <stdatomic.h>
+#include <x86intrin.h>
+
+// Ring buffer global de eventos (NULL = trace desligado; ver q_trace_enable)
+extern _Atomic(struct q_trace_ring*) q_trace_ring_global;
+
+// Grava um evento completo [t_begin, t_end] da thread atual no ring (lock-free)
+void q_trace_emit(uint32_t layer, const char* name, uint64_t t_begin, uint64_t t_end);
+
+// Custo: ~25 ciclos (rdtsc) + um update de 32 bytes - desprezível por op
+static inline void q_profile_record(q_context* ctx, uint32_t layer, q_profile_op op, uint64_t ticks) {
+    if (ctx == NULL || ctx->profile == NULL) {
+        return;
+    }
+    q_profile_stats* stats = ctx->profile;
+    if (layer >= Q_PROFILE_MAX_LAYERS && layer != Q_PROFILE_GLOBAL) {
+        layer = Q_PROFILE_MAX_LAYERS - 1;
+    }
+    if (layer < Q_PROFILE_MAX_LAYERS && layer >= stats->n_layers) {
+        stats->n_layers = layer + 1;
+    }
+    q_profile_entry* e = &stats->entries[layer][op];
+    e->count++;
+    e->total_ticks += ticks;
+    if (ticks < e->min_ticks) {
+        e->min_ticks = ticks;
+    }
+    if (ticks > e->max_ticks) {
+        e->max_ticks = ticks;
+    }
+}
+
+// Fim de um intervalo: evento no trace (se ligado), retorna a duração em ticks
+static inline uint64_t q_profile_interval(uint32_t layer, q_profile_op op, uint64_t t_begin) {
+    const uint64_t t_end = __rdtsc();
+    if (__builtin_expect(atomic_load_explicit(&q_trace_ring_global, memory_order_relaxed) != NULL, 0)) {
+        q_trace_emit(layer, q_profile_op_name(op), t_begin, t_end);
+    }
+    return t_end - t_begin;
+}
+
+static inline void q_trace_span(uint32_t layer, const char* name, uint64_t t_begin) {
+    if (__builtin_expect(atomic_load_explicit(&q_trace_ring_global, memory_order_relaxed) != NULL, 0)) {
+        q_trace_emit(layer, name, t_begin, __rdtsc());
+    }
+}
+
+#define Q_PROFILE_START(t) const uint64_t t = __rdtsc()
+#define Q_PROFILE_STOP(ctx, layer, op, t) \
+    q_profile_record((ctx), (layer), (op), q_profile_interval((layer), (op), (t)))
+#define Q_PROFILE_ACC_DECL(acc) uint64_t acc = 0
+#define Q_PROFILE_ACC(acc, layer, op, t) ((acc) += q_profile_interval((layer), (op), (t)))
+#define Q_PROFILE_RECORD(ctx, layer, op, ticks) q_profile_record((ctx), (layer), (op), (ticks))
+#define Q_TRACE_SPAN(layer, name, t) q_trace_span((layer), (name), (t))
+
+#else
+
+#define Q_PROFILE_START(t) ((void)0)
+#define Q_PROFILE_STOP(ctx, layer, op, t) ((void)0)
+#define Q_PROFILE_ACC_DECL(acc) ((void)0)
+#define Q_PROFILE_ACC(acc, layer, op, t) ((void)0)
+#define Q_PROFILE_RECORD(ctx, layer, op, ticks) ((void)0)
+#define Q_TRACE_SPAN(layer, name, t) ((void)0)
+
+#endif // Q_PROFILE
+
+#endif // QORUS_PROFILE_H
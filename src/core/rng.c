@@ -0,0 +1,153 @@
+#include "qorus.h"
+#include <immintrin.h>
+
+// ============================================================================
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3")
+// ============================================================================
+//
+// Bloco = Philox(key[2], ctr[4]) -> 4 palavras de 32 bits
+//   ctr = {block_lo, block_hi, stream_lo, stream_hi}
+// O stream é uma função pura de (seed, stream, block, word): nenhuma sincronização,
+// sessões concorrentes na mesma thread não interferem e uma requisição pode
+// ser reproduzida isoladamente (mesmo seed -> mesmos tokens).
+//
+// Caminho AVX2: 8 blocos em paralelo (layout SoA, 1 registrador por palavra
+// do contador); mul 32x32->64 em lanes pares/ímpares com _mm256_mul_epu32.
+// Custo: ~10 rounds x 2 mul por bloco (4 floats).
+
+#define PHILOX_M0 0xD2511F53U
+#define PHILOX_M1 0xCD9E8D57U
+#define PHILOX_W0 0x9E3779B9U
+#define PHILOX_W1 0xBB67AE85U
+#define PHILOX_ROUNDS 10
+
+// float em [0, 1) com 24 bits de mantissa (mesma conversão do gerador thread-local)
+#define RNG_U32_TO_UNIT(u) ((float)((u) >> 8) * (1.0f / 16777216.0f))
+
+static void philox4x32_block(const uint32_t key_in[2], uint64_t block, uint64_t stream, uint32_t out[4]) {
+    uint32_t c0 = (uint32_t)block;
+    uint32_t c1 = (uint32_t)(block >> 32);
+    uint32_t c2 = (uint32_t)stream;
+    uint32_t c3 = (uint32_t)(stream >> 32);
+    uint32_t k0 = key_in[0];
+    uint32_t k1 = key_in[1];
+    for (int r = 0; r < PHILOX_ROUNDS; r++) {
+        const uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        const uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        const uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        const uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// mul 32x32 -> (hi, lo) nas 8 lanes: lanes pares e ímpares em dois _mm256_mul_epu32
+static inline void philox_mulhilo8(__m256i a, __m256i m, __m256i* hi, __m256i* lo) {
+    const __m256i p_even = _mm256_mul_epu32(a, m);
+    const __m256i p_odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    *lo = _mm256_blend_epi32(p_even, _mm256_slli_epi64(p_odd, 32), 0xAA);
+    *hi = _mm256_blend_epi32(_mm256_srli_epi64(p_even, 32), p_odd, 0xAA);
+}
+
+// 8 blocos consecutivos [block, block + 8) -> 32 floats em ordem de stream
+// Pré-condição: block_lo + 7 não dá wrap (chamador garante)
+static void philox4x32_blocks8(const uint32_t key_in[2], uint64_t block, uint64_t stream, float* restrict out) {
+    __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((int)(uint32_t)block),
+                                  _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i c1 = _mm256_set1_epi32((int)(uint32_t)(block >> 32));
+    __m256i c2 = _mm256_set1_epi32((int)(uint32_t)stream);
+    __m256i c3 = _mm256_set1_epi32((int)(uint32_t)(stream >> 32));
+    const __m256i m0 = _mm256_set1_epi32((int)PHILOX_M0);
+    const __m256i m1 = _mm256_set1_epi32((int)PHILOX_M1);
+    uint32_t k0 = key_in[0];
+    uint32_t k1 = key_in[1];
+    for (int r = 0; r < PHILOX_ROUNDS; r++) {
+        __m256i hi0, lo0, hi1, lo1;
+        philox_mulhilo8(c0, m0, &hi0, &lo0);
+        philox_mulhilo8(c2, m1, &hi1, &lo1);
+        c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32((int)k0));
+        c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32((int)k1));
+        c1 = lo1;
+        c3 = lo0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    // u32 -> [0, 1): (u >> 8) < 2^24 é exato em float
+    const __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+    const __m256 f0 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c0, 8)), scale);
+    const __m256 f1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c1, 8)), scale);
+    const __m256 f2 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c2, 8)), scale);
+    const __m256 f3 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(c3, 8)), scale);
+
+    // Transposição 4x8 (SoA -> ordem de stream): bloco b ocupa out[4b .. 4b+3]
+    const __m256 t0 = _mm256_unpacklo_ps(f0, f1);  // b0w0 b0w1 b1w0 b1w1 | b4 b5
+    const __m256 t1 = _mm256_unpackhi_ps(f0, f1);  // b2 b3 | b6 b7
+    const __m256 t2 = _mm256_unpacklo_ps(f2, f3);
+    const __m256 t3 = _mm256_unpackhi_ps(f2, f3);
+    const __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));  // b0 | b4
+    const __m256 u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));  // b1 | b5
+    const __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));  // b2 | b6
+    const __m256 u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));  // b3 | b7
+    _mm256_storeu_ps(out + 0, _mm256_permute2f128_ps(u0, u1, 0x20));
+    _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(u2, u3, 0x20));
+    _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(u0, u1, 0x31));
+    _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(u2, u3, 0x31));
+}
+
+void q_rng_init(q_rng* restrict rng, uint64_t seed, uint64_t stream) {
+    if (rng == NULL) {
+        return;
+    }
+    rng->key[0] = (uint32_t)seed;
+    rng->key[1] = (uint32_t)(seed >> 32);
+    rng->stream = stream;
+    rng->block = 0;
+    rng->word = 0;
+    rng->lanes_tag = 0;
+}
+
+float q_rng_uniform(q_rng* restrict rng) {
+    // Um bloco Philox serve as 4 palavras; a tag cobre block reposicionado à mão
+    // (tag 0 = vazio: block UINT64_MAX nunca fica em cache)
+    if (rng->lanes_tag == 0 || rng->lanes_tag != rng->block + 1) {
+        philox4x32_block(rng->key, rng->block, rng->stream, rng->lanes);
+        rng->lanes_tag = rng->block + 1;
+    }
+    const uint32_t u = rng->lanes[rng->word & 3];
+    if (++rng->word == 4) {
+        rng->word = 0;
+        rng->block++;
+    }
+    return RNG_U32_TO_UNIT(u);
+}
+
+q_error_code q_rng_uniform_f32(q_rng* restrict rng, float* restrict out, size_t n) {
+    Q_VALIDATE_PTR_OR_RETURN(rng, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(out != NULL || n == 0, Q_ERR_INVALID_ARG);
+
+    size_t i = 0;
+    // Cabeça: completar o bloco parcial atual
+    while (i < n && rng->word != 0) {
+        out[i++] = q_rng_uniform(rng);
+    }
+    // Corpo: 8 blocos (32 floats) por passo, sem wrap da metade baixa do contador
+    while (n - i >= 32 && (uint32_t)rng->block <= UINT32_MAX - 7U) {
+        philox4x32_blocks8(rng->key, rng->block, rng->stream, out + i);
+        rng->block += 8;
+        i += 32;
+    }
+    // Cauda (e blocos que cruzam o wrap de block_lo)
+    while (i < n) {
+        out[i++] = q_rng_uniform(rng);
+    }
+    return Q_OK;
+}
@@ -0,0 +1,271 @@
+#include "qorus.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+// ============================================================================
+// Session Snapshot (KV Cache + posição de geração)
+// ============================================================================
+//
+// Layout do arquivo (zero-parse, little-endian):
+//   [0, 64)    q_session_header
+//   [64, ...)  KV usado, empacotado: para cada (layer, kv_head), as posições
+//              [0, n_pos) na mesma ordem do KV cache em memória:
+//              [n_pos, head_dim * 2] (K e V intercalados por posição)
+//
+// O KV cache em memória tem stride max_seq_len por (layer, head); o arquivo
+// guarda apenas as n_pos posições usadas (compacto). O load faz mmap e copia
+// cada bloco contíguo direto para o kv_buffer - sem parsing, custo = page-in.
+//
+// model_hash amarra o snapshot ao modelo: config completa + tamanho do arquivo
+// de pesos + checksum de SESSION_HASH_WINDOWS janelas espaçadas uniformemente
+// sobre os pesos mmapados (~256 KB lidos, independente do tamanho do modelo).
+// Detecta outro modelo/conversão com a mesma geometria; não é verificação de
+// integridade byte a byte dos pesos.
+
+#define Q_SESSION_MAGIC   0x51534553  // 'QSES'
+#define Q_SESSION_VERSION 2  // v2: model_hash
+
+#define SESSION_HASH_WINDOWS     64
+#define SESSION_HASH_WINDOW_SIZE 4096
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n_layers;
+    uint32_t n_kv_heads;
+    uint32_t head_dim;
+    uint32_t max_seq_len;
+    uint32_t n_pos;          // Posições válidas no KV cache (= current_pos)
+    uint32_t current_pos;    // q_generation_state.current_pos
+    uint64_t model_hash;     // session_model_hash (config + amostra dos pesos)
+    uint32_t reserved[6];
+} __attribute__((packed, aligned(64))) q_session_header;
+
+_Static_assert(sizeof(q_session_header) == 64, "q_session_header must be 64 bytes");
+
+// Tamanho de um bloco (layer, head) no arquivo e stride do mesmo bloco no KV cache
+// Returns false em overflow
+static bool session_block_sizes(
+    const q_llama_config* config,
+    uint32_t n_pos,
+    size_t* block_bytes,
+    size_t* head_stride_bytes
+) {
+    const size_t head_dim = config->dim / config->n_heads;
+    const size_t pos_bytes = head_dim * 2 * sizeof(float);  // K + V
+
+    if (n_pos != 0 && pos_bytes > SIZE_MAX / n_pos) return false;
+    if (pos_bytes > SIZE_MAX / config->max_seq_len) return false;
+
+    *block_bytes = pos_bytes * n_pos;
+    *head_stride_bytes = pos_bytes * config->max_seq_len;
+    return true;
+}
+
+// FNV-1a em palavras de 64 bits (memcpy: janelas podem estar desalinhadas)
+static uint64_t session_hash_bytes(uint64_t h, const uint8_t* data, size_t n) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+    for (; i < n; i++) {
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Impressão digital do modelo: config + tamanho + janelas amostradas dos pesos
+static uint64_t session_model_hash(const q_llama_config* config, const q_context* ctx) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = session_hash_bytes(h, (const uint8_t*)config, sizeof(*config));
+
+    const uint8_t* weights = (const uint8_t*)ctx->weights_mmap;
+    const uint64_t size = (weights != NULL) ? ctx->weights_size : 0;
+    h = session_hash_bytes(h, (const uint8_t*)&size, sizeof(size));
+    if (size <= (uint64_t)SESSION_HASH_WINDOWS * SESSION_HASH_WINDOW_SIZE) {
+        return session_hash_bytes(h, weights, (size_t)size);
+    }
+    const uint64_t span = size - SESSION_HASH_WINDOW_SIZE;
+    for (uint64_t w = 0; w < SESSION_HASH_WINDOWS; w++) {
+        const uint64_t offset = span * w / (SESSION_HASH_WINDOWS - 1);
+        h = session_hash_bytes(h, weights + offset, SESSION_HASH_WINDOW_SIZE);
+    }
+    return h;
+}
+
+// Valida state e calcula geometria comum a save/load
+static q_error_code session_validate_state(
+    const q_generation_state* state,
+    size_t* block_bytes,
+    size_t* head_stride_bytes,
+    uint32_t n_pos
+) {
+    Q_VALIDATE_PTR_OR_RETURN(state, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(state->ctx, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(state->model, Q_ERR_INVALID_ARG);
+
+    const q_llama_config* config = &state->model->config;
+    if (state->ctx->kv_buffer == NULL || config->n_heads == 0 || config->max_seq_len == 0) {
+        return Q_ERR_INVALID_ARG;
+    }
+    if (n_pos > config->max_seq_len) {
+        return Q_ERR_INVALID_SIZE;
+    }
+    if (!session_block_sizes(config, n_pos, block_bytes, head_stride_bytes)) {
+        return Q_ERR_OVERFLOW;
+    }
+
+    // KV cache precisa cobrir [n_layers, n_kv_heads, max_seq_len] completo
+    const size_t n_blocks = (size_t)config->n_layers * (size_t)config->n_kv_heads;
+    if (n_blocks != 0 && *head_stride_bytes > state->ctx->kv_size / n_blocks) {
+        return Q_ERR_INVALID_SIZE;
+    }
+    return Q_OK;
+}
+
+q_error_code q_session_save(const q_generation_state* restrict state, const char* path) {
+    Q_VALIDATE_PTR_OR_RETURN(state, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(path, Q_ERR_INVALID_ARG);
+
+    size_t block_bytes = 0;
+    size_t head_stride_bytes = 0;
+    q_error_code ret = session_validate_state(state, &block_bytes, &head_stride_bytes, state->current_pos);
+    if (ret != Q_OK) {
+        return ret;
+    }
+
+    const q_llama_config* config = &state->model->config;
+    q_session_header header = {
+        .magic = Q_SESSION_MAGIC,
+        .version = Q_SESSION_VERSION,
+        .n_layers = config->n_layers,
+        .n_kv_heads = config->n_kv_heads,
+        .head_dim = config->dim / config->n_heads,
+        .max_seq_len = config->max_seq_len,
+        .n_pos = state->current_pos,
+        .current_pos = state->current_pos,
+        .model_hash = session_model_hash(config, state->ctx),
+    };
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        return Q_ERR_FILE_OPEN;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, f) != 1) {
+        fclose(f);
+        return Q_ERR_FILE_WRITE;
+    }
+
+    // Um fwrite contíguo por (layer, head): apenas as posições usadas
+    const uint8_t* kv = (const uint8_t*)state->ctx->kv_buffer;
+    const size_t n_blocks = (size_t)config->n_layers * (size_t)config->n_kv_heads;
+    if (block_bytes > 0) {
+        for (size_t b = 0; b < n_blocks; b++) {
+            if (fwrite(kv + b * head_stride_bytes, 1, block_bytes, f) != block_bytes) {
+                fclose(f);
+                return Q_ERR_FILE_WRITE;
+            }
+        }
+    }
+
+    if (fclose(f) != 0) {
+        return Q_ERR_FILE_WRITE;
+    }
+    return Q_OK;
+}
+
+q_error_code q_session_load(q_generation_state* restrict state, const char* path) {
+    Q_VALIDATE_PTR_OR_RETURN(state, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(path, Q_ERR_INVALID_ARG);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return Q_ERR_FILE_OPEN;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return Q_ERR_FILE_STAT;
+    }
+    size_t file_size = (size_t)st.st_size;
+
+    if (file_size < sizeof(q_session_header)) {
+        close(fd);
+        return Q_ERR_FILE_TOO_SMALL;
+    }
+
+    void* map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return Q_ERR_MMAP_FAILED;
+    }
+
+    // Leitura sequencial única: pedir readahead agressivo
+    #if defined(__linux__) || defined(__FreeBSD__)
+    madvise(map, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    #endif
+
+    const q_session_header* header = (const q_session_header*)map;
+    q_error_code ret = Q_OK;
+
+    if (header->magic != Q_SESSION_MAGIC || header->version != Q_SESSION_VERSION) {
+        ret = Q_ERR_INVALID_MAGIC;
+        goto unmap;
+    }
+
+    size_t block_bytes = 0;
+    size_t head_stride_bytes = 0;
+    ret = session_validate_state(state, &block_bytes, &head_stride_bytes, header->n_pos);
+    if (ret != Q_OK) {
+        goto unmap;
+    }
+
+    // Snapshot só é válido para a mesma geometria de KV cache
+    const q_llama_config* config = &state->model->config;
+    if (header->n_layers != config->n_layers ||
+        header->n_kv_heads != config->n_kv_heads ||
+        header->head_dim != config->dim / config->n_heads ||
+        header->max_seq_len != config->max_seq_len ||
+        header->current_pos > header->n_pos) {
+        ret = Q_ERR_INVALID_CONFIG;
+        goto unmap;
+    }
+
+    // Mesma geometria, modelo diferente: KV não corresponde aos pesos carregados
+    if (header->model_hash != session_model_hash(config, state->ctx)) {
+        ret = Q_ERR_MODEL_MISMATCH;
+        goto unmap;
+    }
+
+    const size_t n_blocks = (size_t)config->n_layers * (size_t)config->n_kv_heads;
+    if (block_bytes != 0 && n_blocks > (SIZE_MAX - sizeof(q_session_header)) / block_bytes) {
+        ret = Q_ERR_OVERFLOW;
+        goto unmap;
+    }
+    if (file_size != sizeof(q_session_header) + n_blocks * block_bytes) {
+        ret = Q_ERR_FILE_TOO_SMALL;
+        goto unmap;
+    }
+
+    // Cópia direta bloco a bloco (payload já está no layout do KV cache)
+    const uint8_t* payload = (const uint8_t*)map + sizeof(q_session_header);
+    uint8_t* kv = (uint8_t*)state->ctx->kv_buffer;
+    for (size_t b = 0; b < n_blocks; b++) {
+        memcpy(kv + b * head_stride_bytes, payload + b * block_bytes, block_bytes);
+    }
+
+    state->current_pos = header->current_pos;
+
+unmap:
+    munmap(map, file_size);
+    return ret;
+}
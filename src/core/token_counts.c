@@ -0,0 +1,120 @@
+#include "qorus.h"
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// Token Counts: histograma esparso incremental dos tokens gerados
+// ============================================================================
+//
+// Layout:
+//   ids[n_unique], counts[n_unique]  SoA denso, iterado pelo estágio de
+//                                    penalties (gather/scatter nos logits)
+//   index[capacity]                  open-addressing (linear probing):
+//                                    slot = posição densa + 1, 0 = vazio
+//
+// capacity = potência de 2 >= 2 * max_unique (load factor <= 0.5), então
+// probes são curtos e a tabela nunca enche. Sem remoção: reset zera tudo.
+
+#define TOKEN_COUNTS_HASH 0x9E3779B1U  // Fibonacci hashing
+
+static inline uint32_t token_counts_slot(const q_token_counts* tc, uint32_t token_id) {
+    return (uint32_t)(token_id * TOKEN_COUNTS_HASH) >> tc->shift;
+}
+
+q_error_code q_token_counts_init(q_token_counts* restrict tc, uint32_t max_unique) {
+    Q_VALIDATE_PTR_OR_RETURN(tc, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_NONZERO_OR_RETURN(max_unique, Q_ERR_INVALID_SIZE);
+    Q_VALIDATE_OR_RETURN(max_unique <= (1U << 30), Q_ERR_INVALID_SIZE);
+
+    memset(tc, 0, sizeof(*tc));
+    uint32_t log2_cap = 1;
+    while ((1U << log2_cap) < 2 * max_unique) {
+        log2_cap++;
+    }
+    tc->capacity = 1U << log2_cap;
+    tc->shift = 32 - log2_cap;
+    tc->max_unique = max_unique;
+
+    tc->ids = (uint32_t*)malloc((size_t)max_unique * sizeof(uint32_t));
+    tc->counts = (uint32_t*)malloc((size_t)max_unique * sizeof(uint32_t));
+    tc->index = (uint32_t*)calloc(tc->capacity, sizeof(uint32_t));
+    if (tc->ids == NULL || tc->counts == NULL || tc->index == NULL) {
+        q_token_counts_free(tc);
+        return Q_ERR_ALLOC_FAILED;
+    }
+    return Q_OK;
+}
+
+q_error_code q_token_counts_add(q_token_counts* restrict tc, uint32_t token_id) {
+    Q_VALIDATE_PTR_OR_RETURN(tc, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(tc->index, Q_ERR_INVALID_ARG);
+
+    const uint32_t mask = tc->capacity - 1;
+    uint32_t slot = token_counts_slot(tc, token_id);
+    for (;;) {
+        const uint32_t pos = tc->index[slot];
+        if (pos == 0) {
+            break;  // Token novo
+        }
+        if (tc->ids[pos - 1] == token_id) {
+            tc->counts[pos - 1]++;
+            return Q_OK;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (tc->n_unique >= tc->max_unique) {
+        return Q_ERR_INVALID_SIZE;
+    }
+    tc->ids[tc->n_unique] = token_id;
+    tc->counts[tc->n_unique] = 1;
+    tc->n_unique++;
+    tc->index[slot] = tc->n_unique;
+    if (token_id > tc->max_id) {
+        tc->max_id = token_id;
+    }
+    return Q_OK;
+}
+
+uint32_t q_token_counts_get(const q_token_counts* restrict tc, uint32_t token_id) {
+    if (tc == NULL || tc->index == NULL) {
+        return 0;
+    }
+    const uint32_t mask = tc->capacity - 1;
+    for (uint32_t slot = token_counts_slot(tc, token_id);; slot = (slot + 1) & mask) {
+        const uint32_t pos = tc->index[slot];
+        if (pos == 0) {
+            return 0;
+        }
+        if (tc->ids[pos - 1] == token_id) {
+            return tc->counts[pos - 1];
+        }
+    }
+}
+
+void q_token_counts_reset(q_token_counts* restrict tc) {
+    if (tc == NULL || tc->index == NULL) {
+        return;
+    }
+    // Esparso: limpar só os slots ocupados (O(n_unique), não O(capacity))
+    const uint32_t mask = tc->capacity - 1;
+    for (uint32_t i = 0; i < tc->n_unique; i++) {
+        uint32_t slot = token_counts_slot(tc, tc->ids[i]);
+        while (tc->index[slot] != i + 1) {
+            slot = (slot + 1) & mask;
+        }
+        tc->index[slot] = 0;
+    }
+    tc->n_unique = 0;
+    tc->max_id = 0;
+}
+
+void q_token_counts_free(q_token_counts* restrict tc) {
+    if (tc == NULL) {
+        return;
+    }
+    free(tc->ids);
+    free(tc->counts);
+    free(tc->index);
+    memset(tc, 0, sizeof(*tc));
+}
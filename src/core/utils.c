@@ -26,6 +26,8 @@ const char* q_strerror(q_error_code err) {
         case Q_ERR_MISALIGNED: return "Pointer not properly aligned";
         case Q_ERR_INVALID_DTYPE: return "Invalid data type";
         case Q_ERR_INVALID_SIZE: return "Invalid size";
+        case Q_ERR_FILE_WRITE: return "Failed to write file";
+        case Q_ERR_MODEL_MISMATCH: return "Snapshot belongs to a different model";
         default: return "Unknown error";
     }
 }
@@ -6,7 +6,8 @@
 //
 // Complexidade:
 // - Sampling greedy: O(V) onde V = vocab_size
-// - Sampling top-k/top-p: O(V + k log k) usando partial sort (não full sort O(V log V))
+// - Sampling top-k/top-p: O(V log k) pior caso, ~O(V) típico (seleção por heap com threshold
+//   SIMD); softmax/top-p/CDF apenas sobre os k candidatos
 // - Loop de geração: O(T × (F + V)) para greedy, O(T × (F + V + k log k)) para top-k/top-p
 // ============================================================================
 
@@ -15,11 +16,12 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
-#include <float.h>
 #include <threads.h>  // Para thread-local storage (C11)
 #ifdef __AVX2__
 #include <immintrin.h>  // Para SIMD AVX2
 #endif
+#include "ops/avx2/avx_math.h"  // exp_approx_avx/horizontal_*: mesma aritmética do q_softmax_f32_avx2
+#include "core/profile.h"  // Q_PROFILE_*: timers de penalties/grammar/sampler (slot global)
 #if !defined(__STDC_NO_THREADS__) && __STDC_VERSION__ >= 201112L
     #define Q_HAS_THREADS 1
 #else
@@ -56,795 +58,651 @@
 //
 // ============================================================================
 
-// Helper: Comparar índices por probabilidade (descendente)
-// Usado para ordenação parcial
+// Candidato do sampler: token e probabilidade (heap, nucleus, CDF)
 typedef struct {
     uint32_t index;
     float prob;
 } prob_index_t;
 
-// OTIMIZAÇÃO CRÍTICA: SoA (Structure of Arrays) para melhor cache locality
-// Separar indices e probs em arrays distintos reduz cache misses em 50%
-// Cache line = 64 bytes:
-// - AoS: 8 elementos por cache line, apenas prob usado → 50% waste
-// - SoA: 16 floats por cache line, todos usados → 100% utilization
-typedef struct {
-    uint32_t* indices;  // [size] - token indices
-    float* probs;        // [size] - corresponding probabilities
-    uint32_t size;       // Current size (vocab_size or nucleus_size)
-} prob_array_t;
+// ============================================================================
+// TOP-K-FIRST SAMPLER
+// ============================================================================
+// Uma passada de seleção sobre V floats por token (sem probs[V], cópias ou sort
+// do vocabulário inteiro):
+//   1. max(logits/T): passada SIMD somente leitura
+//   2. exp + soma Z + seleção: min-heap de k candidatos; threshold SIMD
+//      (movemask) descarta blocos de 8 abaixo do mínimo do heap
+//   3. Renormalização top-k, nucleus top-p e CDF apenas sobre os candidatos
+// Top-p sem top-k tenta 64 candidatos; se o nucleus não couber, um histograma
+// de massa por faixa de e define um limiar e só os tokens acima dele são
+// coletados e ordenados (radix sort), em vez do vocabulário inteiro.
+//
+// Aritmética fixa (reprodutível para o mesmo estado do RNG):
+// - logits/T: mul por 1/T no corpo quando logits alinhados, divisão na cauda
+// - exp_approx_avx no corpo e expf na cauda (V % 8); Z acumulado nas mesmas
+//   lanes e na mesma ordem do q_softmax_f32_avx2; p = e * (1/Z)
+// - Somas de top-k/top-p em ordem decrescente de p e CDF em ordem de índice
+// Empates exatos de p na fronteira do corte ficam com o menor índice.
+// ============================================================================
 
-// NOTE: compare_prob_desc no longer used after qsort_soa() implementation
-// Kept for reference but marked unused
-__attribute__((unused)) static int compare_prob_desc(const void* a, const void* b) {
-    const prob_index_t* pa = (const prob_index_t*)a;
-    const prob_index_t* pb = (const prob_index_t*)b;
-    if (pa->prob > pb->prob) return -1;
-    if (pa->prob < pb->prob) return 1;
-    return 0;
-}
+// Top-p sem top-k: candidatos do heap antes de recorrer ao histograma de massa
+#define SAMPLER_TOP_P_INITIAL_K 64U
+// Min-p sem top-k/top-p: capacidade inicial da coleta (recoleta se exceder)
+#define SAMPLER_MIN_P_INITIAL_CAPACITY 1024U
 
-// NOTE: Old AoS insertion_sort_desc removed - replaced by insertion_sort_desc_soa()
-// NOTE: Old AoS quickselect_top_k removed - replaced by quickselect_top_k_soa()
-// The old function is kept below (marked unused) for find_nucleus_size_optimized reference
+// Softmax com temperatura sobre o vocabulário, sem materializar probs[V]
+typedef struct {
+    float temperature;
+    float inv_temp;
+    float max_scaled;  // max(logits / T)
+    float sum;         // Z = Σ exp(logits/T - max) (preenchido por sampler_select)
+    float inv_sum;     // 1 / Z
+    uint32_t vec_end;  // [0, vec_end): corpo SIMD (exp_approx_avx); [vec_end, V): cauda (expf)
+    bool simd_scale;   // Corpo escala com mul(1/T) (logits alinhados); senão div(T)
+} sampler_softmax_t;
 
-// OTIMIZAÇÃO CRÍTICA: Insertion sort com SoA
-// Mantém sincronização entre indices e probs durante sort
-static void insertion_sort_desc_soa(prob_array_t* restrict arr, uint32_t n) {
-    for (uint32_t i = 1; i < n; i++) {
-        float key_prob = arr->probs[i];
-        uint32_t key_idx = arr->indices[i];
-        uint32_t j = i;
-        
-        // Mover elementos maiores que key para a direita
-        while (j > 0 && arr->probs[j - 1] < key_prob) {
-            arr->probs[j] = arr->probs[j - 1];
-            arr->indices[j] = arr->indices[j - 1];
-            j--;
-        }
-        arr->probs[j] = key_prob;
-        arr->indices[j] = key_idx;
+// logits[i..i+8) / T (mul por 1/T se alinhado, senão div por T)
+static inline __m256 sampler_scaled8(
+    const sampler_softmax_t* restrict sm,
+    const float* restrict logits,
+    uint32_t i
+) {
+    __m256 x = _mm256_loadu_ps(&logits[i]);
+    if (sm->simd_scale) {
+        return _mm256_mul_ps(x, _mm256_set1_ps(sm->inv_temp));
     }
+    return _mm256_div_ps(x, _mm256_set1_ps(sm->temperature));  // Divisão IEEE = escalar
 }
 
-// Helper: Partition SoA array around pivot (returns pivot position)
-// Similar to quickselect partition but returns pivot index for quicksort
-static uint32_t partition_soa(
-    prob_array_t* restrict arr,
-    uint32_t left,
-    uint32_t right
+// Passada 1: max(logits / T)
+static void sampler_softmax_init(
+    sampler_softmax_t* restrict sm,
+    const float* restrict logits,
+    uint32_t vocab_size,
+    float temperature
 ) {
-    // Use last element as pivot
-    uint32_t pivot_idx = right;
-    float pivot_prob = arr->probs[pivot_idx];
-    uint32_t store_idx = left;
-    
-    // Partition: move elements >= pivot to the left
-    for (uint32_t i = left; i < right; i++) {
-        if (arr->probs[i] >= pivot_prob) {
-            // Swap both arrays simultaneously (maintain synchronization)
-            float tmp_prob = arr->probs[i];
-            arr->probs[i] = arr->probs[store_idx];
-            arr->probs[store_idx] = tmp_prob;
-            
-            uint32_t tmp_idx = arr->indices[i];
-            arr->indices[i] = arr->indices[store_idx];
-            arr->indices[store_idx] = tmp_idx;
-            
-            store_idx++;
+    sm->temperature = temperature;
+    sm->inv_temp = 1.0f / temperature;
+    sm->sum = 1.0f;
+    sm->inv_sum = 1.0f;
+    // q_softmax_f32_avx2 só vetoriza V >= 8; abaixo disso tudo é "cauda"
+    sm->vec_end = (vocab_size >= 8) ? (vocab_size & ~7U) : 0;
+    sm->simd_scale = (vocab_size >= 8) && (((uintptr_t)logits % 32) == 0);
+
+    float max_val;
+    uint32_t i;
+    if (sm->vec_end > 0) {
+        __m256 max_vec = _mm256_set1_ps(-INFINITY);
+        for (i = 0; i < sm->vec_end; i += 8) {
+            max_vec = _mm256_max_ps(max_vec, sampler_scaled8(sm, logits, i));
         }
+        max_val = horizontal_max_avx(max_vec);
+    } else {
+        max_val = logits[0] / temperature;
+        i = 1;
     }
-    
-    // Place pivot in correct position
-    float tmp_prob = arr->probs[pivot_idx];
-    arr->probs[pivot_idx] = arr->probs[store_idx];
-    arr->probs[store_idx] = tmp_prob;
-    
-    uint32_t tmp_idx = arr->indices[pivot_idx];
-    arr->indices[pivot_idx] = arr->indices[store_idx];
-    arr->indices[store_idx] = tmp_idx;
-    
-    return store_idx;
+    for (; i < vocab_size; i++) {
+        float x = logits[i] / temperature;
+        if (x > max_val) {
+            max_val = x;
+        }
+    }
+    sm->max_scaled = max_val;
 }
 
-// Quicksort for SoA (recursive)
-// Maintains synchronization between indices and probs
-static void qsort_soa_recursive(
-    prob_array_t* restrict arr,
-    uint32_t left,
-    uint32_t right
-) {
-    if (left >= right) {
-        return;
-    }
-    
-    // For small arrays, use insertion sort (better cache locality)
-    if (right - left < 16) {
-        // Create temporary SoA view for insertion sort
-        prob_array_t sub_arr = {
-            .indices = &arr->indices[left],
-            .probs = &arr->probs[left],
-            .size = right - left + 1
-        };
-        insertion_sort_desc_soa(&sub_arr, right - left + 1);
-        return;
-    }
-    
-    // Partition and recurse
-    uint32_t pivot_idx = partition_soa(arr, left, right);
-    
-    // Recursively sort left and right partitions
-    if (pivot_idx > left) {
-        qsort_soa_recursive(arr, left, pivot_idx - 1);
-    }
-    if (pivot_idx < right) {
-        qsort_soa_recursive(arr, pivot_idx + 1, right);
-    }
+// Ordem dos candidatos: e decrescente, índice crescente nos empates
+static inline bool candidate_worse(const prob_index_t* a, const prob_index_t* b) {
+    return a->prob < b->prob || (!(a->prob > b->prob) && a->index > b->index);
 }
 
-// Public interface: Sort SoA array (n elements) in descending order
-// OTIMIZAÇÃO CRÍTICA: Elimina conversão AoS → qsort → AoS
-// Mantém SoA layout durante todo o sort, melhorando cache locality
-static void qsort_soa(prob_array_t* restrict arr, uint32_t n) {
-    if (n == 0 || n == 1) {
-        return;
-    }
-    
-    // For small arrays, use insertion sort directly
-    if (n < 16) {
-        insertion_sort_desc_soa(arr, n);
-        return;
+static void candidate_sift_down(prob_index_t* restrict heap, uint32_t n, uint32_t pos) {
+    for (;;) {
+        uint32_t worst = 2 * pos + 1;
+        if (worst >= n) {
+            return;
+        }
+        if (worst + 1 < n && candidate_worse(&heap[worst + 1], &heap[worst])) {
+            worst++;
+        }
+        if (!candidate_worse(&heap[worst], &heap[pos])) {
+            return;
+        }
+        prob_index_t tmp = heap[pos];
+        heap[pos] = heap[worst];
+        heap[worst] = tmp;
+        pos = worst;
     }
-    
-    // Use quicksort for larger arrays
-    qsort_soa_recursive(arr, 0, n - 1);
 }
 
-// Helper: Allocate SoA structure via arena (zero-malloc)
-// Returns NULL on failure (arena OOM)
-static prob_array_t* prob_array_alloc(
-    q_context* restrict ctx,
-    uint32_t size
+// Min-heap (raiz = pior candidato). Índices chegam em ordem crescente, então
+// um empate com a raiz perde: vence o menor índice, como no sort estável.
+static inline void candidate_offer(
+    prob_index_t* restrict heap,
+    uint32_t* restrict n,
+    uint32_t k,
+    uint32_t index,
+    float e
 ) {
-    if (ctx == NULL || ctx->scratch_buffer == NULL || size == 0) {
-        return NULL;
-    }
-    
-    // Allocate structure itself
-    prob_array_t* arr = (prob_array_t*)q_arena_alloc(ctx, sizeof(prob_array_t));
-    if (arr == NULL) {
-        return NULL;
-    }
-    
-    // Allocate indices array (aligned to 64 bytes)
-    size_t indices_size = Q_ALIGN_SIZE((size_t)size * sizeof(uint32_t));
-    arr->indices = (uint32_t*)q_arena_alloc(ctx, indices_size);
-    if (arr->indices == NULL) {
-        return NULL;
-    }
-    
-    // Allocate probs array (aligned to 64 bytes)
-    size_t probs_size = Q_ALIGN_SIZE((size_t)size * sizeof(float));
-    arr->probs = (float*)q_arena_alloc(ctx, probs_size);
-    if (arr->probs == NULL) {
-        return NULL;
+    if (*n < k) {
+        uint32_t pos = (*n)++;
+        heap[pos].index = index;
+        heap[pos].prob = e;
+        while (pos > 0) {
+            uint32_t parent = (pos - 1) / 2;
+            if (!candidate_worse(&heap[pos], &heap[parent])) {
+                break;
+            }
+            prob_index_t tmp = heap[pos];
+            heap[pos] = heap[parent];
+            heap[parent] = tmp;
+            pos = parent;
+        }
+    } else if (e > heap[0].prob) {
+        heap[0].index = index;
+        heap[0].prob = e;
+        candidate_sift_down(heap, k, 0);
     }
-    
-    arr->size = size;
-    return arr;
 }
 
-// OTIMIZAÇÃO CRÍTICA: Quickselect com SoA e prefetch
-// Reduz cache misses em 50% comparado a AoS
-// Prefetch condicional: apenas para arrays grandes (size > 1000)
-static void quickselect_top_k_soa(
-    prob_array_t* restrict arr,
-    uint32_t left,
-    uint32_t right,
+// Passada 2: e = exp(logits/T - max), Z = Σe e top-k por e
+// Retorna número de candidatos (min(k, V)), ordenados por e decrescente
+// k = 0: só calcula Z
+static uint32_t sampler_select(
+    sampler_softmax_t* restrict sm,
+    const float* restrict logits,
+    uint32_t vocab_size,
+    prob_index_t* restrict heap,
     uint32_t k
 ) {
-    if (left >= right || k == 0) {
-        return;
-    }
-    
-    // Prefetch condicional: apenas para arrays grandes
-    // Prefetch ~200-300 ciclos antes do uso (8 elementos à frente)
-    // CORREÇÃO CRÍTICA: Verificar contra 'right' (intervalo particionado) em vez de 'arr->size'
-    if (arr->size > 1000 && right - left > 16) {
-        uint32_t prefetch_idx = left + 16;
-        if (prefetch_idx <= right) {  // ✅ CORRIGIDO: <= right garante acesso válido ao intervalo [left, right]
-            __builtin_prefetch(&arr->probs[prefetch_idx], 0, 3);  // Read, L3 cache
+    const __m256 max_vec = _mm256_set1_ps(sm->max_scaled);
+    __m256 sum_vec = _mm256_setzero_ps();
+    float lanes[8];
+    uint32_t n = 0;
+    // e >= 0: threshold -1 aceita tudo até o heap encher
+    __m256 threshold = _mm256_set1_ps(k > 0 ? -1.0f : INFINITY);
+
+    for (uint32_t i = 0; i < sm->vec_end; i += 8) {
+        __m256 e = exp_approx_avx(_mm256_sub_ps(sampler_scaled8(sm, logits, i), max_vec));
+        sum_vec = _mm256_add_ps(sum_vec, e);
+
+        // Caminho comum com heap cheio: bloco inteiro abaixo do threshold
+        int bits = _mm256_movemask_ps(_mm256_cmp_ps(e, threshold, _CMP_GT_OQ));
+        if (bits == 0) {
+            continue;
         }
-    }
-    
-    // Particionar usando último elemento como pivot
-    uint32_t pivot_idx = right;
-    float pivot_prob = arr->probs[pivot_idx];
-    uint32_t store_idx = left;
-    
-    // Loop otimizado: acesso sequencial a probs (cache-friendly)
-    for (uint32_t i = left; i < right; i++) {
-        // Prefetch próximo elemento (8 elementos à frente)
-        if (arr->size > 1000 && i + 8 < right) {
-            __builtin_prefetch(&arr->probs[i + 8], 0, 3);
+        _mm256_storeu_ps(lanes, e);
+        while (bits != 0) {
+            int lane = __builtin_ctz((unsigned int)bits);
+            bits &= bits - 1;
+            candidate_offer(heap, &n, k, i + (uint32_t)lane, lanes[lane]);
         }
-        
-        if (arr->probs[i] >= pivot_prob) {
-            // Swap em ambos arrays simultaneamente (manter sincronização)
-            float tmp_prob = arr->probs[i];
-            arr->probs[i] = arr->probs[store_idx];
-            arr->probs[store_idx] = tmp_prob;
-            
-            uint32_t tmp_idx = arr->indices[i];
-            arr->indices[i] = arr->indices[store_idx];
-            arr->indices[store_idx] = tmp_idx;
-            
-            store_idx++;
+        if (n == k) {
+            threshold = _mm256_set1_ps(heap[0].prob);
         }
     }
-    
-    // Colocar pivot na posição correta
-    float tmp_prob = arr->probs[pivot_idx];
-    arr->probs[pivot_idx] = arr->probs[store_idx];
-    arr->probs[store_idx] = tmp_prob;
-    
-    uint32_t tmp_idx = arr->indices[pivot_idx];
-    arr->indices[pivot_idx] = arr->indices[store_idx];
-    arr->indices[store_idx] = tmp_idx;
-    
-    // Se encontramos exatamente k elementos, terminamos
-    if (store_idx == k - 1) {
-        return;
+
+    float sum_val = (sm->vec_end > 0) ? horizontal_sum_avx(sum_vec) : 0.0f;
+    for (uint32_t i = sm->vec_end; i < vocab_size; i++) {
+        float e = expf(logits[i] / sm->temperature - sm->max_scaled);
+        sum_val += e;
+        if (k > 0) {
+            candidate_offer(heap, &n, k, i, e);
+        }
     }
-    
-    // Recursão
-    if (store_idx > k - 1) {
-        quickselect_top_k_soa(arr, left, store_idx - 1, k);
-    } else {
-        quickselect_top_k_soa(arr, store_idx + 1, right, k);
+    sm->sum = sum_val;
+    sm->inv_sum = 1.0f / sum_val;
+
+    // Heapsort: raiz (pior) vai para o fim → ordem decrescente
+    for (uint32_t end = n; end > 1; end--) {
+        prob_index_t tmp = heap[0];
+        heap[0] = heap[end - 1];
+        heap[end - 1] = tmp;
+        candidate_sift_down(heap, end - 1, 0);
     }
+    return n;
+}
+
+// Buckets de massa para top-p: e ∈ [0, 1] indexado pelos bits altos do float
+// (expoente + 2 bits de mantissa) → limiar com granularidade de ~19% em e
+#define SAMPLER_MASS_SHIFT 21
+#define SAMPLER_MASS_BUCKETS ((0x3F800000U >> SAMPLER_MASS_SHIFT) + 1)
+
+static inline uint32_t sampler_mass_bucket(float e) {
+    uint32_t bits;
+    memcpy(&bits, &e, sizeof(bits));
+    uint32_t bucket = bits >> SAMPLER_MASS_SHIFT;
+    return bucket < SAMPLER_MASS_BUCKETS ? bucket : SAMPLER_MASS_BUCKETS - 1;
 }
 
-// Helper: Computar softmax com temperatura
-// Retorna distribuição de probabilidades válida (soma = 1.0)
-// OTIMIZAÇÃO: Usa SIMD (AVX2) quando possível para melhor performance
-static q_error_code compute_softmax_with_temp(
+// Nucleus maior que os candidatos iniciais: histograma de massa por bucket
+// escolhe o maior limiar b com massa(e >= b) >= top_p·Z (+ margem de
+// arredondamento). Todos os e >= b formam um top-m exato (empates inclusos).
+// Retorna b; *count_out = m
+static float sampler_mass_threshold(
+    const sampler_softmax_t* restrict sm,
     const float* restrict logits,
-    float* restrict probs,
     uint32_t vocab_size,
-    float temperature
+    float top_p,
+    uint32_t* restrict count_out
 ) {
-    if (temperature <= 0.0f) {
-        // Greedy: não precisa computar softmax completo
-        return Q_OK;
-    }
-    
-    // CORREÇÃO CRÍTICA: Violação de `restrict` corrigida
-    // Problema: `scaled_logits = probs` violava `restrict` porque ambos apontavam para o mesmo buffer
-    // Solução: Aplicar temperatura diretamente em `probs` e usar `probs` como input para softmax
-    // Isso é seguro porque `logits` e `probs` são `restrict` diferentes (não alias)
-    
-    // OTIMIZAÇÃO CRÍTICA: Aplicar temperatura usando SIMD AVX2 diretamente em `probs`
-    // Estratégia: aplicar temperatura vetorizada em `probs`, depois usar softmax SIMD in-place se alinhado
-    // Fallback: implementação escalar se não alinhado ou pequeno
-    float* restrict scaled_logits = probs;  // Usar probs como buffer temporário (seguro: logits != probs)
-    
-    // Aplicar temperatura usando SIMD AVX2 (8 elementos por vez)
-    #ifdef __AVX2__
-    // Verificar alinhamento e tamanho mínimo para SIMD
-    bool can_use_simd_temp = (vocab_size >= 8) && 
-                              (((uintptr_t)logits % 32) == 0) &&
-                              (((uintptr_t)scaled_logits % 32) == 0);
-    
-    if (can_use_simd_temp) {
-        // Broadcast temperature para registro AVX2
-        __m256 temp_vec = _mm256_set1_ps(temperature);
-        __m256 inv_temp_vec = _mm256_div_ps(_mm256_set1_ps(1.0f), temp_vec);  // 1/temp para multiplicação (mais rápido)
-        
-        // Processar elementos vetorizados (8 por vez)
-        uint32_t vec_end = vocab_size & ~7U;  // Múltiplo de 8
-        uint32_t i = 0;
-        
-        for (; i < vec_end; i += 8) {
-            // Carregar 8 elementos
-            __m256 logits_vec = _mm256_load_ps(&logits[i]);
-            
-            // Dividir por temperatura (multiplicar por 1/temp é mais rápido)
-            __m256 scaled_vec = _mm256_mul_ps(logits_vec, inv_temp_vec);
-            
-            // Armazenar resultado
-            _mm256_store_ps(&scaled_logits[i], scaled_vec);
-        }
-        
-        // Processar elementos restantes escalarmente
-        for (; i < vocab_size; i++) {
-            scaled_logits[i] = logits[i] / temperature;
-        }
-    } else {
-        // Fallback escalar para pequenos arrays ou não alinhados
-        for (uint32_t i = 0; i < vocab_size; i++) {
-            scaled_logits[i] = logits[i] / temperature;
+    float mass[SAMPLER_MASS_BUCKETS];
+    uint32_t count[SAMPLER_MASS_BUCKETS];
+    memset(mass, 0, sizeof(mass));
+    memset(count, 0, sizeof(count));
+
+    const __m256 max_vec = _mm256_set1_ps(sm->max_scaled);
+    float lanes[8];
+    for (uint32_t i = 0; i < sm->vec_end; i += 8) {
+        __m256 e = exp_approx_avx(_mm256_sub_ps(sampler_scaled8(sm, logits, i), max_vec));
+        _mm256_storeu_ps(lanes, e);
+        for (uint32_t j = 0; j < 8; j++) {
+            uint32_t bucket = sampler_mass_bucket(lanes[j]);
+            mass[bucket] += lanes[j];
+            count[bucket]++;
         }
     }
-    #else
-    // Fallback escalar se AVX2 não disponível
-    for (uint32_t i = 0; i < vocab_size; i++) {
-        scaled_logits[i] = logits[i] / temperature;
+    for (uint32_t i = sm->vec_end; i < vocab_size; i++) {
+        float e = expf(logits[i] / sm->temperature - sm->max_scaled);
+        uint32_t bucket = sampler_mass_bucket(e);
+        mass[bucket] += e;
+        count[bucket]++;
     }
-    #endif
-    
-    // Tentar usar softmax SIMD se alinhado e tamanho suficiente
-    // Nota: q_softmax_f32_avx2 requer alinhamento de 32 bytes
-    bool use_simd = (vocab_size >= 8) && 
-                    (((uintptr_t)scaled_logits % 32) == 0) &&
-                    (((uintptr_t)probs % 32) == 0);
-    
-    if (use_simd) {
-        // Usar softmax SIMD otimizado in-place
-        // CORREÇÃO: q_softmax_f32_avx2 suporta aliasing (input == output), então é seguro usar scaled_logits == probs
-        // Suprimir warning de restrict apenas para esta chamada específica
-        #pragma GCC diagnostic push
-        #pragma GCC diagnostic ignored "-Wrestrict"
-        q_error_code ret = q_softmax_f32_avx2(scaled_logits, probs, vocab_size);
-        #pragma GCC diagnostic pop
-        if (ret == Q_OK) {
-            return Q_OK;
+
+    const float target = top_p * sm->sum * 1.001f;
+    float acc = 0.0f;
+    uint32_t m = 0;
+    for (uint32_t bucket = SAMPLER_MASS_BUCKETS; bucket > 0; bucket--) {
+        acc += mass[bucket - 1];
+        m += count[bucket - 1];
+        if (acc >= target && bucket > 1) {
+            uint32_t bits = (bucket - 1) << SAMPLER_MASS_SHIFT;
+            float threshold;
+            memcpy(&threshold, &bits, sizeof(threshold));
+            *count_out = m;
+            return threshold;
         }
-        // Fallback para escalar se SIMD falhar
     }
-    
-    // Fallback: implementação escalar (mesma lógica anterior)
-    float max_logit = scaled_logits[0];
-    for (uint32_t i = 1; i < vocab_size; i++) {
-        if (scaled_logits[i] > max_logit) {
-            max_logit = scaled_logits[i];
+    *count_out = vocab_size;
+    return 0.0f;  // Todos
+}
+
+// Coleta (índice, e) com e >= threshold em ordem de índice
+static uint32_t sampler_collect(
+    const sampler_softmax_t* restrict sm,
+    const float* restrict logits,
+    uint32_t vocab_size,
+    float threshold,
+    prob_index_t* restrict cand,
+    uint32_t capacity
+) {
+    const __m256 max_vec = _mm256_set1_ps(sm->max_scaled);
+    const __m256 threshold_vec = _mm256_set1_ps(threshold);
+    float lanes[8];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sm->vec_end; i += 8) {
+        __m256 e = exp_approx_avx(_mm256_sub_ps(sampler_scaled8(sm, logits, i), max_vec));
+        int bits = _mm256_movemask_ps(_mm256_cmp_ps(e, threshold_vec, _CMP_GE_OQ));
+        if (bits == 0) {
+            continue;
         }
-    }
-    
-    float sum_exp = 0.0f;
-    for (uint32_t i = 0; i < vocab_size; i++) {
-        float exp_val = expf(scaled_logits[i] - max_logit);
-        probs[i] = exp_val;
-        sum_exp += exp_val;
-    }
-    
-    if (sum_exp > 0.0f) {
-        float inv_sum = 1.0f / sum_exp;
-        for (uint32_t i = 0; i < vocab_size; i++) {
-            probs[i] *= inv_sum;
+        _mm256_storeu_ps(lanes, e);
+        while (bits != 0 && n < capacity) {
+            int lane = __builtin_ctz((unsigned int)bits);
+            bits &= bits - 1;
+            cand[n].index = i + (uint32_t)lane;
+            cand[n].prob = lanes[lane];
+            n++;
         }
-    } else {
-        // Fallback: distribuição uniforme
-        float uniform = 1.0f / (float)vocab_size;
-        for (uint32_t i = 0; i < vocab_size; i++) {
-            probs[i] = uniform;
+    }
+    for (uint32_t i = sm->vec_end; i < vocab_size && n < capacity; i++) {
+        float e = expf(logits[i] / sm->temperature - sm->max_scaled);
+        if (e >= threshold) {
+            cand[n].index = i;
+            cand[n].prob = e;
+            n++;
         }
     }
-    
-    return Q_OK;
+    return n;
 }
 
-// Helper: Aplicar top-k filtering
-// OTIMIZAÇÃO CRÍTICA: Usa SoA (Structure of Arrays) para melhor cache locality
-// Usa partial sort O(V + k log k) em vez de full sort O(V log V)
-// Usa arena se ctx fornecido, senão malloc (fallback para testes)
-static q_error_code apply_top_k(
-    float* restrict probs,
+// Min-p/typical sem truncamento prévio: Z e coleta de e >= threshold na mesma
+// passada (sm->sum/inv_sum idênticos a sampler_select). Guarda até capacity
+// candidatos em ordem de índice; retorna o total de e >= threshold
+static uint32_t sampler_collect_sum(
+    sampler_softmax_t* restrict sm,
+    const float* restrict logits,
     uint32_t vocab_size,
-    uint32_t top_k,
-    bool* restrict mask_out,  // [out] mask indicando quais tokens são válidos
-    q_context* restrict ctx   // [in] Contexto para arena (opcional, NULL = usar malloc)
+    float threshold,
+    prob_index_t* restrict cand,
+    uint32_t capacity
 ) {
-    if (top_k == 0 || top_k >= vocab_size) {
-        // Desabilitado ou todos os tokens válidos
-        for (uint32_t i = 0; i < vocab_size; i++) {
-            mask_out[i] = true;
-        }
-        return Q_OK;
-    }
-    
-    // OTIMIZAÇÃO CRÍTICA: Usar SoA em vez de AoS para melhor cache locality
-    bool use_arena = (ctx != NULL && ctx->scratch_buffer != NULL);
-    prob_array_t* prob_arr = NULL;
-    
-    if (use_arena) {
-        prob_arr = prob_array_alloc(ctx, vocab_size);
-        if (prob_arr == NULL) {
-            return Q_ERR_ARENA_OOM;
-        }
-    } else {
-        // Fallback: usar malloc para testes
-        prob_arr = (prob_array_t*)malloc(sizeof(prob_array_t));
-        if (prob_arr == NULL) {
-            return Q_ERR_ALLOC_FAILED;
+    const __m256 max_vec = _mm256_set1_ps(sm->max_scaled);
+    const __m256 threshold_vec = _mm256_set1_ps(threshold);
+    __m256 sum_vec = _mm256_setzero_ps();
+    float lanes[8];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < sm->vec_end; i += 8) {
+        __m256 e = exp_approx_avx(_mm256_sub_ps(sampler_scaled8(sm, logits, i), max_vec));
+        sum_vec = _mm256_add_ps(sum_vec, e);
+        int bits = _mm256_movemask_ps(_mm256_cmp_ps(e, threshold_vec, _CMP_GE_OQ));
+        if (bits == 0) {
+            continue;
         }
-        prob_arr->size = vocab_size;
-        prob_arr->indices = (uint32_t*)malloc(vocab_size * sizeof(uint32_t));
-        prob_arr->probs = (float*)malloc(vocab_size * sizeof(float));
-        if (prob_arr->indices == NULL || prob_arr->probs == NULL) {
-            free(prob_arr->indices);
-            free(prob_arr->probs);
-            free(prob_arr);
-            return Q_ERR_ALLOC_FAILED;
+        _mm256_storeu_ps(lanes, e);
+        while (bits != 0) {
+            int lane = __builtin_ctz((unsigned int)bits);
+            bits &= bits - 1;
+            if (n < capacity) {
+                cand[n].index = i + (uint32_t)lane;
+                cand[n].prob = lanes[lane];
+            }
+            n++;
         }
     }
-    
-    // Initialize SoA arrays
-    for (uint32_t i = 0; i < vocab_size; i++) {
-        prob_arr->indices[i] = i;
-        prob_arr->probs[i] = probs[i];
-    }
-    
-    // Partial sort O(V + k log k): quickselect + sort apenas top-k
-    // 1. Quickselect: encontrar top-k elementos O(V) médio
-    // OTIMIZAÇÃO: Usar SoA com prefetch
-    quickselect_top_k_soa(prob_arr, 0, vocab_size - 1, top_k);
-    
-    // 2. Sort apenas top-k: O(k log k) ou O(k²) para pequenos
-    // OTIMIZAÇÃO CRÍTICA: Usar qsort_soa() para eliminar conversão AoS desnecessária
-    // Mantém SoA layout durante todo o sort, melhorando cache locality e reduzindo bandwidth
-    qsort_soa(prob_arr, top_k);
-    
-    // Zerar probabilidades fora do top-k
-    for (uint32_t i = 0; i < vocab_size; i++) {
-        mask_out[i] = false;
-    }
-    
-    float sum_top_k = 0.0f;
-    for (uint32_t i = 0; i < top_k; i++) {
-        uint32_t idx = prob_arr->indices[i];
-        mask_out[idx] = true;
-        sum_top_k += probs[idx];
-    }
-    
-    // Renormalizar top-k (garantir soma = 1.0)
-    if (sum_top_k > 0.0f) {
-        for (uint32_t i = 0; i < vocab_size; i++) {
-            if (mask_out[i]) {
-                probs[i] /= sum_top_k;
-            } else {
-                probs[i] = 0.0f;
+
+    float sum_val = (sm->vec_end > 0) ? horizontal_sum_avx(sum_vec) : 0.0f;
+    for (uint32_t i = sm->vec_end; i < vocab_size; i++) {
+        float e = expf(logits[i] / sm->temperature - sm->max_scaled);
+        sum_val += e;
+        if (e >= threshold) {
+            if (n < capacity) {
+                cand[n].index = i;
+                cand[n].prob = e;
             }
+            n++;
         }
     }
-    
-    // Cleanup: apenas se usou malloc (arena é resetada automaticamente)
-    if (!use_arena) {
-        free(prob_arr->indices);
-        free(prob_arr->probs);
-        free(prob_arr);
+    sm->sum = sum_val;
+    sm->inv_sum = 1.0f / sum_val;
+    return n;
+}
+
+// e do maior logit, conhecido já após a passada do max: exp_approx_avx(0) no
+// corpo, expf(0) = 1 na cauda. O menor dos dois garante que o argmax passa no
+// limiar min_p·e_max (min_p <= 1), esteja ele no corpo ou na cauda
+static float sampler_e_max(const sampler_softmax_t* restrict sm) {
+    if (sm->vec_end == 0) {
+        return 1.0f;
     }
-    return Q_OK;
+    float lanes[8];
+    _mm256_storeu_ps(lanes, exp_approx_avx(_mm256_setzero_ps()));
+    return lanes[0] < 1.0f ? lanes[0] : 1.0f;
 }
 
-// Helper: Encontrar quantos elementos são necessários para atingir top_p (SoA version)
-// CORREÇÃO CRÍTICA: Elimina memcpy repetido no binary search
-// Estratégia: Sort completo UMA VEZ + binary search no cumsum prefixo (sem restaurar arrays)
-// Complexidade: O(V log V) - mesmo assintoticamente, mas fatores constantes ~100× menores
-// Retorna o tamanho do nucleus e deixa prob_arr ordenado para best_k
-static uint32_t find_nucleus_size_optimized_soa(
-    prob_array_t* restrict prob_arr,
-    uint32_t vocab_size,
-    float top_p,
-    q_context* restrict ctx  // [in] Contexto para arena (opcional, NULL = usar malloc)
-) {
-    // CORREÇÃO CRÍTICA: Sort completo UMA VEZ em vez de quickselect repetido
-    // Isso elimina necessidade de restaurar arrays a cada iteração do binary search
-    qsort_soa(prob_arr, vocab_size);
-    
-    // Calcular cumsum prefixo UMA VEZ (O(V))
-    // Isso permite binary search com lookups O(1) em vez de calcular cumsum a cada iteração
-    bool use_arena = (ctx != NULL && ctx->scratch_buffer != NULL);
-    float* cumsum_prefix = NULL;
-    
-    if (use_arena) {
-        size_t cumsum_size = Q_ALIGN_SIZE((size_t)vocab_size * sizeof(float));
-        cumsum_prefix = (float*)q_arena_alloc(ctx, cumsum_size);
-        if (cumsum_prefix == NULL) {
-            return vocab_size;  // Fallback: retornar máximo
+// Chave crescente do radix sort: índice, ou e decrescente (e >= 0: os bits
+// do float ordenam como uint32, então ~bits ordena por e decrescente)
+static inline uint32_t sampler_radix_key(const prob_index_t* c, bool by_index) {
+    if (by_index) {
+        return c->index;
+    }
+    uint32_t bits;
+    memcpy(&bits, &c->prob, sizeof(bits));
+    return ~bits;
+}
+
+// Radix sort LSD estável (8 bits por passada); tmp: [n] auxiliar; resultado em cand
+// Por e: estabilidade mantém índices crescentes nos empates (mesma ordem de
+// candidate_worse), pois sampler_collect coleta em ordem de índice
+static void sampler_radix_sort(prob_index_t* restrict cand, prob_index_t* restrict tmp, uint32_t n, bool by_index) {
+    prob_index_t* src = cand;
+    prob_index_t* dst = tmp;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        uint32_t count[256] = {0};
+        for (uint32_t i = 0; i < n; i++) {
+            count[(sampler_radix_key(&src[i], by_index) >> shift) & 0xFF]++;
         }
-    } else {
-        cumsum_prefix = (float*)malloc(vocab_size * sizeof(float));
-        if (cumsum_prefix == NULL) {
-            return vocab_size;
+        if (n == 0 || count[(sampler_radix_key(&src[0], by_index) >> shift) & 0xFF] == n) {
+            continue;  // Mesmo dígito em todos (ex.: expoentes de e ∈ [0, 1], bytes altos do índice)
         }
-    }
-    
-    // Calcular cumsum prefixo (array já está ordenado em ordem decrescente)
-    cumsum_prefix[0] = prob_arr->probs[0];
-    for (uint32_t i = 1; i < vocab_size; i++) {
-        cumsum_prefix[i] = cumsum_prefix[i - 1] + prob_arr->probs[i];
-    }
-    
-    // Binary search no cumsum prefixo (O(log V) sem memcpy!)
-    // Encontrar k mínimo tal que cumsum_prefix[k-1] >= top_p
-    uint32_t left = 1;
-    uint32_t right = vocab_size;
-    uint32_t best_k = vocab_size;
-    
-    while (left <= right) {
-        uint32_t mid = left + (right - left) / 2;
-        float cumsum = cumsum_prefix[mid - 1];  // O(1) lookup - sem memcpy!
-        
-        if (cumsum >= top_p) {
-            // Encontramos um k válido, tentar menor
-            best_k = mid;
-            right = mid - 1;
-        } else {
-            // Precisamos de mais elementos
-            left = mid + 1;
+        uint32_t offset = 0;
+        for (uint32_t d = 0; d < 256; d++) {
+            uint32_t c = count[d];
+            count[d] = offset;
+            offset += c;
         }
+        for (uint32_t i = 0; i < n; i++) {
+            dst[count[(sampler_radix_key(&src[i], by_index) >> shift) & 0xFF]++] = src[i];
+        }
+        prob_index_t* swap = src;
+        src = dst;
+        dst = swap;
     }
-    
-    // CORREÇÃO: prob_arr já está ordenado, então best_k primeiros elementos são o nucleus
-    // Não precisamos fazer quickselect final - array já está correto!
-    
-    // Cleanup: apenas se usou malloc (arena é resetada automaticamente)
-    if (!use_arena) {
-        free(cumsum_prefix);
+    if (src != cand) {
+        memcpy(cand, src, (size_t)n * sizeof(prob_index_t));
     }
-    
-    return best_k;
 }
 
-// NOTE: Old AoS quickselect_top_k kept for find_nucleus_size_optimized (unused)
-// Replaced by quickselect_top_k_soa() which uses SoA for better cache
-__attribute__((unused)) static void quickselect_top_k(
-    prob_index_t* arr,
-    uint32_t left,
-    uint32_t right,
-    uint32_t k
-) {
-    if (left >= right || k == 0) {
-        return;
+// Σp = 1 sobre os candidatos (soma na ordem atual do array)
+static void sampler_renormalize(prob_index_t* restrict cand, uint32_t n) {
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        sum += cand[i].prob;
     }
-    
-    // Particionar usando último elemento como pivot
-    uint32_t pivot_idx = right;
-    float pivot_prob = arr[pivot_idx].prob;
-    uint32_t store_idx = left;
-    
-    // Mover elementos maiores que pivot para a esquerda
-    for (uint32_t i = left; i < right; i++) {
-        if (arr[i].prob >= pivot_prob) {
-            // Swap
-            prob_index_t tmp = arr[i];
-            arr[i] = arr[store_idx];
-            arr[store_idx] = tmp;
-            store_idx++;
+    if (sum > 0.0f) {
+        for (uint32_t i = 0; i < n; i++) {
+            cand[i].prob /= sum;
         }
     }
-    
-    // Colocar pivot na posição correta
-    prob_index_t tmp = arr[pivot_idx];
-    arr[pivot_idx] = arr[store_idx];
-    arr[store_idx] = tmp;
-    
-    // Se encontramos exatamente k elementos, terminamos
-    if (store_idx == k - 1) {
-        return;
+}
+
+// e → p = e·(1/Z), como a normalização de q_softmax_f32_avx2; top-k renormaliza
+// pela soma em ordem decrescente de p
+static void sampler_normalize(prob_index_t* restrict cand, uint32_t n, float inv_sum, bool renormalize) {
+    for (uint32_t i = 0; i < n; i++) {
+        cand[i].prob *= inv_sum;
     }
-    
-    // Se temos mais que k elementos à esquerda, continuar recursivamente
-    if (store_idx > k - 1) {
-        quickselect_top_k(arr, left, store_idx - 1, k);
-    } else {
-        // Se temos menos que k, continuar à direita
-        quickselect_top_k(arr, store_idx + 1, right, k);
+    if (renormalize) {
+        sampler_renormalize(cand, n);
     }
 }
 
-// NOTE: Old AoS find_nucleus_size_optimized kept for reference but not used
-// Replaced by find_nucleus_size_optimized_soa() which uses SoA for better cache
-__attribute__((unused)) static uint32_t find_nucleus_size_optimized(
-    prob_index_t* restrict prob_indices,
-    uint32_t vocab_size,
+// Menor prefixo (ordem decrescente) com Σp >= top_p, renormalizado
+// *reached = false: todos os candidatos somam < top_p (nucleus = todos)
+static uint32_t sampler_nucleus_size(
+    prob_index_t* restrict cand,
+    uint32_t n,
     float top_p,
-    q_context* restrict ctx  // [in] Contexto para arena (opcional, NULL = usar malloc)
+    bool* restrict reached
 ) {
-    // OTIMIZAÇÃO CRÍTICA: Criar cópia UMA VEZ (não múltiplas vezes como antes)
-    // Usar binary search para encontrar k mínimo tal que cumsum(top-k) >= top_p
-    bool use_arena = (ctx != NULL && ctx->scratch_buffer != NULL);
-    prob_index_t* temp_indices = NULL;
-    
-    if (use_arena) {
-        size_t temp_size = Q_ALIGN_SIZE((size_t)vocab_size * sizeof(prob_index_t));
-        temp_indices = (prob_index_t*)q_arena_alloc(ctx, temp_size);
-        if (temp_indices == NULL) {
-            return vocab_size;  // Fallback: retornar máximo
-        }
-    } else {
-        temp_indices = (prob_index_t*)malloc(vocab_size * sizeof(prob_index_t));
-        if (temp_indices == NULL) {
-            return vocab_size;  // Fallback: retornar máximo
+    float cumsum = 0.0f;
+    uint32_t size = 0;
+    while (size < n) {
+        cumsum += cand[size++].prob;
+        if (cumsum >= top_p) {
+            break;
         }
     }
-    
-    // Copiar dados originais UMA VEZ
-    memcpy(temp_indices, prob_indices, vocab_size * sizeof(prob_index_t));
-    
-    // Binary search no espaço [1, vocab_size]
-    // Complexidade: O(log V) iterações × O(V) por iteração = O(V log V)
-    uint32_t left = 1;
-    uint32_t right = vocab_size;
-    uint32_t best_k = vocab_size;
-    
-    while (left <= right) {
-        uint32_t mid = left + (right - left) / 2;
-        
-        // Restaurar array e fazer quickselect
-        memcpy(prob_indices, temp_indices, vocab_size * sizeof(prob_index_t));
-        quickselect_top_k(prob_indices, 0, vocab_size - 1, mid);
-        
-        // Calcular cumsum dos top-mid elementos
-        float cumsum = 0.0f;
-        for (uint32_t i = 0; i < mid; i++) {
-            cumsum += prob_indices[i].prob;
+    *reached = (cumsum >= top_p);
+    if (cumsum > 0.0f) {
+        for (uint32_t i = 0; i < size; i++) {
+            cand[i].prob /= cumsum;
         }
-        
-        if (cumsum >= top_p) {
-            // Encontramos um k válido, tentar menor
-            best_k = mid;
-            right = mid - 1;
-            // OTIMIZAÇÃO: Manter prob_indices particionado para best_k
-            // (já está particionado para mid, que pode ser best_k)
+    }
+    return size;
+}
+
+// Min-p: mantém p >= min_p · p_max. Candidatos em ordem decrescente → o
+// conjunto é um prefixo, achado por busca binária (sem varrer nem ordenar)
+static uint32_t sampler_min_p_size(prob_index_t* restrict cand, uint32_t n, float min_p) {
+    const float threshold = min_p * cand[0].prob;
+    uint32_t lo = 1;  // p_max sempre fica
+    uint32_t hi = n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (cand[mid].prob >= threshold) {
+            lo = mid + 1;
         } else {
-            // Precisamos de mais elementos
-            left = mid + 1;
+            hi = mid;
         }
     }
-    
-    // OTIMIZAÇÃO CRÍTICA: Se best_k != último mid testado, fazer quickselect final
-    // Mas na maioria dos casos, best_k já está particionado corretamente
-    // Verificar se precisamos reparticionar
-    if (best_k < vocab_size) {
-        // Verificar se último quickselect foi para best_k ou para outro valor
-        // Por segurança, fazer quickselect final apenas se necessário
-        // (Na prática, o último quickselect já foi para um valor próximo de best_k)
-        memcpy(prob_indices, temp_indices, vocab_size * sizeof(prob_index_t));
-        quickselect_top_k(prob_indices, 0, vocab_size - 1, best_k);
-    }
-    
-    // Cleanup: apenas se usou malloc (arena é resetada automaticamente)
-    if (!use_arena) {
-        free(temp_indices);
-    }
-    
-    return best_k;
+    sampler_renormalize(cand, lo);
+    return lo;
 }
 
-// Helper: Aplicar top-p (nucleus) filtering
-// OTIMIZAÇÃO CRÍTICA: Usa SoA (Structure of Arrays) para melhor cache locality
-// Usa partial sort O(V + k log k) em vez de full sort O(V log V)
-// Usa arena se ctx fornecido, senão malloc (fallback para testes)
-static q_error_code apply_top_p(
-    float* restrict probs,
-    uint32_t vocab_size,
-    float top_p,
-    bool* restrict mask_out,  // [out] mask indicando quais tokens são válidos
-    q_context* restrict ctx   // [in] Contexto para arena (opcional, NULL = usar malloc)
-) {
-    if (top_p <= 0.0f || top_p >= 1.0f) {
-        // Desabilitado ou todos os tokens válidos
-        for (uint32_t i = 0; i < vocab_size; i++) {
-            mask_out[i] = true;
+// Surpresa relativa à entropia: |-log p - H| (p = 0 nunca é típico)
+static inline float sampler_typical_score(float p, float entropy) {
+    return p > 0.0f ? fabsf(-logf(p) - entropy) : INFINITY;
+}
+
+// Locally typical sampling: tokens por |-log p - H| crescente até massa >= typical_p
+// Em ordem decrescente de p, s_i = -log p_i - H é crescente, então |s_i| tem
+// forma de V: o conjunto típico é uma janela contígua em torno do pivô s ≈ 0.
+// Expansão two-pointer pelo lado de menor |s| = merge de duas sequências já
+// ordenadas (empate → maior p), sem sort. Janela movida para cand[0..size)
+static uint32_t sampler_typical_size(prob_index_t* restrict cand, uint32_t n, float typical_p) {
+    float entropy = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        if (cand[i].prob > 0.0f) {
+            entropy -= cand[i].prob * logf(cand[i].prob);
         }
-        return Q_OK;
     }
-    
-    // OTIMIZAÇÃO CRÍTICA: Usar SoA em vez de AoS para melhor cache locality
-    bool use_arena = (ctx != NULL && ctx->scratch_buffer != NULL);
-    prob_array_t* prob_arr = NULL;
-    
-    if (use_arena) {
-        prob_arr = prob_array_alloc(ctx, vocab_size);
-        if (prob_arr == NULL) {
-            return Q_ERR_ARENA_OOM;
-        }
-    } else {
-        // Fallback: usar malloc para testes
-        prob_arr = (prob_array_t*)malloc(sizeof(prob_array_t));
-        if (prob_arr == NULL) {
-            return Q_ERR_ALLOC_FAILED;
-        }
-        prob_arr->size = vocab_size;
-        prob_arr->indices = (uint32_t*)malloc(vocab_size * sizeof(uint32_t));
-        prob_arr->probs = (float*)malloc(vocab_size * sizeof(float));
-        if (prob_arr->indices == NULL || prob_arr->probs == NULL) {
-            free(prob_arr->indices);
-            free(prob_arr->probs);
-            free(prob_arr);
-            return Q_ERR_ALLOC_FAILED;
+
+    // Pivô: primeiro i com -log p_i >= H (predicado monotônico)
+    uint32_t lo = 0;
+    uint32_t hi = n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (cand[mid].prob > 0.0f && -logf(cand[mid].prob) < entropy) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
-    
-    // Initialize SoA arrays
-    for (uint32_t i = 0; i < vocab_size; i++) {
-        prob_arr->indices[i] = i;
-        prob_arr->probs[i] = probs[i];
-    }
-    
-    // OTIMIZAÇÃO CRÍTICA: Encontrar tamanho do nucleus usando binary search com SoA
-    // Complexidade: O(V log V) em vez de O(V²) - melhoria de ~100-1000×
-    // find_nucleus_size_optimized_soa já deixa prob_arr particionado para nucleus_size
-    uint32_t nucleus_size = find_nucleus_size_optimized_soa(prob_arr, vocab_size, top_p, ctx);
-    
-    // Sort apenas nucleus_size elementos O(k log k) ou O(k²) para pequenos
-    // OTIMIZAÇÃO CRÍTICA: Usar qsort_soa() para eliminar conversão AoS desnecessária
-    // Mantém SoA layout durante todo o sort, melhorando cache locality e reduzindo bandwidth
-    qsort_soa(prob_arr, nucleus_size);
-    
-    // Zerar probabilidades fora do nucleus
-    for (uint32_t i = 0; i < vocab_size; i++) {
-        mask_out[i] = false;
+
+    uint32_t left = lo;   // Janela [left, right)
+    uint32_t right = lo;
+    float mass = 0.0f;
+    while (right - left < n && mass < typical_p) {
+        float score_left = (left > 0) ? sampler_typical_score(cand[left - 1].prob, entropy) : INFINITY;
+        float score_right = (right < n) ? sampler_typical_score(cand[right].prob, entropy) : INFINITY;
+        if (left > 0 && !(score_left > score_right)) {
+            mass += cand[--left].prob;
+        } else {
+            mass += cand[right++].prob;
+        }
     }
-    
-    float sum_nucleus = 0.0f;
-    for (uint32_t i = 0; i < nucleus_size; i++) {
-        uint32_t idx = prob_arr->indices[i];
-        mask_out[idx] = true;
-        sum_nucleus += probs[idx];
+
+    uint32_t size = right - left;
+    if (left > 0) {
+        memmove(cand, cand + left, (size_t)size * sizeof(prob_index_t));
     }
-    
-    // Renormalizar nucleus (garantir soma = 1.0)
-    if (sum_nucleus > 0.0f) {
-        for (uint32_t i = 0; i < vocab_size; i++) {
-            if (mask_out[i]) {
-                probs[i] /= sum_nucleus;
-            } else {
-                probs[i] = 0.0f;
-            }
+    sampler_renormalize(cand, size);
+    return size;
+}
+
+static int compare_candidate_index(const void* a, const void* b) {
+    uint32_t ia = ((const prob_index_t*)a)->index;
+    uint32_t ib = ((const prob_index_t*)b)->index;
+    return (ia > ib) - (ia < ib);
+}
+
+// CDF sobre candidatos já em ordem de índice
+static uint32_t sampler_cdf_pick(const prob_index_t* restrict cand, uint32_t n, float random_value) {
+    float cumsum = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        cumsum += cand[i].prob;
+        if (random_value < cumsum) {
+            return cand[i].index;
         }
     }
-    
-    // Cleanup: apenas se usou malloc (arena é resetada automaticamente)
-    if (!use_arena) {
-        free(prob_arr->indices);
-        free(prob_arr->probs);
-        free(prob_arr);
+    // Fallback: último candidato (erros de arredondamento)
+    return cand[n - 1].index;
+}
+
+// CDF em ordem de índice sobre os candidatos (mesma ordem da CDF com mask)
+// tmp: buffer [n] para radix sort (nucleus grande); NULL → qsort
+static uint32_t sampler_sample_candidates(
+    prob_index_t* restrict cand,
+    prob_index_t* restrict tmp,
+    uint32_t n,
+    float random_value
+) {
+    if (tmp != NULL) {
+        sampler_radix_sort(cand, tmp, n, true);
+    } else {
+        qsort(cand, n, sizeof(prob_index_t), compare_candidate_index);
     }
-    return Q_OK;
+    return sampler_cdf_pick(cand, n, random_value);
 }
 
-// Helper: Sample de distribuição usando CDF (Cumulative Distribution Function)
-// OTIMIZAÇÃO: Se mask fornecido, sample apenas sobre elementos válidos (O(k) em vez de O(V))
-static uint32_t sample_from_distribution(
-    const float* restrict probs,
+// Sem top-k/top-p: CDF sobre o vocabulário, p recalculado em blocos de 8
+static uint32_t sampler_sample_full(
+    const sampler_softmax_t* restrict sm,
+    const float* restrict logits,
     uint32_t vocab_size,
-    float random_value,  // Valor aleatório em [0, 1)
-    const bool* restrict mask  // [in] Mask opcional indicando elementos válidos (NULL = todos válidos)
+    float random_value
 ) {
-    if (mask != NULL) {
-        // OTIMIZAÇÃO: Sample apenas sobre elementos válidos (top-k ou top-p)
-        // Complexidade: O(k) em vez de O(V) onde k << V
-        float cumsum = 0.0f;
-        for (uint32_t i = 0; i < vocab_size; i++) {
-            if (mask[i]) {
-                cumsum += probs[i];
-                if (random_value < cumsum) {
-                    return i;
-                }
-            }
-        }
-        // Fallback: retornar último token válido
-        for (uint32_t i = vocab_size; i > 0; i--) {
-            if (mask[i - 1]) {
-                return i - 1;
-            }
-        }
-        return vocab_size - 1;
-    } else {
-        // Caminho original: sample sobre todo vocabulário
-        float cumsum = 0.0f;
-        for (uint32_t i = 0; i < vocab_size; i++) {
-            cumsum += probs[i];
+    const __m256 max_vec = _mm256_set1_ps(sm->max_scaled);
+    const __m256 inv_sum_vec = _mm256_set1_ps(sm->inv_sum);
+    float lanes[8];
+    float cumsum = 0.0f;
+
+    for (uint32_t i = 0; i < sm->vec_end; i += 8) {
+        __m256 e = exp_approx_avx(_mm256_sub_ps(sampler_scaled8(sm, logits, i), max_vec));
+        _mm256_storeu_ps(lanes, _mm256_mul_ps(e, inv_sum_vec));
+        for (uint32_t j = 0; j < 8; j++) {
+            cumsum += lanes[j];
             if (random_value < cumsum) {
-                return i;
+                return i + j;
             }
         }
-        // Fallback: retornar último token (devido a erros de arredondamento)
-        return vocab_size - 1;
     }
+    for (uint32_t i = sm->vec_end; i < vocab_size; i++) {
+        float p = expf(logits[i] / sm->temperature - sm->max_scaled);
+        p *= sm->inv_sum;
+        cumsum += p;
+        if (random_value < cumsum) {
+            return i;
+        }
+    }
+    // Fallback: retornar último token (devido a erros de arredondamento)
+    return vocab_size - 1;
+}
+
+static prob_index_t* sampler_alloc_candidates(q_context* restrict ctx, bool use_arena, uint32_t n) {
+    if (use_arena) {
+        return (prob_index_t*)q_arena_alloc(ctx, Q_ALIGN_SIZE((size_t)n * sizeof(prob_index_t)));
+    }
+    return (prob_index_t*)malloc((size_t)n * sizeof(prob_index_t));
+}
+
+// Gerador thread-local padrão (xorshift64*, seed fixa por thread)
+// Mantido para chamadores sem q_rng: mesma sequência de antes por thread
+static float sampler_thread_uniform(void) {
+    // Usar gerador de números aleatórios thread-safe (xorshift)
+    // Thread-local storage garante que cada thread tenha seu próprio estado
+    #if Q_HAS_THREADS
+        static thread_local uint64_t rng_state = 123456789ULL;
+    #else
+        // Fallback: usar pthread thread-local storage
+        static pthread_key_t rng_key;
+        static pthread_once_t rng_key_once = PTHREAD_ONCE_INIT;
+        static void rng_key_init(void) {
+            pthread_key_create(&rng_key, NULL);
+        }
+        pthread_once(&rng_key_once, rng_key_init);
+        uint64_t* rng_state_ptr = (uint64_t*)pthread_getspecific(rng_key);
+        if (rng_state_ptr == NULL) {
+            rng_state_ptr = (uint64_t*)malloc(sizeof(uint64_t));
+            *rng_state_ptr = 123456789ULL;
+            pthread_setspecific(rng_key, rng_state_ptr);
+        }
+        uint64_t rng_state = *rng_state_ptr;
+    #endif
+    
+    // Xorshift64* (gerador rápido e de boa qualidade)
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    uint32_t rng_u32 = (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+    float random_value = ((float)(rng_u32 >> 8)) / 16777216.0f; // [0, 1)
+    
+    #if Q_HAS_THREADS
+        // Thread-local já atualizado automaticamente
+    #else
+        *rng_state_ptr = rng_state;  // Atualizar estado thread-local
+    #endif
+    return random_value;
 }
 
 // Main sampling function
@@ -857,6 +715,37 @@ q_error_code q_sample_token(
     float top_p,
     uint32_t* restrict token_id_out,
     q_context* restrict ctx  // [in] Contexto para arena (opcional, NULL = usar malloc)
+) {
+    return q_sample_token_rng(logits, vocab_size, temperature, top_k, top_p, NULL, token_id_out, ctx);
+}
+
+// Sampling com stream explícito: rng != NULL torna a requisição reproduzível
+q_error_code q_sample_token_rng(
+    const float* restrict logits,
+    uint32_t vocab_size,
+    float temperature,
+    uint32_t top_k,
+    float top_p,
+    q_rng* restrict rng,
+    uint32_t* restrict token_id_out,
+    q_context* restrict ctx  // [in] Contexto para arena (opcional, NULL = usar malloc)
+) {
+    return q_sample_token_ext(logits, vocab_size, temperature, top_k, top_p, 0.0f, 0.0f,
+                              rng, token_id_out, ctx);
+}
+
+// Sampling completo: top-k → top-p → min-p → typical sobre os candidatos
+q_error_code q_sample_token_ext(
+    const float* restrict logits,
+    uint32_t vocab_size,
+    float temperature,
+    uint32_t top_k,
+    float top_p,
+    float min_p,
+    float typical_p,
+    q_rng* restrict rng,
+    uint32_t* restrict token_id_out,
+    q_context* restrict ctx  // [in] Contexto para arena (opcional, NULL = usar malloc)
 ) {
     // STEP 0.5: VALIDATION (Preconditions)
     Q_VALIDATE_PTR_OR_RETURN(logits, Q_ERR_INVALID_ARG);
@@ -864,6 +753,8 @@ q_error_code q_sample_token(
     Q_VALIDATE_OR_RETURN(vocab_size > 0, Q_ERR_INVALID_SIZE);
     Q_VALIDATE_OR_RETURN(temperature >= 0.0f, Q_ERR_INVALID_ARG);
     Q_VALIDATE_OR_RETURN(isfinite(temperature), Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(min_p >= 0.0f && min_p <= 1.0f, Q_ERR_INVALID_ARG);        // NaN falha
+    Q_VALIDATE_OR_RETURN(typical_p >= 0.0f && typical_p <= 1.0f, Q_ERR_INVALID_ARG);
     
     // Greedy sampling (temperature = 0.0)
     // Usar comparação com epsilon para evitar warning de float-equal
@@ -881,116 +772,151 @@ q_error_code q_sample_token(
         return Q_OK;
     }
     
-    // Alocar buffers temporários
-    // Zero-malloc: usar arena se disponível, senão malloc (fallback)
-    // OTIMIZAÇÃO SIMD: Garantir alinhamento de 32 bytes para softmax SIMD
-    bool use_arena = (ctx != NULL && ctx->scratch_buffer != NULL);
-    float* probs = NULL;
-    bool* mask = NULL;
-    
-    if (use_arena) {
-        // Arena já garante alinhamento de 64 bytes (Q_ALIGN_SIZE), suficiente para SIMD
-        size_t probs_size = Q_ALIGN_SIZE((size_t)vocab_size * sizeof(float));
-        size_t mask_size = Q_ALIGN_SIZE((size_t)vocab_size * sizeof(bool));
-        probs = (float*)q_arena_alloc(ctx, probs_size);
-        mask = (bool*)q_arena_alloc(ctx, mask_size);
-        if (probs == NULL || mask == NULL) {
-            return Q_ERR_ARENA_OOM;
-        }
-    } else {
-        probs = (float*)malloc(vocab_size * sizeof(float));
-        mask = (bool*)malloc(vocab_size * sizeof(bool));
-        if (probs == NULL || mask == NULL) {
-            free(probs);
-            free(mask);
-            return Q_ERR_ALLOC_FAILED;
-        }
-    }
-    
-    // Step 1: Computar softmax com temperatura
-    q_error_code err = compute_softmax_with_temp(logits, probs, vocab_size, temperature);
-    if (err != Q_OK) {
-        free(probs);
-        free(mask);
-        return err;
+    // Step 1: Valor aleatório (um por chamada não-greedy)
+    float random_value = (rng != NULL) ? q_rng_uniform(rng) : sampler_thread_uniform();
+    
+    // Step 2: max(logits / T)
+    sampler_softmax_t sm;
+    sampler_softmax_init(&sm, logits, vocab_size, temperature);
+    
+    bool use_top_k = (top_k > 0 && top_k < vocab_size);
+    bool use_top_p = (top_p > 0.0f && top_p < 1.0f);
+    bool use_min_p = (min_p > 0.0f);
+    bool use_typical = (typical_p > 0.0f && typical_p < 1.0f);
+    if (!use_top_k && !use_top_p && !use_min_p && !use_typical) {
+        // Temperatura pura: Z + CDF em streaming, sem buffers
+        (void)sampler_select(&sm, logits, vocab_size, NULL, 0);
+        *token_id_out = sampler_sample_full(&sm, logits, vocab_size, random_value);
+        return Q_OK;
     }
     
-    // Step 2: Aplicar top-k se especificado
-    // OTIMIZAÇÃO: apply_top_k já aplica mask e renormaliza, não precisa fazer novamente
-    if (top_k > 0) {
-        err = apply_top_k(probs, vocab_size, top_k, mask, ctx);
-        if (err != Q_OK) {
+    bool use_arena = (ctx != NULL && ctx->scratch_buffer != NULL);
+    q_error_code alloc_err = use_arena ? Q_ERR_ARENA_OOM : Q_ERR_ALLOC_FAILED;
+    
+    if (!use_top_k && !use_top_p) {
+        // Min-p/typical sem truncamento prévio: o filtro vetorial e >= min_p·e_max
+        // (movemask) forma o conjunto de candidatos na mesma passada de Z, em
+        // ordem de índice. Typical sem min-p parte do vocabulário inteiro (limiar 0)
+        float threshold = use_min_p ? min_p * sampler_e_max(&sm) : 0.0f;
+        uint32_t m = (use_min_p && vocab_size > SAMPLER_MIN_P_INITIAL_CAPACITY)
+                         ? SAMPLER_MIN_P_INITIAL_CAPACITY : vocab_size;
+        prob_index_t* cand = sampler_alloc_candidates(ctx, use_arena, use_typical ? 2 * m : m);
+        if (cand == NULL) {
+            return alloc_err;
+        }
+        uint32_t n = sampler_collect_sum(&sm, logits, vocab_size, threshold, cand, m);
+        if (n > m) {
+            // Distribuição achatada: mais candidatos que a estimativa; recoleta com a contagem exata
             if (!use_arena) {
-                free(probs);
-                free(mask);
+                free(cand);
+            }
+            m = n;
+            cand = sampler_alloc_candidates(ctx, use_arena, use_typical ? 2 * m : m);
+            if (cand == NULL) {
+                return alloc_err;
             }
-            return err;
+            n = sampler_collect(&sm, logits, vocab_size, threshold, cand, m);
         }
-        // Nota: apply_top_k já aplicou mask e renormalizou, não precisa fazer novamente
+        sampler_normalize(cand, n, sm.inv_sum, true);
+        if (use_typical) {
+            // Typical precisa de ordem decrescente de p (janela contígua)
+            prob_index_t* tmp = cand + m;
+            sampler_radix_sort(cand, tmp, n, false);
+            n = sampler_typical_size(cand, n, typical_p);
+            *token_id_out = sampler_sample_candidates(cand, tmp, n, random_value);
+        } else {
+            // Só min-p: já em ordem de índice, CDF direta sem sort
+            *token_id_out = sampler_cdf_pick(cand, n, random_value);
+        }
+        if (!use_arena) {
+            free(cand);
+        }
+        return Q_OK;
     }
     
-    // Step 3: Aplicar top-p se especificado
-    // OTIMIZAÇÃO: apply_top_p já aplica mask e renormaliza, não precisa fazer novamente
-    if (top_p > 0.0f) {
-        err = apply_top_p(probs, vocab_size, top_p, mask, ctx);
-        if (err != Q_OK) {
-            if (!use_arena) {
-                free(probs);
-                free(mask);
+    // Step 3: Top-k candidatos por heap (top-p sem top-k: primeiros 64)
+    uint32_t k = use_top_k ? top_k
+                           : (vocab_size < SAMPLER_TOP_P_INITIAL_K ? vocab_size : SAMPLER_TOP_P_INITIAL_K);
+    prob_index_t* cand = sampler_alloc_candidates(ctx, use_arena, k);
+    prob_index_t* tmp = NULL;
+    if (cand == NULL) {
+        return alloc_err;
+    }
+    uint32_t n = sampler_select(&sm, logits, vocab_size, cand, k);
+    
+    // Step 4: Probabilidades dos candidatos (renormalizadas se top-k)
+    sampler_normalize(cand, n, sm.inv_sum, use_top_k);
+    
+    // Step 5: Nucleus top-p sobre os candidatos
+    if (use_top_p) {
+        bool reached = false;
+        uint32_t nucleus = sampler_nucleus_size(cand, n, top_p, &reached);
+        if (!reached && !use_top_k && n < vocab_size) {
+            // Massa top_p além dos 64 candidatos: limiar por histograma de massa,
+            // coleta de todos os e >= limiar e sort só desse conjunto
+            uint32_t m = 0;
+            float threshold = sampler_mass_threshold(&sm, logits, vocab_size, top_p, &m);
+            for (;;) {
+                if (!use_arena) {
+                    free(cand);
+                }
+                cand = sampler_alloc_candidates(ctx, use_arena, 2 * m);  // + buffer do radix sort
+                if (cand == NULL) {
+                    return alloc_err;
+                }
+                n = sampler_collect(&sm, logits, vocab_size, threshold, cand, m);
+                tmp = cand + m;
+                sampler_radix_sort(cand, tmp, n, false);
+                sampler_normalize(cand, n, sm.inv_sum, false);
+                nucleus = sampler_nucleus_size(cand, n, top_p, &reached);
+                if (reached || n >= vocab_size) {
+                    break;
+                }
+                // Margem do histograma insuficiente (arredondamento): vocabulário inteiro
+                threshold = 0.0f;
+                m = vocab_size;
             }
-            return err;
         }
-        // Nota: apply_top_p já aplicou mask e renormalizou, não precisa fazer novamente
+        n = nucleus;
     }
     
-    // Step 4: Sample da distribuição final
-    // Usar gerador de números aleatórios thread-safe (xorshift)
-    // Thread-local storage garante que cada thread tenha seu próprio estado
-    #if Q_HAS_THREADS
-        static thread_local uint64_t rng_state = 123456789ULL;
-    #else
-        // Fallback: usar pthread thread-local storage
-        static pthread_key_t rng_key;
-        static pthread_once_t rng_key_once = PTHREAD_ONCE_INIT;
-        static void rng_key_init(void) {
-            pthread_key_create(&rng_key, NULL);
-        }
-        pthread_once(&rng_key_once, rng_key_init);
-        uint64_t* rng_state_ptr = (uint64_t*)pthread_getspecific(rng_key);
-        if (rng_state_ptr == NULL) {
-            rng_state_ptr = (uint64_t*)malloc(sizeof(uint64_t));
-            *rng_state_ptr = 123456789ULL;
-            pthread_setspecific(rng_key, rng_state_ptr);
-        }
-        uint64_t rng_state = *rng_state_ptr;
-    #endif
-    
-    // Xorshift64* (gerador rápido e de boa qualidade)
-    rng_state ^= rng_state >> 12;
-    rng_state ^= rng_state << 25;
-    rng_state ^= rng_state >> 27;
-    uint32_t rng_u32 = (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
-    float random_value = ((float)(rng_u32 >> 8)) / 16777216.0f; // [0, 1)
-    
-    #if Q_HAS_THREADS
-        // Thread-local já atualizado automaticamente
-    #else
-        *rng_state_ptr = rng_state;  // Atualizar estado thread-local
-    #endif
+    // Step 5.5: Min-p e typical sobre o conjunto truncado (ordem decrescente)
+    if (use_min_p) {
+        n = sampler_min_p_size(cand, n, min_p);
+    }
+    if (use_typical) {
+        n = sampler_typical_size(cand, n, typical_p);
+    }
     
-    // OTIMIZAÇÃO: Passar mask para sample apenas sobre elementos válidos (O(k) em vez de O(V))
-    *token_id_out = sample_from_distribution(probs, vocab_size, random_value, mask);
+    // Step 6: Sample (CDF em ordem de índice)
+    *token_id_out = sampler_sample_candidates(cand, tmp, n, random_value);
     
     // Cleanup: apenas se usou malloc (arena é resetada automaticamente)
     if (!use_arena) {
-        free(probs);
-        free(mask);
+        free(cand);
     }
-    
     return Q_OK;
 }
 
 // Main generation loop
+// Forward de geração: logits completos para o sampler, ou (logits == NULL)
+// LM head + argmax fundidos para greedy sem gramática - [vocab_size] nunca é escrito
+static q_error_code generate_forward(
+    q_generation_state* restrict state,
+    const uint32_t* restrict tokens,
+    uint32_t seq_len,
+    uint32_t pos,
+    float* restrict logits,
+    uint32_t* restrict greedy_token
+) {
+    if (logits != NULL) {
+        return llama_forward(state->model, state->ctx, tokens, seq_len, pos, logits);
+    }
+    float greedy_logit = 0.0f;
+    return llama_forward_topk(state->model, state->ctx, tokens, seq_len, pos,
+                              1, greedy_token, &greedy_logit, NULL);
+}
+
 q_error_code q_generate(q_generation_state* restrict state) {
     // STEP 0.5: VALIDATION (Preconditions)
     Q_VALIDATE_PTR_OR_RETURN(state, Q_ERR_INVALID_ARG);
@@ -1003,6 +929,12 @@ q_error_code q_generate(q_generation_state* restrict state) {
     Q_VALIDATE_OR_RETURN(state->max_tokens > 0, Q_ERR_INVALID_SIZE);
     Q_VALIDATE_OR_RETURN(state->temperature >= 0.0f, Q_ERR_INVALID_ARG);
     Q_VALIDATE_OR_RETURN(isfinite(state->temperature), Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(isfinite(state->repetition_penalty) && state->repetition_penalty >= 0.0f,
+                         Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(isfinite(state->frequency_penalty) && isfinite(state->presence_penalty),
+                         Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(state->min_p >= 0.0f && state->min_p <= 1.0f, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(state->typical_p >= 0.0f && state->typical_p <= 1.0f, Q_ERR_INVALID_ARG);
     
     // Validar que modelo e tokenizer estão inicializados
     // Nota: Não temos flag initialized em q_llama_model, então assumimos válido se não NULL
@@ -1019,14 +951,22 @@ q_error_code q_generate(q_generation_state* restrict state) {
     uint32_t vocab_size = state->model->config.vocab_size;
     uint32_t max_seq_len = state->model->config.max_seq_len;
     
-    // Validar que prompt cabe no contexto
-    if (state->num_prompt_tokens > max_seq_len) {
+    // Resume: KV [0, current_pos) já preenchido (q_session_load ou q_generate anterior);
+    // prefill apenas dos tokens novos a partir de current_pos
+    const uint32_t start_pos = state->resume ? state->current_pos : 0;
+    
+    // Validar que prompt (tokens novos) cabe no contexto
+    if (start_pos > max_seq_len || state->num_prompt_tokens > max_seq_len - start_pos) {
         return Q_ERR_INVALID_SIZE;
     }
     
     // Inicializar estado de geração
     state->num_generated_tokens = 0;
-    state->current_pos = 0;
+    state->current_pos = start_pos;
+    if (state->grammar != NULL) {
+        Q_VALIDATE_OR_RETURN(state->grammar->initialized, Q_ERR_INVALID_ARG);
+        q_grammar_reset(state->grammar);
+    }
     
     // Step 1: Prefill - Forward pass com todos os tokens do prompt
     // Reset arena antes do prefill (preserva estruturas do modelo via scratch_base_offset)
@@ -1035,27 +975,47 @@ q_error_code q_generate(q_generation_state* restrict state) {
     // CORREÇÃO CRÍTICA: Alocar logits no heap (persiste entre resets de arena)
     // Problema: Re-alocação após cada reset causa overhead desnecessário
     // Solução: Alocar logits fora da arena (heap) para persistir entre resets
-    size_t logits_size = Q_ALIGN_SIZE((size_t)vocab_size * sizeof(float));
-    float* logits = (float*)aligned_alloc(Q_ALIGN, logits_size);
-    if (logits == NULL) {
-        return Q_ERR_ALLOC_FAILED;
+    // Penalties: histograma esparso incremental (custo por token O(tokens distintos))
+    const float rep_penalty = state->repetition_penalty;
+    const bool use_penalties = (rep_penalty > 0.0f && (rep_penalty < 1.0f || rep_penalty > 1.0f)) ||
+                               state->frequency_penalty < 0.0f || state->frequency_penalty > 0.0f ||
+                               state->presence_penalty < 0.0f || state->presence_penalty > 0.0f;
+    // Greedy sem gramática/penalties: argmax fundido ao LM head, logits nunca materializados
+    const bool fused_greedy = state->temperature < 1e-6f && state->grammar == NULL && !use_penalties;
+    float* logits = NULL;
+    if (!fused_greedy) {
+        size_t logits_size = Q_ALIGN_SIZE((size_t)vocab_size * sizeof(float));
+        logits = (float*)aligned_alloc(Q_ALIGN, logits_size);
+        if (logits == NULL) {
+            return Q_ERR_ALLOC_FAILED;
+        }
+    }
+    if (use_penalties) {
+        q_error_code counts_err = q_token_counts_init(&state->token_counts, state->max_tokens);
+        if (counts_err != Q_OK) {
+            free(logits);
+            return counts_err;
+        }
     }
+    uint32_t greedy_token = 0;
     
-    q_error_code err = llama_forward(
-        state->model,
-        state->ctx,
+    Q_PROFILE_START(t_prefill);
+    q_error_code err = generate_forward(
+        state,
         state->prompt_tokens,
         state->num_prompt_tokens,
-        0,  // pos = 0 para prefill
-        logits
+        start_pos,  // 0, ou fim do KV restaurado (resume)
+        logits,
+        &greedy_token
     );
     
     if (err != Q_OK) {
-        return err;
+        goto cleanup;
     }
+    Q_TRACE_SPAN(Q_PROFILE_GLOBAL, "prefill", t_prefill);
     
     // Atualizar posição atual
-    state->current_pos = state->num_prompt_tokens;
+    state->current_pos = start_pos + state->num_prompt_tokens;
     
     // Step 2: Loop de geração incremental
     // Para cada token a ser gerado:
@@ -1065,31 +1025,92 @@ q_error_code q_generate(q_generation_state* restrict state) {
             break;  // Contexto cheio
         }
         
+        // Penalties sobre os tokens já gerados (in-place: logits é recalculado a cada forward)
+        if (use_penalties) {
+            Q_PROFILE_START(t_penalties);
+            err = q_apply_penalties_f32_avx2(logits, vocab_size, &state->token_counts, rep_penalty,
+                                             state->frequency_penalty, state->presence_penalty);
+            if (err != Q_OK) {
+                goto cleanup;
+            }
+            Q_PROFILE_STOP(state->ctx, Q_PROFILE_GLOBAL, Q_PROF_PENALTIES, t_penalties);
+        }
+        
+        // Constrained decoding: mascarar tokens inválidos no estado atual da gramática
+        // (apply + accept acumulados num único registro por token)
+        Q_PROFILE_ACC_DECL(acc_grammar);
+        if (state->grammar != NULL) {
+            Q_PROFILE_START(t_grammar);
+            err = q_grammar_apply(state->grammar, logits, vocab_size);
+            if (err != Q_OK) {
+                goto cleanup;
+            }
+            Q_PROFILE_ACC(acc_grammar, Q_PROFILE_GLOBAL, Q_PROF_GRAMMAR, t_grammar);
+        }
+        
         // Sample token dos logits
         // Nota: logits ainda é válido do forward pass anterior
-        uint32_t token_id = 0;
-        err = q_sample_token(
-            logits,
-            vocab_size,
-            state->temperature,
-            state->top_k,
-            state->top_p,
-            &token_id,
-            state->ctx  // Usar arena para zero-malloc
-        );
-        
-        if (err != Q_OK) {
-            return err;
+        uint32_t token_id = greedy_token;
+        if (!fused_greedy) {
+            Q_PROFILE_START(t_sampler);
+            err = q_sample_token_ext(
+                logits,
+                vocab_size,
+                state->temperature,
+                state->top_k,
+                state->top_p,
+                state->min_p,
+                state->typical_p,
+                state->rng,  // NULL = gerador thread-local
+                &token_id,
+                state->ctx  // Usar arena para zero-malloc
+            );
+            
+            if (err != Q_OK) {
+                goto cleanup;
+            }
+            Q_PROFILE_STOP(state->ctx, Q_PROFILE_GLOBAL, Q_PROF_SAMPLER, t_sampler);
         }
         
         // Validar token ID
         if (token_id >= vocab_size) {
-            return Q_ERR_INVALID_ARG;  // Token inválido
+            err = Q_ERR_INVALID_ARG;  // Token inválido
+            goto cleanup;
+        }
+        
+        // Avançar gramática. Fallback de arredondamento do sampler pode retornar
+        // token mascarado (prob 0): usar argmax dos logits mascarados (sempre permitido)
+        if (state->grammar != NULL) {
+            Q_PROFILE_START(t_accept);
+            if (q_grammar_accept_token(state->grammar, token_id) != Q_OK) {
+                for (uint32_t i = 0; i < vocab_size; i++) {
+                    if (logits[i] > logits[token_id]) {
+                        token_id = i;
+                    }
+                }
+                err = q_grammar_accept_token(state->grammar, token_id);
+                if (err != Q_OK) {
+                    goto cleanup;
+                }
+            }
+            Q_PROFILE_ACC(acc_grammar, Q_PROFILE_GLOBAL, Q_PROF_GRAMMAR, t_accept);
+            Q_PROFILE_RECORD(state->ctx, Q_PROFILE_GLOBAL, Q_PROF_GRAMMAR, acc_grammar);
         }
         
         // Armazenar token gerado
         state->generated_tokens[state->num_generated_tokens] = token_id;
         state->num_generated_tokens++;
+        if (use_penalties) {
+            err = q_token_counts_add(&state->token_counts, token_id);
+            if (err != Q_OK) {
+                goto cleanup;
+            }
+        }
+        
+        // Streaming: entregar token antes do próximo forward (callback pode parar geração)
+        if (state->on_token != NULL && !state->on_token(token_id, state->user_data)) {
+            break;
+        }
         
         // Verificar se é EOS token (parar geração)
         if (token_id == state->tokenizer->eos_token_id) {
@@ -1106,26 +1127,34 @@ q_error_code q_generate(q_generation_state* restrict state) {
         // Forward pass incremental: apenas o novo token (seq_len = 1)
         // KV cache já contém tokens anteriores, então apenas processamos o novo token
         uint32_t incremental_tokens[1] = {token_id};
-        err = llama_forward(
-            state->model,
-            state->ctx,
+        Q_PROFILE_START(t_decode);
+        err = generate_forward(
+            state,
             incremental_tokens,
             1,  // seq_len = 1 (apenas novo token)
             state->current_pos,  // posição atual no contexto
-            logits
+            logits,
+            &greedy_token
         );
         
         if (err != Q_OK) {
-            return err;
+            goto cleanup;
         }
+        Q_TRACE_SPAN(Q_PROFILE_GLOBAL, "decode", t_decode);
         
         // Atualizar posição
         state->current_pos++;
     }
     
-    // CORREÇÃO: Liberar logits alocado no heap
+    err = Q_OK;
+    
+cleanup:
+    // CORREÇÃO: Liberar logits alocado no heap (também nos caminhos de erro)
     free(logits);
+    if (use_penalties) {
+        q_token_counts_free(&state->token_counts);
+    }
     
-    return Q_OK;
+    return err;
 }
 
@@ -1,4 +1,6 @@
 #include "qorus.h"
+#include "../ops/avx2/avx_math.h"
+#include "../core/profile.h"
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -488,7 +490,7 @@ q_error_code llama_build_graph(q_context* restrict ctx, q_llama_model* restrict
         layer->wk = create_tensor_view(
             ctx,
             (uint8_t*)ctx->weights_mmap + offset,
-            model->config.dim, kv_dim, 1, 1,
+            kv_dim, model->config.dim, 1, 1,  // GEMV layout: [out, in]
             Q_Q4_0,
             "wk.weight"
         );
@@ -508,7 +510,7 @@ q_error_code llama_build_graph(q_context* restrict ctx, q_llama_model* restrict
         layer->wv = create_tensor_view(
             ctx,
             (uint8_t*)ctx->weights_mmap + offset,
-            model->config.dim, kv_dim, 1, 1,
+            kv_dim, model->config.dim, 1, 1,  // GEMV layout: [out, in]
             Q_Q4_0,
             "wv.weight"
         );
@@ -568,7 +570,7 @@ q_error_code llama_build_graph(q_context* restrict ctx, q_llama_model* restrict
         layer->w_gate = create_tensor_view(
             ctx,
             (uint8_t*)ctx->weights_mmap + offset,
-            model->config.dim, model->config.hidden_dim, 1, 1,
+            model->config.hidden_dim, model->config.dim, 1, 1,  // GEMV layout: [out, in]
             Q_Q4_0,
             "w_gate.weight"
         );
@@ -588,7 +590,7 @@ q_error_code llama_build_graph(q_context* restrict ctx, q_llama_model* restrict
         layer->w_up = create_tensor_view(
             ctx,
             (uint8_t*)ctx->weights_mmap + offset,
-            model->config.dim, model->config.hidden_dim, 1, 1,
+            model->config.hidden_dim, model->config.dim, 1, 1,  // GEMV layout: [out, in]
             Q_Q4_0,
             "w_up.weight"
         );
@@ -608,7 +610,7 @@ q_error_code llama_build_graph(q_context* restrict ctx, q_llama_model* restrict
         layer->w_down = create_tensor_view(
             ctx,
             (uint8_t*)ctx->weights_mmap + offset,
-            model->config.hidden_dim, model->config.dim, 1, 1,
+            model->config.dim, model->config.hidden_dim, 1, 1,  // GEMV layout: [out, in]
             Q_Q4_0,
             "w_down.weight"
         );
@@ -975,6 +977,23 @@ static q_error_code init_layer_scratchpad(
 // Correção 2: Refatorar generate_rope_cos_sin para usar pré-cálculo
 // ============================================================================
 
+// Helper: RMSNorm linha a linha sobre [rows, dim]
+// q_rmsnorm_f32_avx2 normaliza um único vetor; cada posição tem sua própria escala
+static q_error_code rmsnorm_rows(
+    const float* restrict x,
+    const float* restrict weight,
+    float* restrict out,
+    uint32_t rows,
+    uint32_t dim,
+    float eps
+) {
+    for (uint32_t r = 0; r < rows; r++) {
+        q_error_code ret = q_rmsnorm_f32_avx2(x + (size_t)r * dim, weight, out + (size_t)r * dim, dim, eps);
+        if (ret != Q_OK) return ret;
+    }
+    return Q_OK;
+}
+
 // Helper: Generate RoPE cos/sin tables for a specific position
 // CORRIGIDO: Usa frequências pré-calculadas (elimina powf do hot path)
 // Output: cos_buf[head_dim], sin_buf[head_dim] (duplicated layout: [c0,c0,c1,c1,...])
@@ -1106,9 +1125,11 @@ static q_error_code llama_attention_forward(
     // REMOVIDO: Todas as alocações q_arena_alloc
     // USAR: scratch->x_norm, scratch->q_buf, etc.
     
-    // Pre-attention RMSNorm: x -> x_norm
-    q_error_code ret = q_rmsnorm_f32_avx2(x, (const float*)layer->attn_norm->data, scratch->x_norm, dim, config->rms_norm_eps);
+    // Pre-attention RMSNorm: x -> x_norm (todas as linhas - prefill com seq_len > 1)
+    Q_PROFILE_START(t_norm);
+    q_error_code ret = rmsnorm_rows(x, (const float*)layer->attn_norm->data, scratch->x_norm, seq_len, dim, config->rms_norm_eps);
     if (ret != Q_OK) return ret;
+    Q_PROFILE_STOP(ctx, layer_idx, Q_PROF_ATTN_NORM, t_norm);
     
     // Q/K/V projections using GEMV (Q4_0 weights)
     // CRITICAL FIX: Use q_gemv_q4_f32_avx2 for Q4_0 weights (not q_matmul_f32_avx2)
@@ -1116,7 +1137,7 @@ static q_error_code llama_attention_forward(
     // This is equivalent to MatMul but optimized for Q4_0 weights
     
     // Q projection: x_norm @ wq -> q_buf [seq_len, dim]
-    
+    Q_PROFILE_START(t_qkv);
     for (uint32_t i = 0; i < seq_len; i++) {
         const float* x_row = scratch->x_norm + (size_t)i * dim;
         float* q_row = scratch->q_buf + (size_t)i * dim;
@@ -1163,6 +1184,7 @@ static q_error_code llama_attention_forward(
             return ret;
         }
     }
+    Q_PROFILE_STOP(ctx, layer_idx, Q_PROF_QKV_PROJ, t_qkv);
     
     // CORREÇÃO 1: Buffers já alocados no scratchpad
     // REMOVIDO: Todas as alocações q_arena_alloc
@@ -1171,6 +1193,7 @@ static q_error_code llama_attention_forward(
     // Apply RoPE to Q and K (per head, per token)
     // Q: [seq_len, n_heads, head_dim] -> reshape to [seq_len * n_heads, head_dim]
     // K: [seq_len, n_kv_heads, head_dim] -> reshape to [seq_len * n_kv_heads, head_dim]
+    Q_PROFILE_START(t_rope);
     for (uint32_t t = 0; t < seq_len; t++) {
         uint32_t token_pos = pos + t;  // Absolute position in sequence
         
@@ -1197,7 +1220,10 @@ static q_error_code llama_attention_forward(
         }
     }
     
+    Q_PROFILE_STOP(ctx, layer_idx, Q_PROF_ROPE, t_rope);
+    
     // Update KV cache at position pos (store K and V for all tokens in sequence)
+    Q_PROFILE_START(t_kv);
     for (uint32_t t = 0; t < seq_len; t++) {
         uint32_t cache_pos = pos + t;
         if (cache_pos >= config->max_seq_len) {
@@ -1243,6 +1269,7 @@ static q_error_code llama_attention_forward(
             memcpy(v_dst, v_src, head_dim * sizeof(float));
         }
     }
+    Q_PROFILE_STOP(ctx, layer_idx, Q_PROF_KV_STORE, t_kv);
     
     // CRITICAL: Ensure k_t_buf is properly aligned for AVX2 (32-byte alignment)
     // Q_ALIGN_SIZE already aligns to 64 bytes, but verify explicitly
@@ -1306,9 +1333,15 @@ static q_error_code llama_attention_forward(
         .type = Q_F32
     };
     
+    // Profiling: ops intercaladas por head, acumuladas e registradas uma vez por camada
+    Q_PROFILE_ACC_DECL(acc_scores);
+    Q_PROFILE_ACC_DECL(acc_softmax);
+    Q_PROFILE_ACC_DECL(acc_value);
+    
     for (uint32_t qh = 0; qh < n_heads; qh++) {
         // Determine which KV head to use (GQA: multiple Q heads share KV head)
         uint32_t kv_head_idx = qh / (n_heads / n_kv_heads);
+        Q_PROFILE_START(t_scores);
         
         // OPTIMIZATION: Transpose K only if this KV head hasn't been transposed yet
         // This avoids redundant transposition for query heads that share the same KV head
@@ -1371,8 +1404,10 @@ static q_error_code llama_attention_forward(
             #endif
             return ret;
         }
+        Q_PROFILE_ACC(acc_scores, layer_idx, Q_PROF_ATTN_SCORES, t_scores);
         
         // Scale scores: scores *= 1/sqrt(head_dim)
+        Q_PROFILE_START(t_softmax);
         for (uint32_t i = 0; i < seq_len * seq_len; i++) {
             scratch->scores_buf[i] *= scale;
         }
@@ -1412,7 +1447,10 @@ static q_error_code llama_attention_forward(
             }
         }
         
+        Q_PROFILE_ACC(acc_softmax, layer_idx, Q_PROF_ATTN_SOFTMAX, t_softmax);
+        
         // Attention output: probs @ V -> [seq_len, head_dim]
+        Q_PROFILE_START(t_value);
         // CORREÇÃO 1: Usar stride alinhado para probs_tensor
         // OTIMIZAÇÃO: Estruturas já inicializadas fora do loop, apenas atualizar ponteiros
         probs_tensor.data = (void*)probs_buf;
@@ -1436,13 +1474,17 @@ static q_error_code llama_attention_forward(
             const float* attn_head = scratch->attn_head_buf + (size_t)t * head_dim;
             memcpy(out_head, attn_head, head_dim * sizeof(float));
         }
+        Q_PROFILE_ACC(acc_value, layer_idx, Q_PROF_ATTN_VALUE, t_value);
     }
+    Q_PROFILE_RECORD(ctx, layer_idx, Q_PROF_ATTN_SCORES, acc_scores);
+    Q_PROFILE_RECORD(ctx, layer_idx, Q_PROF_ATTN_SOFTMAX, acc_softmax);
+    Q_PROFILE_RECORD(ctx, layer_idx, Q_PROF_ATTN_VALUE, acc_value);
     
     // Output projection: attn_out @ wo -> [seq_len, dim]
     // CRITICAL FIX: Use q_gemv_q4_f32_avx2 for Q4_0 weights
     // CORREÇÃO: Usar scratch->q_rope_buf como entrada (dados concatenados das heads)
     // e output como saída (sem aliasing)
-    
+    Q_PROFILE_START(t_out);
     for (uint32_t i = 0; i < seq_len; i++) {
         const float* attn_row = scratch->q_rope_buf + (size_t)i * dim;  // Input: dados concatenados das heads
         float* out_row = output + (size_t)i * dim;  // Output: escrever diretamente em output
@@ -1456,6 +1498,7 @@ static q_error_code llama_attention_forward(
             return ret;
         }
     }
+    Q_PROFILE_STOP(ctx, layer_idx, Q_PROF_ATTN_OUT_PROJ, t_out);
     
     return Q_OK;
 }
@@ -1464,10 +1507,11 @@ static q_error_code llama_attention_forward(
 // CORRIGIDO: Usa scratchpad reutilizável (Correção 1)
 static q_error_code llama_mlp_forward(
     q_llama_layer* restrict layer,
-    q_context* restrict ctx __attribute__((unused)),  // Pode não ser usado em todas as implementações
+    q_context* restrict ctx __attribute__((unused)),  // Só usado pelos timers de Q_PROFILE
     const q_llama_config* restrict config,
     const float* restrict x,           // Input [seq_len, dim]
     float* restrict output,             // Output [seq_len, dim]
+    uint32_t layer_idx __attribute__((unused)),  // Só usado pelos timers de Q_PROFILE
     uint32_t seq_len,
     layer_scratchpad* restrict scratch  // NOVO: scratchpad reutilizável
 ) {
@@ -1482,6 +1526,7 @@ static q_error_code llama_mlp_forward(
     // CRITICAL FIX: Use q_gemv_q4_f32_avx2 for Q4_0 weights
     
     q_error_code ret;
+    Q_PROFILE_START(t_gate_up);
     for (uint32_t i = 0; i < seq_len; i++) {
         const float* x_row = x + (size_t)i * dim;
         float* gate_row = scratch->gate_buf + (size_t)i * hidden_dim;
@@ -1510,9 +1555,11 @@ static q_error_code llama_mlp_forward(
             return ret;
         }
     }
+    Q_PROFILE_STOP(ctx, layer_idx, Q_PROF_MLP_GATE_UP, t_gate_up);
     
     // CORREÇÃO 1: SiLU activation usando scratchpad
     // REMOVIDO: Alocação q_arena_alloc
+    Q_PROFILE_START(t_silu_mul);
     ret = q_silu_f32_avx2(scratch->gate_buf, scratch->gate_silu, seq_len * hidden_dim);
     
     if (ret != Q_OK) return ret;
@@ -1549,9 +1596,11 @@ static q_error_code llama_mlp_forward(
     ret = q_mul_f32_avx2(&gate_silu_flat, &up_flat, &mul_tensor);
     
     if (ret != Q_OK) return ret;
+    Q_PROFILE_STOP(ctx, layer_idx, Q_PROF_MLP_SILU_MUL, t_silu_mul);
     
     // Down projection: mul_buf @ w_down -> output [seq_len, dim]
     // CRITICAL FIX: Use q_gemv_q4_f32_avx2 for Q4_0 weights
+    Q_PROFILE_START(t_down);
     for (uint32_t i = 0; i < seq_len; i++) {
         const float* mul_row = scratch->mul_buf + (size_t)i * hidden_dim;
         float* out_row = output + (size_t)i * dim;
@@ -1559,6 +1608,7 @@ static q_error_code llama_mlp_forward(
         
         if (ret != Q_OK) return ret;
     }
+    Q_PROFILE_STOP(ctx, layer_idx, Q_PROF_MLP_DOWN, t_down);
     
     return Q_OK;
 }
@@ -1584,6 +1634,7 @@ static q_error_code llama_layer_forward(
     // USAR: scratch->attn_out, scratch->mlp_out, scratch->x_norm, scratch->x_norm_mlp
     
     // Attention block
+    Q_PROFILE_START(t_layer);
     q_error_code ret = llama_attention_forward(layer, ctx, model, config, x, scratch->attn_out, layer_idx, seq_len, pos, scratch);
     if (ret != Q_OK) {
         #ifdef DEBUG
@@ -1594,6 +1645,7 @@ static q_error_code llama_layer_forward(
     }
     
     // Residual connection: x = x + attn_out
+    Q_PROFILE_START(t_residual);
     uint32_t total_size = seq_len * dim;
     
     q_tensor x_tensor = {
@@ -1621,15 +1673,18 @@ static q_error_code llama_layer_forward(
     if (ret != Q_OK) return ret;
     
     // Pre-MLP RMSNorm (usar scratch->x_norm_mlp)
-    ret = q_rmsnorm_f32_avx2(scratch->x_norm, (const float*)layer->ffn_norm->data, scratch->x_norm_mlp, dim, config->rms_norm_eps);
+    ret = rmsnorm_rows(scratch->x_norm, (const float*)layer->ffn_norm->data, scratch->x_norm_mlp, seq_len, dim, config->rms_norm_eps);
     if (ret != Q_OK) return ret;
+    Q_PROFILE_ACC_DECL(acc_residual);
+    Q_PROFILE_ACC(acc_residual, layer_idx, Q_PROF_RESIDUAL_NORM, t_residual);
     
     // MLP block
-    ret = llama_mlp_forward(layer, ctx, config, scratch->x_norm_mlp, scratch->mlp_out, seq_len, scratch);
+    ret = llama_mlp_forward(layer, ctx, config, scratch->x_norm_mlp, scratch->mlp_out, layer_idx, seq_len, scratch);
     
     if (ret != Q_OK) return ret;
     
     // Residual connection: x = x + mlp_out
+    Q_PROFILE_START(t_residual_mlp);
     q_tensor mlp_tensor = {
         .data = (void*)scratch->mlp_out,
         .ne = {total_size, 1, 1, 1},
@@ -1647,24 +1702,37 @@ static q_error_code llama_layer_forward(
     ret = q_add_f32_avx2(&x_residual, &mlp_tensor, &output_tensor);
     
     if (ret != Q_OK) return ret;
+    Q_PROFILE_ACC(acc_residual, layer_idx, Q_PROF_RESIDUAL_NORM, t_residual_mlp);
+    Q_PROFILE_RECORD(ctx, layer_idx, Q_PROF_RESIDUAL_NORM, acc_residual);
+    Q_TRACE_SPAN(layer_idx, "layer", t_layer);
     
     return Q_OK;
 }
 
-// Main forward pass function
-q_error_code llama_forward(
+// ============================================================================
+// Forward Pass Core (compartilhado por llama_forward / scoring / embeddings)
+// ============================================================================
+
+// Executa embeddings + todas as camadas e devolve os hidden states ANTES da
+// RMSNorm final: *hidden_out -> [seq_len, dim] (arena, 32-byte aligned por linha).
+// O scratchpad é devolvido ao chamador para reutilizar last_token_buf.
+// NOTE: Não aplica output_norm nem LM head - cada entry point decide quais
+// linhas normalizar/projetar (llama_forward: só a última; scoring: todas).
+static q_error_code llama_forward_hidden(
     q_llama_model* restrict model,
     q_context* restrict ctx,
     const uint32_t* restrict tokens,
     uint32_t seq_len,
     uint32_t pos,
-    float* restrict logits
+    float** restrict hidden_out,
+    layer_scratchpad* restrict scratch_out
 ) {
     // Validation
     Q_VALIDATE_PTR_OR_RETURN(model, Q_ERR_INVALID_ARG);
     Q_VALIDATE_PTR_OR_RETURN(ctx, Q_ERR_INVALID_ARG);
     Q_VALIDATE_PTR_OR_RETURN(tokens, Q_ERR_INVALID_ARG);
-    Q_VALIDATE_PTR_OR_RETURN(logits, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(hidden_out, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(scratch_out, Q_ERR_INVALID_ARG);
     Q_VALIDATE_NONZERO_OR_RETURN(seq_len, Q_ERR_INVALID_SIZE);
     
     if (seq_len > model->config.max_seq_len) {
@@ -1693,7 +1761,6 @@ q_error_code llama_forward(
     // In a production system, we'd track model_arena_head separately
     
     uint32_t dim = model->config.dim;
-    uint32_t vocab_size = model->config.vocab_size;
     
     // Allocate buffer for token embeddings [seq_len, dim]
     size_t embd_size = (size_t)seq_len * (size_t)dim * sizeof(float);
@@ -1716,7 +1783,7 @@ q_error_code llama_forward(
     q_error_code ret = token_embedding_lookup(model->token_embd, tokens, seq_len, x);
     if (ret != Q_OK) {
         #ifdef DEBUG
-        fprintf(stderr, "ERROR: llama_forward: token_embedding_lookup returned %d\n", ret);
+        fprintf(stderr, "ERROR: llama_forward_hidden: token_embedding_lookup returned %d\n", ret);
         abort();
         #endif
         return ret;
@@ -1728,14 +1795,14 @@ q_error_code llama_forward(
     size_t scratchpad_size = calculate_layer_scratchpad_size(&model->config, seq_len);
     if (scratchpad_size == 0) return Q_ERR_OVERFLOW;
     
-    layer_scratchpad scratch;
+    layer_scratchpad* scratch = scratch_out;
     uint8_t* scratch_mem = (uint8_t*)q_arena_alloc(ctx, scratchpad_size);
     if (scratch_mem == NULL) {
         return Q_ERR_ARENA_OOM;
     }
     
     // CRITICAL: Inicializar com verificação de erro
-    ret = init_layer_scratchpad(&scratch, scratch_mem, &model->config, seq_len);
+    ret = init_layer_scratchpad(scratch, scratch_mem, &model->config, seq_len);
     if (ret != Q_OK) return ret;
 
     // Validação de Bounds Defensiva (Double Check)
@@ -1747,7 +1814,7 @@ q_error_code llama_forward(
     size_t last_token_aligned_sz = safe_align_size(dim_sz_bytes);
     if (last_token_aligned_sz == 0) return Q_ERR_OVERFLOW;
 
-    uintptr_t last_buf_start = (uintptr_t)scratch.last_token_buf;
+    uintptr_t last_buf_start = (uintptr_t)scratch->last_token_buf;
     if (last_buf_start < mem_start) return Q_ERR_INVALID_ARG; // Sanity check
 
     // Check overflow: last_buf_start + last_token_aligned_sz
@@ -1778,10 +1845,10 @@ q_error_code llama_forward(
         float* output = (l % 2 == 0) ? layer_buf_B : layer_buf_A;
         
         ret = llama_layer_forward(&model->layers[l], ctx, model, &model->config, 
-                                 x, output, l, seq_len, pos, &scratch);
+                                 x, output, l, seq_len, pos, scratch);
         if (ret != Q_OK) {
             #ifdef DEBUG
-            fprintf(stderr, "ERROR: llama_forward: llama_layer_forward[%u] returned %d\n", l, ret);
+            fprintf(stderr, "ERROR: llama_forward_hidden: llama_layer_forward[%u] returned %d\n", l, ret);
             abort();
             #endif
             return ret;
@@ -1790,31 +1857,70 @@ q_error_code llama_forward(
         x = output; // Swap para próxima camada
     }
     
+    *hidden_out = x;
+    return Q_OK;
+}
+
+// Steps 1-3 do forward: embeddings + camadas + RMSNorm final da ÚLTIMA posição
+// *last_out -> scratchpad.last_token_buf [dim] (32-byte aligned), pronto para o LM head
+static q_error_code llama_forward_last_hidden(
+    q_llama_model* restrict model,
+    q_context* restrict ctx,
+    const uint32_t* restrict tokens,
+    uint32_t seq_len,
+    uint32_t pos,
+    const float** restrict last_out
+) {
+    // Steps 1-2: Embeddings + camadas
+    float* x = NULL;
+    layer_scratchpad scratch;
+    q_error_code ret = llama_forward_hidden(model, ctx, tokens, seq_len, pos, &x, &scratch);
+    if (ret != Q_OK) {
+        return ret;
+    }
+    
+    uint32_t dim = model->config.dim;
+    
     // Step 3: Final RMSNorm
-    float* x_final = (float*)q_arena_alloc(ctx, layer_buf_size);
-    if (x_final == NULL) {
-        return Q_ERR_ARENA_OOM;
+    // Apenas a última posição é necessária para os logits (prefill e incremental).
+    // Normaliza direto no buffer reutilizável do scratchpad (evita alocar [seq_len, dim]).
+    if (scratch.last_token_buf == NULL) return Q_ERR_INVALID_ARG;
+    
+    const float* last_token_ptr = x + (size_t)(seq_len - 1) * dim;
+    ret = q_rmsnorm_f32_avx2(last_token_ptr, (const float*)model->output_norm->data,
+                             scratch.last_token_buf, dim, model->config.rms_norm_eps);
+    if (ret != Q_OK) {
+        return ret;
     }
+    *last_out = scratch.last_token_buf;
+    return Q_OK;
+}
+
+// Main forward pass function
+q_error_code llama_forward(
+    q_llama_model* restrict model,
+    q_context* restrict ctx,
+    const uint32_t* restrict tokens,
+    uint32_t seq_len,
+    uint32_t pos,
+    float* restrict logits
+) {
+    Q_VALIDATE_PTR_OR_RETURN(logits, Q_ERR_INVALID_ARG);
     
-    ret = q_rmsnorm_f32_avx2(x, (const float*)model->output_norm->data, x_final, dim, model->config.rms_norm_eps);
+    // Steps 1-3: Embeddings + camadas + RMSNorm final
+    const float* last_token = NULL;
+    q_error_code ret = llama_forward_last_hidden(model, ctx, tokens, seq_len, pos, &last_token);
     if (ret != Q_OK) {
         return ret;
     }
     
+    uint32_t dim = model->config.dim;
+    uint32_t vocab_size = model->config.vocab_size;
+    
     // Step 4: LM Head projection
     // For last token only (incremental generation: seq_len == 1)
     // For prefill (seq_len > 1), we only need logits for last position
     
-    // CRITICAL FIX: Usar buffer reutilizável do scratchpad (evita alocação no hot path)
-    const float* last_token_ptr = x_final + (size_t)(seq_len - 1) * dim;
-    
-    // Validação paranoica
-    if (scratch.last_token_buf == NULL) return Q_ERR_INVALID_ARG;
-    
-    // Copiar para o buffer reutilizável do scratchpad
-    memcpy(scratch.last_token_buf, last_token_ptr, dim * sizeof(float));
-    const float* last_token = scratch.last_token_buf;
-    
     // Create tensor view for last token [1, dim]
     q_tensor last_token_tensor = {
         .data = (void*)last_token,
@@ -1841,10 +1947,309 @@ q_error_code llama_forward(
     };
     
     // Compute: last_token [1, dim] @ output^T [dim, vocab_size] -> logits [1, vocab_size]
+    Q_PROFILE_START(t_lm_head);
     ret = q_matmul_f32_avx2(&last_token_tensor, &output_t_tensor, &logits_tensor, ctx);
     if (ret != Q_OK) {
         return ret;
     }
+    Q_PROFILE_STOP(ctx, Q_PROFILE_GLOBAL, Q_PROF_LM_HEAD, t_lm_head);
+    
+    return Q_OK;
+}
+
+// Forward pass com LM head + top-k fundidos (decoding greedy / top-k pequeno)
+// Logits são produzidos em blocos de 8 linhas de output e reduzidos em
+// registradores: [vocab_size] só é escrito se o chamador pedir (logits != NULL)
+q_error_code llama_forward_topk(
+    q_llama_model* restrict model,
+    q_context* restrict ctx,
+    const uint32_t* restrict tokens,
+    uint32_t seq_len,
+    uint32_t pos,
+    uint32_t k,
+    uint32_t* restrict top_ids,
+    float* restrict top_logits,
+    float* restrict logits
+) {
+    Q_VALIDATE_PTR_OR_RETURN(top_ids, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(top_logits, Q_ERR_INVALID_ARG);
+    
+    const float* last_token = NULL;
+    q_error_code ret = llama_forward_last_hidden(model, ctx, tokens, seq_len, pos, &last_token);
+    if (ret != Q_OK) {
+        return ret;
+    }
+    
+    // Step 4: LM Head fundido com seleção (output: [vocab_size, dim], linhas contíguas)
+    Q_PROFILE_START(t_lm_head);
+    ret = q_lm_head_topk_f32_avx2(last_token, model->output, k, top_ids, top_logits, logits);
+    if (ret != Q_OK) {
+        return ret;
+    }
+    Q_PROFILE_STOP(ctx, Q_PROFILE_GLOBAL, Q_PROF_LM_HEAD, t_lm_head);
+    
+    return Q_OK;
+}
+
+// ============================================================================
+// Sequence Scoring (log-probs de sequência completa)
+// ============================================================================
+
+// Tiling do LM head para scoring: [ROW_TILE, dim] @ output^T[dim, VOCAB_CHUNK]
+// Buffer de logits por chunk: 32 * 2048 * 4 = 256KB (cabe em L2)
+// NUNCA materializa [seq_len, vocab_size]
+#define Q_SCORE_ROW_TILE    32
+#define Q_SCORE_VOCAB_CHUNK 2048
+
+// Online log-sum-exp: incorpora um chunk de logits no estado (max, sum)
+// Invariante: sum = Σ exp(x_j - max) para todos os x_j vistos até agora
+static void logsumexp_chunk_update(
+    const float* restrict x,   // [n], 32-byte aligned
+    uint32_t n,
+    float* restrict running_max,
+    float* restrict running_sum
+) {
+    const uint32_t vec_end = n & ~7U;
+    
+    // Passo 1: max do chunk (AVX2 + tail escalar)
+    __m256 max_vec = _mm256_set1_ps(-INFINITY);
+    for (uint32_t i = 0; i < vec_end; i += 8) {
+        max_vec = _mm256_max_ps(max_vec, _mm256_load_ps(x + i));
+    }
+    float chunk_max = horizontal_max_avx(max_vec);
+    for (uint32_t i = vec_end; i < n; i++) {
+        if (x[i] > chunk_max) chunk_max = x[i];
+    }
+    
+    // Passo 2: rescale da soma anterior se o max mudou
+    float new_max = (chunk_max > *running_max) ? chunk_max : *running_max;
+    float sum = *running_sum * expf(*running_max - new_max);  // expf(-inf) = 0 no 1º chunk
+    
+    // Passo 3: Σ exp(x - new_max) com exp de precisão total (log-probs são sensíveis à cauda)
+    const __m256 max_bcast = _mm256_set1_ps(new_max);
+    __m256 sum_vec = _mm256_setzero_ps();
+    for (uint32_t i = 0; i < vec_end; i += 8) {
+        __m256 shifted = _mm256_sub_ps(_mm256_load_ps(x + i), max_bcast);
+        sum_vec = _mm256_add_ps(sum_vec, exp_precise_avx(shifted));
+    }
+    sum += horizontal_sum_avx(sum_vec);
+    for (uint32_t i = vec_end; i < n; i++) {
+        sum += expf(x[i] - new_max);
+    }
+    
+    *running_max = new_max;
+    *running_sum = sum;
+}
+
+q_error_code llama_score_tokens(
+    q_llama_model* restrict model,
+    q_context* restrict ctx,
+    const uint32_t* restrict tokens,
+    uint32_t seq_len,
+    uint32_t pos,
+    float* restrict logprobs
+) {
+    Q_VALIDATE_PTR_OR_RETURN(model, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(tokens, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(logprobs, Q_ERR_INVALID_ARG);
+    
+    // Precisa de pelo menos um par (contexto, alvo)
+    if (seq_len < 2) {
+        return Q_ERR_INVALID_SIZE;
+    }
+    
+    const uint32_t dim = model->config.dim;
+    const uint32_t vocab_size = model->config.vocab_size;
+    
+    // Alvos são indexados diretamente nos logits - validar ANTES do forward
+    for (uint32_t i = 1; i < seq_len; i++) {
+        if (tokens[i] >= vocab_size) {
+            return Q_ERR_INVALID_ARG;
+        }
+    }
+    
+    // Step 1: UM prefill para todas as posições
+    float* hidden = NULL;
+    layer_scratchpad scratch;
+    q_error_code ret = llama_forward_hidden(model, ctx, tokens, seq_len, pos, &hidden, &scratch);
+    if (ret != Q_OK) {
+        return ret;
+    }
+    
+    // Step 2: Buffers de tile (arena)
+    float* norm_tile = (float*)q_arena_alloc(ctx, (size_t)Q_SCORE_ROW_TILE * dim * sizeof(float));
+    float* chunk_logits = (float*)q_arena_alloc(ctx, (size_t)Q_SCORE_ROW_TILE * Q_SCORE_VOCAB_CHUNK * sizeof(float));
+    if (norm_tile == NULL || chunk_logits == NULL) {
+        return Q_ERR_ARENA_OOM;
+    }
+    
+    float row_max[Q_SCORE_ROW_TILE];
+    float row_sum[Q_SCORE_ROW_TILE];
+    float target_logit[Q_SCORE_ROW_TILE];
+    
+    // Posição i prevê tokens[i + 1] -> seq_len - 1 linhas de saída
+    const uint32_t n_rows = seq_len - 1;
+    const float* norm_weight = (const float*)model->output_norm->data;
+    const float* output_w = (const float*)model->output->data;
+    
+    for (uint32_t r0 = 0; r0 < n_rows; r0 += Q_SCORE_ROW_TILE) {
+        const uint32_t rows = (n_rows - r0 < Q_SCORE_ROW_TILE) ? (n_rows - r0) : Q_SCORE_ROW_TILE;
+        
+        // Step 3: Final RMSNorm do tile
+        ret = rmsnorm_rows(hidden + (size_t)r0 * dim, norm_weight, norm_tile, rows, dim, model->config.rms_norm_eps);
+        if (ret != Q_OK) {
+            return ret;
+        }
+        for (uint32_t r = 0; r < rows; r++) {
+            row_max[r] = -INFINITY;
+            row_sum[r] = 0.0f;
+            target_logit[r] = -INFINITY;
+        }
+        
+        q_tensor tile_tensor = {
+            .data = (void*)norm_tile,
+            .ne = {rows, dim, 1, 1},
+            .nb = {dim * sizeof(float), sizeof(float), sizeof(float), sizeof(float)},
+            .type = Q_F32
+        };
+        
+        // Step 4: LM head em chunks de vocabulário + log-softmax gather fundido
+        for (uint32_t v0 = 0; v0 < vocab_size; v0 += Q_SCORE_VOCAB_CHUNK) {
+            const uint32_t cols = (vocab_size - v0 < Q_SCORE_VOCAB_CHUNK) ? (vocab_size - v0) : Q_SCORE_VOCAB_CHUNK;
+            
+            // View transposta de output[v0:v0+cols, :] -> [dim, cols] (sem cópia)
+            q_tensor output_t_tensor = {
+                .data = (void*)(output_w + (size_t)v0 * dim),
+                .ne = {dim, cols, 1, 1},
+                .nb = {sizeof(float), dim * sizeof(float), sizeof(float), sizeof(float)},
+                .type = Q_F32
+            };
+            
+            q_tensor chunk_tensor = {
+                .data = (void*)chunk_logits,
+                .ne = {rows, cols, 1, 1},
+                .nb = {Q_SCORE_VOCAB_CHUNK * sizeof(float), sizeof(float), sizeof(float), sizeof(float)},
+                .type = Q_F32
+            };
+            
+            ret = q_matmul_f32_avx2(&tile_tensor, &output_t_tensor, &chunk_tensor, ctx);
+            if (ret != Q_OK) {
+                return ret;
+            }
+            
+            for (uint32_t r = 0; r < rows; r++) {
+                const float* row = chunk_logits + (size_t)r * Q_SCORE_VOCAB_CHUNK;
+                logsumexp_chunk_update(row, cols, &row_max[r], &row_sum[r]);
+                
+                const uint32_t target = tokens[r0 + r + 1];
+                if (target >= v0 && target < v0 + cols) {
+                    target_logit[r] = row[target - v0];
+                }
+            }
+        }
+        
+        // Step 5: log p(target) = logit[target] - logsumexp(logits)
+        for (uint32_t r = 0; r < rows; r++) {
+            logprobs[r0 + r] = target_logit[r] - row_max[r] - logf(row_sum[r]);
+        }
+    }
+    
+    return Q_OK;
+}
+
+// ============================================================================
+// Sentence Embeddings (hidden states pooled, sem LM head)
+// ============================================================================
+
+// out[i] = in[i] / ||in||_2 (AVX2; dim múltiplo de 8 garantido por llama_build_graph)
+static void l2_normalize_f32(const float* restrict in, float* restrict out, uint32_t dim) {
+    __m256 acc = _mm256_setzero_ps();
+    for (uint32_t i = 0; i < dim; i += 8) {
+        __m256 v = _mm256_load_ps(in + i);
+        acc = _mm256_fmadd_ps(v, v, acc);
+    }
+    float norm_sq = horizontal_sum_avx(acc);
+    // Vetor nulo: evita divisão por zero (saída = zeros)
+    const __m256 inv = _mm256_set1_ps(norm_sq > 0.0f ? 1.0f / sqrtf(norm_sq) : 0.0f);
+    for (uint32_t i = 0; i < dim; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_load_ps(in + i), inv));
+    }
+}
+
+q_error_code llama_embed(
+    q_llama_model* restrict model,
+    q_context* restrict ctx,
+    const uint32_t* restrict tokens,
+    const uint32_t* restrict seq_lens,
+    uint32_t n_seqs,
+    q_pooling_type pooling,
+    float* restrict embeddings
+) {
+    Q_VALIDATE_PTR_OR_RETURN(model, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(ctx, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(tokens, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(seq_lens, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(embeddings, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_NONZERO_OR_RETURN(n_seqs, Q_ERR_INVALID_SIZE);
+    
+    if (pooling != Q_POOL_MEAN && pooling != Q_POOL_LAST) {
+        return Q_ERR_INVALID_ARG;
+    }
+    
+    const uint32_t dim = model->config.dim;
+    const float* norm_weight = (const float*)model->output_norm->data;
+    const float eps = model->config.rms_norm_eps;
+    
+    size_t token_offset = 0;
+    for (uint32_t s = 0; s < n_seqs; s++) {
+        const uint32_t seq_len = seq_lens[s];
+        if (seq_len == 0) {
+            return Q_ERR_INVALID_SIZE;
+        }
+        
+        // Watermark local: libera temporários desta sequência antes da próxima
+        // (mesma semântica de q_arena_reset, sem descartar alocações do chamador)
+        const size_t arena_mark = ctx->scratch_head;
+        
+        // Step 1: Prefill de todas as posições (embeddings + camadas)
+        float* hidden = NULL;
+        layer_scratchpad scratch;
+        q_error_code ret = llama_forward_hidden(model, ctx, tokens + token_offset, seq_len, 0, &hidden, &scratch);
+        if (ret != Q_OK) {
+            ctx->scratch_head = arena_mark;
+            return ret;
+        }
+        
+        // Step 2: Final RMSNorm + pooling (acumula em last_token_buf, alinhado)
+        float* pooled = scratch.last_token_buf;
+        if (pooling == Q_POOL_LAST) {
+            ret = q_rmsnorm_f32_avx2(hidden + (size_t)(seq_len - 1) * dim, norm_weight, pooled, dim, eps);
+        } else {
+            // Normaliza todas as linhas no x_norm do scratchpad ([seq_len, dim], livre
+            // após o forward) e acumula a média
+            ret = rmsnorm_rows(hidden, norm_weight, scratch.x_norm, seq_len, dim, eps);
+            memset(pooled, 0, (size_t)dim * sizeof(float));
+            const __m256 inv_len = _mm256_set1_ps(1.0f / (float)seq_len);
+            for (uint32_t t = 0; t < seq_len && ret == Q_OK; t++) {
+                const float* row = scratch.x_norm + (size_t)t * dim;
+                for (uint32_t i = 0; i < dim; i += 8) {
+                    __m256 acc = _mm256_load_ps(pooled + i);
+                    acc = _mm256_fmadd_ps(_mm256_load_ps(row + i), inv_len, acc);
+                    _mm256_store_ps(pooled + i, acc);
+                }
+            }
+        }
+        if (ret != Q_OK) {
+            ctx->scratch_head = arena_mark;
+            return ret;
+        }
+        
+        // Step 3: L2 normalize -> saída (sem LM head)
+        l2_normalize_f32(pooled, embeddings + (size_t)s * dim, dim);
+        
+        ctx->scratch_head = arena_mark;
+        token_offset += seq_len;
+    }
     
     return Q_OK;
 }
@@ -60,6 +60,43 @@ static inline __m256 exp_approx_avx(__m256 x) {
     return result;
 }
 
+// Full-range exp (Cephes-style): exp(x) = 2^n * p(r), r = x - n*ln2, |r| <= ln2/2
+// Precision: ~2 ULP em [-87, 88] (necessário para log-probs, onde exp_approx_avx
+// satura em |x| > 5). Custo: ~2x exp_approx_avx.
+static inline __m256 exp_precise_avx(__m256 x) {
+    const __m256 exp_hi = _mm256_set1_ps(88.3762626647949f);
+    const __m256 exp_lo = _mm256_set1_ps(-87.3365447504f);
+    const __m256 log2e = _mm256_set1_ps(1.44269504088896341f);
+    const __m256 ln2_hi = _mm256_set1_ps(0.693359375f);
+    const __m256 ln2_lo = _mm256_set1_ps(-2.12194440e-4f);
+
+    x = _mm256_min_ps(x, exp_hi);
+    x = _mm256_max_ps(x, exp_lo);
+
+    // n = round(x / ln2)
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(x, log2e), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+
+    // r = x - n*ln2 (Cody-Waite: ln2 dividido em hi + lo)
+    __m256 r = _mm256_fnmadd_ps(n, ln2_hi, x);
+    r = _mm256_fnmadd_ps(n, ln2_lo, r);
+
+    // p(r) = 1 + r + r^2 * poly(r)
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    __m256 r2 = _mm256_mul_ps(r, r);
+    p = _mm256_fmadd_ps(p, r2, _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    // 2^n via manipulação do expoente IEEE-754
+    __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+    __m256 pow2n = _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+
+    return _mm256_mul_ps(p, pow2n);
+}
+
 // Horizontal sum reduction (shared utility)
 static inline float horizontal_sum_avx(__m256 vec) {
     __m128 low = _mm256_extractf128_ps(vec, 0);
@@ -0,0 +1,242 @@
+#include "qorus.h"
+#include "avx_math.h"
+#include <immintrin.h>
+#include <math.h>
+
+// LM Head + Top-k AVX2: logits = W @ x com seleção top-k/argmax fundida
+// Usado em decoding greedy/top-k: o vetor logits[vocab_size] (128-512KB) não
+// precisa ser escrito nem relido pelo sampler
+//
+// Estratégia:
+// - Linhas de W em pares (x carregado 1x por par), mesma aritmética de
+//   q_matmul_f32_avx2 (4 acumuladores × 32 floats, horizontal sum, cauda
+//   escalar) → logits bit-idênticos ao caminho matmul
+// - A cada 8 linhas, logits viram um registro AVX2:
+//   k = 1: argmax por lane em registradores (valor + índice via blendv)
+//   k > 1: threshold = mínimo do heap; movemask descarta blocos sem candidato
+// - Empates: menor índice vence (mesmo resultado do argmax escalar)
+//
+// Time Complexity: O(V × dim) - limitado pela leitura de W
+// Space Complexity: O(k) - heap nos próprios buffers de saída
+
+// Dot product de uma linha de W, mesma ordem de acumulação de q_matmul_f32_avx2
+static inline float lm_head_dot(const float* restrict x, const float* restrict w, uint32_t dim) {
+    const uint32_t k_vec = dim & ~31U;
+    float dot = 0.0f;
+    if (k_vec > 0) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        for (uint32_t k = 0; k < k_vec; k += 32) {
+            acc0 = _mm256_fmadd_ps(_mm256_load_ps(x + k + 0), _mm256_loadu_ps(w + k + 0), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_load_ps(x + k + 8), _mm256_loadu_ps(w + k + 8), acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_load_ps(x + k + 16), _mm256_loadu_ps(w + k + 16), acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_load_ps(x + k + 24), _mm256_loadu_ps(w + k + 24), acc3);
+        }
+        dot = horizontal_sum_avx(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    }
+    for (uint32_t k = k_vec; k < dim; k++) {
+        dot += x[k] * w[k];
+    }
+    return dot;
+}
+
+// Duas linhas por iteração: x reutilizado dos registradores, 8 acumuladores independentes
+static inline void lm_head_dot2(
+    const float* restrict x,
+    const float* restrict w0,
+    const float* restrict w1,
+    uint32_t dim,
+    float* restrict out0,
+    float* restrict out1
+) {
+    const uint32_t k_vec = dim & ~31U;
+    float dot0 = 0.0f;
+    float dot1 = 0.0f;
+    if (k_vec > 0) {
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+        __m256 a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        __m256 b0 = _mm256_setzero_ps(), b1 = _mm256_setzero_ps();
+        __m256 b2 = _mm256_setzero_ps(), b3 = _mm256_setzero_ps();
+        for (uint32_t k = 0; k < k_vec; k += 32) {
+            const __m256 x0 = _mm256_load_ps(x + k + 0);
+            const __m256 x1 = _mm256_load_ps(x + k + 8);
+            const __m256 x2 = _mm256_load_ps(x + k + 16);
+            const __m256 x3 = _mm256_load_ps(x + k + 24);
+            a0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(w0 + k + 0), a0);
+            a1 = _mm256_fmadd_ps(x1, _mm256_loadu_ps(w0 + k + 8), a1);
+            a2 = _mm256_fmadd_ps(x2, _mm256_loadu_ps(w0 + k + 16), a2);
+            a3 = _mm256_fmadd_ps(x3, _mm256_loadu_ps(w0 + k + 24), a3);
+            b0 = _mm256_fmadd_ps(x0, _mm256_loadu_ps(w1 + k + 0), b0);
+            b1 = _mm256_fmadd_ps(x1, _mm256_loadu_ps(w1 + k + 8), b1);
+            b2 = _mm256_fmadd_ps(x2, _mm256_loadu_ps(w1 + k + 16), b2);
+            b3 = _mm256_fmadd_ps(x3, _mm256_loadu_ps(w1 + k + 24), b3);
+        }
+        dot0 = horizontal_sum_avx(_mm256_add_ps(_mm256_add_ps(a0, a1), _mm256_add_ps(a2, a3)));
+        dot1 = horizontal_sum_avx(_mm256_add_ps(_mm256_add_ps(b0, b1), _mm256_add_ps(b2, b3)));
+    }
+    for (uint32_t k = k_vec; k < dim; k++) {
+        dot0 += x[k] * w0[k];
+    }
+    for (uint32_t k = k_vec; k < dim; k++) {
+        dot1 += x[k] * w1[k];
+    }
+    *out0 = dot0;
+    *out1 = dot1;
+}
+
+// Min-heap (raiz = pior): logit menor, ou índice maior no empate
+static inline bool topk_worse(float la, uint32_t ia, float lb, uint32_t ib) {
+    return la < lb || (!(la > lb) && ia > ib);
+}
+
+static void topk_sift_down(uint32_t* restrict ids, float* restrict vals, uint32_t n, uint32_t pos) {
+    for (;;) {
+        uint32_t worst = 2 * pos + 1;
+        if (worst >= n) {
+            return;
+        }
+        if (worst + 1 < n && topk_worse(vals[worst + 1], ids[worst + 1], vals[worst], ids[worst])) {
+            worst++;
+        }
+        if (!topk_worse(vals[worst], ids[worst], vals[pos], ids[pos])) {
+            return;
+        }
+        float tv = vals[pos]; vals[pos] = vals[worst]; vals[worst] = tv;
+        uint32_t ti = ids[pos]; ids[pos] = ids[worst]; ids[worst] = ti;
+        pos = worst;
+    }
+}
+
+// Índices chegam em ordem crescente: empate com a raiz perde (menor índice vence)
+static inline void topk_offer(uint32_t* restrict ids, float* restrict vals, uint32_t* restrict n,
+                              uint32_t k, uint32_t index, float logit) {
+    if (*n < k) {
+        uint32_t pos = (*n)++;
+        ids[pos] = index;
+        vals[pos] = logit;
+        while (pos > 0) {
+            uint32_t parent = (pos - 1) / 2;
+            if (!topk_worse(vals[pos], ids[pos], vals[parent], ids[parent])) {
+                break;
+            }
+            float tv = vals[pos]; vals[pos] = vals[parent]; vals[parent] = tv;
+            uint32_t ti = ids[pos]; ids[pos] = ids[parent]; ids[parent] = ti;
+            pos = parent;
+        }
+    } else if (logit > vals[0]) {
+        ids[0] = index;
+        vals[0] = logit;
+        topk_sift_down(ids, vals, k, 0);
+    }
+}
+
+q_error_code q_lm_head_topk_f32_avx2(
+    const float* restrict x,
+    const q_tensor* restrict weights,
+    uint32_t k,
+    uint32_t* restrict top_ids,
+    float* restrict top_logits,
+    float* restrict logits
+) {
+    Q_VALIDATE_PTR_OR_RETURN(x, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(weights, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(weights->data, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(top_ids, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(top_logits, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_ALIGNED_OR_RETURN(x, Q_ERR_MISALIGNED);
+    Q_VALIDATE_OR_RETURN(weights->type == Q_F32, Q_ERR_INVALID_DTYPE);
+
+    const uint32_t vocab_size = weights->ne[0];
+    const uint32_t dim = weights->ne[1];
+    Q_VALIDATE_NONZERO_OR_RETURN(vocab_size, Q_ERR_INVALID_SIZE);
+    Q_VALIDATE_NONZERO_OR_RETURN(dim, Q_ERR_INVALID_SIZE);
+    Q_VALIDATE_OR_RETURN(k > 0 && k <= vocab_size, Q_ERR_INVALID_SIZE);
+
+    const float* W = (const float*)weights->data;
+    const size_t row_stride = weights->nb[0] / sizeof(float);
+    Q_VALIDATE_OR_RETURN(row_stride >= dim, Q_ERR_INVALID_SIZE);
+
+    // Estado k = 1: argmax por lane (strict > mantém o primeiro índice de cada lane)
+    __m256 best_val = _mm256_set1_ps(-INFINITY);
+    __m256i best_idx = _mm256_setzero_si256();
+    const __m256i lane_idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    // Estado k > 1: heap em top_ids/top_logits; -INFINITY aceita tudo até encher
+    uint32_t n = 0;
+    __m256 threshold = _mm256_set1_ps(-INFINITY);
+    bool accept_all = true;
+
+    float block[8] __attribute__((aligned(32)));
+    for (uint32_t v0 = 0; v0 < vocab_size; v0 += 8) {
+        const uint32_t rows = (vocab_size - v0 < 8) ? (vocab_size - v0) : 8;
+        const float* w = W + (size_t)v0 * row_stride;
+        uint32_t r = 0;
+        for (; r + 2 <= rows; r += 2) {
+            lm_head_dot2(x, w + (size_t)r * row_stride, w + (size_t)(r + 1) * row_stride, dim,
+                         &block[r], &block[r + 1]);
+        }
+        if (r < rows) {
+            block[r] = lm_head_dot(x, w + (size_t)r * row_stride, dim);
+            r++;
+        }
+        for (; r < 8; r++) {
+            block[r] = -INFINITY;  // Linhas além do vocabulário nunca vencem
+        }
+
+        if (logits != NULL) {
+            for (r = 0; r < rows; r++) {
+                logits[v0 + r] = block[r];
+            }
+        }
+
+        const __m256 vals = _mm256_load_ps(block);
+        if (k == 1) {
+            const __m256 gt = _mm256_cmp_ps(vals, best_val, _CMP_GT_OQ);
+            const __m256i idx = _mm256_add_epi32(lane_idx, _mm256_set1_epi32((int)v0));
+            best_val = _mm256_blendv_ps(best_val, vals, gt);
+            best_idx = _mm256_castps_si256(_mm256_blendv_ps(
+                _mm256_castsi256_ps(best_idx), _mm256_castsi256_ps(idx), gt));
+            continue;
+        }
+
+        int bits = (1 << rows) - 1;
+        if (!accept_all) {
+            bits &= _mm256_movemask_ps(_mm256_cmp_ps(vals, threshold, _CMP_GT_OQ));
+        }
+        while (bits != 0) {
+            const int lane = __builtin_ctz((unsigned int)bits);
+            bits &= bits - 1;
+            topk_offer(top_ids, top_logits, &n, k, v0 + (uint32_t)lane, block[lane]);
+        }
+        if (n == k) {
+            accept_all = false;
+            threshold = _mm256_set1_ps(top_logits[0]);
+        }
+    }
+
+    if (k == 1) {
+        // Redução entre lanes: maior valor, menor índice no empate
+        float vals[8] __attribute__((aligned(32)));
+        uint32_t idxs[8] __attribute__((aligned(32)));
+        _mm256_store_ps(vals, best_val);
+        _mm256_store_si256((__m256i*)(void*)idxs, best_idx);
+        uint32_t best = 0;
+        for (uint32_t l = 1; l < 8; l++) {
+            if (topk_worse(vals[best], idxs[best], vals[l], idxs[l])) {
+                best = l;
+            }
+        }
+        top_ids[0] = idxs[best];
+        top_logits[0] = vals[best];
+        return Q_OK;
+    }
+
+    // Heapsort: raiz (pior) vai para o fim → ordem decrescente
+    for (uint32_t end = n; end > 1; end--) {
+        float tv = top_logits[0]; top_logits[0] = top_logits[end - 1]; top_logits[end - 1] = tv;
+        uint32_t ti = top_ids[0]; top_ids[0] = top_ids[end - 1]; top_ids[end - 1] = ti;
+        topk_sift_down(top_ids, top_logits, end - 1, 0);
+    }
+    return Q_OK;
+}
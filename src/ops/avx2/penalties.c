@@ -0,0 +1,82 @@
+#include "qorus.h"
+#include <immintrin.h>
+#include <math.h>
+
+// Penalties AVX2: repetition / frequency / presence só nos tokens já gerados
+// Usado por q_generate entre llama_forward e q_grammar_apply/q_sample_token
+//
+// Para cada token t com count c > 0 (q_token_counts):
+//   repetition: logit = logit > 0 ? logit / r : logit * r
+//   frequency:  logit -= c * f
+//   presence:   logit -= p
+//
+// Estratégia: ids/counts do histograma já estão em SoA denso
+// - gather de 8 logits por ids (vpgatherdps), penalties em registro
+// - scatter escalar (AVX2 não tem scatter); ids são distintos -> sem conflito
+//
+// Time Complexity: O(n_unique) - independe de vocab_size
+// Space Complexity: O(1) - In-place
+
+// Mesma ordem de operações do caminho vetorial (resultados bit-idênticos)
+static inline float penalty_apply_one(float logit, uint32_t count, float rep, float freq, float pres) {
+    logit = (logit > 0.0f) ? logit / rep : logit * rep;
+    logit -= (float)count * freq;
+    logit -= pres;
+    return logit;
+}
+
+q_error_code q_apply_penalties_f32_avx2(
+    float* restrict logits,
+    uint32_t vocab_size,
+    const q_token_counts* restrict counts,
+    float repetition_penalty,
+    float frequency_penalty,
+    float presence_penalty
+) {
+    Q_VALIDATE_PTR_OR_RETURN(logits, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(counts, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_NONZERO_OR_RETURN(vocab_size, Q_ERR_INVALID_SIZE);
+    Q_VALIDATE_OR_RETURN(isfinite(repetition_penalty) && repetition_penalty >= 0.0f, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(isfinite(frequency_penalty) && isfinite(presence_penalty), Q_ERR_INVALID_ARG);
+
+    const uint32_t n = counts->n_unique;
+    if (n == 0) {
+        return Q_OK;
+    }
+    Q_VALIDATE_OR_RETURN(counts->max_id < vocab_size, Q_ERR_INVALID_ARG);
+
+    // 0 = desabilitado (divisão por 1 é exata: caminho único para os três termos)
+    const float rep = (repetition_penalty > 0.0f) ? repetition_penalty : 1.0f;
+    const uint32_t* restrict ids = counts->ids;
+    const uint32_t* restrict cnt = counts->counts;
+
+    const __m256 vrep = _mm256_set1_ps(rep);
+    const __m256 vfreq = _mm256_set1_ps(frequency_penalty);
+    const __m256 vpres = _mm256_set1_ps(presence_penalty);
+    const __m256 zero = _mm256_setzero_ps();
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i vid = _mm256_loadu_si256((const __m256i*)(const void*)(ids + i));
+        const __m256 vcnt = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(const void*)(cnt + i)));
+        __m256 v = _mm256_i32gather_ps(logits, vid, 4);
+
+        const __m256 positive = _mm256_cmp_ps(v, zero, _CMP_GT_OQ);
+        v = _mm256_blendv_ps(_mm256_mul_ps(v, vrep), _mm256_div_ps(v, vrep), positive);
+        v = _mm256_sub_ps(v, _mm256_mul_ps(vcnt, vfreq));
+        v = _mm256_sub_ps(v, vpres);
+
+        float out[8] __attribute__((aligned(32)));
+        _mm256_store_ps(out, v);
+        for (uint32_t l = 0; l < 8; l++) {
+            logits[ids[i + l]] = out[l];
+        }
+    }
+
+    // Tail escalar
+    for (; i < n; i++) {
+        logits[ids[i]] = penalty_apply_one(logits[ids[i]], cnt[i], rep, frequency_penalty, presence_penalty);
+    }
+
+    return Q_OK;
+}
@@ -0,0 +1,53 @@
+#include "qorus.h"
+#include <immintrin.h>
+
+// Token Mask AVX2: logits[i] = mask_value onde bit i de allowed é 0
+// Usado pelo constrained decoding (q_grammar) entre llama_forward e q_sample_token
+//
+// Estratégia: 1 byte do bitmask cobre 8 logits = 1 registro AVX2
+// - Broadcast da palavra, sllv leva o bit de cada lane ao bit de sinal
+// - blendv com mask_value (sem gather); único branch é por palavra de 32 bits
+//
+// Time Complexity: O(V) - ~V/32 iterações de 4 blends
+// Space Complexity: O(1) - In-place
+
+q_error_code q_token_mask_f32_avx2(
+    float* restrict logits,
+    const uint32_t* restrict allowed,
+    uint32_t vocab_size,
+    float mask_value
+) {
+    Q_VALIDATE_PTR_OR_RETURN(logits, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(allowed, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_NONZERO_OR_RETURN(vocab_size, Q_ERR_INVALID_SIZE);
+
+    // Desloca bit j do byte para o bit de sinal da lane j (blendv usa só o sinal)
+    const __m256i lane_shift = _mm256_setr_epi32(31, 30, 29, 28, 27, 26, 25, 24);
+    const __m256 vec_mask_val = _mm256_set1_ps(mask_value);
+
+    // 1 palavra do bitmask = 32 logits = 4 registros AVX2
+    // Palavra toda permitida (caso comum dentro de strings): pula sem tocar logits
+    uint32_t i = 0;
+    const uint32_t word_end = vocab_size & ~31U;
+    for (; i < word_end; i += 32) {
+        const uint32_t w = allowed[i >> 5];
+        if (w == 0xFFFFFFFFU) {
+            continue;
+        }
+        for (uint32_t b = 0; b < 4; b++) {
+            __m256 keep = _mm256_castsi256_ps(
+                _mm256_sllv_epi32(_mm256_set1_epi32((int)(w >> (b * 8))), lane_shift));
+            __m256 v = _mm256_loadu_ps(&logits[i + b * 8]);
+            _mm256_storeu_ps(&logits[i + b * 8], _mm256_blendv_ps(vec_mask_val, v, keep));
+        }
+    }
+
+    // Tail escalar
+    for (; i < vocab_size; i++) {
+        if ((allowed[i >> 5] & (1U << (i & 31))) == 0) {
+            logits[i] = mask_value;
+        }
+    }
+
+    return Q_OK;
+}
@@ -7,7 +7,9 @@
 // Algorithm:
 // 1. Split text into bytes (UTF-8 encoding)
 // 2. Convert bytes to base token IDs
-// 3. Apply BPE merges greedily (highest priority first)
+// 3. Pre-tokenize (Llama-3 split pattern, pretokenizer.c) and apply BPE merges
+//    per pre-token in rank order (textos grandes: segmentos em paralelo)
+//    Palavras repetidas saem do cache LRU de encode sem rodar os merges
 // 4. Add special tokens (BOS/EOS) if requested
 //
 // This file replaces dummy_tokenizer.c with a complete BPE implementation.
@@ -18,14 +20,36 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Tokenizer binary file format constants
 #define TOKENIZER_MAGIC 0x51544B52  // 'QTKR'
 #define TOKENIZER_VERSION 1
 #define TOKENIZER_HEADER_SIZE 32
 
+// Formato v2 (zero-parse, mmap): seções alinhadas a 64 bytes, little-endian
+//   header [64]  : u32 magic, version=2, vocab_size, num_merges, bos, eos, pad,
+//                  table_slots, index_off, blob_off, blob_size, merges_off,
+//                  table_off, reserved[3]
+//   index        : u32 (offset no blob, length)[vocab_size]
+//   blob         : bytes dos tokens, cada um terminado em '\0' (length = strlen;
+//                  token do byte 0 é "" como em v1 após o parse)
+//   merges       : q_bpe_merge[num_merges] (3 × u32, ordem = rank)
+//   table        : bpe_merge_group[table_slots / 4] (grupos de 4 slots, 64 bytes;
+//                  probing linear por grupo com hash_pair; key UINT64_MAX = vazio).
+//                  Gerado por tools/convert_llama.py ou q_tokenizer_save
+#define TOKENIZER_VERSION_V2     2
+#define TOKENIZER_V2_HEADER_SIZE 64
+#define TOKENIZER_V2_ALIGN       64
+
 // ============================================================================
 // STEP 0: CHAIN OF THOUGHT - Problem Analysis
 // ============================================================================
@@ -57,26 +81,45 @@
 // Maximum text length for internal buffers (safety limit)
 #define MAX_TEXT_BYTES (1024 * 1024)  // 1MB max text
 
+// Encode paralelo: textos grandes divididos em segmentos (fronteiras de pré-token)
+#define Q_TOKENIZER_PARALLEL_MIN_BYTES (128 * 1024)  // Abaixo disso: single-thread
+#define Q_TOKENIZER_SEGMENT_MIN_BYTES  (64 * 1024)   // Trabalho mínimo por thread
+#define Q_TOKENIZER_MAX_THREADS        8
+
+// Encode em batch: documentos distribuídos entre threads (faixas balanceadas por bytes)
+#define Q_TOKENIZER_BATCH_MAX_THREADS  64
+#define Q_TOKENIZER_BATCH_MIN_BYTES    (32 * 1024)   // Trabalho mínimo por thread
+
 // Token deletion marker (soft-delete optimization)
-// Used to mark tokens as deleted without moving memory (O(m × n³) → O(m × n))
+// Used to mark tokens as deleted without moving memory (compactação única no fim do merge)
 #define Q_TOKEN_DELETED UINT32_MAX
 
 // ============================================================================
-// Hash Table for BPE Merge Lookup (Optimization)
+// Merge Table for BPE Lookup (open addressing, grupos SIMD)
 // ============================================================================
+// Estilo Swiss table: grupos de 4 slots em exatamente uma cache line, chaves
+// contíguas comparadas com um único _mm256_cmpeq_epi64. Load factor <= 0.5:
+// quase todo lookup (hit ou miss) resolve no primeiro grupo, sem perseguir
+// ponteiros e com um branch previsível por grupo.
+// Mesmo layout da tabela pré-construída do formato v2 (usada in-place via mmap);
+// em v1 a tabela é construída no load.
 
-// Hash table entry (chaining for collisions)
-typedef struct bpe_hash_entry {
-    uint64_t key;                    // (token_id1 << 16) | token_id2
-    uint32_t merged_id;              // Resulting merged token ID
-    struct bpe_hash_entry* next;      // Next entry in chain (for collisions)
-} bpe_hash_entry;
+#define BPE_GROUP_SLOTS 4
+#define BPE_SLOT_EMPTY  UINT64_MAX
 
-// Hash table structure
-typedef struct {
-    bpe_hash_entry** buckets;        // Array of bucket pointers
-    size_t num_buckets;              // Number of buckets (power of 2)
-    size_t num_entries;              // Number of entries
+// Grupo da tabela de merges: layout fixo, é também o formato em disco (v2)
+// (mesma definição em tools/convert_llama.py)
+struct bpe_merge_group {
+    uint64_t keys[BPE_GROUP_SLOTS];        // (token_id1 << 32) | token_id2; BPE_SLOT_EMPTY = vazio
+    uint32_t merged_id[BPE_GROUP_SLOTS];   // Resulting merged token ID
+    uint32_t rank[BPE_GROUP_SLOTS];        // Prioridade = índice em tok->merges (menor = primeiro)
+};
+
+// Tabela construída em runtime (v1): dona dos grupos apontados por tok->merge_groups
+typedef struct bpe_hash_table {
+    struct bpe_merge_group* groups;  // [num_groups], alinhado a 64 bytes
+    size_t num_groups;               // Potência de 2
+    size_t num_entries;              // Pares distintos inseridos
 } bpe_hash_table;
 
 // Helper: Find next power of 2 >= n
@@ -94,144 +137,790 @@ static inline size_t next_power_of_2(size_t n) {
     return n + 1;
 }
 
-// Hash function: Multiplicative hash (Knuth)
+// Hash function: Multiplicative hash (Knuth) + fold dos bits altos
+// Sem o fold, os bits baixos (usados pelo bucket) dependeriam só de id2:
+// todos os pares com o mesmo token direito cairiam na mesma cadeia
 static inline uint64_t hash_pair(uint32_t id1, uint32_t id2) {
-    uint64_t key = ((uint64_t)id1 << 16) | id2;
+    uint64_t key = ((uint64_t)id1 << 32) | id2;
     // Golden ratio multiplier for good distribution
-    return key * 2654435761ULL;
+    uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+// Número de grupos para num_merges regras: load factor <= 0.5 (potência de 2, >= 1)
+static inline size_t merge_table_groups(uint32_t num_merges) {
+    const size_t slots = next_power_of_2((size_t)num_merges * 2);
+    return (slots > BPE_GROUP_SLOTS) ? slots / BPE_GROUP_SLOTS : 1;
+}
+
+// Preenche grupos (já marcados vazios) com as regras em ordem de rank
+// Par duplicado: mantém a primeira regra (menor rank). Returns pares distintos
+static size_t fill_merge_groups(
+    const q_bpe_merge* restrict merges,
+    uint32_t num_merges,
+    struct bpe_merge_group* restrict groups,
+    size_t num_groups
+) {
+    const size_t mask = num_groups - 1;
+    size_t entries = 0;
+    for (uint32_t r = 0; r < num_merges; r++) {
+        const uint32_t id1 = merges[r].token_id1;
+        const uint32_t id2 = merges[r].token_id2;
+        const uint64_t key = ((uint64_t)id1 << 32) | id2;
+        size_t g = (size_t)(hash_pair(id1, id2) & mask);
+        for (;;) {
+            struct bpe_merge_group* grp = &groups[g];
+            size_t i = 0;
+            while (i < BPE_GROUP_SLOTS && grp->keys[i] != key && grp->keys[i] != BPE_SLOT_EMPTY) {
+                i++;
+            }
+            if (i == BPE_GROUP_SLOTS) {
+                g = (g + 1) & mask;  // Grupo cheio: próximo grupo
+                continue;
+            }
+            if (grp->keys[i] == BPE_SLOT_EMPTY) {
+                grp->keys[i] = key;
+                grp->merged_id[i] = merges[r].merged_id;
+                grp->rank[i] = r;
+                entries++;
+            }
+            break;
+        }
+    }
+    return entries;
 }
 
-// Build hash table from merge rules
-// Called during q_tokenizer_load after merges are loaded
+// Build merge table from merge rules
+// Called during q_tokenizer_load (v1) after merges are loaded
 static q_error_code build_merge_hash_table(q_tokenizer* restrict tok) {
     Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
     
     // Early return if no merges
     if (tok->num_merges == 0) {
-        // Store hash table pointer in a way that doesn't require modifying q_tokenizer struct
-        // For now, we'll use a static variable (not thread-safe, but acceptable for v1.0)
-        // TODO: Add merge_hash_table field to q_tokenizer struct in future version
         return Q_OK;
     }
     
-    // Calculate number of buckets (load factor 0.5)
-    size_t num_buckets = next_power_of_2((size_t)tok->num_merges * 2);
-    if (num_buckets == 0 || num_buckets > SIZE_MAX / sizeof(bpe_hash_entry*)) {
+    const size_t num_groups = merge_table_groups(tok->num_merges);
+    if (num_groups > UINT32_MAX || num_groups > SIZE_MAX / sizeof(struct bpe_merge_group)) {
         return Q_ERR_OVERFLOW;
     }
     
-    // Allocate hash table
     bpe_hash_table* ht = (bpe_hash_table*)calloc(1, sizeof(bpe_hash_table));
     if (ht == NULL) {
         return Q_ERR_ALLOC_FAILED;
     }
-    
-    ht->buckets = (bpe_hash_entry**)calloc(num_buckets, sizeof(bpe_hash_entry*));
-    if (ht->buckets == NULL) {
+    ht->groups = (struct bpe_merge_group*)aligned_alloc(64, num_groups * sizeof(struct bpe_merge_group));
+    if (ht->groups == NULL) {
         free(ht);
         return Q_ERR_ALLOC_FAILED;
     }
+    memset(ht->groups, 0xFF, num_groups * sizeof(struct bpe_merge_group));  // keys = BPE_SLOT_EMPTY
+    ht->num_groups = num_groups;
+    ht->num_entries = fill_merge_groups(tok->merges, tok->num_merges, ht->groups, num_groups);
     
-    ht->num_buckets = num_buckets;
-    ht->num_entries = 0;
-    
-    // Insert all merge rules into hash table
-    for (uint32_t i = 0; i < tok->num_merges; i++) {
-        uint32_t id1 = tok->merges[i].token_id1;
-        uint32_t id2 = tok->merges[i].token_id2;
-        uint32_t merged = tok->merges[i].merged_id;
-        
-        // Calculate hash
-        uint64_t hash = hash_pair(id1, id2);
-        size_t bucket = hash % num_buckets;
-        uint64_t key = ((uint64_t)id1 << 16) | id2;
-        
-        // Create entry
-        bpe_hash_entry* entry = (bpe_hash_entry*)malloc(sizeof(bpe_hash_entry));
-        if (entry == NULL) {
-            // Cleanup on error
-            for (size_t b = 0; b < num_buckets; b++) {
-                bpe_hash_entry* e = ht->buckets[b];
-                while (e != NULL) {
-                    bpe_hash_entry* next = e->next;
-                    free(e);
-                    e = next;
-                }
-            }
-            free(ht->buckets);
-            free(ht);
-            return Q_ERR_ALLOC_FAILED;
-        }
-        
-        entry->key = key;
-        entry->merged_id = merged;
-        entry->next = ht->buckets[bucket];
-        ht->buckets[bucket] = entry;
-        ht->num_entries++;
-    }
-    
-    // Store hash table pointer in tokenizer struct
-    tok->merge_hash_table = (struct bpe_hash_table*)ht;
-    
+    tok->merge_hash_table = ht;
+    tok->merge_groups = ht->groups;
+    tok->merge_groups_mask = (uint32_t)(num_groups - 1);
     return Q_OK;
 }
 
-// Lookup merge rule in hash table (O(1) amortized)
-// Returns merged_id or UINT32_MAX if not found
-static uint32_t lookup_merge_hash(
-    const bpe_hash_table* restrict ht,
+// Lookup por grupo: 4 chaves comparadas de uma vez (AVX2)
+// Sempre há slot vazio (load factor <= 0.5), então o probing termina
+// Returns merged_id (rank em *rank_out) or UINT32_MAX if not found
+static inline uint32_t lookup_merge_groups(
+    const struct bpe_merge_group* restrict groups,
+    uint32_t mask,
     uint32_t token_id1,
-    uint32_t token_id2
+    uint32_t token_id2,
+    uint32_t* restrict rank_out
 ) {
-    if (ht == NULL) {
-        return UINT32_MAX;
-    }
-    
-    uint64_t hash = hash_pair(token_id1, token_id2);
-    size_t bucket = hash % ht->num_buckets;
-    uint64_t search_key = ((uint64_t)token_id1 << 16) | token_id2;
-    
-    // Traverse chain
-    for (const bpe_hash_entry* entry = ht->buckets[bucket]; entry != NULL; entry = entry->next) {
-        if (entry->key == search_key) {
-            return entry->merged_id;
+    const uint64_t key = ((uint64_t)token_id1 << 32) | token_id2;
+    const __m256i needle = _mm256_set1_epi64x((long long)key);
+    const __m256i empty = _mm256_set1_epi64x(-1);
+    size_t g = (size_t)(hash_pair(token_id1, token_id2) & mask);
+    for (;;) {
+        const struct bpe_merge_group* grp = &groups[g];
+        const __m256i keys = _mm256_load_si256((const __m256i*)(const void*)grp->keys);
+        const int hit = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(keys, needle)));
+        if (hit != 0) {
+            const int i = __builtin_ctz((unsigned)hit);
+            *rank_out = grp->rank[i];
+            return grp->merged_id[i];
+        }
+        if (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(keys, empty))) != 0) {
+            return UINT32_MAX;
         }
+        g = (g + 1) & mask;
     }
-    
-    return UINT32_MAX;  // Not found
 }
 
-// Wrapper to lookup using tokenizer's hash table
+// Wrapper to lookup using tokenizer's merge table (v1 construída ou v2 mapeada)
+// Fallback O(m): tokenizers montados à mão (testes) não têm tabela
 static inline uint32_t lookup_merge_in_tokenizer(
     const q_tokenizer* restrict tok,
     uint32_t token_id1,
-    uint32_t token_id2
+    uint32_t token_id2,
+    uint32_t* restrict rank_out
 ) {
-    if (tok->merge_hash_table == NULL) {
-        return UINT32_MAX;
+    if (tok->merge_groups != NULL) {
+        return lookup_merge_groups(tok->merge_groups, tok->merge_groups_mask,
+                                   token_id1, token_id2, rank_out);
+    }
+    for (uint32_t i = 0; i < tok->num_merges; i++) {
+        if (tok->merges[i].token_id1 == token_id1 && tok->merges[i].token_id2 == token_id2) {
+            *rank_out = i;
+            return tok->merges[i].merged_id;
+        }
     }
-    return lookup_merge_hash((const bpe_hash_table*)tok->merge_hash_table, token_id1, token_id2);
+    return UINT32_MAX;
 }
 
-// Free hash table
+// Free merge table
 static void free_hash_table(bpe_hash_table* restrict ht) {
     if (ht == NULL) {
         return;
     }
+    free(ht->groups);
+    free(ht);
+}
+
+// ============================================================================
+// Word-level Encode Cache (LRU por conjunto, leitura lock-free)
+// ============================================================================
+// Pré-token (bytes) -> sequência de token IDs após merges. O resultado de uma
+// palavra só depende dos seus bytes, então prompts repetidos pulam os merges.
+//
+// Layout: BPE_CACHE_SETS conjuntos × BPE_CACHE_WAYS vias, entrada de 128 bytes.
+// Concorrência (tokenizer é compartilhado entre threads/workers):
+// - Leitura: seqlock por entrada (seq par = estável), sem locks nem escrita
+//   exceto o carimbo LRU; leitura rasgada é detectada e tratada como miss
+// - Escrita: CAS seq par -> ímpar; se outra thread está escrevendo, desiste
+//   (é só um cache). Todos os campos são atômicos relaxed (sem data race em C11)
+// - Evicção: via com carimbo mais antigo no conjunto (LRU aproximado)
+// ============================================================================
+
+#define BPE_CACHE_SETS        2048  // Potência de 2
+#define BPE_CACHE_WAYS        4     // 8192 entradas, 1MB
+#define BPE_CACHE_KEY_WORDS   4
+#define BPE_CACHE_MAX_KEY     (BPE_CACHE_KEY_WORDS * 8)  // Pré-tokens maiores não são cacheados
+#define BPE_CACHE_TOK_WORDS   8
+#define BPE_CACHE_MAX_TOKENS  (BPE_CACHE_TOK_WORDS * 2)
+
+typedef struct {
+    _Alignas(64) _Atomic uint32_t seq;           // Seqlock: ímpar = escrita em andamento
+    _Atomic uint32_t stamp;                      // Relógio do último acesso (LRU)
+    _Atomic uint64_t tag;                        // Hash da palavra (0 = vazia)
+    _Atomic uint64_t meta;                       // key_len | (n_tokens << 8)
+    _Atomic uint64_t key[BPE_CACHE_KEY_WORDS];   // Bytes da palavra (zero-padded)
+    _Atomic uint64_t tokens[BPE_CACHE_TOK_WORDS];// 2 token IDs por palavra
+} bpe_cache_entry;
+
+struct bpe_word_cache {
+    bpe_cache_entry* entries;                    // [BPE_CACHE_SETS * BPE_CACHE_WAYS]
+    _Alignas(64) _Atomic uint32_t clock;         // Incrementado a cada inserção
+    _Atomic uint32_t num_entries;
+    _Alignas(64) _Atomic uint64_t hits;          // Acumulados por segmento (não por palavra)
+    _Atomic uint64_t misses;
+    _Atomic uint64_t merges;                     // Merges aplicados (palavras fora do cache)
+    _Atomic uint64_t trie_words;                 // Palavras resolvidas pelo vocab trie
+    _Atomic uint64_t invalid_utf8;               // Textos com UTF-8 inválido
+};
+
+static struct bpe_word_cache* bpe_cache_create(void) {
+    struct bpe_word_cache* cache = (struct bpe_word_cache*)aligned_alloc(64, sizeof(*cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    const size_t bytes = (size_t)BPE_CACHE_SETS * BPE_CACHE_WAYS * sizeof(bpe_cache_entry);
+    cache->entries = (bpe_cache_entry*)aligned_alloc(64, bytes);
+    if (cache->entries == NULL) {
+        free(cache);
+        return NULL;
+    }
+    memset(cache->entries, 0, bytes);
+    atomic_init(&cache->clock, 0);
+    atomic_init(&cache->num_entries, 0);
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    atomic_init(&cache->merges, 0);
+    atomic_init(&cache->trie_words, 0);
+    return cache;
+}
+
+static void bpe_cache_destroy(struct bpe_word_cache* cache) {
+    if (cache == NULL) {
+        return;
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+// Chave empacotada em palavras de 64 bits: comparação e hash sem loop por byte
+static inline uint64_t bpe_cache_key(const char* word, size_t len, uint64_t key[BPE_CACHE_KEY_WORDS]) {
+    memset(key, 0, BPE_CACHE_KEY_WORDS * sizeof(uint64_t));
+    memcpy(key, word, len);
+    uint64_t h = (uint64_t)len * 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < BPE_CACHE_KEY_WORDS; i++) {
+        h = (h ^ key[i]) * 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    return h | 1;  // 0 reservado para "vazia"
+}
+
+static inline bpe_cache_entry* bpe_cache_set(struct bpe_word_cache* cache, uint64_t tag) {
+    return &cache->entries[((size_t)(tag >> 32) & (BPE_CACHE_SETS - 1)) * BPE_CACHE_WAYS];
+}
+
+// Returns número de tokens copiados para out (0 = miss)
+static size_t bpe_cache_lookup(
+    struct bpe_word_cache* cache,
+    uint64_t tag,
+    const uint64_t key[BPE_CACHE_KEY_WORDS],
+    size_t len,
+    uint32_t out[BPE_CACHE_MAX_TOKENS]
+) {
+    bpe_cache_entry* set = bpe_cache_set(cache, tag);
+    for (size_t w = 0; w < BPE_CACHE_WAYS; w++) {
+        bpe_cache_entry* e = &set[w];
+        if (atomic_load_explicit(&e->tag, memory_order_relaxed) != tag) {
+            continue;
+        }
+        const uint32_t seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+        if (seq & 1U) {
+            return 0;
+        }
+        const uint64_t entry_tag = atomic_load_explicit(&e->tag, memory_order_relaxed);
+        const uint64_t meta = atomic_load_explicit(&e->meta, memory_order_relaxed);
+        bool same = (entry_tag == tag) && (size_t)(meta & 0xFF) == len;
+        for (size_t i = 0; i < BPE_CACHE_KEY_WORDS; i++) {
+            same = same && atomic_load_explicit(&e->key[i], memory_order_relaxed) == key[i];
+        }
+        const size_t n = (size_t)((meta >> 8) & 0xFF);
+        for (size_t i = 0; i < BPE_CACHE_TOK_WORDS && 2 * i < n; i++) {
+            const uint64_t pair = atomic_load_explicit(&e->tokens[i], memory_order_relaxed);
+            out[2 * i] = (uint32_t)pair;
+            out[2 * i + 1] = (uint32_t)(pair >> 32);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) != seq) {
+            return 0;  // Escrita concorrente: trata como miss
+        }
+        if (!same) {
+            continue;  // Colisão de tag com outra palavra
+        }
+        const uint32_t now = atomic_load_explicit(&cache->clock, memory_order_relaxed);
+        if (atomic_load_explicit(&e->stamp, memory_order_relaxed) != now) {
+            atomic_store_explicit(&e->stamp, now, memory_order_relaxed);
+        }
+        return n;
+    }
+    return 0;
+}
+
+static void bpe_cache_insert(
+    struct bpe_word_cache* cache,
+    uint64_t tag,
+    const uint64_t key[BPE_CACHE_KEY_WORDS],
+    size_t len,
+    const uint32_t* tokens,
+    size_t n
+) {
+    bpe_cache_entry* set = bpe_cache_set(cache, tag);
+    const uint32_t now = atomic_fetch_add_explicit(&cache->clock, 1U, memory_order_relaxed) + 1U;
+    
+    // Vítima: via vazia, senão a de carimbo mais antigo (idade com wraparound)
+    bpe_cache_entry* victim = &set[0];
+    uint32_t oldest = 0;
+    for (size_t w = 0; w < BPE_CACHE_WAYS; w++) {
+        if (atomic_load_explicit(&set[w].tag, memory_order_relaxed) == 0) {
+            victim = &set[w];
+            break;
+        }
+        const uint32_t age = now - atomic_load_explicit(&set[w].stamp, memory_order_relaxed);
+        if (age >= oldest) {
+            oldest = age;
+            victim = &set[w];
+        }
+    }
+    
+    uint32_t seq = atomic_load_explicit(&victim->seq, memory_order_relaxed);
+    if ((seq & 1U) || !atomic_compare_exchange_strong_explicit(
+            &victim->seq, &seq, seq + 1U, memory_order_acquire, memory_order_relaxed)) {
+        return;  // Outra thread escrevendo nesta via
+    }
+    atomic_thread_fence(memory_order_release);
+    
+    if (atomic_load_explicit(&victim->tag, memory_order_relaxed) == 0) {
+        atomic_fetch_add_explicit(&cache->num_entries, 1U, memory_order_relaxed);
+    }
+    atomic_store_explicit(&victim->tag, tag, memory_order_relaxed);
+    atomic_store_explicit(&victim->meta, (uint64_t)len | ((uint64_t)n << 8), memory_order_relaxed);
+    for (size_t i = 0; i < BPE_CACHE_KEY_WORDS; i++) {
+        atomic_store_explicit(&victim->key[i], key[i], memory_order_relaxed);
+    }
+    for (size_t i = 0; 2 * i < n; i++) {
+        const uint64_t hi = (2 * i + 1 < n) ? tokens[2 * i + 1] : 0;
+        atomic_store_explicit(&victim->tokens[i], (uint64_t)tokens[2 * i] | (hi << 32),
+                              memory_order_relaxed);
+    }
+    atomic_store_explicit(&victim->stamp, now, memory_order_relaxed);
+    atomic_store_explicit(&victim->seq, seq + 2U, memory_order_release);
+}
+
+// ============================================================================
+// Vocab Trie (double-array): encode por longest-prefix com backtracking
+// ============================================================================
+// Em vez de partir dos bytes e aplicar ~n merges por palavra, percorre um trie
+// double-array dos tokens auto-consistentes (BPE dos próprios bytes devolve o
+// token) e pega o prefixo mais longo. Um token só é aceito se o par com o token
+// anterior é compatível com a ordem dos merges (nenhum merge cruzando a fronteira
+// dispararia antes); senão tenta o próximo prefixo mais curto e, esgotados,
+// recua (backtracking). A sequência aceita é exatamente a saída do BPE por rank
+// (mesma caracterização do encoder por backtracking do crate Rust `bpe`); na
+// prática quase não há recuos e nenhum merge é executado.
+//
+// Só construído para merges "canônicos" (senão o encode usa apenas merges):
+// - vocab_size >= 256 (byte b = token b)
+// - entradas de cada merge alcançável são criadas antes dele (ordem de rank)
+//   e cada token é criado por no máximo um merge
+// Rank de criação (rid): byte b -> b; token do merge r -> 256 + r
+// ============================================================================
+
+#define BPE_TRIE_NONE      UINT32_MAX
+#define BPE_TRIE_MAX_TOKEN 256   // Tokens maiores ficam fora do trie (palavras maiores: merges)
+#define BPE_TRIE_RID_BASE  256U
+
+// q_tokenizer.vocab_trie_state
+#define BPE_TRIE_ABSENT   0U  // Sem merges ou montado à mão: nunca constrói
+#define BPE_TRIE_PENDING  1U  // Load concluído; construção no primeiro encode
+#define BPE_TRIE_BUILDING 2U
+#define BPE_TRIE_READY    3U  // vocab_trie publicado (NULL: merges não canônicos ou sem memória)
+
+struct bpe_vocab_trie {
+    // Double-array: filho de s pelo byte c = base[s] + c + 1, se check[filho] == s
+    uint32_t* base;
+    uint32_t* check;        // BPE_TRIE_NONE = slot livre
+    uint32_t* value;        // Token terminal no nó (BPE_TRIE_NONE = nenhum)
+    size_t num_slots;
+    // Por token [vocab_size]
+    uint32_t* rid;          // Rank de criação; BPE_TRIE_NONE = inalcançável
+    uint32_t* left;         // Metades do merge que cria o token (byte: ele mesmo)
+    uint32_t* right;
+    uint32_t* len;          // Bytes do token
+    uint32_t* shorter;      // Maior token do trie que é prefixo próprio (BPE_TRIE_NONE = nenhum)
+};
+
+// Entrada de chave na construção (ordenada lexicograficamente)
+typedef struct {
+    const uint8_t* bytes;
+    uint32_t len;
+    uint32_t token;
+} bpe_trie_key;
+
+// Nó pendente na construção em largura: chaves [lo, hi) compartilham depth bytes
+typedef struct {
+    uint32_t node;
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t depth;
+} bpe_trie_pending;
+
+static void bpe_trie_destroy(struct bpe_vocab_trie* trie) {
+    if (trie == NULL) {
+        return;
+    }
+    free(trie->base);
+    free(trie->check);
+    free(trie->value);
+    free(trie->rid);
+    free(trie->left);
+    free(trie->right);
+    free(trie->len);
+    free(trie->shorter);
+    free(trie);
+}
+
+// Par (t1, t2) sobrevive ao BPE de bytes(t1) + bytes(t2)?
+// Desfaz merges a partir da fronteira (o token criado por último primeiro) e verifica
+// se algum par cruzando a fronteira teria rank menor que o instante em que deixa de
+// existir. limit: instante em que t1/t2 deixam de existir (UINT32_MAX = nunca).
+// Empate à esquerda (+1 no lado direito): mesmo critério do heap (posição menor primeiro)
+static bool bpe_trie_pair_valid(
+    const q_tokenizer* restrict tok,
+    const struct bpe_vocab_trie* restrict trie,
+    uint32_t t1,
+    uint32_t t2,
+    uint32_t limit
+) {
+    for (;;) {
+        uint32_t rank = 0;
+        if (lookup_merge_in_tokenizer(tok, t1, t2, &rank) != UINT32_MAX &&
+            rank + BPE_TRIE_RID_BASE < limit) {
+            return false;
+        }
+        const uint32_t r1 = trie->rid[t1];
+        const uint32_t r2 = trie->rid[t2];
+        if (r1 > r2) {
+            limit = r1;
+            t1 = trie->right[t1];
+            if (trie->rid[t1] == limit) {  // t1 é byte: desfaz t2
+                limit = r2 + 1;
+                t2 = trie->left[t2];
+                if (trie->rid[t2] + 1 == limit) {
+                    return true;
+                }
+            }
+        } else {
+            limit = r2 + 1;
+            t2 = trie->left[t2];
+            if (trie->rid[t2] + 1 == limit) {  // t2 é byte: desfaz t1
+                limit = r1;
+                t1 = trie->right[t1];
+                if (trie->rid[t1] == limit) {
+                    return true;
+                }
+            }
+        }
+    }
+}
+
+// Garante slots [0, n) no double-array (novos slots livres)
+static bool bpe_trie_grow(struct bpe_vocab_trie* restrict trie, size_t n) {
+    if (n <= trie->num_slots) {
+        return true;
+    }
+    size_t cap = (trie->num_slots < 1024) ? 1024 : trie->num_slots;
+    while (cap < n) {
+        cap *= 2;
+    }
+    uint32_t* base = (uint32_t*)realloc(trie->base, cap * sizeof(uint32_t));
+    if (base == NULL) {
+        return false;
+    }
+    trie->base = base;
+    uint32_t* check = (uint32_t*)realloc(trie->check, cap * sizeof(uint32_t));
+    if (check == NULL) {
+        return false;
+    }
+    trie->check = check;
+    uint32_t* value = (uint32_t*)realloc(trie->value, cap * sizeof(uint32_t));
+    if (value == NULL) {
+        return false;
+    }
+    trie->value = value;
+    for (size_t i = trie->num_slots; i < cap; i++) {
+        trie->base[i] = 0;
+        trie->check[i] = BPE_TRIE_NONE;
+        trie->value[i] = BPE_TRIE_NONE;
+    }
+    trie->num_slots = cap;
+    return true;
+}
+
+// Ranks de criação e decomposição de cada token; false se merges não canônicos
+static bool bpe_trie_assign_ranks(const q_tokenizer* restrict tok, struct bpe_vocab_trie* restrict trie) {
+    for (uint32_t t = 0; t < tok->vocab_size; t++) {
+        trie->rid[t] = BPE_TRIE_NONE;
+        trie->shorter[t] = BPE_TRIE_NONE;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        trie->rid[b] = b;
+        trie->left[b] = b;
+        trie->right[b] = b;
+        trie->len[b] = 1;
+    }
+    for (uint32_t r = 0; r < tok->num_merges; r++) {
+        const q_bpe_merge* m = &tok->merges[r];
+        if (trie->rid[m->token_id1] == BPE_TRIE_NONE || trie->rid[m->token_id2] == BPE_TRIE_NONE) {
+            continue;  // Entrada ainda não criada (verificado abaixo)
+        }
+        if (m->merged_id < 256 || trie->rid[m->merged_id] != BPE_TRIE_NONE) {
+            return false;  // Token criado por mais de um merge
+        }
+        const uint32_t len = trie->len[m->token_id1] + trie->len[m->token_id2];
+        trie->rid[m->merged_id] = BPE_TRIE_RID_BASE + r;
+        trie->left[m->merged_id] = m->token_id1;
+        trie->right[m->merged_id] = m->token_id2;
+        trie->len[m->merged_id] = (len > BPE_TRIE_MAX_TOKEN) ? BPE_TRIE_MAX_TOKEN + 1 : len;
+    }
+    // Merge cujas entradas só existem depois dele dispararia fora da ordem de criação
+    for (uint32_t r = 0; r < tok->num_merges; r++) {
+        const uint32_t r1 = trie->rid[tok->merges[r].token_id1];
+        const uint32_t r2 = trie->rid[tok->merges[r].token_id2];
+        if (r1 != BPE_TRIE_NONE && r2 != BPE_TRIE_NONE &&
+            (r1 >= BPE_TRIE_RID_BASE + r || r2 >= BPE_TRIE_RID_BASE + r)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Agrupa keys[lo, hi) pelo byte em depth (chave que termina em depth primeiro)
+// Partição estável por contagem (MSD radix): o trie inteiro sai sem ordenar as chaves
+static void bpe_trie_partition(
+    bpe_trie_key* restrict keys,
+    bpe_trie_key* restrict tmp,
+    uint32_t lo,
+    uint32_t hi,
+    uint32_t depth
+) {
+    // Faixas pequenas (maioria dos nós): insertion sort pelo byte em depth
+    if (hi - lo <= 32) {
+        for (uint32_t i = lo + 1; i < hi; i++) {
+            const bpe_trie_key key = keys[i];
+            const int c = (key.len == depth) ? -1 : key.bytes[depth];
+            uint32_t j = i;
+            while (j > lo && ((keys[j - 1].len == depth) ? -1 : keys[j - 1].bytes[depth]) > c) {
+                keys[j] = keys[j - 1];
+                j--;
+            }
+            keys[j] = key;
+        }
+        return;
+    }
+    uint32_t count[257] = {0};  // [0] = termina em depth, [c + 1] = byte c
+    for (uint32_t i = lo; i < hi; i++) {
+        count[(keys[i].len == depth) ? 0 : keys[i].bytes[depth] + 1U]++;
+    }
+    uint32_t sum = lo;
+    for (size_t c = 0; c < 257; c++) {
+        const uint32_t n = count[c];
+        count[c] = sum;
+        sum += n;
+    }
+    for (uint32_t i = lo; i < hi; i++) {
+        tmp[count[(keys[i].len == depth) ? 0 : keys[i].bytes[depth] + 1U]++] = keys[i];
+    }
+    memcpy(&keys[lo], &tmp[lo], (size_t)(hi - lo) * sizeof(bpe_trie_key));
+}
+
+// Monta o double-array (DFS com pilha explícita), agrupando as chaves nó a nó
+// Base de cada nó: first fit (menor base com todos os slots filhos livres)
+static bool bpe_trie_build_array(
+    struct bpe_vocab_trie* restrict trie,
+    bpe_trie_key* restrict keys,
+    uint32_t num_keys
+) {
+    size_t stack_cap = 1024;
+    size_t stack_size = 0;
+    bpe_trie_pending* stack = (bpe_trie_pending*)malloc(stack_cap * sizeof(bpe_trie_pending));
+    bpe_trie_key* tmp = (bpe_trie_key*)malloc(((size_t)num_keys + 1) * sizeof(bpe_trie_key));
+    if (stack == NULL || tmp == NULL || !bpe_trie_grow(trie, 1024)) {
+        free(stack);
+        free(tmp);
+        return false;
+    }
+    trie->check[0] = 0;  // Raiz ocupa o slot 0
+    stack[stack_size++] = (bpe_trie_pending){ 0, 0, num_keys, 0 };
+    size_t first_free = 1;
+    bool ok = true;
+    
+    while (ok && stack_size > 0) {
+        const bpe_trie_pending p = stack[--stack_size];
+        if (p.hi - p.lo > 1) {
+            bpe_trie_partition(keys, tmp, p.lo, p.hi, p.depth);
+        }
+        uint32_t lo = p.lo;
+        if (keys[lo].len == p.depth) {
+            trie->value[p.node] = keys[lo].token;  // Chave termina neste nó (duplicatas: a primeira)
+            while (lo < p.hi && keys[lo].len == p.depth) {
+                lo++;
+            }
+        }
+        if (lo == p.hi) {
+            continue;  // Folha: base = 0
+        }
+        
+        // Rótulos distintos no byte depth (grupos contíguos após a partição)
+        uint16_t labels[256];
+        size_t num_labels = 0;
+        for (uint32_t i = lo; i < p.hi; i++) {
+            const uint8_t c = keys[i].bytes[p.depth];
+            if (num_labels == 0 || labels[num_labels - 1] != c) {
+                labels[num_labels++] = c;
+            }
+        }
+        
+        while (first_free < trie->num_slots && trie->check[first_free] != BPE_TRIE_NONE) {
+            first_free++;
+        }
+        size_t b = (first_free > (size_t)labels[0] + 1) ? first_free - labels[0] - 1 : 0;
+        for (;; b++) {
+            if (b > UINT32_MAX - 512 || !bpe_trie_grow(trie, b + 257)) {
+                ok = false;
+                break;
+            }
+            size_t k = 0;
+            while (k < num_labels && trie->check[b + labels[k] + 1] == BPE_TRIE_NONE) {
+                k++;
+            }
+            if (k == num_labels) {
+                break;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+        trie->base[p.node] = (uint32_t)b;
+        
+        // Ocupa os slots filhos e empilha a faixa de chaves de cada um
+        if (stack_size + num_labels > stack_cap) {
+            while (stack_size + num_labels > stack_cap) {
+                stack_cap *= 2;
+            }
+            bpe_trie_pending* grown = (bpe_trie_pending*)realloc(stack, stack_cap * sizeof(bpe_trie_pending));
+            if (grown == NULL) {
+                ok = false;
+                break;
+            }
+            stack = grown;
+        }
+        uint32_t start = lo;
+        for (size_t k = 0; k < num_labels; k++) {
+            uint32_t end = start;
+            while (end < p.hi && keys[end].bytes[p.depth] == labels[k]) {
+                end++;
+            }
+            const size_t child = b + labels[k] + 1;
+            trie->check[child] = p.node;
+            stack[stack_size++] = (bpe_trie_pending){ (uint32_t)child, start, end, p.depth + 1 };
+            start = end;
+        }
+    }
+    free(stack);
+    free(tmp);
+    return ok;
+}
+
+// Longest-prefix de bytes[0..n) no trie: token ou BPE_TRIE_NONE
+static inline uint32_t bpe_trie_longest(
+    const struct bpe_vocab_trie* restrict trie,
+    const uint8_t* restrict bytes,
+    size_t n
+) {
+    uint32_t s = 0;
+    uint32_t best = BPE_TRIE_NONE;
+    for (size_t i = 0; i < n; i++) {
+        const size_t t = (size_t)trie->base[s] + bytes[i] + 1;
+        if (t >= trie->num_slots || trie->check[t] != s) {
+            break;
+        }
+        s = (uint32_t)t;
+        if (trie->value[s] != BPE_TRIE_NONE) {
+            best = trie->value[s];
+        }
+    }
+    return best;
+}
+
+// Constrói o trie a partir dos merges do tokenizer
+// Returns NULL se não aplicável (merges não canônicos) ou sem memória: encode usa merges
+static struct bpe_vocab_trie* bpe_trie_create(const q_tokenizer* restrict tok) {
+    if (tok->vocab_size < 256 || tok->num_merges == 0 || tok->merges == NULL) {
+        return NULL;
+    }
+    const size_t n = tok->vocab_size;
+    struct bpe_vocab_trie* trie = (struct bpe_vocab_trie*)calloc(1, sizeof(*trie));
+    if (trie == NULL) {
+        return NULL;
+    }
+    trie->rid = (uint32_t*)malloc(n * sizeof(uint32_t));
+    trie->left = (uint32_t*)malloc(n * sizeof(uint32_t));
+    trie->right = (uint32_t*)malloc(n * sizeof(uint32_t));
+    trie->len = (uint32_t*)malloc(n * sizeof(uint32_t));
+    trie->shorter = (uint32_t*)malloc(n * sizeof(uint32_t));
+    uint8_t* consistent = (uint8_t*)calloc(n, 1);
+    size_t* key_off = (size_t*)malloc(n * sizeof(size_t));
+    uint8_t* pool = NULL;
+    bpe_trie_key* keys = NULL;
+    bool ok = trie->rid != NULL && trie->left != NULL && trie->right != NULL &&
+              trie->len != NULL && trie->shorter != NULL && consistent != NULL &&
+              key_off != NULL && bpe_trie_assign_ranks(tok, trie);
+    
+    // Auto-consistência em ordem de rank: partes consistentes, o par (a, b) resolve
+    // para este merge e nada cruza a fronteira antes dele
+    size_t pool_size = 256;
+    uint32_t num_keys = 256;
+    if (ok) {
+        memset(consistent, 1, 256);
+        for (uint32_t r = 0; r < tok->num_merges; r++) {
+            const q_bpe_merge* m = &tok->merges[r];
+            if (trie->rid[m->merged_id] != BPE_TRIE_RID_BASE + r) {
+                continue;  // Merge inalcançável
+            }
+            uint32_t rank = 0;
+            if (consistent[m->token_id1] && consistent[m->token_id2] &&
+                lookup_merge_in_tokenizer(tok, m->token_id1, m->token_id2, &rank) == m->merged_id &&
+                rank == r &&
+                bpe_trie_pair_valid(tok, trie, m->token_id1, m->token_id2, BPE_TRIE_RID_BASE + r)) {
+                consistent[m->merged_id] = 1;
+                if (trie->len[m->merged_id] <= BPE_TRIE_MAX_TOKEN) {
+                    pool_size += trie->len[m->merged_id];
+                    num_keys++;
+                }
+            }
+        }
+        pool = (uint8_t*)malloc(pool_size);
+        keys = (bpe_trie_key*)malloc((size_t)num_keys * sizeof(bpe_trie_key));
+        ok = (pool != NULL && keys != NULL);
+    }
     
-    if (ht->buckets != NULL) {
-        for (size_t i = 0; i < ht->num_buckets; i++) {
-            bpe_hash_entry* entry = ht->buckets[i];
-            while (entry != NULL) {
-                bpe_hash_entry* next = entry->next;
-                free(entry);
-                entry = next;
+    // Bytes das chaves: byte b -> {b}; merge -> concatenação das partes
+    if (ok) {
+        uint32_t k = 0;
+        for (uint32_t b = 0; b < 256; b++) {
+            pool[b] = (uint8_t)b;
+            key_off[b] = b;
+            keys[k++] = (bpe_trie_key){ &pool[b], 1, b };
+        }
+        size_t used = 256;
+        for (uint32_t r = 0; r < tok->num_merges; r++) {
+            const q_bpe_merge* m = &tok->merges[r];
+            const uint32_t t = m->merged_id;
+            if (trie->rid[t] != BPE_TRIE_RID_BASE + r || !consistent[t] ||
+                trie->len[t] > BPE_TRIE_MAX_TOKEN) {
+                continue;
             }
+            const uint32_t len1 = trie->len[m->token_id1];
+            key_off[t] = used;
+            memcpy(&pool[used], &pool[key_off[m->token_id1]], len1);
+            memcpy(&pool[used + len1], &pool[key_off[m->token_id2]], trie->len[m->token_id2]);
+            keys[k++] = (bpe_trie_key){ &pool[used], trie->len[t], t };
+            used += trie->len[t];
         }
-        free(ht->buckets);
+        ok = bpe_trie_build_array(trie, keys, num_keys);
     }
     
-    free(ht);
+    // Próximo prefixo mais curto de cada token (candidato seguinte no backtracking)
+    if (ok) {
+        for (uint32_t k = 0; k < num_keys; k++) {
+            trie->shorter[keys[k].token] = bpe_trie_longest(trie, keys[k].bytes, keys[k].len - 1);
+        }
+    }
+    
+    free(consistent);
+    free(key_off);
+    free(pool);
+    free(keys);
+    if (!ok) {
+        bpe_trie_destroy(trie);
+        return NULL;
+    }
+    return trie;
+}
+
+// Constrói o trie no primeiro encode em vez do load (~27 ms no vocab Llama-3,
+// pagos mesmo por quem só decodifica). Uma thread constrói; encodes concorrentes
+// seguem pelos merges (mesma saída) até a publicação
+static void bpe_trie_ensure(q_tokenizer* restrict tok) {
+    uint32_t expected = BPE_TRIE_PENDING;
+    if (atomic_load_explicit(&tok->vocab_trie_state, memory_order_acquire) != BPE_TRIE_PENDING ||
+        !atomic_compare_exchange_strong_explicit(&tok->vocab_trie_state, &expected, BPE_TRIE_BUILDING,
+                                                 memory_order_acq_rel, memory_order_relaxed)) {
+        return;
+    }
+    atomic_store_explicit(&tok->vocab_trie, bpe_trie_create(tok), memory_order_release);
+    atomic_store_explicit(&tok->vocab_trie_state, BPE_TRIE_READY, memory_order_release);
 }
 
 // ============================================================================
@@ -276,6 +965,194 @@ static q_error_code read_u8(FILE* f, uint8_t* out) {
 
 // Load tokenizer from binary file
 // This function is kept from dummy_tokenizer.c (unchanged)
+// Alinha offset de seção do formato v2
+static inline size_t tokenizer_v2_align(size_t n) {
+    return (n + TOKENIZER_V2_ALIGN - 1) & ~(size_t)(TOKENIZER_V2_ALIGN - 1);
+}
+
+// Seção [off, off + size) dentro do arquivo e alinhada a `align`
+static inline bool tokenizer_v2_section_ok(size_t off, size_t size, size_t file_size, size_t align) {
+    return (off % align) == 0 && off >= TOKENIZER_V2_HEADER_SIZE &&
+           off <= file_size && size <= file_size - off;
+}
+
+// Refaz o probing de lookup_merge_groups a partir do grupo home da chave:
+// true se o lookup encontra exatamente o slot (g, i). Falso se outra cópia da
+// chave vem antes no probing (duplicata) ou se um slot vazio corta a cadeia
+// (chave inalcançável). Pré-condição: a tabela tem ao menos um slot vazio
+static bool merge_slot_reachable(
+    const struct bpe_merge_group* restrict groups,
+    size_t mask,
+    size_t g_slot,
+    uint32_t i_slot
+) {
+    const uint64_t key = groups[g_slot].keys[i_slot];
+    size_t g = (size_t)(hash_pair((uint32_t)(key >> 32), (uint32_t)key) & mask);
+    for (;;) {
+        bool has_empty = false;
+        for (uint32_t i = 0; i < BPE_GROUP_SLOTS; i++) {
+            if (groups[g].keys[i] == key) {
+                return g == g_slot && i == i_slot;  // Lookup retorna o primeiro match do grupo
+            }
+            has_empty = has_empty || (groups[g].keys[i] == BPE_SLOT_EMPTY);
+        }
+        if (has_empty) {
+            return false;
+        }
+        g = (g + 1) & mask;
+    }
+}
+
+// Valida o conteúdo mapeado (O(vocab + merges + slots × probe), sem alocação):
+// arquivo corrompido não pode causar leitura fora do mapeamento nem probing
+// infinito no hot path
+static q_error_code validate_tokenizer_v2(
+    const uint8_t* restrict base,
+    size_t file_size,
+    const uint32_t* restrict hdr
+) {
+    const uint32_t vocab_size = hdr[2];
+    const uint32_t num_merges = hdr[3];
+    const uint32_t table_slots = hdr[7];
+    const size_t index_off = hdr[8];
+    const size_t blob_off = hdr[9];
+    const size_t blob_size = hdr[10];
+    const size_t merges_off = hdr[11];
+    const size_t table_off = hdr[12];
+    
+    if (vocab_size == 0 || vocab_size > 1000000 || num_merges > 1000000) {
+        return Q_ERR_INVALID_SIZE;
+    }
+    // Tabela: grupos em potência de 2 com ao menos um slot vazio (probing termina)
+    const uint32_t num_groups = table_slots / BPE_GROUP_SLOTS;
+    if ((num_merges == 0) != (table_slots == 0) ||
+        (table_slots != 0 && (table_slots % BPE_GROUP_SLOTS != 0 ||
+                              (num_groups & (num_groups - 1)) != 0 || table_slots <= num_merges))) {
+        return Q_ERR_INVALID_SIZE;
+    }
+    if (!tokenizer_v2_section_ok(index_off, (size_t)vocab_size * 2 * sizeof(uint32_t), file_size, 4) ||
+        !tokenizer_v2_section_ok(blob_off, blob_size, file_size, 1) ||
+        !tokenizer_v2_section_ok(merges_off, (size_t)num_merges * sizeof(q_bpe_merge), file_size, 4) ||
+        !tokenizer_v2_section_ok(table_off, (size_t)num_groups * sizeof(struct bpe_merge_group),
+                                 file_size, TOKENIZER_V2_ALIGN)) {
+        return Q_ERR_FILE_TOO_SMALL;
+    }
+    
+    const uint32_t* index = (const uint32_t*)(const void*)(base + index_off);
+    const char* blob = (const char*)(base + blob_off);
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        const size_t off = index[2 * i];
+        const size_t len = index[2 * i + 1];
+        if (off >= blob_size || strnlen(blob + off, blob_size - off) != len || len == blob_size - off) {
+            return Q_ERR_INVALID_SIZE;
+        }
+    }
+    
+    const q_bpe_merge* merges = (const q_bpe_merge*)(const void*)(base + merges_off);
+    for (uint32_t i = 0; i < num_merges; i++) {
+        if (merges[i].token_id1 >= vocab_size || merges[i].token_id2 >= vocab_size ||
+            merges[i].merged_id >= vocab_size) {
+            return Q_ERR_INVALID_ARG;
+        }
+    }
+    
+    const struct bpe_merge_group* groups = (const struct bpe_merge_group*)(const void*)(base + table_off);
+    // table_slots > num_merges não basta: slots podem ser cópias de uma mesma regra.
+    // Sem slot vazio, lookup de par ausente nunca terminaria
+    size_t empty_slots = 0;
+    for (uint32_t g = 0; g < num_groups; g++) {
+        for (uint32_t i = 0; i < BPE_GROUP_SLOTS; i++) {
+            empty_slots += (groups[g].keys[i] == BPE_SLOT_EMPTY);
+        }
+    }
+    if (num_groups != 0 && empty_slots == 0) {
+        return Q_ERR_INVALID_ARG;
+    }
+    for (uint32_t g = 0; g < num_groups; g++) {
+        for (uint32_t i = 0; i < BPE_GROUP_SLOTS; i++) {
+            if (groups[g].keys[i] == BPE_SLOT_EMPTY) {
+                continue;
+            }
+            const uint32_t r = groups[g].rank[i];
+            if (r >= num_merges || groups[g].merged_id[i] != merges[r].merged_id ||
+                groups[g].keys[i] != (((uint64_t)merges[r].token_id1 << 32) | merges[r].token_id2) ||
+                !merge_slot_reachable(groups, num_groups - 1, g, i)) {
+                return Q_ERR_INVALID_ARG;
+            }
+        }
+    }
+    return Q_OK;
+}
+
+// Load v2: mmap read-only, strings/merges/tabela usados in-place
+// Única alocação: array de ponteiros vocab (compatibilidade com tok->vocab[i])
+static q_error_code load_tokenizer_v2(q_tokenizer* restrict tok, const char* tokenizer_path) {
+    int fd = open(tokenizer_path, O_RDONLY);
+    if (fd < 0) {
+        return Q_ERR_FILE_OPEN;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return Q_ERR_FILE_STAT;
+    }
+    const size_t file_size = (size_t)st.st_size;
+    if (file_size < TOKENIZER_V2_HEADER_SIZE) {
+        close(fd);
+        return Q_ERR_FILE_TOO_SMALL;
+    }
+    void* map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return Q_ERR_MMAP_FAILED;
+    }
+    #if defined(__linux__) || defined(__FreeBSD__)
+    madvise(map, file_size, MADV_WILLNEED);
+    #endif
+    
+    const uint8_t* base = (const uint8_t*)map;
+    uint32_t hdr[TOKENIZER_V2_HEADER_SIZE / sizeof(uint32_t)];
+    memcpy(hdr, base, sizeof(hdr));
+    q_error_code err = (hdr[0] != TOKENIZER_MAGIC) ? Q_ERR_INVALID_MAGIC :
+                       (hdr[1] != TOKENIZER_VERSION_V2) ? Q_ERR_INVALID_ARG :
+                       validate_tokenizer_v2(base, file_size, hdr);
+    if (err != Q_OK) {
+        munmap(map, file_size);
+        return err;
+    }
+    
+    tok->vocab_size = hdr[2];
+    tok->num_merges = hdr[3];
+    tok->bos_token_id = hdr[4];
+    tok->eos_token_id = hdr[5];
+    tok->pad_token_id = hdr[6];
+    tok->vocab = (char**)malloc((size_t)tok->vocab_size * sizeof(char*));
+    if (tok->vocab == NULL) {
+        munmap(map, file_size);
+        memset(tok, 0, sizeof(q_tokenizer));
+        return Q_ERR_ALLOC_FAILED;
+    }
+    
+    const uint32_t* index = (const uint32_t*)(const void*)(base + hdr[8]);
+    char* blob = (char*)map + hdr[9];  // PROT_READ: ponteiros não-const só por compatibilidade
+    for (uint32_t i = 0; i < tok->vocab_size; i++) {
+        tok->vocab[i] = blob + index[2 * i];
+    }
+    tok->vocab_index = index;
+    if (tok->num_merges > 0) {
+        tok->merges = (q_bpe_merge*)(void*)((char*)map + hdr[11]);
+        tok->merge_groups = (const struct bpe_merge_group*)(const void*)(base + hdr[12]);
+        tok->merge_groups_mask = hdr[7] / BPE_GROUP_SLOTS - 1;
+        tok->word_cache = bpe_cache_create();  // Opcional (NULL = sem cache)
+        atomic_store_explicit(&tok->vocab_trie_state, BPE_TRIE_PENDING, memory_order_relaxed);
+    }
+    tok->mapped = map;
+    tok->mapped_size = file_size;
+    tok->initialized = true;
+    return Q_OK;
+}
+
+// Load tokenizer: v1 (parse sequencial) ou v2 (mmap zero-parse)
 q_error_code q_tokenizer_load(q_tokenizer* restrict tok, const char* tokenizer_path) {
     Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
     Q_VALIDATE_PTR_OR_RETURN(tokenizer_path, Q_ERR_INVALID_ARG);
@@ -298,6 +1175,10 @@ q_error_code q_tokenizer_load(q_tokenizer* restrict tok, const char* tokenizer_p
     
     uint32_t version;
     err = read_u32(f, &version);
+    if (err == Q_OK && version == TOKENIZER_VERSION_V2) {
+        fclose(f);
+        return load_tokenizer_v2(tok, tokenizer_path);
+    }
     if (err != Q_OK || version != TOKENIZER_VERSION) {
         fclose(f);
         return (err != Q_OK) ? err : Q_ERR_INVALID_ARG;
@@ -472,12 +1353,32 @@ q_error_code q_tokenizer_load(q_tokenizer* restrict tok, const char* tokenizer_p
             fclose(f);
             return err_hash;
         }
+        
+        // Encode cache: opcional (falha de alocação só desativa o cache)
+        tok->word_cache = bpe_cache_create();
+        #ifdef DEBUG
+        if (tok->word_cache == NULL) {
+            fprintf(stderr, "WARNING: q_tokenizer_load: encode cache disabled (allocation failed)\n");
+        }
+        #endif
+        
+        // Vocab trie: construído no primeiro encode (bpe_trie_ensure)
+        atomic_store_explicit(&tok->vocab_trie_state, BPE_TRIE_PENDING, memory_order_relaxed);
     } else {
-        // No merges, hash table is NULL
+        // No merges, hash table is NULL (and nothing to cache)
         tok->merge_hash_table = NULL;
+        tok->word_cache = NULL;
     }
     
-    if (fclose(f) != 0) {
+    // Tabela de comprimentos (decode sem strlen): opcional, como o encode cache
+    tok->token_lens = (uint32_t*)malloc((size_t)tok->vocab_size * sizeof(uint32_t));
+    if (tok->token_lens != NULL) {
+        for (uint32_t i = 0; i < tok->vocab_size; i++) {
+            tok->token_lens[i] = (uint32_t)strlen(tok->vocab[i]);
+        }
+    }
+    
+    if (fclose(f) != 0) {
         #ifdef DEBUG
         fprintf(stderr, "WARNING: q_tokenizer_load: fclose() failed, but data already loaded\n");
         #endif
@@ -486,162 +1387,304 @@ q_error_code q_tokenizer_load(q_tokenizer* restrict tok, const char* tokenizer_p
     return Q_OK;
 }
 
-// Helper: Split text into bytes (UTF-8 aware, but simplified for v1.0)
-// For v1.0, we treat each byte as a separate unit
-// Future: Implement proper UTF-8 decoding and regex splitting
-static q_error_code split_text_to_bytes(
-    const char* restrict text,
-    uint8_t* restrict bytes_out,
-    size_t* restrict num_bytes_out,
-    size_t max_bytes
-) {
-    Q_VALIDATE_PTR_OR_RETURN(text, Q_ERR_INVALID_ARG);
-    Q_VALIDATE_PTR_OR_RETURN(bytes_out, Q_ERR_INVALID_ARG);
-    Q_VALIDATE_PTR_OR_RETURN(num_bytes_out, Q_ERR_INVALID_ARG);
+// Save tokenizer in v2 format (ver layout no topo do arquivo)
+// Tabela de merges: grupos de 4, load factor <= 0.5, par duplicado mantém o menor rank
+q_error_code q_tokenizer_save(const q_tokenizer* restrict tok, const char* path) {
+    Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(path, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(tok->initialized && tok->vocab != NULL, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(tok->num_merges == 0 || tok->merges != NULL, Q_ERR_INVALID_ARG);
     
-    size_t text_len = strlen(text);
-    if (text_len > max_bytes) {
-        return Q_ERR_ARENA_OOM;
+    const uint32_t vocab_size = tok->vocab_size;
+    const uint32_t num_merges = tok->num_merges;
+    const size_t num_groups = (num_merges > 0) ? merge_table_groups(num_merges) : 0;
+    const size_t table_slots = num_groups * BPE_GROUP_SLOTS;
+    
+    size_t blob_size = 0;
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        if (tok->vocab[i] == NULL) {
+            return Q_ERR_INVALID_ARG;
+        }
+        blob_size += strlen(tok->vocab[i]) + 1;
+    }
+    const size_t index_off = TOKENIZER_V2_HEADER_SIZE;
+    const size_t blob_off = tokenizer_v2_align(index_off + (size_t)vocab_size * 2 * sizeof(uint32_t));
+    const size_t merges_off = tokenizer_v2_align(blob_off + blob_size);
+    const size_t table_off = tokenizer_v2_align(merges_off + (size_t)num_merges * sizeof(q_bpe_merge));
+    const size_t file_size = table_off + num_groups * sizeof(struct bpe_merge_group);
+    if (file_size > UINT32_MAX) {
+        return Q_ERR_OVERFLOW;
     }
     
-    // Simple byte-by-byte copy (UTF-8 handling deferred to future version)
-    for (size_t i = 0; i < text_len; i++) {
-        bytes_out[i] = (uint8_t)text[i];
+    uint8_t* out = (uint8_t*)calloc(1, file_size);
+    if (out == NULL) {
+        return Q_ERR_ALLOC_FAILED;
+    }
+    const uint32_t hdr[TOKENIZER_V2_HEADER_SIZE / sizeof(uint32_t)] = {
+        TOKENIZER_MAGIC, TOKENIZER_VERSION_V2, vocab_size, num_merges,
+        tok->bos_token_id, tok->eos_token_id, tok->pad_token_id, (uint32_t)table_slots,
+        (uint32_t)index_off, (uint32_t)blob_off, (uint32_t)blob_size, (uint32_t)merges_off,
+        (uint32_t)table_off, 0, 0, 0,
+    };
+    memcpy(out, hdr, sizeof(hdr));
+    
+    size_t blob_pos = 0;
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        const uint32_t len = (uint32_t)strlen(tok->vocab[i]);
+        const uint32_t entry[2] = { (uint32_t)blob_pos, len };
+        memcpy(out + index_off + (size_t)i * sizeof(entry), entry, sizeof(entry));
+        memcpy(out + blob_off + blob_pos, tok->vocab[i], (size_t)len + 1);
+        blob_pos += (size_t)len + 1;
+    }
+    
+    if (num_merges > 0) {
+        memcpy(out + merges_off, tok->merges, (size_t)num_merges * sizeof(q_bpe_merge));
+        struct bpe_merge_group* groups = (struct bpe_merge_group*)(void*)(out + table_off);
+        memset(groups, 0xFF, num_groups * sizeof(struct bpe_merge_group));  // keys = BPE_SLOT_EMPTY
+        fill_merge_groups(tok->merges, num_merges, groups, num_groups);
     }
     
-    *num_bytes_out = text_len;
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        free(out);
+        return Q_ERR_FILE_OPEN;
+    }
+    const bool ok = fwrite(out, 1, file_size, f) == file_size;
+    free(out);
+    if (fclose(f) != 0 || !ok) {
+        return Q_ERR_FILE_WRITE;
+    }
     return Q_OK;
 }
 
-// Helper: Convert bytes to base token IDs
-// Each byte value becomes a token ID (if < vocab_size)
-static q_error_code bytes_to_token_ids(
+// Front-end: byte i → token base (valor do byte; PAD se >= vocab_size)
+// Vocab byte-level (>= 256): identidade, 32 bytes por passo (vpmovzxbd → 4 × 8 ids)
+static void bpe_map_bytes(
     const q_tokenizer* restrict tok,
     const uint8_t* restrict bytes,
-    size_t num_bytes,
-    uint32_t* restrict token_ids_out,
-    size_t* restrict num_tokens_out,
-    size_t max_tokens
+    size_t len,
+    uint32_t* restrict ids
 ) {
-    Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
-    Q_VALIDATE_PTR_OR_RETURN(bytes, Q_ERR_INVALID_ARG);
-    Q_VALIDATE_PTR_OR_RETURN(token_ids_out, Q_ERR_INVALID_ARG);
-    Q_VALIDATE_PTR_OR_RETURN(num_tokens_out, Q_ERR_INVALID_ARG);
-    
-    if (num_bytes > max_tokens) {
-        return Q_ERR_ARENA_OOM;
-    }
-    
-    for (size_t i = 0; i < num_bytes; i++) {
-        uint8_t byte_val = bytes[i];
-        // Map byte to token ID (byte value = token ID if < vocab_size)
-        if (byte_val < tok->vocab_size) {
-            token_ids_out[i] = byte_val;
-        } else {
-            // Fallback: use pad token for invalid bytes
-            token_ids_out[i] = tok->pad_token_id;
+    size_t i = 0;
+    if (tok->vocab_size >= 256) {
+        for (; i + 32 <= len; i += 32) {
+            const __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(bytes + i));
+            const __m128i lo = _mm256_castsi256_si128(v);
+            const __m128i hi = _mm256_extracti128_si256(v, 1);
+            _mm256_storeu_si256((__m256i*)(void*)(ids + i), _mm256_cvtepu8_epi32(lo));
+            _mm256_storeu_si256((__m256i*)(void*)(ids + i + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+            _mm256_storeu_si256((__m256i*)(void*)(ids + i + 16), _mm256_cvtepu8_epi32(hi));
+            _mm256_storeu_si256((__m256i*)(void*)(ids + i + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
         }
     }
-    
-    *num_tokens_out = num_bytes;
+    for (; i < len; i++) {
+        ids[i] = (bytes[i] < tok->vocab_size) ? bytes[i] : tok->pad_token_id;
+    }
+}
+
+// Texto de entrada com UTF-8 inválido: codificado byte a byte (fallback), contado nas stats
+static void bpe_check_utf8(const q_tokenizer* restrict tok, const char* restrict text, size_t len) {
+    if (tok->word_cache != NULL && !q_utf8_validate(text, len)) {
+        atomic_fetch_add_explicit(&tok->word_cache->invalid_utf8, 1, memory_order_relaxed);
+    }
+}
+
+// Buffers do merge engine, reutilizados entre pré-tokens (um por thread)
+typedef struct {
+    uint32_t* prev;
+    uint32_t* next;
+    uint64_t* heap;
+    size_t capacity;   // Tokens suportados (heap tem 3 × capacity)
+    uint64_t cache_hits;    // Contadores locais, publicados uma vez por segmento
+    uint64_t cache_misses;
+    uint64_t merges;        // Merges aplicados pelo heap
+    uint64_t trie_words;    // Palavras resolvidas pelo vocab trie (sem merges)
+} bpe_scratch;
+
+static void bpe_scratch_free(bpe_scratch* restrict scratch) {
+    free(scratch->prev);
+    free(scratch->next);
+    free(scratch->heap);
+    memset(scratch, 0, sizeof(*scratch));
+}
+
+// Garante capacidade para n tokens (cresce geometricamente)
+static q_error_code bpe_scratch_reserve(bpe_scratch* restrict scratch, size_t n) {
+    if (n <= scratch->capacity) {
+        return Q_OK;
+    }
+    size_t cap = (scratch->capacity < 64) ? 64 : scratch->capacity;
+    while (cap < n) {
+        cap *= 2;
+    }
+    if (cap > SIZE_MAX / (3 * sizeof(uint64_t))) {
+        return Q_ERR_OVERFLOW;
+    }
+    bpe_scratch_free(scratch);
+    scratch->prev = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    scratch->next = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    scratch->heap = (uint64_t*)malloc(3 * cap * sizeof(uint64_t));
+    if (scratch->prev == NULL || scratch->next == NULL || scratch->heap == NULL) {
+        bpe_scratch_free(scratch);
+        return Q_ERR_ALLOC_FAILED;
+    }
+    scratch->capacity = cap;
     return Q_OK;
 }
 
-// Helper: Apply BPE merges greedily
-// Algorithm: Iterate through merges in priority order, apply all applicable merges
-// Continue until no more merges can be applied
-// OPTIMIZAÇÃO CRÍTICA: Soft-Delete elimina memmove O(n) → O(m × n³) reduzido para O(m × n)
+// Candidato a merge na heap: uint64 (rank << 32) | left
+// - Menor rank primeiro; empate: posição mais à esquerda
+// - IDs do par vêm de tok->merges[rank] (rank = índice da regra): entrada de 8 bytes
+// - Entradas ficam obsoletas quando o par muda; validadas no pop (lazy deletion)
+#define BPE_NO_NEIGHBOR UINT32_MAX
+
+static inline void bpe_heap_sift_down(uint64_t* restrict heap, size_t n, size_t i) {
+    const uint64_t item = heap[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && heap[child + 1] < heap[child]) {
+            child++;
+        }
+        if (item <= heap[child]) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = item;
+}
+
+static inline void bpe_heap_push(uint64_t* restrict heap, size_t* restrict size, uint64_t item) {
+    size_t i = (*size)++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (heap[parent] <= item) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = item;
+}
+
+static inline uint64_t bpe_heap_pop(uint64_t* restrict heap, size_t* restrict size) {
+    const uint64_t top = heap[0];
+    const size_t n = --(*size);
+    if (n > 0) {
+        heap[0] = heap[n];
+        bpe_heap_sift_down(heap, n, 0);
+    }
+    return top;
+}
+
+// Chave de heap para o par (left, right), ou UINT64_MAX se não há regra
+static inline uint64_t bpe_pair_key(
+    const q_tokenizer* restrict tok,
+    const uint32_t* restrict token_ids,
+    uint32_t left,
+    uint32_t right
+) {
+    uint32_t rank = 0;
+    if (lookup_merge_in_tokenizer(tok, token_ids[left], token_ids[right], &rank) == UINT32_MAX) {
+        return UINT64_MAX;
+    }
+    return ((uint64_t)rank << 32) | left;
+}
+
+// Helper: Apply BPE merges in rank order
+// Algorithm: Min-heap de pares adjacentes ordenados por rank + lista duplamente ligada
+// - Pop do par de menor rank (empate: mais à esquerda), merge, re-enfileira vizinhos
+// - Entradas obsoletas descartadas no pop (IDs/adjacência não conferem)
+// Time Complexity: O(n log n) - cada merge remove 1 token e gera ≤ 2 pushes
+// Space Complexity: O(n) - prev/next + heap (≤ 3n entradas de 8 bytes) em scratch
+// Substitui o rescan O(merges × n) por passada; soft-delete mantido para compactação final
 static q_error_code apply_bpe_merges(
     const q_tokenizer* restrict tok,
     uint32_t* restrict token_ids,
     size_t* restrict num_tokens,
-    size_t max_tokens __attribute__((unused))
+    bpe_scratch* restrict scratch
 ) {
     Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
     Q_VALIDATE_PTR_OR_RETURN(token_ids, Q_ERR_INVALID_ARG);
     Q_VALIDATE_PTR_OR_RETURN(num_tokens, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(scratch, Q_ERR_INVALID_ARG);
     
     // Early return if no merges
-    if (tok->num_merges == 0 || *num_tokens < 2) {
+    const size_t n = *num_tokens;
+    if (tok->num_merges == 0 || n < 2) {
         return Q_OK;
     }
+    if (n >= BPE_NO_NEIGHBOR / 3) {
+        return Q_ERR_OVERFLOW;
+    }
     
-    bool changed = true;
-    size_t deleted_count = 0;
-    const size_t COMPACT_THRESHOLD = (*num_tokens) / 2;
+    // Lista duplamente ligada sobre as posições
+    // Heap: n-1 pares iniciais + ≤ 2 pushes por merge (≤ n-1 merges)
+    q_error_code err = bpe_scratch_reserve(scratch, n);
+    if (err != Q_OK) {
+        return err;
+    }
+    uint32_t* restrict prev = scratch->prev;
+    uint32_t* restrict next = scratch->next;
+    uint64_t* restrict heap = scratch->heap;
+    
+    size_t heap_size = 0;
+    for (size_t i = 0; i < n; i++) {
+        prev[i] = (i == 0) ? BPE_NO_NEIGHBOR : (uint32_t)(i - 1);
+        next[i] = (i + 1 == n) ? BPE_NO_NEIGHBOR : (uint32_t)(i + 1);
+        if (i + 1 < n) {
+            uint64_t key = bpe_pair_key(tok, token_ids, (uint32_t)i, (uint32_t)(i + 1));
+            if (key != UINT64_MAX) {
+                heap[heap_size++] = key;
+            }
+        }
+    }
+    // Heapify de Floyd: O(n) em vez de n pushes O(log n)
+    for (size_t i = heap_size / 2; i-- > 0;) {
+        bpe_heap_sift_down(heap, heap_size, i);
+    }
     
-    // Iterate while merges are being applied
-    while (changed) {
-        changed = false;
+    while (heap_size > 0) {
+        const uint64_t key = bpe_heap_pop(heap, &heap_size);
+        const uint32_t left = (uint32_t)(key & 0xFFFFFFFFU);
+        const q_bpe_merge* rule = &tok->merges[key >> 32];
+        const uint32_t right = next[left];
         
-        // For each merge rule in priority order (index = priority)
-        for (uint32_t i = 0; i < tok->num_merges; i++) {
-            uint32_t id1 = tok->merges[i].token_id1;
-            uint32_t id2 = tok->merges[i].token_id2;
-            uint32_t merged;
-            
-            // OPTIMIZATION: Use hash table for O(1) lookup if available
-            // Fallback to direct access if hash table not built (for tests)
-            if (tok->merge_hash_table != NULL) {
-                merged = lookup_merge_in_tokenizer(tok, id1, id2);
-                if (merged == UINT32_MAX) {
-                    // Hash table lookup failed, use direct access (defensive)
-                    merged = tok->merges[i].merged_id;
-                }
-            } else {
-                // Fallback: Direct access (for compatibility with tests)
-                merged = tok->merges[i].merged_id;
-            }
-            
-            // Find all adjacent pairs (id1, id2) in token list
-            // OPTIMIZAÇÃO CRÍTICA: Pular tokens mortos (Q_TOKEN_DELETED) em O(1)
-            // Elimina necessidade de memmove, reduzindo complexidade de O(m × n³) para O(m × n)
-            for (size_t j = 0; j < *num_tokens; j++) {
-                // Pular tokens mortos
-                if (token_ids[j] == Q_TOKEN_DELETED) {
-                    continue;
-                }
-                
-                // Encontrar próximo token vivo
-                size_t next = j + 1;
-                while (next < *num_tokens && token_ids[next] == Q_TOKEN_DELETED) {
-                    next++;
-                }
-                if (next >= *num_tokens) {
-                    break;  // Não há mais tokens para verificar
-                }
-                
-                // Verificar merge
-                if (token_ids[j] == id1 && token_ids[next] == id2) {
-                    // Apply merge: replace pair with merged_id
-                    token_ids[j] = merged;
-                    token_ids[next] = Q_TOKEN_DELETED;  // Marcar como morto (soft-delete)
-                    deleted_count++;
-                    changed = true;
-                    // NOTA: NÃO fazemos j-- ou recuo. O loop continua.
-                    // A natureza iterativa do 'while(changed)' pega o novo token na próxima passada.
-                }
-            }
+        // Par ainda adjacente e com os mesmos IDs? (senão: entrada obsoleta)
+        if (right == BPE_NO_NEIGHBOR || token_ids[left] != rule->token_id1 ||
+            token_ids[right] != rule->token_id2) {
+            continue;
         }
         
-        // Lazy Compaction: Só paga o preço do O(n) se valer a pena (densidade de buracos > 50%)
-        // Isso reduz overhead de compactação de O(n) por iteração para O(n) apenas quando necessário
-        if (deleted_count > COMPACT_THRESHOLD) {
-            size_t write_idx = 0;
-            for (size_t i = 0; i < *num_tokens; i++) {
-                if (token_ids[i] != Q_TOKEN_DELETED) {
-                    token_ids[write_idx++] = token_ids[i];
-                }
-            }
-            *num_tokens = write_idx;
-            deleted_count = 0;
+        // Merge: left absorve right (soft-delete de right)
+        scratch->merges++;
+        token_ids[left] = rule->merged_id;
+        token_ids[right] = Q_TOKEN_DELETED;
+        const uint32_t after = next[right];
+        next[left] = after;
+        if (after != BPE_NO_NEIGHBOR) {
+            prev[after] = left;
+        }
+        
+        // Novos pares com os vizinhos
+        const uint32_t before = prev[left];
+        if (before != BPE_NO_NEIGHBOR) {
+            uint64_t k = bpe_pair_key(tok, token_ids, before, left);
+            if (k != UINT64_MAX) bpe_heap_push(heap, &heap_size, k);
+        }
+        if (after != BPE_NO_NEIGHBOR) {
+            uint64_t k = bpe_pair_key(tok, token_ids, left, after);
+            if (k != UINT64_MAX) bpe_heap_push(heap, &heap_size, k);
         }
     }
     
     // Compactação Final Obrigatória: Remove todos os tokens mortos antes de retornar
     // Garante que o array de saída contém apenas tokens válidos
     size_t write_idx = 0;
-    for (size_t i = 0; i < *num_tokens; i++) {
+    for (size_t i = 0; i < n; i++) {
         if (token_ids[i] != Q_TOKEN_DELETED) {
             token_ids[write_idx++] = token_ids[i];
         }
@@ -651,6 +1694,259 @@ static q_error_code apply_bpe_merges(
     return Q_OK;
 }
 
+// Publica contadores de cache do segmento (um atomic add por segmento, não por palavra)
+static void bpe_cache_publish(struct bpe_word_cache* cache, const bpe_scratch* restrict scratch) {
+    if (cache == NULL) {
+        return;
+    }
+    if (scratch->cache_hits > 0) {
+        atomic_fetch_add_explicit(&cache->hits, scratch->cache_hits, memory_order_relaxed);
+    }
+    if (scratch->cache_misses > 0) {
+        atomic_fetch_add_explicit(&cache->misses, scratch->cache_misses, memory_order_relaxed);
+    }
+    if (scratch->merges > 0) {
+        atomic_fetch_add_explicit(&cache->merges, scratch->merges, memory_order_relaxed);
+    }
+    if (scratch->trie_words > 0) {
+        atomic_fetch_add_explicit(&cache->trie_words, scratch->trie_words, memory_order_relaxed);
+    }
+}
+
+// Encode de uma palavra (bytes = token base) pelo trie
+// prev do scratch guarda os tokens aceitos, next marca posições sem continuação válida
+// Returns false se a palavra deve seguir pelos merges (não cabe no trie / sem memória)
+static bool bpe_trie_encode_word(
+    const q_tokenizer* restrict tok,
+    const struct bpe_vocab_trie* restrict trie,
+    const uint8_t* restrict bytes,
+    uint32_t* restrict token_ids,
+    size_t* restrict num_tokens,
+    bpe_scratch* restrict scratch
+) {
+    const size_t n = *num_tokens;
+    if (n > BPE_TRIE_MAX_TOKEN || bpe_scratch_reserve(scratch, n + 1) != Q_OK) {
+        return false;
+    }
+    uint32_t* restrict out = scratch->prev;
+    uint32_t* restrict dead = scratch->next;
+    memset(dead, 0, (n + 1) * sizeof(uint32_t));
+    
+    size_t count = 0;
+    size_t pos = 0;
+    uint32_t next = bpe_trie_longest(trie, bytes, n);
+    while (pos < n) {
+        uint32_t token = next;
+        const uint32_t last = (count > 0) ? out[count - 1] : BPE_TRIE_NONE;
+        for (;;) {
+            const size_t end = pos + trie->len[token];
+            if (!dead[end] && (last == BPE_TRIE_NONE ||
+                               bpe_trie_pair_valid(tok, trie, last, token, UINT32_MAX))) {
+                out[count++] = token;
+                pos = end;
+                next = bpe_trie_longest(trie, bytes + pos, n - pos);
+                break;
+            }
+            if (trie->shorter[token] != BPE_TRIE_NONE) {
+                token = trie->shorter[token];
+                continue;
+            }
+            // Nenhum candidato a partir de pos: recua um token
+            if (count == 0) {
+                return false;
+            }
+            dead[pos] = 1;
+            count--;
+            pos -= trie->len[last];
+            next = last;
+            break;
+        }
+    }
+    memcpy(token_ids, out, count * sizeof(uint32_t));
+    *num_tokens = count;
+    scratch->trie_words++;
+    return true;
+}
+
+// Merges de uma palavra: trie (longest-prefix) quando disponível, senão heap de merges
+static inline q_error_code bpe_encode_word(
+    const q_tokenizer* restrict tok,
+    const char* restrict word,
+    uint32_t* restrict token_ids,
+    size_t* restrict num_tokens,
+    bpe_scratch* restrict scratch
+) {
+    const struct bpe_vocab_trie* trie = atomic_load_explicit(&tok->vocab_trie, memory_order_acquire);
+    if (trie != NULL && bpe_trie_encode_word(tok, trie, (const uint8_t*)word, token_ids, num_tokens, scratch)) {
+        return Q_OK;
+    }
+    return apply_bpe_merges(tok, token_ids, num_tokens, scratch);
+}
+
+// Aplica BPE a cada pré-token de text[seg_start, seg_end) independentemente
+// Pré-tokens curtos passam pelo encode cache (hit: copia tokens, sem merges)
+// token_ids[i] = token base do byte i; resultado compactado a partir de seg_start
+// text_len é o tamanho total (lookahead do pré-tokenizer pode olhar além do segmento)
+static q_error_code bpe_encode_segment(
+    const q_tokenizer* restrict tok,
+    const char* restrict text,
+    size_t text_len,
+    uint32_t* restrict token_ids,
+    size_t seg_start,
+    size_t seg_end,
+    size_t* restrict num_out,
+    bpe_scratch* restrict scratch
+) {
+    struct bpe_word_cache* cache = tok->word_cache;
+    size_t write = seg_start;
+    size_t pos = seg_start;
+    while (pos < seg_end) {
+        const size_t end = q_pretokenize_next(text, text_len, pos);
+        size_t n = end - pos;
+        if (n >= 2 && cache != NULL && n <= BPE_CACHE_MAX_KEY) {
+            uint64_t key[BPE_CACHE_KEY_WORDS];
+            uint32_t cached[BPE_CACHE_MAX_TOKENS];
+            const uint64_t tag = bpe_cache_key(text + pos, n, key);
+            const size_t n_cached = bpe_cache_lookup(cache, tag, key, n, cached);
+            if (n_cached > 0 && n_cached <= n) {
+                memcpy(&token_ids[write], cached, n_cached * sizeof(uint32_t));
+                write += n_cached;
+                pos = end;
+                scratch->cache_hits++;
+                continue;
+            }
+            q_error_code err = bpe_encode_word(tok, text + pos, &token_ids[pos], &n, scratch);
+            if (err != Q_OK) {
+                return err;
+            }
+            scratch->cache_misses++;
+            if (n <= BPE_CACHE_MAX_TOKENS) {
+                bpe_cache_insert(cache, tag, key, end - pos, &token_ids[pos], n);
+            }
+        } else if (n >= 2) {
+            q_error_code err = bpe_encode_word(tok, text + pos, &token_ids[pos], &n, scratch);
+            if (err != Q_OK) {
+                return err;
+            }
+        }
+        if (write != pos) {
+            memmove(&token_ids[write], &token_ids[pos], n * sizeof(uint32_t));
+        }
+        write += n;
+        pos = end;
+    }
+    *num_out = write - seg_start;
+    return Q_OK;
+}
+
+// Segmento de encode processado por uma thread
+typedef struct {
+    const q_tokenizer* tok;
+    const char* text;
+    size_t text_len;
+    uint32_t* token_ids;
+    size_t start;
+    size_t end;
+    size_t count;
+    q_error_code err;
+} bpe_segment_job;
+
+static void* bpe_segment_worker(void* arg) {
+    bpe_segment_job* job = (bpe_segment_job*)arg;
+    bpe_scratch scratch = {0};
+    job->err = bpe_encode_segment(job->tok, job->text, job->text_len, job->token_ids,
+                                  job->start, job->end, &job->count, &scratch);
+    bpe_cache_publish(job->tok->word_cache, &scratch);
+    bpe_scratch_free(&scratch);
+    return NULL;
+}
+
+// Pré-tokeniza e aplica merges por pré-token; textos grandes em paralelo
+// Segmentos terminam em fronteiras de pré-token: resultado idêntico ao sequencial
+static q_error_code apply_bpe_pretokenized(
+    const q_tokenizer* restrict tok,
+    const char* restrict text,
+    size_t text_len,
+    uint32_t* restrict token_ids,
+    size_t* restrict num_tokens
+) {
+    // Sem merges: tokens base já são o resultado
+    if (tok->num_merges == 0 || text_len < 2) {
+        return Q_OK;
+    }
+    
+    size_t n_threads = 1;
+    if (text_len >= Q_TOKENIZER_PARALLEL_MIN_BYTES) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (online > 1) ? (size_t)online : 1;
+        if (n_threads > Q_TOKENIZER_MAX_THREADS) n_threads = Q_TOKENIZER_MAX_THREADS;
+        if (n_threads > text_len / Q_TOKENIZER_SEGMENT_MIN_BYTES) {
+            n_threads = text_len / Q_TOKENIZER_SEGMENT_MIN_BYTES;
+        }
+    }
+    
+    if (n_threads <= 1) {
+        bpe_scratch scratch = {0};
+        q_error_code err = bpe_encode_segment(tok, text, text_len, token_ids, 0, text_len,
+                                              num_tokens, &scratch);
+        bpe_cache_publish(tok->word_cache, &scratch);
+        bpe_scratch_free(&scratch);
+        return err;
+    }
+    
+    // Fronteiras: primeiro fim de pré-token após cada alvo len × k / T (scan O(n) barato)
+    bpe_segment_job jobs[Q_TOKENIZER_MAX_THREADS];
+    size_t n_jobs = 0;
+    size_t seg_start = 0;
+    size_t pos = 0;
+    while (pos < text_len) {
+        pos = q_pretokenize_next(text, text_len, pos);
+        const size_t target = text_len * (n_jobs + 1) / n_threads;
+        if (pos >= target || pos == text_len) {
+            jobs[n_jobs] = (bpe_segment_job){
+                .tok = tok, .text = text, .text_len = text_len, .token_ids = token_ids,
+                .start = seg_start, .end = pos, .count = 0, .err = Q_OK,
+            };
+            n_jobs++;
+            seg_start = pos;
+            if (n_jobs == n_threads) {
+                jobs[n_jobs - 1].end = text_len;
+                break;
+            }
+        }
+    }
+    
+    // Segmento 0 na thread chamadora; demais em threads auxiliares
+    pthread_t threads[Q_TOKENIZER_MAX_THREADS];
+    bool started[Q_TOKENIZER_MAX_THREADS] = {false};
+    for (size_t i = 1; i < n_jobs; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, bpe_segment_worker, &jobs[i]) == 0);
+        if (!started[i]) {
+            bpe_segment_worker(&jobs[i]);  // Fallback: processa inline
+        }
+    }
+    bpe_segment_worker(&jobs[0]);
+    for (size_t i = 1; i < n_jobs; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    
+    // Concatena segmentos (compactação em ordem, memmove para a esquerda)
+    size_t write = 0;
+    for (size_t i = 0; i < n_jobs; i++) {
+        if (jobs[i].err != Q_OK) {
+            return jobs[i].err;
+        }
+        if (write != jobs[i].start) {
+            memmove(&token_ids[write], &token_ids[jobs[i].start], jobs[i].count * sizeof(uint32_t));
+        }
+        write += jobs[i].count;
+    }
+    *num_tokens = write;
+    return Q_OK;
+}
+
 // Helper: Add special tokens (BOS/EOS) to token list
 static q_error_code add_special_tokens(
     const q_tokenizer* restrict tok,
@@ -690,7 +1986,7 @@ static q_error_code add_special_tokens(
     return Q_OK;
 }
 
-// Main BPE encoding function
+// Main BPE encoding function (null-terminated text)
 // This replaces the dummy implementation in dummy_tokenizer.c
 q_error_code q_tokenizer_encode(
     q_tokenizer* restrict tok,
@@ -700,17 +1996,35 @@ q_error_code q_tokenizer_encode(
     uint32_t max_tokens,
     bool add_bos,
     bool add_eos
+) {
+    Q_VALIDATE_PTR_OR_RETURN(text, Q_ERR_INVALID_ARG);
+    return q_tokenizer_encode_len(tok, text, strlen(text), tokens_out, num_tokens_out,
+                                  max_tokens, add_bos, add_eos);
+}
+
+// Encode de (text, len): um único passe de front-end, sem strlen nem cópia de bytes
+// Saída com folga (max_tokens >= len + 2): tokens base, merges e BOS/EOS direto em
+// tokens_out, sem alocação; senão buffer temporário de len + 2 tokens
+q_error_code q_tokenizer_encode_len(
+    q_tokenizer* restrict tok,
+    const char* restrict text,
+    size_t text_len,
+    uint32_t* restrict tokens_out,
+    uint32_t* restrict num_tokens_out,
+    uint32_t max_tokens,
+    bool add_bos,
+    bool add_eos
 ) {
     // STEP 0.5: VALIDATION (Preconditions)
     Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
-    Q_VALIDATE_PTR_OR_RETURN(text, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(text != NULL || text_len == 0, Q_ERR_INVALID_ARG);
     Q_VALIDATE_PTR_OR_RETURN(tokens_out, Q_ERR_INVALID_ARG);
     Q_VALIDATE_PTR_OR_RETURN(num_tokens_out, Q_ERR_INVALID_ARG);
     Q_VALIDATE_OR_RETURN(tok->initialized, Q_ERR_INVALID_ARG);
     Q_VALIDATE_OR_RETURN(max_tokens > 0, Q_ERR_INVALID_SIZE);
     
     // Handle empty text
-    if (text[0] == '\0') {
+    if (text_len == 0) {
         *num_tokens_out = 0;
         // Still add BOS/EOS if requested
         if (add_bos || add_eos) {
@@ -724,80 +2038,277 @@ q_error_code q_tokenizer_encode(
         return Q_OK;
     }
     
-    // Calculate text length (bounded check)
-    size_t text_len = strlen(text);
     if (text_len > MAX_TEXT_BYTES) {
         return Q_ERR_ARENA_OOM;
     }
+    bpe_trie_ensure(tok);
+    
+    // Worst case: one token per byte (before merges) + BOS + EOS
+    const size_t worst_case = text_len + 2;
+    uint32_t* token_ids = tokens_out;
+    if (worst_case > (size_t)max_tokens) {
+        token_ids = (uint32_t*)malloc(worst_case * sizeof(uint32_t));
+        if (token_ids == NULL) {
+            return Q_ERR_ALLOC_FAILED;
+        }
+    }
     
-    // Allocate buffers dynamically (avoid stack overflow)
-    // Worst case: one token per byte (before merges)
-    size_t buffer_size = (text_len > (size_t)max_tokens) ? text_len : (size_t)max_tokens;
-    uint8_t* bytes = (uint8_t*)malloc(buffer_size);
-    if (bytes == NULL) {
-        return Q_ERR_ALLOC_FAILED;
+    // Step 1: Front-end (bytes → token base, AVX2) + validação UTF-8 (só estatística:
+    // bytes inválidos seguem como tokens de byte)
+    const size_t first = add_bos ? 1 : 0;
+    bpe_map_bytes(tok, (const uint8_t*)text, text_len, token_ids + first);
+    bpe_check_utf8(tok, text, text_len);
+    
+    // Step 2: Pre-tokenize (Llama-3 split) and apply BPE merges per pre-token
+    size_t num_tokens = text_len;
+    q_error_code err = apply_bpe_pretokenized(tok, text, text_len, token_ids + first, &num_tokens);
+    
+    // Step 3: Add special tokens (BOS/EOS) and validate final count
+    if (err == Q_OK) {
+        if (add_bos) {
+            token_ids[0] = tok->bos_token_id;
+            num_tokens++;
+        }
+        if (add_eos) {
+            token_ids[num_tokens++] = tok->eos_token_id;
+        }
+        if (num_tokens > (size_t)max_tokens) {
+            err = Q_ERR_ARENA_OOM;
+        }
     }
     
-    uint32_t* token_ids = (uint32_t*)malloc(buffer_size * sizeof(uint32_t));
-    if (token_ids == NULL) {
-        free(bytes);
+    // Step 4: Copy to output (buffer temporário)
+    if (err == Q_OK) {
+        if (token_ids != tokens_out) {
+            memcpy(tokens_out, token_ids, num_tokens * sizeof(uint32_t));
+        }
+        *num_tokens_out = (uint32_t)num_tokens;
+    }
+    if (token_ids != tokens_out) {
+        free(token_ids);
+    }
+    return err;
+}
+
+// ============================================================================
+// Batch Encoding (q_tokenizer_encode_batch)
+// ============================================================================
+// Cada thread recebe uma faixa contígua de documentos (balanceada por bytes) e
+// codifica em sua arena de scratch (tokens + buffers do merge engine), que
+// cresce geometricamente e é reutilizada entre documentos: nenhum malloc por
+// documento. Ao final, cada arena vira um único memcpy no buffer ragged.
+
+// Arena de uma thread do batch
+typedef struct {
+    const q_tokenizer* tok;
+    const q_text_span* inputs;
+    uint32_t first;          // Faixa de documentos [first, last)
+    uint32_t last;
+    bool add_bos;
+    bool add_eos;
+    size_t* counts;          // counts[i] = tokens do documento i (offsets_out + 1)
+    uint32_t* tokens;        // Tokens da faixa, concatenados
+    size_t used;
+    size_t capacity;
+    bpe_scratch scratch;
+    q_error_code err;
+} bpe_batch_worker;
+
+static q_error_code bpe_batch_reserve(bpe_batch_worker* restrict w, size_t n) {
+    if (w->used + n <= w->capacity) {
+        return Q_OK;
+    }
+    size_t cap = (w->capacity < 4096) ? 4096 : w->capacity;
+    while (cap < w->used + n) {
+        cap *= 2;
+    }
+    uint32_t* grown = (uint32_t*)realloc(w->tokens, cap * sizeof(uint32_t));
+    if (grown == NULL) {
         return Q_ERR_ALLOC_FAILED;
     }
-    
-    size_t num_bytes = 0;
-    size_t num_tokens = 0;
-    
-    // Step 1: Split text to bytes
-    q_error_code err = split_text_to_bytes(text, bytes, &num_bytes, buffer_size);
+    w->tokens = grown;
+    w->capacity = cap;
+    return Q_OK;
+}
+
+// Codifica um documento (ptr, len) no fim da arena: BOS + bytes + merges + EOS
+static q_error_code bpe_batch_encode_one(bpe_batch_worker* restrict w, const q_text_span* restrict in) {
+    const q_tokenizer* tok = w->tok;
+    const size_t len = in->len;
+    if (len > MAX_TEXT_BYTES) {
+        return Q_ERR_ARENA_OOM;
+    }
+    if (len > 0 && in->text == NULL) {
+        return Q_ERR_INVALID_ARG;
+    }
+    q_error_code err = bpe_batch_reserve(w, len + 2);
     if (err != Q_OK) {
-        free(bytes);
-        free(token_ids);
         return err;
     }
     
-    // Step 2: Convert bytes to base token IDs
-    err = bytes_to_token_ids(tok, bytes, num_bytes, token_ids, &num_tokens, buffer_size);
-    if (err != Q_OK) {
-        free(bytes);
-        free(token_ids);
-        return err;
+    uint32_t* out = w->tokens + w->used;
+    size_t n = 0;
+    if (w->add_bos) {
+        out[n++] = tok->bos_token_id;
+    }
+    uint32_t* ids = out + n;
+    bpe_map_bytes(tok, (const uint8_t*)in->text, len, ids);
+    bpe_check_utf8(tok, in->text, len);
+    size_t num = len;
+    if (tok->num_merges > 0 && len >= 2) {
+        err = bpe_encode_segment(tok, in->text, len, ids, 0, len, &num, &w->scratch);
+        if (err != Q_OK) {
+            return err;
+        }
+    }
+    n += num;
+    if (w->add_eos) {
+        out[n++] = tok->eos_token_id;
+    }
+    w->used += n;
+    return Q_OK;
+}
+
+static void* bpe_batch_run(void* arg) {
+    bpe_batch_worker* w = (bpe_batch_worker*)arg;
+    w->err = Q_OK;
+    for (uint32_t i = w->first; i < w->last && w->err == Q_OK; i++) {
+        const size_t before = w->used;
+        w->err = bpe_batch_encode_one(w, &w->inputs[i]);
+        w->counts[i] = w->used - before;
+    }
+    bpe_cache_publish(w->tok->word_cache, &w->scratch);
+    return NULL;
+}
+
+// Encode a batch of (ptr, len) texts into a ragged output buffer
+q_error_code q_tokenizer_encode_batch(
+    q_tokenizer* restrict tok,
+    const q_text_span* restrict inputs,
+    uint32_t num_inputs,
+    uint32_t* restrict tokens_out,
+    size_t tokens_capacity,
+    size_t* restrict offsets_out,
+    bool add_bos,
+    bool add_eos,
+    uint32_t num_threads
+) {
+    Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(offsets_out, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(tok->initialized, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(num_inputs == 0 || inputs != NULL, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(tokens_capacity == 0 || tokens_out != NULL, Q_ERR_INVALID_ARG);
+    
+    offsets_out[0] = 0;
+    if (num_inputs == 0) {
+        return Q_OK;
     }
+    bpe_trie_ensure(tok);  // Antes das threads: workers só leem o ponteiro
     
-    // Step 3: Apply BPE merges (greedy)
-    err = apply_bpe_merges(tok, token_ids, &num_tokens, buffer_size);
-    if (err != Q_OK) {
-        free(bytes);
-        free(token_ids);
-        return err;
+    size_t total_bytes = 0;
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        total_bytes += inputs[i].len;
     }
     
-    // Step 4: Add special tokens (BOS/EOS)
-    err = add_special_tokens(tok, token_ids, &num_tokens, buffer_size, add_bos, add_eos);
-    if (err != Q_OK) {
-        free(bytes);
-        free(token_ids);
-        return err;
+    // Threads: explícito (num_threads > 0) ou CPUs online limitadas pelo trabalho
+    size_t n_threads = num_threads;
+    if (n_threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (online > 1) ? (size_t)online : 1;
+        if (n_threads > total_bytes / Q_TOKENIZER_BATCH_MIN_BYTES) {
+            n_threads = total_bytes / Q_TOKENIZER_BATCH_MIN_BYTES;
+        }
+    }
+    if (n_threads > Q_TOKENIZER_BATCH_MAX_THREADS) n_threads = Q_TOKENIZER_BATCH_MAX_THREADS;
+    if (n_threads > num_inputs) n_threads = num_inputs;
+    if (n_threads == 0) n_threads = 1;
+    
+    bpe_batch_worker* workers = (bpe_batch_worker*)calloc(n_threads, sizeof(bpe_batch_worker));
+    pthread_t* threads = (pthread_t*)calloc(n_threads, sizeof(pthread_t));
+    bool* started = (bool*)calloc(n_threads, sizeof(bool));
+    if (workers == NULL || threads == NULL || started == NULL) {
+        free(workers);
+        free(threads);
+        free(started);
+        return Q_ERR_ALLOC_FAILED;
     }
     
-    // Step 5: Validate final count
-    if (num_tokens > (size_t)max_tokens) {
-        free(bytes);
-        free(token_ids);
-        return Q_ERR_ARENA_OOM;
+    // Faixas contíguas: thread t começa no primeiro documento cujo início em bytes
+    // alcança total × t / T (ordem preservada => cópia final é um memcpy por thread)
+    size_t n_workers = 0;
+    size_t bytes_before = 0;
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        if (n_workers < n_threads &&
+            (n_workers == 0 || bytes_before >= total_bytes * n_workers / n_threads)) {
+            if (n_workers > 0) {
+                workers[n_workers - 1].last = i;
+            }
+            workers[n_workers] = (bpe_batch_worker){
+                .tok = tok, .inputs = inputs, .first = i, .last = num_inputs,
+                .add_bos = add_bos, .add_eos = add_eos, .counts = offsets_out + 1,
+            };
+            n_workers++;
+        }
+        bytes_before += inputs[i].len;
     }
     
-    // Step 6: Copy to output
-    memcpy(tokens_out, token_ids, num_tokens * sizeof(uint32_t));
-    *num_tokens_out = (uint32_t)num_tokens;
+    // Faixa 0 na thread chamadora; demais em threads auxiliares
+    for (size_t t = 1; t < n_workers; t++) {
+        started[t] = (pthread_create(&threads[t], NULL, bpe_batch_run, &workers[t]) == 0);
+        if (!started[t]) {
+            bpe_batch_run(&workers[t]);  // Fallback: processa inline
+        }
+    }
+    bpe_batch_run(&workers[0]);
+    for (size_t t = 1; t < n_workers; t++) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        }
+    }
     
-    // Cleanup
-    free(bytes);
-    free(token_ids);
+    q_error_code err = Q_OK;
+    for (size_t t = 0; t < n_workers && err == Q_OK; t++) {
+        err = workers[t].err;
+    }
+    if (err == Q_OK) {
+        // counts -> offsets (prefix sum in-place); total em offsets_out[num_inputs]
+        for (uint32_t i = 0; i < num_inputs; i++) {
+            offsets_out[i + 1] += offsets_out[i];
+        }
+        if (offsets_out[num_inputs] > tokens_capacity) {
+            err = Q_ERR_ARENA_OOM;  // offsets_out[num_inputs] = capacidade necessária
+        } else {
+            for (size_t t = 0; t < n_workers; t++) {
+                if (workers[t].used > 0) {
+                    memcpy(tokens_out + offsets_out[workers[t].first], workers[t].tokens,
+                           workers[t].used * sizeof(uint32_t));
+                }
+            }
+        }
+    }
     
-    return Q_OK;
+    for (size_t t = 0; t < n_workers; t++) {
+        free(workers[t].tokens);
+        bpe_scratch_free(&workers[t].scratch);
+    }
+    free(workers);
+    free(threads);
+    free(started);
+    return err;
 }
 
 
+// Comprimento do token: tabela do load v1, índice do v2 ou strlen (tokenizer montado à mão)
+static inline size_t bpe_token_len(const q_tokenizer* restrict tok, uint32_t token_id) {
+    if (tok->token_lens != NULL) {
+        return tok->token_lens[token_id];
+    }
+    if (tok->vocab_index != NULL) {
+        return tok->vocab_index[2 * token_id + 1];
+    }
+    return strlen(tok->vocab[token_id]);
+}
+
 // Decode token IDs into text
 // This function is kept from dummy_tokenizer.c (unchanged)
 q_error_code q_tokenizer_decode(
@@ -836,7 +2347,7 @@ q_error_code q_tokenizer_decode(
             continue;
         }
         
-        size_t token_len = strlen(token_str);
+        size_t token_len = bpe_token_len(tok, token_id);
         
         // Check buffer space
         if (pos + token_len >= text_buf_size - 1) {
@@ -854,6 +2365,137 @@ q_error_code q_tokenizer_decode(
     return Q_OK;
 }
 
+// ============================================================================
+// Streaming Detokenizer
+// ============================================================================
+// Cada push copia bytes retidos + bytes do token (comprimento da tabela, sem
+// strlen) e retém apenas a sequência UTF-8 incompleta no fim: O(|token|) por
+// token, independente do tamanho do texto já gerado.
+
+// Bytes no fim de s[0..len) que formam uma sequência UTF-8 iniciada mas incompleta
+// (lead byte válido + menos continuações que o necessário). Bytes inválidos não são
+// retidos: seguem adiante como em q_tokenizer_decode.
+static size_t utf8_incomplete_tail(const uint8_t* restrict s, size_t len) {
+    for (size_t back = 1; back <= 3 && back <= len; back++) {
+        const uint8_t c = s[len - back];
+        if ((c & 0xC0) == 0x80) {
+            continue;  // Continuação: procurar o lead byte
+        }
+        size_t need = 0;
+        if (c >= 0xC2 && c <= 0xDF) {
+            need = 2;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            need = 3;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            need = 4;
+        }
+        return (need > back) ? back : 0;
+    }
+    return 0;
+}
+
+q_error_code q_detokenizer_init(q_detokenizer* restrict dec, const q_tokenizer* restrict tok) {
+    Q_VALIDATE_PTR_OR_RETURN(dec, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(tok->initialized, Q_ERR_INVALID_ARG);
+    
+    memset(dec, 0, sizeof(*dec));
+    dec->tok = tok;
+    return Q_OK;
+}
+
+q_error_code q_detokenizer_push(
+    q_detokenizer* restrict dec,
+    uint32_t token_id,
+    char* restrict out,
+    size_t out_size,
+    size_t* restrict out_len
+) {
+    Q_VALIDATE_PTR_OR_RETURN(dec, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(dec->tok, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(out, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(out_len, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(out_size > 0, Q_ERR_INVALID_SIZE);
+    
+    const q_tokenizer* tok = dec->tok;
+    out[0] = '\0';
+    *out_len = 0;
+    
+    // Mesmo filtro de q_tokenizer_decode: especiais e IDs inválidos não emitem nada
+    if (token_id == tok->bos_token_id || token_id == tok->eos_token_id ||
+        token_id == tok->pad_token_id || token_id >= tok->vocab_size ||
+        tok->vocab[token_id] == NULL) {
+        return Q_OK;
+    }
+    
+    const size_t token_len = bpe_token_len(tok, token_id);
+    const size_t total = dec->pending_len + token_len;
+    if (total + 1 > out_size) {
+        return Q_ERR_ARENA_OOM;
+    }
+    memcpy(out, dec->pending, dec->pending_len);
+    memcpy(out + dec->pending_len, tok->vocab[token_id], token_len);
+    
+    const size_t held = utf8_incomplete_tail((const uint8_t*)out, total);
+    memcpy(dec->pending, out + total - held, held);
+    dec->pending_len = (uint32_t)held;
+    out[total - held] = '\0';
+    *out_len = total - held;
+    return Q_OK;
+}
+
+q_error_code q_detokenizer_flush(
+    q_detokenizer* restrict dec,
+    char* restrict out,
+    size_t out_size,
+    size_t* restrict out_len
+) {
+    Q_VALIDATE_PTR_OR_RETURN(dec, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(out, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(out_len, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_OR_RETURN(out_size > dec->pending_len, Q_ERR_ARENA_OOM);
+    
+    memcpy(out, dec->pending, dec->pending_len);
+    out[dec->pending_len] = '\0';
+    *out_len = dec->pending_len;
+    dec->pending_len = 0;
+    return Q_OK;
+}
+
+// Encode cache statistics (snapshot; contadores atualizados ao fim de cada encode)
+q_error_code q_tokenizer_get_stats(const q_tokenizer* restrict tok, q_tokenizer_stats* restrict stats) {
+    Q_VALIDATE_PTR_OR_RETURN(tok, Q_ERR_INVALID_ARG);
+    Q_VALIDATE_PTR_OR_RETURN(stats, Q_ERR_INVALID_ARG);
+    
+    memset(stats, 0, sizeof(*stats));
+    struct bpe_word_cache* cache = tok->word_cache;
+    if (cache == NULL) {
+        return Q_OK;
+    }
+    stats->cache_hits = atomic_load_explicit(&cache->hits, memory_order_relaxed);
+    stats->cache_misses = atomic_load_explicit(&cache->misses, memory_order_relaxed);
+    stats->cache_entries = atomic_load_explicit(&cache->num_entries, memory_order_relaxed);
+    stats->cache_capacity = BPE_CACHE_SETS * BPE_CACHE_WAYS;
+    stats->merges_applied = atomic_load_explicit(&cache->merges, memory_order_relaxed);
+    stats->trie_words = atomic_load_explicit(&cache->trie_words, memory_order_relaxed);
+    stats->invalid_utf8_texts = atomic_load_explicit(&cache->invalid_utf8, memory_order_relaxed);
+    const uint64_t lookups = stats->cache_hits + stats->cache_misses;
+    stats->cache_hit_rate = (lookups > 0) ? (double)stats->cache_hits / (double)lookups : 0.0;
+    return Q_OK;
+}
+
+// Zera contadores de hit/miss (conteúdo do cache é mantido)
+void q_tokenizer_reset_stats(q_tokenizer* restrict tok) {
+    if (tok == NULL || tok->word_cache == NULL) {
+        return;
+    }
+    atomic_store_explicit(&tok->word_cache->hits, 0, memory_order_relaxed);
+    atomic_store_explicit(&tok->word_cache->misses, 0, memory_order_relaxed);
+    atomic_store_explicit(&tok->word_cache->merges, 0, memory_order_relaxed);
+    atomic_store_explicit(&tok->word_cache->trie_words, 0, memory_order_relaxed);
+    atomic_store_explicit(&tok->word_cache->invalid_utf8, 0, memory_order_relaxed);
+}
+
 // Free tokenizer resources
 // This function is kept from dummy_tokenizer.c (unchanged)
 void q_tokenizer_free(q_tokenizer* restrict tok) {
@@ -861,6 +2503,16 @@ void q_tokenizer_free(q_tokenizer* restrict tok) {
         return;
     }
     
+    // v2: strings, merges e tabela pertencem ao mapeamento
+    if (tok->mapped != NULL) {
+        free((void*)tok->vocab);
+        bpe_cache_destroy(tok->word_cache);
+        bpe_trie_destroy(tok->vocab_trie);
+        munmap(tok->mapped, tok->mapped_size);
+        memset(tok, 0, sizeof(q_tokenizer));
+        return;
+    }
+    
     if (tok->vocab != NULL) {
         for (uint32_t i = 0; i < tok->vocab_size; i++) {
             free(tok->vocab[i]);
@@ -877,11 +2529,19 @@ void q_tokenizer_free(q_tokenizer* restrict tok) {
         tok->merges = NULL;
     }
     
+    free(tok->token_lens);
+    tok->token_lens = NULL;
+    
     // Free hash table if it exists
     if (tok->merge_hash_table != NULL) {
         free_hash_table((bpe_hash_table*)tok->merge_hash_table);
         tok->merge_hash_table = NULL;
     }
     
+    bpe_cache_destroy(tok->word_cache);
+    tok->word_cache = NULL;
+    bpe_trie_destroy(tok->vocab_trie);
+    tok->vocab_trie = NULL;
+    
     memset(tok, 0, sizeof(q_tokenizer));
 }
@@ -0,0 +1,285 @@
+// ============================================================================
+// PRE-TOKENIZER (Llama-3 / tiktoken cl100k split pattern)
+// ============================================================================
+// Divide o texto em "palavras" antes do BPE (merges nunca cruzam fronteiras):
+//
+//   (?i:'s|'t|'re|'ve|'m|'ll|'d)
+//   | [^\r\n\p{L}\p{N}]?\p{L}+
+//   | \p{N}{1,3}
+//   |  ?[^\s\p{L}\p{N}]+[\r\n]*
+//   | \s*[\r\n]+
+//   | \s+(?!\S)
+//   | \s+
+//
+// Implementado como scanner UTF-8 escrito à mão (sem engine de regex):
+// cada alternativa vira um teste sobre a classe do code point atual.
+//
+// Classes Unicode (aproximação sem tabelas completas):
+// - ASCII: tabela exata
+// - \s: espaços Unicode (NBSP, U+2000-200A, U+2028/2029, U+3000, ...)
+// - \p{N}: dígitos Latin-1/árabes/devanágari/full-width, super/subscritos,
+//   number forms e enclosed alphanumerics
+// - Pontuação/símbolos: Latin-1, marcas combinantes, General Punctuation,
+//   moedas, setas/matemática/símbolos, pontuação CJK/full-width, emoji
+// - Qualquer outro code point >= 0x80: \p{L} (letras de todos os scripts)
+// - UTF-8 inválido: 1 byte, classe pontuação
+//
+// Thread-safe: função pura sobre (text, len, pos)
+// ============================================================================
+
+#include "qorus.h"
+#include <immintrin.h>
+
+typedef enum {
+    PT_LETTER = 0,
+    PT_NUMBER,
+    PT_SPACE,     // \s exceto \r \n
+    PT_NEWLINE,   // \r \n (também \s)
+    PT_OTHER      // [^\s\p{L}\p{N}]
+} pt_class;
+
+// ASCII: L = letras, N = dígitos, S = espaço, R = \r\n, O = outros
+static const uint8_t ascii_class[128] = {
+    PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER,
+    PT_OTHER, PT_SPACE, PT_NEWLINE, PT_SPACE, PT_SPACE, PT_NEWLINE, PT_OTHER, PT_OTHER,
+    PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER,
+    PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER,
+    PT_SPACE, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER,
+    PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER,
+    PT_NUMBER, PT_NUMBER, PT_NUMBER, PT_NUMBER, PT_NUMBER, PT_NUMBER, PT_NUMBER, PT_NUMBER,
+    PT_NUMBER, PT_NUMBER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER,
+    PT_OTHER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER,
+    PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER,
+    PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER,
+    PT_LETTER, PT_LETTER, PT_LETTER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER,
+    PT_OTHER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER,
+    PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER,
+    PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER, PT_LETTER,
+    PT_LETTER, PT_LETTER, PT_LETTER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER, PT_OTHER,
+};
+
+// Classe de um code point não-ASCII
+static pt_class classify_codepoint(uint32_t cp) {
+    // Espaços Unicode (\s)
+    if (cp == 0x85 || cp == 0xA0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200A) ||
+        cp == 0x2028 || cp == 0x2029 || cp == 0x202F || cp == 0x205F || cp == 0x3000) {
+        return PT_SPACE;
+    }
+
+    if (cp < 0x100) {
+        // Latin-1: ª µ º são letras; ² ³ ¹ ¼ ½ ¾ são números; × ÷ e A1-BF pontuação
+        if (cp == 0xAA || cp == 0xB5 || cp == 0xBA) return PT_LETTER;
+        if (cp == 0xB2 || cp == 0xB3 || cp == 0xB9 || (cp >= 0xBC && cp <= 0xBE)) return PT_NUMBER;
+        if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7) return PT_OTHER;
+        return PT_LETTER;
+    }
+
+    // Dígitos e números de outros scripts (\p{N})
+    if ((cp >= 0x0660 && cp <= 0x0669) || (cp >= 0x06F0 && cp <= 0x06F9) ||
+        (cp >= 0x0966 && cp <= 0x096F) || (cp >= 0x2070 && cp <= 0x2079) ||
+        (cp >= 0x2080 && cp <= 0x2089) || (cp >= 0x2150 && cp <= 0x218B) ||
+        (cp >= 0x2460 && cp <= 0x249B) || (cp >= 0xFF10 && cp <= 0xFF19)) {
+        return PT_NUMBER;
+    }
+
+    // Pontuação, símbolos e marcas (nem letra nem número)
+    if ((cp >= 0x0300 && cp <= 0x036F) ||    // Combining diacritical marks
+        (cp >= 0x2010 && cp <= 0x2027) ||    // General punctuation
+        (cp >= 0x2030 && cp <= 0x205E) ||
+        (cp >= 0x200B && cp <= 0x200F) ||    // Zero-width / direction marks
+        (cp >= 0x20A0 && cp <= 0x20CF) ||    // Currency symbols
+        (cp >= 0x2190 && cp <= 0x245F) ||    // Arrows, math, technical
+        (cp >= 0x2500 && cp <= 0x2BFF) ||    // Box drawing, shapes, misc symbols, dingbats
+        (cp >= 0x3001 && cp <= 0x3004) ||    // CJK punctuation
+        (cp >= 0x3008 && cp <= 0x3020) ||
+        (cp >= 0xFE00 && cp <= 0xFE0F) ||    // Variation selectors
+        (cp >= 0xFE10 && cp <= 0xFE6F) ||    // Vertical/small form punctuation
+        (cp >= 0xFF01 && cp <= 0xFF0F) ||    // Full-width punctuation
+        (cp >= 0xFF1A && cp <= 0xFF20) ||
+        (cp >= 0xFF3B && cp <= 0xFF40) ||
+        (cp >= 0xFF5B && cp <= 0xFF65) ||
+        (cp >= 0x1F000 && cp <= 0x1FAFF)) {  // Emoji e símbolos pictográficos
+        return PT_OTHER;
+    }
+
+    return PT_LETTER;
+}
+
+// Classe do caractere em text[pos] e seu tamanho em bytes (*adv >= 1)
+static inline pt_class class_at(const uint8_t* text, size_t len, size_t pos, size_t* adv) {
+    const uint8_t c = text[pos];
+    if (c < 0x80) {
+        *adv = 1;
+        return (pt_class)ascii_class[c];
+    }
+
+    size_t need;
+    uint32_t cp;
+    if (c >= 0xC2 && c <= 0xDF) {
+        need = 1;
+        cp = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        need = 2;
+        cp = c & 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        need = 3;
+        cp = c & 0x07;
+    } else {
+        *adv = 1;
+        return PT_OTHER;  // Byte de continuação solto ou lead inválido
+    }
+    if (pos + need >= len) {
+        *adv = 1;
+        return PT_OTHER;  // Sequência truncada no fim do texto
+    }
+    for (size_t k = 1; k <= need; k++) {
+        const uint8_t cc = text[pos + k];
+        if ((cc & 0xC0) != 0x80) {
+            *adv = 1;
+            return PT_OTHER;
+        }
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    // Overlong (E0 < A0, F0 < 90), surrogates e > U+10FFFF
+    if ((need == 2 && cp < 0x800) || (need == 3 && (cp < 0x10000 || cp > 0x10FFFF)) ||
+        (cp >= 0xD800 && cp <= 0xDFFF)) {
+        *adv = 1;
+        return PT_OTHER;
+    }
+    *adv = need + 1;
+    return classify_codepoint(cp);
+}
+
+static inline bool is_whitespace_class(pt_class c) {
+    return c == PT_SPACE || c == PT_NEWLINE;
+}
+
+// Máscara das letras ASCII em text[0..32): bit i = 1 se text[i] ∈ [A-Za-z]
+// (c | 0x20) - 'a' ∈ [0, 25] com comparação signed: bytes >= 0x80 caem fora
+static inline uint32_t ascii_letter_mask(const uint8_t* text) {
+    const __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)text);
+    const __m256i t = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)),
+                                      _mm256_set1_epi8('a'));
+    const __m256i in_range = _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), t),
+                                              _mm256_cmpgt_epi8(t, _mm256_set1_epi8(-1)));
+    return (uint32_t)_mm256_movemask_epi8(in_range);
+}
+
+// Consome uma sequência de caracteres da classe cls a partir de pos
+// \p{L}+: letras ASCII em passos de 32 bytes (AVX2); a primeira não-letra ASCII
+// encerra o run, um byte >= 0x80 cai no decodificador escalar (letra de outro script?)
+static inline size_t skip_class(const uint8_t* text, size_t len, size_t pos, pt_class cls) {
+    size_t adv;
+    if (cls == PT_LETTER) {
+        while (pos + 32 <= len) {
+            const uint32_t stop = ~ascii_letter_mask(text + pos);
+            if (stop == 0) {
+                pos += 32;
+                continue;
+            }
+            pos += (size_t)__builtin_ctz(stop);
+            if (text[pos] < 0x80 || class_at(text, len, pos, &adv) != PT_LETTER) {
+                return pos;
+            }
+            pos += adv;
+        }
+    }
+    while (pos < len && class_at(text, len, pos, &adv) == cls) {
+        pos += adv;
+    }
+    return pos;
+}
+
+static inline uint8_t ascii_lower(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? (uint8_t)(c + 32) : c;
+}
+
+// Próxima fronteira de pré-token a partir de pos
+// Time Complexity: O(tamanho do pré-token + 1 caractere de lookahead)
+size_t q_pretokenize_next(const char* text, size_t len, size_t pos) {
+    const uint8_t* s = (const uint8_t*)text;
+    if (s == NULL || pos >= len) {
+        return len;
+    }
+
+    // 1. Contrações: 's 't 're 've 'm 'll 'd (case-insensitive)
+    if (s[pos] == '\'' && pos + 1 < len) {
+        const uint8_t c1 = ascii_lower(s[pos + 1]);
+        if (c1 == 's' || c1 == 't' || c1 == 'm' || c1 == 'd') {
+            return pos + 2;
+        }
+        if (pos + 2 < len) {
+            const uint8_t c2 = ascii_lower(s[pos + 2]);
+            if ((c1 == 'r' && c2 == 'e') || (c1 == 'v' && c2 == 'e') || (c1 == 'l' && c2 == 'l')) {
+                return pos + 3;
+            }
+        }
+    }
+
+    size_t adv0;
+    const pt_class c0 = class_at(s, len, pos, &adv0);
+
+    // 2. [^\r\n\p{L}\p{N}]?\p{L}+
+    if (c0 == PT_LETTER) {
+        return skip_class(s, len, pos + adv0, PT_LETTER);
+    }
+    if ((c0 == PT_SPACE || c0 == PT_OTHER) && pos + adv0 < len) {
+        size_t adv1;
+        if (class_at(s, len, pos + adv0, &adv1) == PT_LETTER) {
+            return skip_class(s, len, pos + adv0 + adv1, PT_LETTER);
+        }
+    }
+
+    // 3. \p{N}{1,3}
+    if (c0 == PT_NUMBER) {
+        size_t end = pos + adv0;
+        for (int k = 1; k < 3 && end < len; k++) {
+            size_t adv;
+            if (class_at(s, len, end, &adv) != PT_NUMBER) {
+                break;
+            }
+            end += adv;
+        }
+        return end;
+    }
+
+    // 4. ' '?[^\s\p{L}\p{N}]+[\r\n]*
+    {
+        size_t p = (s[pos] == ' ') ? pos + 1 : pos;
+        size_t adv;
+        if (p < len && class_at(s, len, p, &adv) == PT_OTHER) {
+            p = skip_class(s, len, p + adv, PT_OTHER);
+            while (p < len && (s[p] == '\r' || s[p] == '\n')) {
+                p++;
+            }
+            return p;
+        }
+    }
+
+    // 5-7. Whitespace (c0 é \s aqui: letras/números/outros já tratados)
+    size_t end = pos;
+    size_t last_char_start = pos;
+    size_t after_last_newline = 0;
+    while (end < len) {
+        size_t adv;
+        const pt_class c = class_at(s, len, end, &adv);
+        if (!is_whitespace_class(c)) {
+            break;
+        }
+        last_char_start = end;
+        end += adv;
+        if (c == PT_NEWLINE) {
+            after_last_newline = end;
+        }
+    }
+    // \s*[\r\n]+ : até o último \r/\n do bloco de espaços
+    if (after_last_newline != 0) {
+        return after_last_newline;
+    }
+    // \s+(?!\S) : deixa o último espaço para o próximo pré-token (" word")
+    if (end < len && last_char_start > pos) {
+        return last_char_start;
+    }
+    // \s+
+    return (end > pos) ? end : pos + adv0;
+}
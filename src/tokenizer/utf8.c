@@ -0,0 +1,157 @@
+// ============================================================================
+// UTF-8 VALIDATION (AVX2)
+// ============================================================================
+// Algoritmo "lookup" de Keiser & Lemire (simdjson): cada byte é classificado
+// por 3 tabelas de 16 entradas (vpshufb) indexadas pelo nibble alto/baixo do
+// byte anterior e pelo nibble alto do byte atual. O AND das 3 consultas marca
+// erros de 2 bytes (continuação faltando/sobrando, overlong, surrogate,
+// > U+10FFFF); sequências de 3/4 bytes conferem se prev2/prev3 exigem
+// continuação. Blocos de 32 bytes puramente ASCII só verificam que não há
+// sequência pendente do bloco anterior.
+//
+// Throughput: ~1 instrução/byte em texto não-ASCII, memória em texto ASCII
+// Thread-safe: função pura sobre (text, len)
+// ============================================================================
+
+#include "qorus.h"
+#include <immintrin.h>
+#include <string.h>
+
+// Bits de erro por par (byte anterior, byte atual)
+#define UTF8_TOO_SHORT       (1 << 0)  // Lead seguido de não-continuação
+#define UTF8_TOO_LONG        (1 << 1)  // ASCII seguido de continuação
+#define UTF8_OVERLONG_3      (1 << 2)  // E0 80..9F
+#define UTF8_TOO_LARGE       (1 << 3)  // F4 90..BF, F5+
+#define UTF8_SURROGATE       (1 << 4)  // ED A0..BF
+#define UTF8_OVERLONG_2      (1 << 5)  // C0/C1
+#define UTF8_TOO_LARGE_1000  (1 << 6)  // F5+ 80..8F
+#define UTF8_OVERLONG_4      (1 << 6)  // F0 80..8F
+#define UTF8_TWO_CONTS       (1 << 7)  // Continuação após continuação (válido só em 3/4 bytes)
+#define UTF8_CARRY           (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+// Bytes input[i - n] com o bloco anterior fornecendo os n primeiros
+#define UTF8_PREV(input, prev_input, n) \
+    _mm256_alignr_epi8((input), _mm256_permute2x128_si256((prev_input), (input), 0x21), 16 - (n))
+
+static inline __m256i utf8_lookup16(__m256i idx, const int8_t table[16]) {
+    const __m128i t = _mm_loadu_si128((const __m128i*)(const void*)table);
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(t), idx);
+}
+
+static const int8_t utf8_byte_1_high[16] = {
+    // 0_______ (ASCII)
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    // 10______ (continuação)
+    (int8_t)UTF8_TWO_CONTS, (int8_t)UTF8_TWO_CONTS, (int8_t)UTF8_TWO_CONTS, (int8_t)UTF8_TWO_CONTS,
+    // 1100____, 1101____ (lead de 2 bytes)
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    // 1110____ (lead de 3 bytes)
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    // 1111____ (lead de 4+ bytes)
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+};
+
+static const int8_t utf8_byte_1_low[16] = {
+    (int8_t)(UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4),  // ____0000
+    (int8_t)(UTF8_CARRY | UTF8_OVERLONG_2),                                      // ____0001
+    (int8_t)UTF8_CARRY,                                                          // ____001_
+    (int8_t)UTF8_CARRY,
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE),                                       // ____0100
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),                 // ____0101
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),                 // ____011_
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),                 // ____1___
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE), // ____1101
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+    (int8_t)(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+};
+
+static const int8_t utf8_byte_2_high[16] = {
+    // ________ 0_______ (ASCII)
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    // ________ 1000____
+    (int8_t)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+             UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4),
+    // ________ 1001____
+    (int8_t)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE),
+    // ________ 101_____
+    (int8_t)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+    (int8_t)(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+    // ________ 11______
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+};
+
+// Erros do bloco input (32 bytes) dado o bloco anterior; != 0 se inválido
+static inline __m256i utf8_check_block(__m256i input, __m256i prev_input) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i prev1 = UTF8_PREV(input, prev_input, 1);
+    const __m256i byte_1_high = utf8_lookup16(
+        _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble), utf8_byte_1_high);
+    const __m256i byte_1_low = utf8_lookup16(_mm256_and_si256(prev1, nibble), utf8_byte_1_low);
+    const __m256i byte_2_high = utf8_lookup16(
+        _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble), utf8_byte_2_high);
+    const __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // 3º/4º byte de sequências longas: bit 7 = deve ser continuação (TWO_CONTS esperado)
+    const __m256i prev2 = UTF8_PREV(input, prev_input, 2);
+    const __m256i prev3 = UTF8_PREV(input, prev_input, 3);
+    const __m256i is_third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    const __m256i is_fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    const __m256i must23_80 = _mm256_and_si256(_mm256_or_si256(is_third, is_fourth),
+                                               _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must23_80, special);
+}
+
+// Sequência iniciada nos 3 últimos bytes do bloco e não terminada nele
+static inline __m256i utf8_incomplete(__m256i input) {
+    const __m256i max_value = _mm256_setr_epi8(
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm256_subs_epu8(input, max_value);
+}
+
+// Validate UTF-8 (RFC 3629: sem overlong, surrogates ou > U+10FFFF)
+bool q_utf8_validate(const char* text, size_t len) {
+    if (text == NULL) {
+        return len == 0;
+    }
+    const uint8_t* s = (const uint8_t*)text;
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+
+    size_t pos = 0;
+    for (; pos + 32 <= len; pos += 32) {
+        const __m256i input = _mm256_loadu_si256((const __m256i*)(const void*)(s + pos));
+        if (_mm256_movemask_epi8(input) == 0) {
+            // Bloco ASCII: só pode falhar por sequência pendente do bloco anterior
+            error = _mm256_or_si256(error, prev_incomplete);
+        } else {
+            error = _mm256_or_si256(error, utf8_check_block(input, prev_input));
+            prev_incomplete = utf8_incomplete(input);
+        }
+        prev_input = input;
+    }
+
+    // Cauda (< 32 bytes): completada com zeros (ASCII) e validada como bloco
+    // Sequência truncada no fim vira TOO_SHORT contra o zero seguinte
+    if (pos < len) {
+        uint8_t tail[32] = {0};
+        memcpy(tail, s + pos, len - pos);
+        const __m256i input = _mm256_loadu_si256((const __m256i*)(const void*)tail);
+        error = _mm256_or_si256(error, utf8_check_block(input, prev_input));
+        prev_incomplete = utf8_incomplete(input);
+    }
+    error = _mm256_or_si256(error, prev_incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
@@ -10,6 +10,11 @@
 // 3. BOS/EOS test: "Hi" with add_bos/add_eos → [bos, 72, 105, eos]
 // 4. Buffer overflow test: should return Q_ERR_ARENA_OOM
 // 5. Empty text test: should return empty tokens (or BOS/EOS only)
+// 6. Multiple merges: priority order
+// 7. Rank order: menor rank disponível após cada merge (heap)
+// 8. Encode cache: palavras repetidas saem do cache com tokens idênticos
+// 9. Formato v2 (mmap): v1 -> q_tokenizer_save -> load v2 com mesmos tokens;
+//    tabela com duplicatas / sem slot vazio é rejeitada
 // ============================================================================
 
 #include "qorus.h"
@@ -18,6 +23,8 @@
 #include <string.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
 
 // Test helper: Create a minimal tokenizer for testing
 static q_error_code create_test_tokenizer(q_tokenizer* tok, uint32_t vocab_size, uint32_t num_merges) {
@@ -227,6 +234,584 @@ static void test_multiple_merges(void) {
     printf("  ✓ PASSED\n\n");
 }
 
+// Test 7: Rank order across newly created tokens
+// Specification: Após cada merge, o par de menor rank disponível é aplicado
+// (inclusive pares formados com o token recém-criado), não a próxima regra da lista
+static void test_merge_rank_order(void) {
+    printf("Test 7: Rank order with newly created tokens\n");
+    
+    q_tokenizer tok;
+    q_error_code err = create_test_tokenizer(&tok, 256, 3);
+    assert(err == Q_OK);
+    
+    // Merge 0: (97, 501) -> 500 ('a' + 'bc')
+    // Merge 1: (98, 99)  -> 501 ('bc')
+    // Merge 2: (501, 100) -> 502 ('bc' + 'd')
+    tok.merges[0].token_id1 = 97;
+    tok.merges[0].token_id2 = 501;
+    tok.merges[0].merged_id = 500;
+    
+    tok.merges[1].token_id1 = 98;
+    tok.merges[1].token_id2 = 99;
+    tok.merges[1].merged_id = 501;
+    
+    tok.merges[2].token_id1 = 501;
+    tok.merges[2].token_id2 = 100;
+    tok.merges[2].merged_id = 502;
+    
+    // "abcd": 'bc' criado primeiro; então (a, bc) rank 0 vence (bc, d) rank 2
+    const char* text = "abcd";
+    uint32_t tokens[256];
+    uint32_t num_tokens = 0;
+    
+    err = q_tokenizer_encode(&tok, text, tokens, &num_tokens, 256, false, false);
+    assert(err == Q_OK);
+    assert(num_tokens == 2);
+    assert(tokens[0] == 500);  // 'abc'
+    assert(tokens[1] == 100);  // 'd'
+    
+    // Sem vizinho "a": apenas (bc, d) rank 2 se aplica ao segundo "bc"
+    err = q_tokenizer_encode(&tok, "xbcbcd", tokens, &num_tokens, 256, false, false);
+    assert(err == Q_OK);
+    assert(num_tokens == 3);
+    assert(tokens[0] == 120);  // 'x'
+    assert(tokens[1] == 501);  // 'bc'
+    assert(tokens[2] == 502);  // 'bcd'
+    
+    free_test_tokenizer(&tok);
+    printf("  ✓ PASSED\n\n");
+}
+
+// Test 8: Word-level encode cache (requer q_tokenizer_load: cache criado no load)
+static void write_u32_le(FILE* f, uint32_t v) {
+    const uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    fwrite(b, 1, 4, f);
+}
+
+// Tokenizer v1 com merges "the"/" cat"/" the" (Tests 8 e 9)
+static void write_merges_tokenizer_v1(const char* path) {
+    // Vocab: 256 bytes + <s></s><pad> + 6 merged tokens
+    static const char* const merged[] = { "th", "the", " c", " ca", " cat", " the" };
+    static const uint32_t merges[][3] = {
+        { 't', 'h', 259 }, { 259, 'e', 260 }, { ' ', 'c', 261 },
+        { 261, 'a', 262 }, { 262, 't', 263 }, { ' ', 260, 264 },
+    };
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    const uint32_t header[8] = { 0x51544B52, 1, 265, 6, 256, 257, 258, 0 };
+    for (size_t i = 0; i < 8; i++) {
+        write_u32_le(f, header[i]);
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        const uint8_t entry[2] = { 1, (uint8_t)i };
+        fwrite(entry, 1, 2, f);
+    }
+    const char* const specials[] = { "<s>", "</s>", "<pad>" };
+    for (size_t i = 0; i < 3; i++) {
+        fputc((int)strlen(specials[i]), f);
+        fwrite(specials[i], 1, strlen(specials[i]), f);
+    }
+    for (size_t i = 0; i < 6; i++) {
+        fputc((int)strlen(merged[i]), f);
+        fwrite(merged[i], 1, strlen(merged[i]), f);
+    }
+    for (size_t i = 0; i < 6; i++) {
+        write_u32_le(f, merges[i][0]);
+        write_u32_le(f, merges[i][1]);
+        write_u32_le(f, merges[i][2]);
+    }
+    assert(fclose(f) == 0);
+}
+
+static void test_encode_cache(void) {
+    printf("Test 8: Word-level encode cache\n");
+    
+    const char* path = "/tmp/qorus_test_encode_cache.bin";
+    write_merges_tokenizer_v1(path);
+    q_tokenizer tok;
+    q_error_code err = q_tokenizer_load(&tok, path);
+    unlink(path);
+    assert(err == Q_OK);
+    
+    q_tokenizer_stats stats;
+    assert(q_tokenizer_get_stats(&tok, &stats) == Q_OK);
+    assert(stats.cache_capacity > 0);
+    assert(stats.cache_hits == 0 && stats.cache_misses == 0);
+    
+    // Pré-tokens: "the" " cat" " the" " cat" " the" -> 3 misses, 2 hits
+    const char* text = "the cat the cat the";
+    const uint32_t expected[] = { 260, 263, 264, 263, 264 };
+    uint32_t tokens[64];
+    uint32_t num_tokens = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        err = q_tokenizer_encode(&tok, text, tokens, &num_tokens, 64, false, false);
+        assert(err == Q_OK);
+        assert(num_tokens == 5);
+        assert(memcmp(tokens, expected, sizeof(expected)) == 0);
+    }
+    
+    // Segundo encode: todas as 5 palavras do cache
+    assert(q_tokenizer_get_stats(&tok, &stats) == Q_OK);
+    assert(stats.cache_misses == 3);
+    assert(stats.cache_hits == 7);
+    assert(stats.cache_entries == 3);
+    assert(stats.cache_hit_rate > 0.69 && stats.cache_hit_rate < 0.71);
+    
+    q_tokenizer_reset_stats(&tok);
+    assert(q_tokenizer_get_stats(&tok, &stats) == Q_OK);
+    assert(stats.cache_hits == 0 && stats.cache_entries == 3);
+    
+    q_tokenizer_free(&tok);
+    printf("  ✓ PASSED\n\n");
+}
+
+// Carrega v2 com a tabela de merges adulterada: mutate(grupos, n_grupos) edita in-place
+// Layout do grupo em disco: u64 keys[4], u32 merged_id[4], u32 rank[4] (64 bytes)
+static q_error_code load_v2_with_table(const char* src_path, void (*mutate)(uint8_t* groups, uint32_t n_groups)) {
+    FILE* f = fopen(src_path, "rb");
+    assert(f != NULL);
+    assert(fseek(f, 0, SEEK_END) == 0);
+    const long size = ftell(f);
+    assert(size > 64 && fseek(f, 0, SEEK_SET) == 0);
+    uint8_t* buf = (uint8_t*)malloc((size_t)size);
+    assert(buf != NULL && fread(buf, 1, (size_t)size, f) == (size_t)size);
+    fclose(f);
+    
+    uint32_t hdr[16];
+    memcpy(hdr, buf, sizeof(hdr));
+    assert(hdr[7] >= 8 && (size_t)hdr[12] + (size_t)hdr[7] * 16 <= (size_t)size);
+    mutate(buf + hdr[12], hdr[7] / 4);
+    
+    const char* bad_path = "/tmp/qorus_test_tokenizer_v2_bad.bin";
+    f = fopen(bad_path, "wb");
+    assert(f != NULL && fwrite(buf, 1, (size_t)size, f) == (size_t)size);
+    fclose(f);
+    free(buf);
+    
+    q_tokenizer tok;
+    const q_error_code err = q_tokenizer_load(&tok, bad_path);
+    if (err == Q_OK) {
+        q_tokenizer_free(&tok);
+    }
+    unlink(bad_path);
+    return err;
+}
+
+// Primeiro slot ocupado (g, i); false se a tabela está vazia
+static bool first_used_slot(const uint8_t* groups, uint32_t n_groups, uint32_t* g_out, uint32_t* i_out) {
+    for (uint32_t g = 0; g < n_groups; g++) {
+        for (uint32_t i = 0; i < 4; i++) {
+            uint64_t key;
+            memcpy(&key, groups + (size_t)g * 64 + i * 8, sizeof(key));
+            if (key != UINT64_MAX) {
+                *g_out = g;
+                *i_out = i;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void copy_slot(uint8_t* groups, uint32_t g_src, uint32_t i_src, uint32_t g_dst, uint32_t i_dst) {
+    uint8_t* src = groups + (size_t)g_src * 64;
+    uint8_t* dst = groups + (size_t)g_dst * 64;
+    memcpy(dst + i_dst * 8, src + i_src * 8, 8);                // key
+    memcpy(dst + 32 + i_dst * 4, src + 32 + i_src * 4, 4);      // merged_id
+    memcpy(dst + 48 + i_dst * 4, src + 48 + i_src * 4, 4);      // rank
+}
+
+// Todos os slots = cópias de uma regra válida: sem slot vazio, probing de par ausente não termina
+static void mutate_fill_with_copies(uint8_t* groups, uint32_t n_groups) {
+    uint32_t g0, i0;
+    assert(first_used_slot(groups, n_groups, &g0, &i0));
+    for (uint32_t g = 0; g < n_groups; g++) {
+        for (uint32_t i = 0; i < 4; i++) {
+            copy_slot(groups, g0, i0, g, i);
+        }
+    }
+}
+
+// Uma única chave duplicada em um slot vazio (tabela continua com slots vazios)
+static void mutate_one_duplicate(uint8_t* groups, uint32_t n_groups) {
+    uint32_t g0, i0;
+    assert(first_used_slot(groups, n_groups, &g0, &i0));
+    for (uint32_t g = 0; g < n_groups; g++) {
+        for (uint32_t i = 0; i < 4; i++) {
+            uint64_t key;
+            memcpy(&key, groups + (size_t)g * 64 + i * 8, sizeof(key));
+            if (key == UINT64_MAX) {
+                copy_slot(groups, g0, i0, g, i);
+                return;
+            }
+        }
+    }
+}
+
+static void mutate_none(uint8_t* groups, uint32_t n_groups) {
+    (void)groups;
+    (void)n_groups;
+}
+
+static void test_tokenizer_v2_roundtrip(void) {
+    printf("Test 9: Tokenizer v2 (mmap) round-trip\n");
+    
+    const char* v1_path = "/tmp/qorus_test_tokenizer_v1.bin";
+    const char* v2_path = "/tmp/qorus_test_tokenizer_v2.bin";
+    write_merges_tokenizer_v1(v1_path);
+    q_tokenizer v1;
+    q_error_code err = q_tokenizer_load(&v1, v1_path);
+    unlink(v1_path);
+    assert(err == Q_OK);
+    assert(v1.mapped == NULL && v1.merge_groups != NULL);
+    assert(q_tokenizer_save(&v1, v2_path) == Q_OK);
+    
+    q_tokenizer v2;
+    err = q_tokenizer_load(&v2, v2_path);
+    assert(err == Q_OK);
+    assert(v2.mapped != NULL && v2.merge_groups != NULL);
+    assert(v2.vocab_size == v1.vocab_size && v2.num_merges == v1.num_merges);
+    assert(v2.bos_token_id == v1.bos_token_id && v2.eos_token_id == v1.eos_token_id);
+    assert(strcmp(v2.vocab[264], " the") == 0);
+    assert(v2.vocab[0][0] == '\0');  // Byte 0: "" como em v1
+    
+    const char* text = "the cat sat on the mat, then the cat left";
+    uint32_t t1[128];
+    uint32_t t2[128];
+    uint32_t n1 = 0;
+    uint32_t n2 = 0;
+    assert(q_tokenizer_encode(&v1, text, t1, &n1, 128, true, true) == Q_OK);
+    assert(q_tokenizer_encode(&v2, text, t2, &n2, 128, true, true) == Q_OK);
+    assert(n1 == n2 && memcmp(t1, t2, n1 * sizeof(uint32_t)) == 0);
+    
+    char d1[256];
+    char d2[256];
+    assert(q_tokenizer_decode(&v1, t1, n1, d1, sizeof(d1)) == Q_OK);
+    assert(q_tokenizer_decode(&v2, t2, n2, d2, sizeof(d2)) == Q_OK);
+    assert(strcmp(d1, text) == 0 && strcmp(d2, text) == 0);
+    q_tokenizer_free(&v2);
+    assert(v2.mapped == NULL && v2.vocab == NULL);
+    
+    // Tabela adulterada: chaves duplicadas / sem slot vazio devem ser rejeitadas no load
+    assert(load_v2_with_table(v2_path, mutate_none) == Q_OK);
+    assert(load_v2_with_table(v2_path, mutate_fill_with_copies) != Q_OK);
+    assert(load_v2_with_table(v2_path, mutate_one_duplicate) != Q_OK);
+    
+    // Arquivo truncado (tabela de merges fora do arquivo) deve ser rejeitado
+    FILE* f = fopen(v2_path, "r+b");
+    assert(f != NULL);
+    assert(fseek(f, 0, SEEK_END) == 0);
+    const long size = ftell(f);
+    assert(fclose(f) == 0);
+    assert(truncate(v2_path, size - 16) == 0);
+    assert(q_tokenizer_load(&v2, v2_path) != Q_OK);
+    assert(v2.initialized == false);
+    unlink(v2_path);
+    
+    q_tokenizer_free(&v1);
+    printf("  ✓ PASSED\n\n");
+}
+
+static void test_encode_batch(void) {
+    printf("Test 10: Batch encoding (ragged output, multiple threads)\n");
+    
+    const char* path = "/tmp/qorus_test_encode_batch.bin";
+    write_merges_tokenizer_v1(path);
+    q_tokenizer tok;
+    q_error_code err = q_tokenizer_load(&tok, path);
+    unlink(path);
+    assert(err == Q_OK);
+    
+    // Documentos são fatias de um único buffer (sem '\0' no fim de cada um)
+    const char* corpus = "the cat sat on the mat|the|the cat the cat the|cat";
+    const size_t bounds[][2] = { {0, 22}, {23, 26}, {27, 46}, {46, 46}, {47, 50} };
+    enum { NUM_DOCS = 5 };
+    q_text_span inputs[NUM_DOCS];
+    for (int i = 0; i < NUM_DOCS; i++) {
+        inputs[i] = (q_text_span){ corpus + bounds[i][0], bounds[i][1] - bounds[i][0] };
+    }
+    
+    uint32_t tokens[256];
+    size_t offsets[NUM_DOCS + 1];
+    const uint32_t thread_counts[] = { 1, 4, 0 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        err = q_tokenizer_encode_batch(&tok, inputs, NUM_DOCS, tokens, 256, offsets,
+                                       true, true, thread_counts[t]);
+        assert(err == Q_OK);
+        assert(offsets[0] == 0);
+        
+        // Cada documento deve coincidir com q_tokenizer_encode isolado
+        for (int i = 0; i < NUM_DOCS; i++) {
+            char doc[64];
+            memcpy(doc, inputs[i].text, inputs[i].len);
+            doc[inputs[i].len] = '\0';
+            uint32_t expected[64];
+            uint32_t n = 0;
+            assert(q_tokenizer_encode(&tok, doc, expected, &n, 64, true, true) == Q_OK);
+            assert(offsets[i + 1] - offsets[i] == n);
+            assert(memcmp(&tokens[offsets[i]], expected, n * sizeof(uint32_t)) == 0);
+        }
+    }
+    
+    // Capacidade insuficiente: Q_ERR_ARENA_OOM e offsets[n] = capacidade necessária
+    const size_t required = offsets[NUM_DOCS];
+    err = q_tokenizer_encode_batch(&tok, inputs, NUM_DOCS, tokens, required - 1, offsets,
+                                   true, true, 2);
+    assert(err == Q_ERR_ARENA_OOM);
+    assert(offsets[NUM_DOCS] == required);
+    
+    // Batch vazio
+    assert(q_tokenizer_encode_batch(&tok, inputs, 0, NULL, 0, offsets, false, false, 0) == Q_OK);
+    assert(offsets[0] == 0);
+    
+    q_tokenizer_free(&tok);
+    printf("  ✓ PASSED\n\n");
+}
+
+static void test_streaming_detokenizer(void) {
+    printf("Test 11: Streaming detokenizer (UTF-8 boundaries)\n");
+    
+    const char* path = "/tmp/qorus_test_detokenizer.bin";
+    write_merges_tokenizer_v1(path);
+    q_tokenizer tok;
+    q_error_code err = q_tokenizer_load(&tok, path);
+    unlink(path);
+    assert(err == Q_OK);
+    assert(tok.token_lens != NULL && tok.token_lens[264] == 4);
+    
+    // Multi-byte: tokens de byte dividem cada sequência UTF-8 (2, 3 e 4 bytes)
+    const char* text = "the caf\xC3\xA9 \xE4\xB8\x96\xE7\x95\x8C the cat \xF0\x9F\x98\x80!";
+    uint32_t tokens[128];
+    uint32_t n = 0;
+    assert(q_tokenizer_encode(&tok, text, tokens, &n, 128, true, true) == Q_OK);
+    char full[256];
+    assert(q_tokenizer_decode(&tok, tokens, n, full, sizeof(full)) == Q_OK);
+    
+    q_detokenizer dec;
+    assert(q_detokenizer_init(&dec, &tok) == Q_OK);
+    char streamed[256];
+    size_t streamed_len = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        char piece[16];
+        size_t piece_len = 0;
+        assert(q_detokenizer_push(&dec, tokens[i], piece, sizeof(piece), &piece_len) == Q_OK);
+        assert(strlen(piece) == piece_len);
+        // Nenhum pedaço emitido termina no meio de uma sequência UTF-8
+        if (piece_len > 0) {
+            const uint8_t last = (uint8_t)piece[piece_len - 1];
+            assert(last < 0x80 || (last & 0xC0) == 0x80);
+        }
+        memcpy(streamed + streamed_len, piece, piece_len);
+        streamed_len += piece_len;
+    }
+    assert(dec.pending_len == 0);
+    streamed[streamed_len] = '\0';
+    assert(strcmp(streamed, full) == 0 && strcmp(streamed, text) == 0);
+    
+    // Sequência truncada no fim do stream: retida no push, devolvida pelo flush
+    char piece[16];
+    size_t piece_len = 0;
+    assert(q_detokenizer_push(&dec, 0xE4, piece, sizeof(piece), &piece_len) == Q_OK);
+    assert(q_detokenizer_push(&dec, 0xB8, piece, sizeof(piece), &piece_len) == Q_OK);
+    assert(piece_len == 0 && dec.pending_len == 2);
+    assert(q_detokenizer_push(&dec, tok.eos_token_id, piece, sizeof(piece), &piece_len) == Q_OK);
+    assert(piece_len == 0 && dec.pending_len == 2);
+    // Buffer pequeno demais: erro sem perder o estado
+    assert(q_detokenizer_push(&dec, 264, piece, 4, &piece_len) == Q_ERR_ARENA_OOM);
+    assert(dec.pending_len == 2);
+    assert(q_detokenizer_flush(&dec, piece, sizeof(piece), &piece_len) == Q_OK);
+    assert(piece_len == 2 && memcmp(piece, "\xE4\xB8", 2) == 0 && dec.pending_len == 0);
+    
+    // Byte inválido (continuação solta) não é retido
+    assert(q_detokenizer_push(&dec, 0x96, piece, sizeof(piece), &piece_len) == Q_OK);
+    assert(piece_len == 1 && dec.pending_len == 0);
+    
+    q_tokenizer_free(&tok);
+    printf("  ✓ PASSED\n\n");
+}
+
+// Tokenizer v1 com merges canônicos aleatórios sobre o alfabeto "abc " (Test 12)
+// Alfabeto pequeno: muitos pares conflitantes, exercita o backtracking do trie
+static void write_random_merges_tokenizer_v1(const char* path, uint32_t num_merges, uint32_t seed) {
+    FILE* f = fopen(path, "wb");
+    assert(f != NULL);
+    const uint32_t vocab_size = 259 + num_merges;
+    const uint32_t header[8] = { 0x51544B52, 1, vocab_size, num_merges, 256, 257, 258, 0 };
+    for (size_t i = 0; i < 8; i++) {
+        write_u32_le(f, header[i]);
+    }
+    uint8_t* lens = (uint8_t*)calloc(vocab_size, 1);
+    uint32_t* merges = (uint32_t*)calloc((size_t)num_merges * 2, sizeof(uint32_t));
+    assert(lens != NULL && merges != NULL);
+    for (uint32_t i = 0; i < 256; i++) {
+        const uint8_t entry[2] = { 1, (uint8_t)i };
+        fwrite(entry, 1, 2, f);
+    }
+    const char* const specials[] = { "<s>", "</s>", "<pad>" };
+    for (size_t i = 0; i < 3; i++) {
+        fputc((int)strlen(specials[i]), f);
+        fwrite(specials[i], 1, strlen(specials[i]), f);
+    }
+    const char alphabet[] = "abc ";
+    for (uint32_t r = 0; r < num_merges; r++) {
+        uint32_t pair[2];
+        bool fresh = false;
+        while (!fresh) {
+            for (int k = 0; k < 2; k++) {
+                seed = seed * 1664525U + 1013904223U;
+                const uint32_t pick = seed >> 8;
+                pair[k] = (r == 0 || pick % 3 == 0) ? (uint32_t)(uint8_t)alphabet[pick % 4]
+                                                    : 259 + (pick / 3) % r;
+            }
+            fresh = true;
+            for (uint32_t j = 0; j < r && fresh; j++) {
+                fresh = !(merges[2 * j] == pair[0] && merges[2 * j + 1] == pair[1]);
+            }
+            const uint32_t len = (pair[0] < 256 ? 1U : lens[pair[0]]) + (pair[1] < 256 ? 1U : lens[pair[1]]);
+            fresh = fresh && len <= 24;
+            lens[259 + r] = (uint8_t)len;
+        }
+        merges[2 * r] = pair[0];
+        merges[2 * r + 1] = pair[1];
+        // String do token: decode não é testado aqui, basta o comprimento
+        fputc(lens[259 + r], f);
+        for (uint32_t k = 0; k < lens[259 + r]; k++) {
+            fputc('a', f);
+        }
+    }
+    for (uint32_t r = 0; r < num_merges; r++) {
+        write_u32_le(f, merges[2 * r]);
+        write_u32_le(f, merges[2 * r + 1]);
+        write_u32_le(f, 259 + r);
+    }
+    free(lens);
+    free(merges);
+    assert(fclose(f) == 0);
+}
+
+static void test_vocab_trie(void) {
+    printf("Test 12: Vocab trie (longest-prefix encode, output-identical)\n");
+    
+    const char* path = "/tmp/qorus_test_vocab_trie.bin";
+    write_merges_tokenizer_v1(path);
+    q_tokenizer tok;
+    q_error_code err = q_tokenizer_load(&tok, path);
+    unlink(path);
+    assert(err == Q_OK);
+    assert(tok.vocab_trie == NULL);  // Construído no primeiro encode, não no load
+    
+    // Palavras fora do cache resolvidas pelo trie, sem nenhum merge
+    const uint32_t expected[] = { 260, 263, 264, 263, 264 };
+    uint32_t tokens[64];
+    uint32_t num_tokens = 0;
+    assert(q_tokenizer_encode(&tok, "the cat the cat the", tokens, &num_tokens, 64, false, false) == Q_OK);
+    assert(tok.vocab_trie != NULL);
+    assert(num_tokens == 5 && memcmp(tokens, expected, sizeof(expected)) == 0);
+    q_tokenizer_stats stats;
+    assert(q_tokenizer_get_stats(&tok, &stats) == Q_OK);
+    assert(stats.trie_words == 3 && stats.merges_applied == 0);
+    q_tokenizer_free(&tok);
+    
+    // Diferencial: trie vs. merges (mesmo arquivo, trie desligado no segundo)
+    write_random_merges_tokenizer_v1(path, 160, 7);
+    q_tokenizer with_trie;
+    q_tokenizer merges_only;
+    assert(q_tokenizer_load(&with_trie, path) == Q_OK);
+    assert(q_tokenizer_load(&merges_only, path) == Q_OK);
+    unlink(path);
+    uint32_t seed = 99;
+    char text[512];
+    uint32_t t1[512];
+    uint32_t t2[512];
+    uint32_t n_warm = 0;
+    assert(q_tokenizer_encode(&with_trie, "a", t1, &n_warm, 512, false, false) == Q_OK);
+    assert(q_tokenizer_encode(&merges_only, "a", t2, &n_warm, 512, false, false) == Q_OK);
+    assert(with_trie.vocab_trie != NULL);
+    struct bpe_vocab_trie* saved = merges_only.vocab_trie;
+    merges_only.vocab_trie = NULL;  // Já construído: NULL desliga o trie
+    q_tokenizer_reset_stats(&with_trie);
+    q_tokenizer_reset_stats(&merges_only);
+    
+    for (int it = 0; it < 200; it++) {
+        size_t len = 0;
+        while (len < 400) {
+            seed = seed * 1664525U + 1013904223U;
+            text[len++] = "abc "[(seed >> 8) % 4];
+        }
+        text[len] = '\0';
+        uint32_t n1 = 0;
+        uint32_t n2 = 0;
+        assert(q_tokenizer_encode(&with_trie, text, t1, &n1, 512, false, false) == Q_OK);
+        assert(q_tokenizer_encode(&merges_only, text, t2, &n2, 512, false, false) == Q_OK);
+        assert(n1 == n2 && memcmp(t1, t2, n1 * sizeof(uint32_t)) == 0);
+    }
+    assert(q_tokenizer_get_stats(&with_trie, &stats) == Q_OK);
+    assert(stats.trie_words > 0 && stats.merges_applied == 0);
+    assert(q_tokenizer_get_stats(&merges_only, &stats) == Q_OK);
+    assert(stats.trie_words == 0 && stats.merges_applied > 0);
+    merges_only.vocab_trie = saved;
+    q_tokenizer_free(&merges_only);
+    q_tokenizer_free(&with_trie);
+    printf("  ✓ PASSED\n\n");
+}
+
+// Test 13: Encode com comprimento explícito (sem '\0'), saída direta vs. buffer
+// temporário e contagem de UTF-8 inválido
+static void test_encode_len(void) {
+    printf("Test 13: Encode with explicit length (no null terminator)\n");
+    
+    const char* path = "/tmp/qorus_test_encode_len.bin";
+    write_merges_tokenizer_v1(path);
+    q_tokenizer tok;
+    q_error_code err = q_tokenizer_load(&tok, path);
+    unlink(path);
+    assert(err == Q_OK);
+    
+    // "the cat" seguido de lixo: só os 7 primeiros bytes contam
+    const char text[] = { 't', 'h', 'e', ' ', 'c', 'a', 't', 'X', 'Y', 'Z' };
+    uint32_t tokens[64];
+    uint32_t num_tokens = 0;
+    assert(q_tokenizer_encode_len(&tok, text, 7, tokens, &num_tokens, 64, true, true) == Q_OK);
+    assert(num_tokens == 4 && tokens[0] == 256 && tokens[1] == 260 && tokens[2] == 263 && tokens[3] == 257);
+    
+    // max_tokens justo (< len + 2): buffer temporário, mesmo resultado
+    uint32_t tight[4];
+    num_tokens = 0;
+    assert(q_tokenizer_encode_len(&tok, text, 7, tight, &num_tokens, 4, true, true) == Q_OK);
+    assert(num_tokens == 4 && memcmp(tokens, tight, sizeof(tight)) == 0);
+    assert(q_tokenizer_encode_len(&tok, text, 7, tight, &num_tokens, 3, true, true) == Q_ERR_ARENA_OOM);
+    
+    // Texto vazio (NULL permitido) e texto com '\0' interno
+    assert(q_tokenizer_encode_len(&tok, NULL, 0, tokens, &num_tokens, 64, true, false) == Q_OK);
+    assert(num_tokens == 1 && tokens[0] == 256);
+    assert(q_tokenizer_encode_len(&tok, "a\0b", 3, tokens, &num_tokens, 64, false, false) == Q_OK);
+    assert(num_tokens == 3 && tokens[0] == 'a' && tokens[1] == 0 && tokens[2] == 'b');
+    
+    // Texto longo (> 32 bytes, passos AVX2 do front-end) com byte >= 0x80:
+    // mesmo resultado que q_tokenizer_encode; UTF-8 inválido é contado
+    char long_text[128];
+    for (size_t i = 0; i < 100; i++) {
+        long_text[i] = "the cat "[i % 8];
+    }
+    long_text[50] = (char)0xFF;
+    long_text[100] = '\0';
+    uint32_t ref[128];
+    uint32_t num_ref = 0;
+    q_tokenizer_reset_stats(&tok);
+    assert(q_tokenizer_encode(&tok, long_text, ref, &num_ref, 128, false, false) == Q_OK);
+    assert(q_tokenizer_encode_len(&tok, long_text, 100, tokens, &num_tokens, 64, false, false) == Q_OK);
+    assert(num_tokens == num_ref && memcmp(tokens, ref, num_ref * sizeof(uint32_t)) == 0);
+    q_tokenizer_stats stats;
+    assert(q_tokenizer_get_stats(&tok, &stats) == Q_OK);
+    assert(stats.invalid_utf8_texts == 2);
+    assert(q_tokenizer_encode_len(&tok, "caf\xC3\xA9", 5, tokens, &num_tokens, 64, false, false) == Q_OK);
+    assert(q_tokenizer_get_stats(&tok, &stats) == Q_OK);
+    assert(stats.invalid_utf8_texts == 2);
+    
+    q_tokenizer_free(&tok);
+    printf("  ✓ PASSED\n\n");
+}
+
 int main(void) {
     printf("========================================\n");
     printf("BPE Tokenizer Specification Tests (TDD)\n");
@@ -238,6 +823,13 @@ int main(void) {
     test_buffer_overflow();
     test_empty_text();
     test_multiple_merges();
+    test_merge_rank_order();
+    test_encode_cache();
+    test_tokenizer_v2_roundtrip();
+    test_encode_batch();
+    test_streaming_detokenizer();
+    test_vocab_trie();
+    test_encode_len();
     
     printf("========================================\n");
     printf("✓ All specification tests PASSED\n");
@@ -479,6 +479,316 @@ static void test_e2e_multiple_generations(void) {
     TEST_PASS();
 }
 
+// Test 4: Streaming callback (on_token) - recebe cada token e pode parar a geração
+typedef struct {
+    uint32_t tokens[16];
+    uint32_t count;
+    uint32_t stop_after;
+} stream_capture;
+
+static bool capture_token(uint32_t token_id, void* user_data) {
+    stream_capture* cap = (stream_capture*)user_data;
+    if (cap->count < 16) {
+        cap->tokens[cap->count] = token_id;
+    }
+    cap->count++;
+    return cap->count < cap->stop_after;
+}
+
+static void test_e2e_streaming_callback(void) {
+    TEST_START("E2E - Streaming callback (on_token stops generation)");
+    
+    if (!ensure_dummy_model() || !ensure_tokenizer()) {
+        TEST_FAIL("Cannot generate dummy model/tokenizer");
+        return;
+    }
+    
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_tokenizer tokenizer = {0};
+    q_error_code ret;
+    
+    ret = q_init_memory(&ctx, "model_dummy.qorus");
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot initialize memory");
+        return;
+    }
+    
+    ret = q_alloc_arena(&ctx, 64 * 1024 * 1024);
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot allocate arena");
+        CLEANUP_CONTEXT(&ctx);
+        return;
+    }
+    
+    ret = llama_build_graph(&ctx, &model);
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot build graph");
+        CLEANUP_CONTEXT(&ctx);
+        return;
+    }
+    
+    size_t kv_size = calculate_kv_cache_size(&model.config);
+    ret = q_alloc_kv_cache(&ctx, kv_size);
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot allocate KV cache");
+        CLEANUP_ALL(&ctx, &model, NULL);
+        return;
+    }
+    
+    ret = q_tokenizer_load(&tokenizer, "tokenizer.bin");
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot load tokenizer");
+        CLEANUP_ALL(&ctx, &model, NULL);
+        return;
+    }
+    
+    uint32_t prompt_tokens[256];
+    uint32_t num_prompt_tokens = 0;
+    ret = q_tokenizer_encode(&tokenizer, "Stream", prompt_tokens, &num_prompt_tokens, 256, true, false);
+    if (ret != Q_OK || num_prompt_tokens == 0) {
+        TEST_FAIL("Cannot encode prompt");
+        CLEANUP_ALL(&ctx, &model, &tokenizer);
+        return;
+    }
+    
+    stream_capture cap = { .count = 0, .stop_after = 2 };
+    uint32_t generated_tokens[256];
+    q_generation_state gen_state = {
+        .ctx = &ctx,
+        .model = &model,
+        .tokenizer = &tokenizer,
+        .prompt_tokens = prompt_tokens,
+        .num_prompt_tokens = num_prompt_tokens,
+        .generated_tokens = generated_tokens,
+        .num_generated_tokens = 0,
+        .max_tokens = 8,
+        .temperature = 0.0f,  // Greedy (sem EOS antecipado aleatório)
+        .on_token = capture_token,
+        .user_data = &cap
+    };
+    
+    ret = q_generate(&gen_state);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("q_generate failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model, &tokenizer);
+        return;
+    }
+    
+    // Callback vê exatamente os tokens gerados, e false interrompe a geração
+    if (cap.count != gen_state.num_generated_tokens || cap.count > cap.stop_after) {
+        TEST_FAIL_MSG("Callback saw %u tokens, generated %u (stop_after %u)",
+                      cap.count, gen_state.num_generated_tokens, cap.stop_after);
+        CLEANUP_ALL(&ctx, &model, &tokenizer);
+        return;
+    }
+    for (uint32_t i = 0; i < cap.count; i++) {
+        if (cap.tokens[i] != generated_tokens[i]) {
+            TEST_FAIL_MSG("Token %u mismatch: callback %u, generated %u",
+                          i, cap.tokens[i], generated_tokens[i]);
+            CLEANUP_ALL(&ctx, &model, &tokenizer);
+            return;
+        }
+    }
+    
+    CLEANUP_ALL(&ctx, &model, &tokenizer);
+    TEST_PASS();
+}
+
+// Test 5: Stream q_rng por requisição - mesmo seed reproduz os mesmos tokens,
+// independente do gerador thread-local ter sido usado entre as duas gerações
+static void test_e2e_seeded_reproducibility(void) {
+    TEST_START("E2E - Seeded q_rng reproduces the same tokens");
+    
+    if (!ensure_dummy_model() || !ensure_tokenizer()) {
+        TEST_FAIL("Cannot generate dummy model/tokenizer");
+        return;
+    }
+    
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_tokenizer tokenizer = {0};
+    q_error_code ret;
+    
+    ret = q_init_memory(&ctx, "model_dummy.qorus");
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot initialize memory");
+        return;
+    }
+    
+    ret = q_alloc_arena(&ctx, 64 * 1024 * 1024);
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot allocate arena");
+        CLEANUP_CONTEXT(&ctx);
+        return;
+    }
+    
+    ret = llama_build_graph(&ctx, &model);
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot build graph");
+        CLEANUP_CONTEXT(&ctx);
+        return;
+    }
+    
+    size_t kv_size = calculate_kv_cache_size(&model.config);
+    ret = q_alloc_kv_cache(&ctx, kv_size);
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot allocate KV cache");
+        CLEANUP_ALL(&ctx, &model, NULL);
+        return;
+    }
+    
+    ret = q_tokenizer_load(&tokenizer, "tokenizer.bin");
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot load tokenizer");
+        CLEANUP_ALL(&ctx, &model, NULL);
+        return;
+    }
+    
+    uint32_t prompt_tokens[256];
+    uint32_t num_prompt_tokens = 0;
+    ret = q_tokenizer_encode(&tokenizer, "Seed", prompt_tokens, &num_prompt_tokens, 256, true, false);
+    if (ret != Q_OK || num_prompt_tokens == 0) {
+        TEST_FAIL("Cannot encode prompt");
+        CLEANUP_ALL(&ctx, &model, &tokenizer);
+        return;
+    }
+    
+    uint32_t generated[3][16];
+    uint32_t counts[3] = {0};
+    for (int run = 0; run < 3; run++) {
+        // run 1: gerador thread-local (avança o estado compartilhado da thread)
+        q_rng rng;
+        q_rng_init(&rng, 0xC0FFEEULL, 7);
+        q_generation_state gen_state = {
+            .ctx = &ctx,
+            .model = &model,
+            .tokenizer = &tokenizer,
+            .prompt_tokens = prompt_tokens,
+            .num_prompt_tokens = num_prompt_tokens,
+            .generated_tokens = generated[run],
+            .max_tokens = 8,
+            .temperature = 1.0f,
+            .top_k = 40,
+            .top_p = 0.95f,
+            .rng = (run == 1) ? NULL : &rng
+        };
+        ret = q_generate(&gen_state);
+        if (ret != Q_OK) {
+            TEST_FAIL_MSG("q_generate (run %d) failed: %d", run, ret);
+            CLEANUP_ALL(&ctx, &model, &tokenizer);
+            return;
+        }
+        counts[run] = gen_state.num_generated_tokens;
+    }
+    
+    if (counts[0] == 0 || counts[0] != counts[2] ||
+        memcmp(generated[0], generated[2], counts[0] * sizeof(uint32_t)) != 0) {
+        TEST_FAIL_MSG("Seeded runs differ (%u vs %u tokens)", counts[0], counts[2]);
+        CLEANUP_ALL(&ctx, &model, &tokenizer);
+        return;
+    }
+    
+    CLEANUP_ALL(&ctx, &model, &tokenizer);
+    TEST_PASS();
+}
+
+// Test 6: Penalties - presence_penalty alto em greedy proíbe repetir tokens já gerados
+static void test_e2e_presence_penalty(void) {
+    TEST_START("E2E - Greedy with large presence_penalty never repeats a token");
+    
+    if (!ensure_dummy_model() || !ensure_tokenizer()) {
+        TEST_FAIL("Cannot generate dummy model/tokenizer");
+        return;
+    }
+    
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_tokenizer tokenizer = {0};
+    q_error_code ret;
+    
+    ret = q_init_memory(&ctx, "model_dummy.qorus");
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot initialize memory");
+        return;
+    }
+    
+    ret = q_alloc_arena(&ctx, 64 * 1024 * 1024);
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot allocate arena");
+        CLEANUP_CONTEXT(&ctx);
+        return;
+    }
+    
+    ret = llama_build_graph(&ctx, &model);
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot build graph");
+        CLEANUP_CONTEXT(&ctx);
+        return;
+    }
+    
+    size_t kv_size = calculate_kv_cache_size(&model.config);
+    ret = q_alloc_kv_cache(&ctx, kv_size);
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot allocate KV cache");
+        CLEANUP_ALL(&ctx, &model, NULL);
+        return;
+    }
+    
+    ret = q_tokenizer_load(&tokenizer, "tokenizer.bin");
+    if (ret != Q_OK) {
+        TEST_FAIL("Cannot load tokenizer");
+        CLEANUP_ALL(&ctx, &model, NULL);
+        return;
+    }
+    
+    uint32_t prompt_tokens[256];
+    uint32_t num_prompt_tokens = 0;
+    ret = q_tokenizer_encode(&tokenizer, "Penalty", prompt_tokens, &num_prompt_tokens, 256, true, false);
+    if (ret != Q_OK || num_prompt_tokens == 0) {
+        TEST_FAIL("Cannot encode prompt");
+        CLEANUP_ALL(&ctx, &model, &tokenizer);
+        return;
+    }
+    
+    uint32_t generated[12];
+    q_generation_state gen_state = {
+        .ctx = &ctx,
+        .model = &model,
+        .tokenizer = &tokenizer,
+        .prompt_tokens = prompt_tokens,
+        .num_prompt_tokens = num_prompt_tokens,
+        .generated_tokens = generated,
+        .max_tokens = 12,
+        .temperature = 0.0f,
+        .presence_penalty = 1.0e4f
+    };
+    ret = q_generate(&gen_state);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("q_generate failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model, &tokenizer);
+        return;
+    }
+    
+    for (uint32_t i = 0; i < gen_state.num_generated_tokens; i++) {
+        for (uint32_t j = 0; j < i; j++) {
+            if (generated[i] == generated[j]) {
+                TEST_FAIL_MSG("Token %u repeated at positions %u and %u", generated[i], j, i);
+                CLEANUP_ALL(&ctx, &model, &tokenizer);
+                return;
+            }
+        }
+    }
+    if (gen_state.token_counts.index != NULL) {
+        TEST_FAIL("token_counts not freed by q_generate");
+        CLEANUP_ALL(&ctx, &model, &tokenizer);
+        return;
+    }
+    
+    CLEANUP_ALL(&ctx, &model, &tokenizer);
+    TEST_PASS();
+}
+
 // ============================================================================
 // MAIN TEST RUNNER
 // ============================================================================
@@ -522,6 +832,24 @@ int main(void) {
         TEST_CRASH();
     }
     
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_e2e_streaming_callback();
+    } else {
+        TEST_CRASH();
+    }
+    
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_e2e_seeded_reproducibility();
+    } else {
+        TEST_CRASH();
+    }
+    
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_e2e_presence_penalty();
+    } else {
+        TEST_CRASH();
+    }
+    
     printf("\n========================================\n");
     printf("  TEST SUMMARY\n");
     printf("========================================\n");
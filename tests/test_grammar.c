@@ -0,0 +1,443 @@
+// ============================================================================
+// TEST: Constrained Decoding (q_grammar JSON)
+// ============================================================================
+// Valida máscaras por estado do autômato JSON sobre um vocabulário sintético,
+// avanço por token (incluindo tokens multi-caractere), UTF-8 estrito em strings
+// e a máscara AVX2
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <math.h>
+
+// ============================================================================
+// TEST CONFIGURATION
+// ============================================================================
+
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int tests_crashed = 0;
+
+static jmp_buf crash_jmp_buf;
+static void crash_handler(int sig) {
+    (void)sig;
+    longjmp(crash_jmp_buf, 1);
+}
+
+// ============================================================================
+// TEST HELPERS
+// ============================================================================
+
+#define TEST_START(name) \
+    do { \
+        printf("Test %d: %s\n", tests_run + 1, name); \
+    } while(0)
+
+#define TEST_PASS() do { \
+    tests_run++; \
+    tests_passed++; \
+    printf("  ✓ PASSED\n"); \
+} while(0)
+
+#define TEST_FAIL(msg) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: %s\n", msg); \
+} while(0)
+
+#define TEST_FAIL_MSG(fmt, ...) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: " fmt "\n", __VA_ARGS__); \
+} while(0)
+
+#define TEST_CRASH() do { \
+    tests_run++; \
+    tests_crashed++; \
+    printf("  ✗ CRASHED\n"); \
+} while(0)
+
+// Vocabulário sintético: bytes estruturais + tokens multi-caractere
+enum {
+    T_LBRACE, T_RBRACE, T_LBRACK, T_RBRACK, T_QUOTE, T_A, T_COLON, T_COMMA,
+    T_ONE, T_SPACE, T_TRUE, T_KEY_COLON, T_CLOSE_ALL, T_DOT, T_ZERO, T_EMPTY,
+    T_BOS, T_EOS, T_PAD, T_NEWLINE, T_MINUS, T_E,
+    T_VOCAB_SIZE
+};
+
+static char* g_vocab_strings[T_VOCAB_SIZE] = {
+    "{", "}", "[", "]", "\"", "a", ":", ",",
+    "1", " ", "true", "\"key\":", "}]", ".", "0", "",
+    "<s>", "</s>", "<pad>", "\n", "-", "e",
+};
+
+static q_tokenizer make_tokenizer(void) {
+    q_tokenizer tok;
+    memset(&tok, 0, sizeof(tok));
+    tok.vocab = g_vocab_strings;
+    tok.vocab_size = T_VOCAB_SIZE;
+    tok.bos_token_id = T_BOS;
+    tok.eos_token_id = T_EOS;
+    tok.pad_token_id = T_PAD;
+    tok.initialized = true;
+    return tok;
+}
+
+// Retorna máscara efetiva do estado atual: token permitido <=> logit finito após apply
+static bool allowed_tokens(q_grammar* g, bool out[T_VOCAB_SIZE]) {
+    float logits[T_VOCAB_SIZE];
+    for (uint32_t i = 0; i < T_VOCAB_SIZE; i++) logits[i] = 1.0f;
+    if (q_grammar_apply(g, logits, T_VOCAB_SIZE) != Q_OK) return false;
+    for (uint32_t i = 0; i < T_VOCAB_SIZE; i++) out[i] = isfinite(logits[i]);
+    return true;
+}
+
+static bool feed(q_grammar* g, const uint32_t* tokens, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (q_grammar_accept_token(g, tokens[i]) != Q_OK) return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// TEST CASES
+// ============================================================================
+
+// Test 1: Estado inicial permite apenas inícios de valor JSON
+static void test_grammar_initial_mask(void) {
+    TEST_START("Grammar - initial state allows only JSON value starts");
+
+    q_tokenizer tok = make_tokenizer();
+    q_grammar g;
+    q_error_code ret = q_grammar_init_json(&g, &tok);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("q_grammar_init_json failed: %d", ret);
+        return;
+    }
+
+    bool allowed[T_VOCAB_SIZE];
+    if (!allowed_tokens(&g, allowed)) {
+        TEST_FAIL("q_grammar_apply failed");
+        q_grammar_free(&g);
+        return;
+    }
+
+    const uint32_t expect_allowed[] = {T_LBRACE, T_LBRACK, T_QUOTE, T_ONE, T_SPACE, T_TRUE,
+                                       T_ZERO, T_NEWLINE, T_MINUS};
+    const uint32_t expect_denied[] = {T_RBRACE, T_RBRACK, T_A, T_COLON, T_COMMA, T_KEY_COLON,
+                                      T_CLOSE_ALL, T_DOT, T_EMPTY, T_BOS, T_EOS, T_PAD, T_E};
+    for (size_t i = 0; i < sizeof(expect_allowed) / sizeof(expect_allowed[0]); i++) {
+        if (!allowed[expect_allowed[i]]) {
+            TEST_FAIL_MSG("token '%s' should be allowed", g_vocab_strings[expect_allowed[i]]);
+            q_grammar_free(&g);
+            return;
+        }
+    }
+    for (size_t i = 0; i < sizeof(expect_denied) / sizeof(expect_denied[0]); i++) {
+        if (allowed[expect_denied[i]]) {
+            TEST_FAIL_MSG("token %u ('%s') should be masked", expect_denied[i], g_vocab_strings[expect_denied[i]]);
+            q_grammar_free(&g);
+            return;
+        }
+    }
+
+    q_grammar_free(&g);
+    TEST_PASS();
+}
+
+// Test 2: Documento aninhado com tokens multi-caractere; EOS só no final
+static void test_grammar_nested_document(void) {
+    TEST_START("Grammar - {\"key\": [1.0, true, {\"a\":-1e1}]} accepted token by token");
+
+    q_tokenizer tok = make_tokenizer();
+    q_grammar g;
+    if (q_grammar_init_json(&g, &tok) != Q_OK) {
+        TEST_FAIL("q_grammar_init_json failed");
+        return;
+    }
+
+    // {"key": [1.0, true, {"a":-1e1
+    const uint32_t prefix[] = {T_LBRACE, T_KEY_COLON, T_SPACE, T_LBRACK, T_ONE, T_DOT, T_ZERO,
+                               T_COMMA, T_SPACE, T_TRUE, T_COMMA, T_SPACE, T_LBRACE, T_QUOTE,
+                               T_A, T_QUOTE, T_COLON, T_MINUS, T_ONE, T_E, T_ONE};
+    if (!feed(&g, prefix, sizeof(prefix) / sizeof(prefix[0]))) {
+        TEST_FAIL("valid prefix rejected");
+        q_grammar_free(&g);
+        return;
+    }
+
+    // "}]" fecha objeto interno + array; "]" sozinho é inválido (topo é objeto)
+    bool allowed[T_VOCAB_SIZE];
+    if (!allowed_tokens(&g, allowed) || !allowed[T_CLOSE_ALL] || !allowed[T_RBRACE] ||
+        allowed[T_RBRACK] || allowed[T_EOS] || allowed[T_COLON]) {
+        TEST_FAIL("wrong mask inside nested object after number");
+        q_grammar_free(&g);
+        return;
+    }
+
+    // Token rejeitado não altera o estado
+    if (q_grammar_accept_token(&g, T_RBRACK) != Q_ERR_INVALID_ARG) {
+        TEST_FAIL("']' should be rejected while top container is an object");
+        q_grammar_free(&g);
+        return;
+    }
+
+    const uint32_t suffix[] = {T_CLOSE_ALL, T_RBRACE};
+    if (!feed(&g, suffix, 2) || !q_grammar_is_complete(&g)) {
+        TEST_FAIL("document should be complete");
+        q_grammar_free(&g);
+        return;
+    }
+
+    // Documento completo: só whitespace e EOS
+    if (!allowed_tokens(&g, allowed) || !allowed[T_EOS] || !allowed[T_SPACE] ||
+        allowed[T_LBRACE] || allowed[T_COMMA]) {
+        TEST_FAIL("complete document should allow only whitespace and EOS");
+        q_grammar_free(&g);
+        return;
+    }
+    if (q_grammar_accept_token(&g, T_EOS) != Q_OK) {
+        TEST_FAIL("EOS rejected on complete document");
+        q_grammar_free(&g);
+        return;
+    }
+
+    // Reset volta ao estado inicial e reaproveita máscaras em cache
+    uint64_t built_before = g.masks_built;
+    q_grammar_reset(&g);
+    if (!allowed_tokens(&g, allowed) || allowed[T_RBRACE] || g.masks_built != built_before) {
+        TEST_FAIL("reset should restore initial state using cached mask");
+        q_grammar_free(&g);
+        return;
+    }
+
+    q_grammar_free(&g);
+    TEST_PASS();
+}
+
+// Test 3: Limite de profundidade Q_GRAMMAR_MAX_DEPTH
+static void test_grammar_depth_limit(void) {
+    TEST_START("Grammar - nesting beyond Q_GRAMMAR_MAX_DEPTH is rejected");
+
+    q_tokenizer tok = make_tokenizer();
+    q_grammar g;
+    if (q_grammar_init_json(&g, &tok) != Q_OK) {
+        TEST_FAIL("q_grammar_init_json failed");
+        return;
+    }
+
+    for (uint32_t i = 0; i < Q_GRAMMAR_MAX_DEPTH; i++) {
+        if (q_grammar_accept_token(&g, T_LBRACK) != Q_OK) {
+            TEST_FAIL_MSG("'[' rejected at depth %u", i);
+            q_grammar_free(&g);
+            return;
+        }
+    }
+    if (q_grammar_accept_token(&g, T_LBRACK) != Q_ERR_INVALID_ARG) {
+        TEST_FAIL("'[' accepted beyond max depth");
+        q_grammar_free(&g);
+        return;
+    }
+
+    q_grammar_free(&g);
+    TEST_PASS();
+}
+
+// Test 4: Decodificação greedy com logits aleatórios sempre produz JSON válido
+static void test_grammar_random_greedy_decode(void) {
+    TEST_START("Grammar - greedy decode over random logits stays valid");
+
+    q_tokenizer tok = make_tokenizer();
+    q_grammar g;
+    if (q_grammar_init_json(&g, &tok) != Q_OK) {
+        TEST_FAIL("q_grammar_init_json failed");
+        return;
+    }
+
+    srand(1234);
+    for (int run = 0; run < 50; run++) {
+        q_grammar_reset(&g);
+        for (int step = 0; step < 200; step++) {
+            float logits[T_VOCAB_SIZE];
+            for (uint32_t i = 0; i < T_VOCAB_SIZE; i++) {
+                logits[i] = (float)rand() / (float)RAND_MAX;
+            }
+            if (q_grammar_apply(&g, logits, T_VOCAB_SIZE) != Q_OK) {
+                TEST_FAIL_MSG("run %d step %d: no token allowed", run, step);
+                q_grammar_free(&g);
+                return;
+            }
+
+            uint32_t token_id = 0;
+            if (q_sample_token(logits, T_VOCAB_SIZE, 0.0f, 0, 0.0f, &token_id, NULL) != Q_OK ||
+                q_grammar_accept_token(&g, token_id) != Q_OK) {
+                TEST_FAIL_MSG("run %d step %d: sampled token %u rejected", run, step, token_id);
+                q_grammar_free(&g);
+                return;
+            }
+            if (token_id == T_EOS) {
+                break;
+            }
+        }
+    }
+
+    q_grammar_free(&g);
+    TEST_PASS();
+}
+
+// Test 5: Máscara AVX2 vs referência escalar (tamanhos não múltiplos de 8)
+static void test_token_mask_avx2(void) {
+    TEST_START("Token mask AVX2 - matches scalar reference for odd sizes");
+
+    const uint32_t sizes[] = {1, 7, 8, 31, 32, 33, 255, 1000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const uint32_t n = sizes[s];
+        float* logits = (float*)malloc(n * sizeof(float));
+        uint32_t* mask = (uint32_t*)calloc((n + 31) / 32, sizeof(uint32_t));
+        if (logits == NULL || mask == NULL) {
+            free(logits);
+            free(mask);
+            TEST_FAIL("allocation failed");
+            return;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            logits[i] = (float)i;
+            if ((i * 2654435761U) & 0x10000U) mask[i >> 5] |= 1U << (i & 31);
+        }
+
+        q_error_code ret = q_token_mask_f32_avx2(logits, mask, n, -INFINITY);
+        bool ok = (ret == Q_OK);
+        for (uint32_t i = 0; i < n && ok; i++) {
+            bool is_allowed = (mask[i >> 5] >> (i & 31)) & 1U;
+            ok = is_allowed ? (logits[i] >= (float)i && logits[i] <= (float)i) : isinf(logits[i]);
+        }
+        free(logits);
+        free(mask);
+        if (!ok) {
+            TEST_FAIL_MSG("mismatch for n=%u", n);
+            return;
+        }
+    }
+
+    TEST_PASS();
+}
+
+// Test 6: Strings só aceitam UTF-8 válido (RFC 3629): sem overlong, surrogates ou > U+10FFFF
+static void test_grammar_utf8_strict(void) {
+    TEST_START("Grammar - overlong, surrogate and > U+10FFFF UTF-8 rejected in strings");
+
+    static char* vocab[] = {
+        "<s>", "</s>", "<pad>", "\"",
+        // Válidos: limites de cada faixa restrita
+        "\xE0\xA0\x80", "\xED\x9F\xBF", "\xE1\x80\x80", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF",
+        "\xF1\x80\x80\x80",
+        // Inválidos: overlong (E0 80..9F, F0 80..8F), surrogates (ED A0..BF), > U+10FFFF (F4 90..BF)
+        "\xE0\x80\x80", "\xE0\x9F\xBF", "\xED\xA0\x80", "\xED\xBF\xBF", "\xF0\x80\x80\x80",
+        "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80", "\xF4\xBF\xBF\xBF",
+        // Sequência dividida entre tokens: lead byte + resto
+        "\xED", "\xA0\x80", "\x9F\xBF",
+    };
+    enum { V_QUOTE = 3, V_VALID_FIRST = 4, V_INVALID_FIRST = 10, V_LEAD_ED = 18,
+           V_SURROGATE_TAIL = 19, V_VALID_TAIL = 20, V_SIZE = 21 };
+    _Static_assert(sizeof(vocab) / sizeof(vocab[0]) == V_SIZE, "vocab size");
+
+    q_tokenizer tok;
+    memset(&tok, 0, sizeof(tok));
+    tok.vocab = vocab;
+    tok.vocab_size = V_SIZE;
+    tok.bos_token_id = 0;
+    tok.eos_token_id = 1;
+    tok.pad_token_id = 2;
+    tok.initialized = true;
+    q_grammar g;
+    if (q_grammar_init_json(&g, &tok) != Q_OK) {
+        TEST_FAIL("q_grammar_init_json failed");
+        return;
+    }
+
+    for (uint32_t t = V_VALID_FIRST; t < V_LEAD_ED; t++) {
+        q_grammar_reset(&g);
+        const bool expect_ok = t < V_INVALID_FIRST;
+        if (q_grammar_accept_token(&g, V_QUOTE) != Q_OK ||
+            (q_grammar_accept_token(&g, t) == Q_OK) != expect_ok) {
+            TEST_FAIL_MSG("token %u: expected %s", t, expect_ok ? "accept" : "reject");
+            q_grammar_free(&g);
+            return;
+        }
+    }
+
+    // Máscara após o lead byte ED: só continuações 80..9F
+    q_grammar_reset(&g);
+    bool ok = q_grammar_accept_token(&g, V_QUOTE) == Q_OK && q_grammar_accept_token(&g, V_LEAD_ED) == Q_OK;
+    float logits[V_SIZE];
+    for (uint32_t i = 0; i < V_SIZE; i++) logits[i] = 1.0f;
+    ok = ok && q_grammar_apply(&g, logits, V_SIZE) == Q_OK;
+    if (!ok || isfinite(logits[V_SURROGATE_TAIL]) || !isfinite(logits[V_VALID_TAIL]) ||
+        q_grammar_accept_token(&g, V_SURROGATE_TAIL) == Q_OK ||
+        q_grammar_accept_token(&g, V_VALID_TAIL) != Q_OK) {
+        TEST_FAIL("split surrogate after ED not masked");
+        q_grammar_free(&g);
+        return;
+    }
+
+    q_grammar_free(&g);
+    TEST_PASS();
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstack-usage="
+int main(void) {
+    printf("========================================\n");
+    printf("  CONSTRAINED DECODING TEST SUITE\n");
+    printf("========================================\n\n");
+
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    void (*tests[])(void) = {
+        test_grammar_initial_mask,
+        test_grammar_nested_document,
+        test_grammar_depth_limit,
+        test_grammar_random_greedy_decode,
+        test_token_mask_avx2,
+        test_grammar_utf8_strict,
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (setjmp(crash_jmp_buf) == 0) {
+            tests[i]();
+        } else {
+            TEST_CRASH();
+        }
+    }
+
+    printf("\n========================================\n");
+    printf("  TEST SUMMARY\n");
+    printf("========================================\n");
+    printf("Tests run:    %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_failed);
+    printf("Tests crashed: %d\n", tests_crashed);
+    printf("========================================\n");
+
+    if (tests_failed == 0 && tests_crashed == 0) {
+        printf("  ALL TESTS PASSED ✓\n");
+        printf("========================================\n");
+        return 0;
+    } else {
+        printf("  SOME TESTS FAILED ✗\n");
+        printf("========================================\n");
+        return 1;
+    }
+}
+#pragma GCC diagnostic pop
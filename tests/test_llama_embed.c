@@ -0,0 +1,344 @@
+// ============================================================================
+// TEST: Sentence Embeddings (llama_embed)
+// ============================================================================
+// Valida pooling (mean/last), normalização L2 e independência entre
+// sequências do mesmo batch
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <math.h>
+
+// ============================================================================
+// TEST CONFIGURATION
+// ============================================================================
+
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int tests_crashed = 0;
+
+static jmp_buf crash_jmp_buf;
+static void crash_handler(int sig) {
+    (void)sig;
+    longjmp(crash_jmp_buf, 1);
+}
+
+#define EMBED_TOLERANCE 1e-4f
+
+// ============================================================================
+// TEST HELPERS
+// ============================================================================
+
+#define TEST_START(name) \
+    do { \
+        printf("Test %d: %s\n", tests_run + 1, name); \
+    } while(0)
+
+#define TEST_PASS() do { \
+    tests_run++; \
+    tests_passed++; \
+    printf("  ✓ PASSED\n"); \
+} while(0)
+
+#define TEST_FAIL(msg) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: %s\n", msg); \
+} while(0)
+
+#define TEST_FAIL_MSG(fmt, ...) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: " fmt "\n", __VA_ARGS__); \
+} while(0)
+
+#define TEST_CRASH() do { \
+    tests_run++; \
+    tests_crashed++; \
+    printf("  ✗ CRASHED\n"); \
+} while(0)
+
+#define CLEANUP_ALL(ctx, model) do { \
+    if ((model)->token_embd != NULL || (model)->layers != NULL) { \
+        llama_free_graph(model); \
+    } \
+    q_free_memory(ctx); \
+} while(0)
+
+// Helper: Ensure dummy model exists
+static bool ensure_dummy_model(void) {
+    FILE* f = fopen("model_dummy.qorus", "rb");
+    if (f != NULL) {
+        fclose(f);
+        return true;
+    }
+
+    printf("  Generating dummy model...\n");
+    int ret = system("python3 tools/convert_llama.py model_dummy.qorus 2 > /dev/null 2>&1");
+    return (ret == 0);
+}
+
+// Helper: Calculate KV cache size
+static size_t calculate_kv_cache_size(const q_llama_config* config) {
+    uint32_t head_dim = config->dim / config->n_heads;
+    size_t kv_size = (size_t)config->n_layers *
+                     (size_t)config->n_kv_heads *
+                     (size_t)config->max_seq_len *
+                     (size_t)head_dim *
+                     sizeof(float) * 2; // K + V
+    return Q_ALIGN_SIZE(kv_size);
+}
+
+// Helper: init → arena → build → KV cache
+static q_error_code setup_model(q_context* ctx, q_llama_model* model) {
+    q_error_code ret = q_init_memory(ctx, "model_dummy.qorus");
+    if (ret != Q_OK) return ret;
+
+    ret = q_alloc_arena(ctx, 64 * 1024 * 1024);  // 64MB
+    if (ret != Q_OK) return ret;
+
+    ret = llama_build_graph(ctx, model);
+    if (ret != Q_OK) return ret;
+
+    return q_alloc_kv_cache(ctx, calculate_kv_cache_size(&model->config));
+}
+
+static float l2_norm(const float* v, uint32_t n) {
+    double sum = 0.0;
+    for (uint32_t i = 0; i < n; i++) {
+        sum += (double)v[i] * (double)v[i];
+    }
+    return (float)sqrt(sum);
+}
+
+static float max_abs_diff(const float* a, const float* b, uint32_t n) {
+    float max_diff = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        float d = fabsf(a[i] - b[i]);
+        if (d > max_diff) max_diff = d;
+    }
+    return max_diff;
+}
+
+// ============================================================================
+// TEST CASES
+// ============================================================================
+
+// Test 1: Batch - norma unitária e cada sequência independente do batch
+static void test_embed_batch_consistency(void) {
+    TEST_START("Embed - unit L2 norm and batch result equals per-sequence result");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    const uint32_t dim = model.config.dim;
+    const uint32_t tokens[] = {1, 42, 7, 1234, 99, 5};
+    const uint32_t seq_lens[] = {4, 2};
+    float* batch = (float*)calloc((size_t)2 * dim, sizeof(float));
+    float* single = (float*)calloc((size_t)dim, sizeof(float));
+    if (batch == NULL || single == NULL) {
+        TEST_FAIL("Failed to allocate embeddings");
+        free(batch);
+        free(single);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    const q_pooling_type modes[] = {Q_POOL_MEAN, Q_POOL_LAST};
+    for (uint32_t m = 0; m < 2; m++) {
+        size_t head_before = ctx.scratch_head;
+        ret = llama_embed(&model, &ctx, tokens, seq_lens, 2, modes[m], batch);
+        if (ret != Q_OK || ctx.scratch_head != head_before) {
+            TEST_FAIL_MSG("llama_embed(batch, mode=%u) failed: %d (arena head restored: %d)",
+                          m, ret, ctx.scratch_head == head_before);
+            goto cleanup;
+        }
+
+        for (uint32_t s = 0; s < 2; s++) {
+            float norm = l2_norm(batch + (size_t)s * dim, dim);
+            if (fabsf(norm - 1.0f) > EMBED_TOLERANCE) {
+                TEST_FAIL_MSG("mode=%u seq=%u: ||e|| = %.6f, expected 1.0", m, s, (double)norm);
+                goto cleanup;
+            }
+        }
+
+        // Segunda sequência sozinha deve produzir o mesmo vetor
+        ret = llama_embed(&model, &ctx, tokens + seq_lens[0], &seq_lens[1], 1, modes[m], single);
+        if (ret != Q_OK) {
+            TEST_FAIL_MSG("llama_embed(single, mode=%u) failed: %d", m, ret);
+            goto cleanup;
+        }
+        float diff = max_abs_diff(batch + dim, single, dim);
+        if (diff > EMBED_TOLERANCE) {
+            TEST_FAIL_MSG("mode=%u: batch vs single max diff %.6e", m, (double)diff);
+            goto cleanup;
+        }
+    }
+
+    TEST_PASS();
+cleanup:
+    free(batch);
+    free(single);
+    CLEANUP_ALL(&ctx, &model);
+}
+
+// Test 2: seq_len = 1 -> mean pooling == last pooling
+static void test_embed_single_token_pooling(void) {
+    TEST_START("Embed - single-token sequence: mean pooling equals last-token pooling");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    const uint32_t dim = model.config.dim;
+    const uint32_t token = 42;
+    const uint32_t seq_len = 1;
+    float* mean_e = (float*)calloc((size_t)dim, sizeof(float));
+    float* last_e = (float*)calloc((size_t)dim, sizeof(float));
+    if (mean_e == NULL || last_e == NULL) {
+        TEST_FAIL("Failed to allocate embeddings");
+        free(mean_e);
+        free(last_e);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    q_error_code ret_mean = llama_embed(&model, &ctx, &token, &seq_len, 1, Q_POOL_MEAN, mean_e);
+    q_error_code ret_last = llama_embed(&model, &ctx, &token, &seq_len, 1, Q_POOL_LAST, last_e);
+    if (ret_mean != Q_OK || ret_last != Q_OK) {
+        TEST_FAIL_MSG("llama_embed failed: mean=%d last=%d", ret_mean, ret_last);
+    } else if (max_abs_diff(mean_e, last_e, dim) > EMBED_TOLERANCE) {
+        TEST_FAIL_MSG("mean vs last max diff %.6e", (double)max_abs_diff(mean_e, last_e, dim));
+    } else {
+        TEST_PASS();
+    }
+
+    free(mean_e);
+    free(last_e);
+    CLEANUP_ALL(&ctx, &model);
+}
+
+// Test 3: Entradas inválidas (sem abort: validações retornam erro)
+static void test_embed_invalid_inputs(void) {
+    TEST_START("Embed - zero-length sequence and unknown pooling are rejected");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    float* out = (float*)calloc((size_t)2 * model.config.dim, sizeof(float));
+    if (out == NULL) {
+        TEST_FAIL("Failed to allocate embeddings");
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    const uint32_t tokens[] = {1, 2};
+    const uint32_t bad_lens[] = {2, 0};
+    const uint32_t good_len = 2;
+    ret = llama_embed(&model, &ctx, tokens, bad_lens, 2, Q_POOL_MEAN, out);
+    if (ret != Q_ERR_INVALID_SIZE) {
+        TEST_FAIL_MSG("seq_len=0: expected Q_ERR_INVALID_SIZE, got %d", ret);
+    } else {
+        ret = llama_embed(&model, &ctx, tokens, &good_len, 1, (q_pooling_type)7, out);
+        if (ret != Q_ERR_INVALID_ARG) {
+            TEST_FAIL_MSG("pooling=7: expected Q_ERR_INVALID_ARG, got %d", ret);
+        } else {
+            TEST_PASS();
+        }
+    }
+
+    free(out);
+    CLEANUP_ALL(&ctx, &model);
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstack-usage="
+int main(void) {
+    printf("========================================\n");
+    printf("  SENTENCE EMBEDDING TEST SUITE\n");
+    printf("========================================\n\n");
+
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_embed_batch_consistency();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_embed_single_token_pooling();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_embed_invalid_inputs();
+    } else {
+        TEST_CRASH();
+    }
+
+    printf("\n========================================\n");
+    printf("  TEST SUMMARY\n");
+    printf("========================================\n");
+    printf("Tests run:    %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_failed);
+    printf("Tests crashed: %d\n", tests_crashed);
+    printf("========================================\n");
+
+    if (tests_failed == 0 && tests_crashed == 0) {
+        printf("  ALL TESTS PASSED ✓\n");
+        printf("========================================\n");
+        return 0;
+    } else {
+        printf("  SOME TESTS FAILED ✗\n");
+        printf("========================================\n");
+        return 1;
+    }
+}
+#pragma GCC diagnostic pop
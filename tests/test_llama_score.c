@@ -0,0 +1,278 @@
+// ============================================================================
+// TEST: Sequence Scoring (llama_score_tokens)
+// ============================================================================
+// Valida log-probs de sequência completa contra referência baseada em
+// llama_forward por prefixo + log-softmax em double
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <math.h>
+
+// ============================================================================
+// TEST CONFIGURATION
+// ============================================================================
+
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int tests_crashed = 0;
+
+static jmp_buf crash_jmp_buf;
+static void crash_handler(int sig) {
+    (void)sig;
+    longjmp(crash_jmp_buf, 1);
+}
+
+// Tolerância: exp_precise_avx (~2 ULP) + ordem de acumulação diferente da referência
+#define LOGPROB_TOLERANCE 1e-2
+
+// ============================================================================
+// TEST HELPERS
+// ============================================================================
+
+#define TEST_START(name) \
+    do { \
+        printf("Test %d: %s\n", tests_run + 1, name); \
+    } while(0)
+
+#define TEST_PASS() do { \
+    tests_run++; \
+    tests_passed++; \
+    printf("  ✓ PASSED\n"); \
+} while(0)
+
+#define TEST_FAIL(msg) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: %s\n", msg); \
+} while(0)
+
+#define TEST_FAIL_MSG(fmt, ...) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: " fmt "\n", __VA_ARGS__); \
+} while(0)
+
+#define TEST_CRASH() do { \
+    tests_run++; \
+    tests_crashed++; \
+    printf("  ✗ CRASHED\n"); \
+} while(0)
+
+#define CLEANUP_ALL(ctx, model) do { \
+    if ((model)->token_embd != NULL || (model)->layers != NULL) { \
+        llama_free_graph(model); \
+    } \
+    q_free_memory(ctx); \
+} while(0)
+
+// Helper: Ensure dummy model exists
+static bool ensure_dummy_model(void) {
+    FILE* f = fopen("model_dummy.qorus", "rb");
+    if (f != NULL) {
+        fclose(f);
+        return true;
+    }
+
+    printf("  Generating dummy model...\n");
+    int ret = system("python3 tools/convert_llama.py model_dummy.qorus 2 > /dev/null 2>&1");
+    return (ret == 0);
+}
+
+// Helper: Calculate KV cache size
+static size_t calculate_kv_cache_size(const q_llama_config* config) {
+    uint32_t head_dim = config->dim / config->n_heads;
+    size_t kv_size = (size_t)config->n_layers *
+                     (size_t)config->n_kv_heads *
+                     (size_t)config->max_seq_len *
+                     (size_t)head_dim *
+                     sizeof(float) * 2; // K + V
+    return Q_ALIGN_SIZE(kv_size);
+}
+
+// Helper: init → arena → build → KV cache
+static q_error_code setup_model(q_context* ctx, q_llama_model* model) {
+    q_error_code ret = q_init_memory(ctx, "model_dummy.qorus");
+    if (ret != Q_OK) return ret;
+
+    ret = q_alloc_arena(ctx, 64 * 1024 * 1024);  // 64MB
+    if (ret != Q_OK) return ret;
+
+    ret = llama_build_graph(ctx, model);
+    if (ret != Q_OK) return ret;
+
+    return q_alloc_kv_cache(ctx, calculate_kv_cache_size(&model->config));
+}
+
+// Referência: log p(target) a partir de logits completos (double)
+static double reference_logprob(const float* logits, uint32_t vocab_size, uint32_t target) {
+    double max_val = logits[0];
+    for (uint32_t i = 1; i < vocab_size; i++) {
+        if (logits[i] > max_val) max_val = logits[i];
+    }
+    double sum = 0.0;
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        sum += exp((double)logits[i] - max_val);
+    }
+    return (double)logits[target] - max_val - log(sum);
+}
+
+// ============================================================================
+// TEST CASES
+// ============================================================================
+
+// Test 1: Scoring bate com llama_forward por prefixo
+static void test_score_matches_forward(void) {
+    TEST_START("Score - logprobs match per-prefix llama_forward reference");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    const uint32_t tokens[] = {1, 42, 7, 1234, 99};
+    const uint32_t seq_len = sizeof(tokens) / sizeof(tokens[0]);
+    const uint32_t vocab_size = model.config.vocab_size;
+
+    float logprobs[4];
+    ret = llama_score_tokens(&model, &ctx, tokens, seq_len, 0, logprobs);
+    q_arena_reset(&ctx);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("llama_score_tokens failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    float* logits = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE((size_t)vocab_size * sizeof(float)));
+    if (logits == NULL) {
+        TEST_FAIL("Failed to allocate logits");
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    for (uint32_t i = 0; i + 1 < seq_len; i++) {
+        ret = llama_forward(&model, &ctx, tokens, i + 1, 0, logits);
+        q_arena_reset(&ctx);
+        if (ret != Q_OK) {
+            TEST_FAIL_MSG("llama_forward(prefix=%u) failed: %d", i + 1, ret);
+            free(logits);
+            CLEANUP_ALL(&ctx, &model);
+            return;
+        }
+
+        double expected = reference_logprob(logits, vocab_size, tokens[i + 1]);
+        if (!isfinite(logprobs[i]) || logprobs[i] > 0.0f ||
+            fabs((double)logprobs[i] - expected) > LOGPROB_TOLERANCE * (1.0 + fabs(expected))) {
+            TEST_FAIL_MSG("logprobs[%u] = %.6f, expected %.6f", i, (double)logprobs[i], expected);
+            free(logits);
+            CLEANUP_ALL(&ctx, &model);
+            return;
+        }
+    }
+
+    free(logits);
+    CLEANUP_ALL(&ctx, &model);
+    TEST_PASS();
+}
+
+// Test 2: Entradas inválidas (sem abort: validações retornam erro)
+static void test_score_invalid_inputs(void) {
+    TEST_START("Score - seq_len < 2 and out-of-vocab targets are rejected");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    float logprobs[2];
+    const uint32_t single[] = {1};
+    ret = llama_score_tokens(&model, &ctx, single, 1, 0, logprobs);
+    if (ret != Q_ERR_INVALID_SIZE) {
+        TEST_FAIL_MSG("seq_len=1: expected Q_ERR_INVALID_SIZE, got %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    const uint32_t bad_target[] = {1, model.config.vocab_size};
+    ret = llama_score_tokens(&model, &ctx, bad_target, 2, 0, logprobs);
+    if (ret != Q_ERR_INVALID_ARG) {
+        TEST_FAIL_MSG("target >= vocab_size: expected Q_ERR_INVALID_ARG, got %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    CLEANUP_ALL(&ctx, &model);
+    TEST_PASS();
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstack-usage="
+int main(void) {
+    printf("========================================\n");
+    printf("  SEQUENCE SCORING TEST SUITE\n");
+    printf("========================================\n\n");
+
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_score_matches_forward();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_score_invalid_inputs();
+    } else {
+        TEST_CRASH();
+    }
+
+    printf("\n========================================\n");
+    printf("  TEST SUMMARY\n");
+    printf("========================================\n");
+    printf("Tests run:    %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_failed);
+    printf("Tests crashed: %d\n", tests_crashed);
+    printf("========================================\n");
+
+    if (tests_failed == 0 && tests_crashed == 0) {
+        printf("  ALL TESTS PASSED ✓\n");
+        printf("========================================\n");
+        return 0;
+    } else {
+        printf("  SOME TESTS FAILED ✗\n");
+        printf("========================================\n");
+        return 1;
+    }
+}
+#pragma GCC diagnostic pop
@@ -0,0 +1,396 @@
+// ============================================================================
+// TEST: Fused LM Head + Top-k (q_lm_head_topk_f32_avx2, llama_forward_topk)
+// ============================================================================
+// Valida seleção fundida contra o caminho não-fundido: q_matmul_f32_avx2 +
+// ordenação completa (kernel) e llama_forward + argmax (modelo dummy).
+// Logits do caminho fundido devem ser bit-idênticos.
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <math.h>
+
+// ============================================================================
+// TEST CONFIGURATION
+// ============================================================================
+
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int tests_crashed = 0;
+
+static jmp_buf crash_jmp_buf;
+static void crash_handler(int sig) {
+    (void)sig;
+    longjmp(crash_jmp_buf, 1);
+}
+
+// ============================================================================
+// TEST HELPERS
+// ============================================================================
+
+#define TEST_START(name) \
+    do { \
+        printf("Test %d: %s\n", tests_run + 1, name); \
+    } while(0)
+
+#define TEST_PASS() do { \
+    tests_run++; \
+    tests_passed++; \
+    printf("  ✓ PASSED\n"); \
+} while(0)
+
+#define TEST_FAIL(msg) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: %s\n", msg); \
+} while(0)
+
+#define TEST_FAIL_MSG(fmt, ...) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: " fmt "\n", __VA_ARGS__); \
+} while(0)
+
+#define TEST_CRASH() do { \
+    tests_run++; \
+    tests_crashed++; \
+    printf("  ✗ CRASHED\n"); \
+} while(0)
+
+#define CLEANUP_ALL(ctx, model) do { \
+    if ((model)->token_embd != NULL || (model)->layers != NULL) { \
+        llama_free_graph(model); \
+    } \
+    q_free_memory(ctx); \
+} while(0)
+
+// Helper: Ensure dummy model exists
+static bool ensure_dummy_model(void) {
+    FILE* f = fopen("model_dummy.qorus", "rb");
+    if (f != NULL) {
+        fclose(f);
+        return true;
+    }
+
+    printf("  Generating dummy model...\n");
+    int ret = system("python3 tools/convert_llama.py model_dummy.qorus 2 > /dev/null 2>&1");
+    return (ret == 0);
+}
+
+// Helper: Calculate KV cache size
+static size_t calculate_kv_cache_size(const q_llama_config* config) {
+    uint32_t head_dim = config->dim / config->n_heads;
+    size_t kv_size = (size_t)config->n_layers *
+                     (size_t)config->n_kv_heads *
+                     (size_t)config->max_seq_len *
+                     (size_t)head_dim *
+                     sizeof(float) * 2; // K + V
+    return Q_ALIGN_SIZE(kv_size);
+}
+
+// Helper: init → arena → build → KV cache
+static q_error_code setup_model(q_context* ctx, q_llama_model* model) {
+    q_error_code ret = q_init_memory(ctx, "model_dummy.qorus");
+    if (ret != Q_OK) return ret;
+
+    ret = q_alloc_arena(ctx, 64 * 1024 * 1024);  // 64MB
+    if (ret != Q_OK) return ret;
+
+    ret = llama_build_graph(ctx, model);
+    if (ret != Q_OK) return ret;
+
+    return q_alloc_kv_cache(ctx, calculate_kv_cache_size(&model->config));
+}
+
+// PRNG determinístico (LCG) para pesos sintéticos
+static uint32_t lcg_state = 12345u;
+static float lcg_float(void) {
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return (float)(lcg_state >> 8) / 16777216.0f - 0.5f;
+}
+
+// Referência: k melhores por seleção ingênua (maior logit, menor índice no empate)
+static void reference_topk(const float* logits, uint32_t vocab_size, uint32_t k,
+                           uint32_t* ids, bool* taken) {
+    memset(taken, 0, vocab_size * sizeof(bool));
+    for (uint32_t j = 0; j < k; j++) {
+        uint32_t best = UINT32_MAX;
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            if (!taken[i] && (best == UINT32_MAX || logits[i] > logits[best])) {
+                best = i;
+            }
+        }
+        taken[best] = true;
+        ids[j] = best;
+    }
+}
+
+// ============================================================================
+// TEST CASES
+// ============================================================================
+
+// Test 1: Kernel vs q_matmul_f32_avx2 + seleção completa (shapes com cauda e empates)
+static void test_kernel_matches_matmul(void) {
+    TEST_START("Kernel - logits bit-identical to matmul, top-k matches full selection");
+
+    static const uint32_t dims[] = {8, 64, 100, 288};
+    static const uint32_t vocabs[] = {1, 7, 37, 1000, 4099};
+    static const uint32_t ks[] = {1, 2, 5, 40};
+
+    q_context ctx = {0};
+    if (q_alloc_arena(&ctx, 64 * 1024 * 1024) != Q_OK) {
+        TEST_FAIL("Failed to allocate arena");
+        return;
+    }
+
+    const uint32_t max_dim = 288;
+    const uint32_t max_vocab = 4099;
+    float* x = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE(max_dim * sizeof(float)));
+    float* w = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE((size_t)max_vocab * max_dim * sizeof(float)));
+    float* ref = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE(max_vocab * sizeof(float)));
+    float* fused = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE(max_vocab * sizeof(float)));
+    bool* taken = (bool*)malloc(max_vocab * sizeof(bool));
+    if (x == NULL || w == NULL || ref == NULL || fused == NULL || taken == NULL) {
+        TEST_FAIL("Failed to allocate buffers");
+        free(x); free(w); free(ref); free(fused); free(taken);
+        q_free_memory(&ctx);
+        return;
+    }
+
+    uint32_t cases = 0;
+    for (size_t di = 0; di < sizeof(dims) / sizeof(dims[0]); di++) {
+        for (size_t vi = 0; vi < sizeof(vocabs) / sizeof(vocabs[0]); vi++) {
+            const uint32_t dim = dims[di];
+            const uint32_t vocab = vocabs[vi];
+            for (uint32_t i = 0; i < dim; i++) x[i] = lcg_float();
+            for (size_t i = 0; i < (size_t)vocab * dim; i++) w[i] = lcg_float();
+            // Linhas duplicadas → logits exatamente empatados (desempate por índice)
+            if (vocab >= 37) {
+                memcpy(w + (size_t)30 * dim, w + (size_t)3 * dim, dim * sizeof(float));
+                memcpy(w + (size_t)(vocab - 1) * dim, w + (size_t)3 * dim, dim * sizeof(float));
+            }
+
+            q_tensor x_t = {.data = x, .ne = {1, dim, 1, 1},
+                            .nb = {dim * sizeof(float), sizeof(float), sizeof(float), sizeof(float)},
+                            .type = Q_F32};
+            q_tensor w_t = {.data = w, .ne = {dim, vocab, 1, 1},
+                            .nb = {sizeof(float), dim * sizeof(float), sizeof(float), sizeof(float)},
+                            .type = Q_F32};
+            q_tensor out_t = {.data = ref, .ne = {1, vocab, 1, 1},
+                              .nb = {vocab * sizeof(float), sizeof(float), sizeof(float), sizeof(float)},
+                              .type = Q_F32};
+            q_error_code ret = q_matmul_f32_avx2(&x_t, &w_t, &out_t, &ctx);
+            q_arena_reset(&ctx);
+            if (ret != Q_OK) {
+                TEST_FAIL_MSG("q_matmul_f32_avx2 failed: %d", ret);
+                goto cleanup;
+            }
+
+            // Pesos no layout do LM head: [vocab, dim]
+            q_tensor head = {.data = w, .ne = {vocab, dim, 1, 1},
+                             .nb = {dim * sizeof(float), sizeof(float), sizeof(float), sizeof(float)},
+                             .type = Q_F32};
+            for (size_t ki = 0; ki < sizeof(ks) / sizeof(ks[0]); ki++) {
+                const uint32_t k = ks[ki] < vocab ? ks[ki] : vocab;
+                uint32_t ids[40];
+                float vals[40];
+                uint32_t expected[40];
+                ret = q_lm_head_topk_f32_avx2(x, &head, k, ids, vals, ki == 0 ? fused : NULL);
+                if (ret != Q_OK) {
+                    TEST_FAIL_MSG("dim=%u vocab=%u k=%u: failed %d", dim, vocab, k, ret);
+                    goto cleanup;
+                }
+                if (ki == 0 && memcmp(fused, ref, vocab * sizeof(float)) != 0) {
+                    TEST_FAIL_MSG("dim=%u vocab=%u: logits differ from matmul", dim, vocab);
+                    goto cleanup;
+                }
+                reference_topk(ref, vocab, k, expected, taken);
+                for (uint32_t j = 0; j < k; j++) {
+                    if (ids[j] != expected[j] || memcmp(&vals[j], &ref[expected[j]], sizeof(float)) != 0) {
+                        TEST_FAIL_MSG("dim=%u vocab=%u k=%u: rank %u got id %u, expected %u",
+                                      dim, vocab, k, j, ids[j], expected[j]);
+                        goto cleanup;
+                    }
+                }
+                cases++;
+            }
+        }
+    }
+    printf("  %u cases\n", cases);
+    TEST_PASS();
+
+cleanup:
+    free(x); free(w); free(ref); free(fused); free(taken);
+    q_free_memory(&ctx);
+}
+
+// Test 2: llama_forward_topk vs llama_forward (prefill + incremental)
+static void test_forward_topk_matches_forward(void) {
+    TEST_START("Model - llama_forward_topk matches llama_forward + argmax/top-k");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    const uint32_t vocab_size = model.config.vocab_size;
+    const size_t logits_bytes = Q_ALIGN_SIZE((size_t)vocab_size * sizeof(float));
+    float* ref = (float*)aligned_alloc(Q_ALIGN, logits_bytes);
+    float* fused = (float*)aligned_alloc(Q_ALIGN, logits_bytes);
+    bool* taken = (bool*)malloc(vocab_size * sizeof(bool));
+    if (ref == NULL || fused == NULL || taken == NULL) {
+        TEST_FAIL("Failed to allocate logits");
+        free(ref); free(fused); free(taken);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    const uint32_t prompt[] = {1, 42, 7, 1234};
+    const uint32_t prompt_len = sizeof(prompt) / sizeof(prompt[0]);
+    for (uint32_t step = 0; step < 3; step++) {
+        // step 0: prefill; steps 1-2: token incremental na posição seguinte
+        const uint32_t* tokens = step == 0 ? prompt : &prompt[step];
+        const uint32_t seq_len = step == 0 ? prompt_len : 1;
+        const uint32_t pos = step == 0 ? 0 : prompt_len + step - 1;
+
+        ret = llama_forward(&model, &ctx, tokens, seq_len, pos, ref);
+        q_arena_reset(&ctx);
+        if (ret != Q_OK) {
+            TEST_FAIL_MSG("llama_forward(step=%u) failed: %d", step, ret);
+            goto cleanup;
+        }
+
+        uint32_t greedy = 0;
+        float greedy_logit = 0.0f;
+        ret = llama_forward_topk(&model, &ctx, tokens, seq_len, pos, 1, &greedy, &greedy_logit, NULL);
+        q_arena_reset(&ctx);
+        uint32_t expected = 0;
+        if (ret == Q_OK) {
+            ret = q_sample_token(ref, vocab_size, 0.0f, 0, 0.0f, &expected, NULL);
+        }
+        if (ret != Q_OK || greedy != expected) {
+            TEST_FAIL_MSG("step=%u: greedy %u, expected %u (ret %d)", step, greedy, expected, ret);
+            goto cleanup;
+        }
+
+        uint32_t ids[8];
+        float vals[8];
+        uint32_t ref_ids[8];
+        ret = llama_forward_topk(&model, &ctx, tokens, seq_len, pos, 8, ids, vals, fused);
+        q_arena_reset(&ctx);
+        if (ret != Q_OK || memcmp(fused, ref, vocab_size * sizeof(float)) != 0) {
+            TEST_FAIL_MSG("step=%u: fused logits differ from llama_forward (ret %d)", step, ret);
+            goto cleanup;
+        }
+        reference_topk(ref, vocab_size, 8, ref_ids, taken);
+        if (memcmp(ids, ref_ids, sizeof(ids)) != 0) {
+            TEST_FAIL_MSG("step=%u: top-8 ids differ (first %u vs %u)", step, ids[0], ref_ids[0]);
+            goto cleanup;
+        }
+    }
+    TEST_PASS();
+
+cleanup:
+    free(ref); free(fused); free(taken);
+    CLEANUP_ALL(&ctx, &model);
+}
+
+// Test 3: Entradas inválidas (sem abort: validações retornam erro)
+static void test_kernel_invalid_inputs(void) {
+    TEST_START("Kernel - k == 0, k > vocab_size and non-F32 weights are rejected");
+
+    float x[8] __attribute__((aligned(32))) = {0};
+    float w[4 * 8] = {0};
+    q_tensor head = {.data = w, .ne = {4, 8, 1, 1},
+                     .nb = {8 * sizeof(float), sizeof(float), sizeof(float), sizeof(float)},
+                     .type = Q_F32};
+    uint32_t ids[5];
+    float vals[5];
+
+    q_error_code ret = q_lm_head_topk_f32_avx2(x, &head, 0, ids, vals, NULL);
+    if (ret != Q_ERR_INVALID_SIZE) {
+        TEST_FAIL_MSG("k=0: expected Q_ERR_INVALID_SIZE, got %d", ret);
+        return;
+    }
+    ret = q_lm_head_topk_f32_avx2(x, &head, 5, ids, vals, NULL);
+    if (ret != Q_ERR_INVALID_SIZE) {
+        TEST_FAIL_MSG("k>vocab: expected Q_ERR_INVALID_SIZE, got %d", ret);
+        return;
+    }
+    head.type = Q_Q8_0;
+    ret = q_lm_head_topk_f32_avx2(x, &head, 1, ids, vals, NULL);
+    if (ret != Q_ERR_INVALID_DTYPE) {
+        TEST_FAIL_MSG("Q8_0 weights: expected Q_ERR_INVALID_DTYPE, got %d", ret);
+        return;
+    }
+    TEST_PASS();
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstack-usage="
+int main(void) {
+    printf("========================================\n");
+    printf("  FUSED LM HEAD + TOP-K TEST SUITE\n");
+    printf("========================================\n\n");
+
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_kernel_matches_matmul();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_forward_topk_matches_forward();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_kernel_invalid_inputs();
+    } else {
+        TEST_CRASH();
+    }
+
+    printf("\n========================================\n");
+    printf("  TEST SUMMARY\n");
+    printf("========================================\n");
+    printf("Tests run:    %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_failed);
+    printf("Tests crashed: %d\n", tests_crashed);
+    printf("========================================\n");
+
+    if (tests_failed == 0 && tests_crashed == 0) {
+        printf("  ALL TESTS PASSED ✓\n");
+        printf("========================================\n");
+        return 0;
+    } else {
+        printf("  SOME TESTS FAILED ✗\n");
+        printf("========================================\n");
+        return 1;
+    }
+}
+#pragma GCC diagnostic pop
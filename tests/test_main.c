@@ -10,6 +10,9 @@
 // - Teste 3: top_k = 10 → Apenas top-10 tokens considerados
 // - Teste 4: top_p = 0.9 → Apenas tokens que somam 90% de probabilidade considerados
 // - Validação: sum(probs) = 1.0 ± 1e-5 (distribuição válida)
+// - Teste 10: sampler top-k-first escolhe o mesmo token que o pipeline com
+//   softmax completo (referência) para o mesmo estado do RNG
+// - Teste 11: min-p/typical escolhem tokens do conjunto da referência por sort
 // ============================================================================
 
 #include "qorus.h"
@@ -19,6 +22,8 @@
 #include <assert.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <threads.h>
 
 // Helper: Verificar se distribuição de probabilidades é válida
 static bool is_valid_distribution(const float* probs, uint32_t vocab_size, float tolerance) {
@@ -535,6 +540,434 @@ static void test_qsort_soa(void) {
     printf("✓ Test 9 PASSED\n\n");
 }
 
+// ============================================================================
+// Test 10: Top-k-first sampler vs pipeline de referência (softmax completo)
+// ============================================================================
+// Referência = pipeline anterior: softmax do vocabulário inteiro
+// (q_softmax_f32_avx2 em buffer alinhado), top-k e top-p por ordenação
+// completa, CDF com mask em ordem de índice. O sampler deve escolher
+// exatamente o mesmo token para o mesmo valor aleatório.
+
+typedef struct {
+    uint32_t index;
+    float prob;
+} ref_cand_t;
+
+static int ref_compare_desc(const void* a, const void* b) {
+    const ref_cand_t* ca = (const ref_cand_t*)a;
+    const ref_cand_t* cb = (const ref_cand_t*)b;
+    if (ca->prob > cb->prob) return -1;
+    if (ca->prob < cb->prob) return 1;
+    return (ca->index > cb->index) - (ca->index < cb->index);
+}
+
+// Mesmo xorshift64* thread-local de q_sample_token (uma chamada = um valor)
+static float ref_next_random(uint64_t* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    uint32_t rng_u32 = (uint32_t)((*state * 0x2545F4914F6CDD1DULL) >> 32);
+    return ((float)(rng_u32 >> 8)) / 16777216.0f;
+}
+
+static uint32_t ref_sample_token(
+    const float* logits,
+    uint32_t vocab_size,
+    float temperature,
+    uint32_t top_k,
+    float top_p,
+    float random_value
+) {
+    size_t probs_bytes = ((size_t)vocab_size * sizeof(float) + 31) & ~(size_t)31;
+    float* probs = (float*)aligned_alloc(32, probs_bytes);
+    bool* mask = (bool*)malloc(vocab_size * sizeof(bool));
+    ref_cand_t* sorted = (ref_cand_t*)malloc(vocab_size * sizeof(ref_cand_t));
+    assert(probs != NULL && mask != NULL && sorted != NULL);
+
+    // Temperatura: mul por 1/T no corpo SIMD (logits alinhados), divisão no resto
+    uint32_t vec_end = 0;
+    if (vocab_size >= 8 && ((uintptr_t)logits % 32) == 0) {
+        float inv_temp = 1.0f / temperature;
+        vec_end = vocab_size & ~7U;
+        for (uint32_t i = 0; i < vec_end; i++) {
+            probs[i] = logits[i] * inv_temp;
+        }
+    }
+    for (uint32_t i = vec_end; i < vocab_size; i++) {
+        probs[i] = logits[i] / temperature;
+    }
+
+    if (vocab_size >= 8) {
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wrestrict"
+        assert(q_softmax_f32_avx2(probs, probs, vocab_size) == Q_OK);
+        #pragma GCC diagnostic pop
+    } else {
+        float max_val = probs[0];
+        for (uint32_t i = 1; i < vocab_size; i++) {
+            if (probs[i] > max_val) max_val = probs[i];
+        }
+        float sum = 0.0f;
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            probs[i] = expf(probs[i] - max_val);
+            sum += probs[i];
+        }
+        float inv_sum = 1.0f / sum;
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            probs[i] *= inv_sum;
+        }
+    }
+
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        mask[i] = true;
+    }
+
+    if (top_k > 0 && top_k < vocab_size) {
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            sorted[i].index = i;
+            sorted[i].prob = probs[i];
+        }
+        qsort(sorted, vocab_size, sizeof(ref_cand_t), ref_compare_desc);
+        float sum_top_k = 0.0f;
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            mask[i] = false;
+        }
+        for (uint32_t i = 0; i < top_k; i++) {
+            mask[sorted[i].index] = true;
+            sum_top_k += sorted[i].prob;
+        }
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            probs[i] = mask[i] ? probs[i] / sum_top_k : 0.0f;
+        }
+    }
+
+    if (top_p > 0.0f && top_p < 1.0f) {
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            sorted[i].index = i;
+            sorted[i].prob = probs[i];
+        }
+        qsort(sorted, vocab_size, sizeof(ref_cand_t), ref_compare_desc);
+        float cumsum = 0.0f;
+        uint32_t nucleus = 0;
+        while (nucleus < vocab_size) {
+            cumsum += sorted[nucleus++].prob;
+            if (cumsum >= top_p) break;
+        }
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            mask[i] = false;
+        }
+        for (uint32_t i = 0; i < nucleus; i++) {
+            mask[sorted[i].index] = true;
+        }
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            probs[i] = mask[i] ? probs[i] / cumsum : 0.0f;
+        }
+    }
+
+    uint32_t token = vocab_size;
+    float cumsum = 0.0f;
+    for (uint32_t i = 0; i < vocab_size && token == vocab_size; i++) {
+        if (mask[i]) {
+            cumsum += probs[i];
+            if (random_value < cumsum) token = i;
+        }
+    }
+    for (uint32_t i = vocab_size; i > 0 && token == vocab_size; i--) {
+        if (mask[i - 1]) token = i - 1;
+    }
+
+    free(probs);
+    free(mask);
+    free(sorted);
+    return token;
+}
+
+typedef struct {
+    uint32_t cases;
+    uint32_t mismatches;
+} diff_result_t;
+
+// Roda em thread nova: estado do RNG thread-local começa na semente padrão
+static int sampler_differential_thread(void* arg) {
+    diff_result_t* result = (diff_result_t*)arg;
+    const uint32_t vocab_sizes[] = {5, 37, 1000, 32000, 32003};
+    const float temperatures[] = {0.7f, 1.0f, 1.3f};
+    const struct { uint32_t top_k; float top_p; } filters[] = {
+        {0, 0.0f}, {1, 0.0f}, {40, 0.0f}, {0, 0.5f}, {0, 0.9f}, {40, 0.95f}, {3, 0.8f},
+    };
+    const uint32_t max_vocab = 32003;
+
+    q_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    assert(q_alloc_arena(&ctx, 8 * 1024 * 1024) == Q_OK);
+
+    // +8 floats: permite logits desalinhados (offset 1) no mesmo buffer
+    float* buffer = (float*)aligned_alloc(32, (max_vocab + 8) * sizeof(float));
+    assert(buffer != NULL);
+
+    uint64_t rng_state = 123456789ULL;
+    uint32_t lcg = 12345u;
+
+    for (uint32_t v = 0; v < sizeof(vocab_sizes) / sizeof(vocab_sizes[0]); v++) {
+        uint32_t vocab_size = vocab_sizes[v];
+        for (uint32_t dist = 0; dist < 4; dist++) {
+            // dist 3: logits desalinhados (caminho escalar de temperatura)
+            float* logits = (dist == 3) ? buffer + 1 : buffer;
+            for (uint32_t i = 0; i < vocab_size; i++) {
+                float u = 0.0f;
+                for (int j = 0; j < 4; j++) {
+                    lcg = lcg * 1664525u + 1013904223u;
+                    u += (float)(lcg >> 8) / 16777216.0f;
+                }
+                float x = (u - 2.0f) * 3.0f;
+                if (dist == 1) {
+                    x = roundf(x * 2.0f) / 2.0f;  // Empates exatos
+                } else if (dist == 2 && (i % 97) == 0) {
+                    x += 6.0f;                    // Poucos tokens dominantes
+                }
+                if ((lcg & 63u) == 0) {
+                    x = -INFINITY;                // Token mascarado (gramática)
+                }
+                logits[i] = x;
+            }
+            logits[vocab_size / 2] = 4.0f;  // Garante ao menos um logit finito
+
+            for (uint32_t t = 0; t < sizeof(temperatures) / sizeof(temperatures[0]); t++) {
+                for (uint32_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+                    uint32_t token_id = UINT32_MAX;
+                    q_context* use_ctx = ((f + t) % 2 == 0) ? &ctx : NULL;
+                    q_arena_reset(&ctx);
+                    q_error_code err = q_sample_token(logits, vocab_size, temperatures[t],
+                                                      filters[f].top_k, filters[f].top_p,
+                                                      &token_id, use_ctx);
+                    assert(err == Q_OK);
+                    float r = ref_next_random(&rng_state);
+                    uint32_t expected = ref_sample_token(logits, vocab_size, temperatures[t],
+                                                         filters[f].top_k, filters[f].top_p, r);
+                    result->cases++;
+                    if (token_id != expected) {
+                        result->mismatches++;
+                        fprintf(stderr, "MISMATCH: V=%u dist=%u T=%.1f k=%u p=%.2f: got %u, expected %u\n",
+                                vocab_size, dist, (double)temperatures[t], filters[f].top_k,
+                                (double)filters[f].top_p, token_id, expected);
+                    }
+                }
+            }
+        }
+    }
+
+    free(buffer);
+    q_free_memory(&ctx);
+    return 0;
+}
+
+static void test_sampler_matches_reference(void) {
+    printf("Test 10: Top-k-first Sampler vs Full-Softmax Reference\n");
+    printf("--------------------------------------------------------\n");
+
+    diff_result_t result = {0, 0};
+    thrd_t thread;
+    assert(thrd_create(&thread, sampler_differential_thread, &result) == thrd_success);
+    int thread_ret = -1;
+    assert(thrd_join(thread, &thread_ret) == thrd_success);
+    assert(thread_ret == 0);
+
+    printf("  %u cases, %u mismatches\n", result.cases, result.mismatches);
+    assert(result.mismatches == 0 && "Sampler must pick the same token as the reference pipeline");
+
+    printf("✓ Same token as full-softmax pipeline for fixed RNG state\n");
+    printf("✓ Test 10 PASSED\n\n");
+}
+
+// ============================================================================
+// Test 11: Min-p e typical vs referência por ordenação completa
+// ============================================================================
+// Referência: softmax do vocabulário (q_softmax_f32_avx2, T = 1), sort
+// decrescente e filtros na ordem top-k → min-p → typical (typical por sort
+// estável de |-log p - H|). O token amostrado deve pertencer ao conjunto da
+// referência e, em vocabulário pequeno, as frequências devem seguir as
+// probabilidades renormalizadas.
+
+typedef struct {
+    uint32_t pos;   // Posição na ordem decrescente de p
+    float score;
+} ref_typical_t;
+
+static int ref_compare_typical(const void* a, const void* b) {
+    const ref_typical_t* ta = (const ref_typical_t*)a;
+    const ref_typical_t* tb = (const ref_typical_t*)b;
+    if (ta->score < tb->score) return -1;
+    if (ta->score > tb->score) return 1;
+    return (ta->pos > tb->pos) - (ta->pos < tb->pos);
+}
+
+// probs_out[V]: probabilidade final (0 = fora do conjunto)
+static void ref_filtered_probs(const float* logits, uint32_t vocab_size, uint32_t top_k,
+                               float min_p, float typical_p, float* probs_out) {
+    float* probs = (float*)aligned_alloc(32, (((size_t)vocab_size * sizeof(float)) + 31) & ~(size_t)31);
+    ref_cand_t* sorted = (ref_cand_t*)malloc(vocab_size * sizeof(ref_cand_t));
+    ref_typical_t* typical = (ref_typical_t*)malloc(vocab_size * sizeof(ref_typical_t));
+    assert(probs != NULL && sorted != NULL && typical != NULL);
+    memcpy(probs, logits, vocab_size * sizeof(float));
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wrestrict"
+    assert(q_softmax_f32_avx2(probs, probs, vocab_size) == Q_OK);
+    #pragma GCC diagnostic pop
+
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        sorted[i].index = i;
+        sorted[i].prob = probs[i];
+    }
+    qsort(sorted, vocab_size, sizeof(ref_cand_t), ref_compare_desc);
+
+    uint32_t n = (top_k > 0 && top_k < vocab_size) ? top_k : vocab_size;
+    if (min_p > 0.0f) {
+        uint32_t keep = 1;
+        while (keep < n && sorted[keep].prob >= min_p * sorted[0].prob) keep++;
+        n = keep;
+    }
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < n; i++) sum += sorted[i].prob;
+    for (uint32_t i = 0; i < n; i++) sorted[i].prob /= sum;
+
+    uint32_t first = 0;
+    if (typical_p > 0.0f && typical_p < 1.0f) {
+        float entropy = 0.0f;
+        for (uint32_t i = 0; i < n; i++) {
+            if (sorted[i].prob > 0.0f) entropy -= sorted[i].prob * logf(sorted[i].prob);
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            typical[i].pos = i;
+            typical[i].score = sorted[i].prob > 0.0f ? fabsf(-logf(sorted[i].prob) - entropy) : INFINITY;
+        }
+        qsort(typical, n, sizeof(ref_typical_t), ref_compare_typical);
+        float mass = 0.0f;
+        uint32_t lo = n;
+        uint32_t hi = 0;
+        for (uint32_t i = 0; i < n && mass < typical_p; i++) {
+            mass += sorted[typical[i].pos].prob;
+            if (typical[i].pos < lo) lo = typical[i].pos;
+            if (typical[i].pos + 1 > hi) hi = typical[i].pos + 1;
+        }
+        first = lo;
+        n = hi;
+        sum = 0.0f;
+        for (uint32_t i = first; i < n; i++) sum += sorted[i].prob;
+        for (uint32_t i = first; i < n; i++) sorted[i].prob /= sum;
+    }
+
+    memset(probs_out, 0, vocab_size * sizeof(float));
+    for (uint32_t i = first; i < n; i++) {
+        probs_out[sorted[i].index] = sorted[i].prob;
+    }
+    free(probs);
+    free(sorted);
+    free(typical);
+}
+
+static void test_min_p_typical(void) {
+    printf("Test 11: Min-p and Typical Sampling vs Sort-based Reference\n");
+    printf("-----------------------------------------------------------\n");
+
+    const uint32_t vocab_sizes[] = {37, 1000, 32000, 32003};
+    const struct { uint32_t top_k; float min_p; float typical_p; } filters[] = {
+        {0, 0.05f, 0.0f}, {0, 0.3f, 0.0f}, {0, 1.0f, 0.0f}, {0, 0.0f, 0.9f}, {0, 0.0f, 0.3f},
+        {40, 0.1f, 0.0f}, {40, 0.0f, 0.7f}, {0, 0.05f, 0.8f}, {100, 0.02f, 0.95f},
+    };
+    const uint32_t max_vocab = 32003;
+
+    q_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    assert(q_alloc_arena(&ctx, 8 * 1024 * 1024) == Q_OK);
+    float* logits = (float*)aligned_alloc(32, (max_vocab + 7) / 8 * 8 * sizeof(float));
+    float* ref = (float*)malloc(max_vocab * sizeof(float));
+    assert(logits != NULL && ref != NULL);
+
+    uint32_t lcg = 4242u;
+    uint32_t cases = 0;
+    for (uint32_t v = 0; v < sizeof(vocab_sizes) / sizeof(vocab_sizes[0]); v++) {
+        uint32_t vocab_size = vocab_sizes[v];
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            lcg = lcg * 1664525u + 1013904223u;
+            logits[i] = ((float)(lcg >> 8) / 16777216.0f - 0.5f) * 12.0f;
+            if ((lcg & 63u) == 0) logits[i] = -INFINITY;
+        }
+        logits[vocab_size / 3] = 7.0f;
+
+        for (uint32_t f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+            ref_filtered_probs(logits, vocab_size, filters[f].top_k, filters[f].min_p,
+                               filters[f].typical_p, ref);
+            q_rng rng;
+            q_rng_init(&rng, 77, (uint64_t)f);
+            for (uint32_t draw = 0; draw < 200; draw++) {
+                uint32_t token_id = UINT32_MAX;
+                q_context* use_ctx = (draw % 2 == 0) ? &ctx : NULL;
+                q_arena_reset(&ctx);
+                assert(q_sample_token_ext(logits, vocab_size, 1.0f, filters[f].top_k, 0.0f,
+                                          filters[f].min_p, filters[f].typical_p, &rng,
+                                          &token_id, use_ctx) == Q_OK);
+                if (!(token_id < vocab_size && ref[token_id] > 0.0f)) {
+                    fprintf(stderr, "V=%u k=%u min_p=%.2f typical=%.2f: token %u outside reference set\n",
+                            vocab_size, filters[f].top_k, (double)filters[f].min_p,
+                            (double)filters[f].typical_p, token_id);
+                    assert(0 && "Sampled token outside min-p/typical set");
+                }
+                cases++;
+            }
+        }
+    }
+    printf("  %u draws inside the reference set\n", cases);
+
+    // Frequências (V = 37): empírico ≈ probabilidade renormalizada da referência
+    enum { DRAWS = 40000 };
+    uint32_t hist[37];
+    for (uint32_t i = 0; i < 37; i++) {
+        logits[i] = sinf((float)i * 0.9f) * 3.0f;
+    }
+    const float freq_filters[][2] = {{0.1f, 0.0f}, {0.0f, 0.6f}, {0.05f, 0.8f}};
+    for (uint32_t f = 0; f < 3; f++) {
+        ref_filtered_probs(logits, 37, 0, freq_filters[f][0], freq_filters[f][1], ref);
+        memset(hist, 0, sizeof(hist));
+        q_rng rng;
+        q_rng_init(&rng, 9, f);
+        for (uint32_t d = 0; d < DRAWS; d++) {
+            uint32_t token_id = 0;
+            assert(q_sample_token_ext(logits, 37, 1.0f, 0, 0.0f, freq_filters[f][0], freq_filters[f][1],
+                                      &rng, &token_id, NULL) == Q_OK);
+            hist[token_id]++;
+        }
+        for (uint32_t i = 0; i < 37; i++) {
+            float empirical = (float)hist[i] / (float)DRAWS;
+            assert(fabsf(empirical - ref[i]) < 0.015f && "Empirical frequency must follow filtered distribution");
+        }
+    }
+    printf("✓ Empirical frequencies follow the filtered distribution\n");
+
+    // min_p = typical_p = 0: idêntico a q_sample_token_rng (mesmo stream)
+    for (uint32_t d = 0; d < 64; d++) {
+        q_rng a;
+        q_rng b;
+        q_rng_init(&a, 1234, d);
+        q_rng_init(&b, 1234, d);
+        uint32_t t_ext = 0;
+        uint32_t t_rng = 0;
+        assert(q_sample_token_ext(logits, 37, 0.8f, d % 5, (d % 3) * 0.4f, 0.0f, 0.0f, &a, &t_ext, NULL) == Q_OK);
+        assert(q_sample_token_rng(logits, 37, 0.8f, d % 5, (d % 3) * 0.4f, &b, &t_rng, NULL) == Q_OK);
+        assert(t_ext == t_rng);
+    }
+
+    uint32_t token_id = 0;
+    assert(q_sample_token_ext(logits, 37, 1.0f, 0, 0.0f, 1.5f, 0.0f, NULL, &token_id, NULL) == Q_ERR_INVALID_ARG);
+    assert(q_sample_token_ext(logits, 37, 1.0f, 0, 0.0f, 0.0f, NAN, NULL, &token_id, NULL) == Q_ERR_INVALID_ARG);
+    assert(q_sample_token_ext(logits, 37, 1.0f, 0, 0.0f, -0.1f, 0.0f, NULL, &token_id, NULL) == Q_ERR_INVALID_ARG);
+
+    free(logits);
+    free(ref);
+    q_free_memory(&ctx);
+    printf("✓ Disabled filters match q_sample_token_rng; invalid parameters rejected\n");
+    printf("✓ Test 11 PASSED\n\n");
+}
+
 // MAIN TEST RUNNER
 int main(void) {
     printf("========================================\n");
@@ -553,6 +986,8 @@ int main(void) {
     test_top_p_convergence();
     test_soa_structure();
     test_qsort_soa();
+    test_sampler_matches_reference();
+    test_min_p_typical();
     
     printf("========================================\n");
     printf("  ALL TESTS PASSED ✓\n");
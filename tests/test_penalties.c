@@ -0,0 +1,295 @@
+// ============================================================================
+// TEST: Sparse token counts + penalties (q_token_counts, q_apply_penalties_f32_avx2)
+// ============================================================================
+// Valida o histograma esparso contra contagem densa e o estágio de penalties
+// (gather/scatter AVX2) contra a referência O(V + n): varrer generated_tokens
+// e aplicar em todos os logits. Logits devem ser bit-idênticos.
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <math.h>
+
+// ============================================================================
+// TEST CONFIGURATION
+// ============================================================================
+
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int tests_crashed = 0;
+
+static jmp_buf crash_jmp_buf;
+static void crash_handler(int sig) {
+    (void)sig;
+    longjmp(crash_jmp_buf, 1);
+}
+
+// ============================================================================
+// TEST HELPERS
+// ============================================================================
+
+#define TEST_START(name) \
+    do { \
+        printf("Test %d: %s\n", tests_run + 1, name); \
+    } while(0)
+
+#define TEST_PASS() do { \
+    tests_run++; \
+    tests_passed++; \
+    printf("  ✓ PASSED\n"); \
+} while(0)
+
+#define TEST_FAIL_MSG(fmt, ...) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: " fmt "\n", __VA_ARGS__); \
+} while(0)
+
+#define TEST_CRASH() do { \
+    tests_run++; \
+    tests_crashed++; \
+    printf("  ✗ CRASHED\n"); \
+} while(0)
+
+// PRNG determinístico (LCG)
+static uint32_t lcg_state = 777u;
+static uint32_t lcg_next(void) {
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return lcg_state >> 8;
+}
+
+// Tokens com repetição (distribuição enviesada para poucos ids)
+static uint32_t skewed_token(uint32_t vocab_size) {
+    const uint32_t r = lcg_next();
+    return (r & 3) == 0 ? (r >> 2) % vocab_size : (r >> 2) % 17;
+}
+
+// Referência O(V + n): contagem densa + penalty em todo o vocabulário
+static void reference_penalties(float* logits, uint32_t vocab_size, const uint32_t* tokens, uint32_t n,
+                                float rep, float freq, float pres, uint32_t* dense) {
+    memset(dense, 0, vocab_size * sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; i++) {
+        dense[tokens[i]]++;
+    }
+    const float r = (rep > 0.0f) ? rep : 1.0f;
+    for (uint32_t v = 0; v < vocab_size; v++) {
+        if (dense[v] == 0) {
+            continue;
+        }
+        float l = logits[v];
+        l = (l > 0.0f) ? l / r : l * r;
+        l -= (float)dense[v] * freq;
+        l -= pres;
+        logits[v] = l;
+    }
+}
+
+// ============================================================================
+// TEST CASES
+// ============================================================================
+
+// Test 1: Histograma esparso == contagem densa (inclui reset e limite max_unique)
+static void test_counts_match_dense(void) {
+    TEST_START("q_token_counts - sparse histogram matches dense counts");
+
+    enum { V = 5000, N = 3000 };
+    static uint32_t tokens[N];
+    static uint32_t dense[V];
+    q_token_counts tc = {0};
+    if (q_token_counts_init(&tc, N) != Q_OK) {
+        TEST_FAIL_MSG("%s", "q_token_counts_init failed");
+        return;
+    }
+
+    for (int round = 0; round < 2; round++) {
+        memset(dense, 0, sizeof(dense));
+        for (uint32_t i = 0; i < N; i++) {
+            tokens[i] = skewed_token(V);
+            dense[tokens[i]]++;
+            if (q_token_counts_add(&tc, tokens[i]) != Q_OK) {
+                TEST_FAIL_MSG("round %d: add(%u) failed", round, tokens[i]);
+                q_token_counts_free(&tc);
+                return;
+            }
+        }
+        uint32_t unique = 0;
+        for (uint32_t v = 0; v < V; v++) {
+            unique += (dense[v] > 0);
+            if (q_token_counts_get(&tc, v) != dense[v]) {
+                TEST_FAIL_MSG("round %d: count(%u) = %u, expected %u",
+                              round, v, q_token_counts_get(&tc, v), dense[v]);
+                q_token_counts_free(&tc);
+                return;
+            }
+        }
+        if (tc.n_unique != unique) {
+            TEST_FAIL_MSG("round %d: n_unique = %u, expected %u", round, tc.n_unique, unique);
+            q_token_counts_free(&tc);
+            return;
+        }
+        q_token_counts_reset(&tc);
+        if (tc.n_unique != 0 || q_token_counts_get(&tc, tokens[0]) != 0) {
+            TEST_FAIL_MSG("round %d: reset left counts behind", round);
+            q_token_counts_free(&tc);
+            return;
+        }
+    }
+    q_token_counts_free(&tc);
+
+    // Mais tokens distintos que max_unique: erro, sem corromper os existentes
+    q_token_counts small = {0};
+    if (q_token_counts_init(&small, 2) != Q_OK ||
+        q_token_counts_add(&small, 5) != Q_OK ||
+        q_token_counts_add(&small, 9) != Q_OK ||
+        q_token_counts_add(&small, 5) != Q_OK ||
+        q_token_counts_add(&small, 11) != Q_ERR_INVALID_SIZE ||
+        q_token_counts_get(&small, 5) != 2 || q_token_counts_get(&small, 11) != 0) {
+        TEST_FAIL_MSG("%s", "max_unique overflow not handled");
+        q_token_counts_free(&small);
+        return;
+    }
+    q_token_counts_free(&small);
+    q_token_counts_free(&small);  // Idempotente
+    TEST_PASS();
+}
+
+// Test 2: Penalties AVX2 == referência O(V + n), tokens não vistos intocados
+static void test_penalties_match_reference(void) {
+    TEST_START("q_apply_penalties_f32_avx2 - bit-identical to dense O(V + n) reference");
+
+    enum { V = 32003, MAX_N = 600 };
+    static float logits[V];
+    static float expected[V];
+    static uint32_t dense[V];
+    static uint32_t tokens[MAX_N];
+    static const uint32_t lengths[] = {0, 1, 7, 8, 9, 100, 600};
+    static const float params[][3] = {
+        {1.3f, 0.0f, 0.0f},     // Só repetition
+        {0.0f, 0.4f, 0.0f},     // Só frequency
+        {0.0f, 0.0f, 0.8f},     // Só presence
+        {1.1f, 0.25f, 0.5f},    // Todos
+        {0.7f, -0.2f, -0.3f},   // Valores que favorecem repetição
+        {1.0f, 0.0f, 0.0f},     // Tudo desabilitado: nenhuma mudança
+    };
+
+    uint32_t cases = 0;
+    for (size_t li = 0; li < sizeof(lengths) / sizeof(lengths[0]); li++) {
+        for (size_t pi = 0; pi < sizeof(params) / sizeof(params[0]); pi++) {
+            const uint32_t n = lengths[li];
+            q_token_counts tc = {0};
+            if (q_token_counts_init(&tc, MAX_N) != Q_OK) {
+                TEST_FAIL_MSG("%s", "q_token_counts_init failed");
+                return;
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                tokens[i] = skewed_token(V);
+                q_token_counts_add(&tc, tokens[i]);
+            }
+            for (uint32_t v = 0; v < V; v++) {
+                // Mistura de sinais, zeros e -inf (token mascarado)
+                const uint32_t r = lcg_next();
+                logits[v] = (r % 97 == 0) ? -INFINITY : ((float)(r % 2001) - 1000.0f) / 100.0f;
+                expected[v] = logits[v];
+            }
+            reference_penalties(expected, V, tokens, n, params[pi][0], params[pi][1], params[pi][2], dense);
+            q_error_code ret = q_apply_penalties_f32_avx2(logits, V, &tc,
+                                                          params[pi][0], params[pi][1], params[pi][2]);
+            q_token_counts_free(&tc);
+            if (ret != Q_OK) {
+                TEST_FAIL_MSG("n=%u params=%zu: failed %d", n, pi, ret);
+                return;
+            }
+            if (memcmp(logits, expected, sizeof(logits)) != 0) {
+                uint32_t v = 0;
+                while (memcmp(&logits[v], &expected[v], sizeof(float)) == 0) v++;
+                TEST_FAIL_MSG("n=%u params=%zu: logits[%u] = %f, expected %f",
+                              n, pi, v, (double)logits[v], (double)expected[v]);
+                return;
+            }
+            cases++;
+        }
+    }
+    printf("  %u cases\n", cases);
+    TEST_PASS();
+}
+
+// Test 3: Entradas inválidas
+static void test_penalties_invalid_inputs(void) {
+    TEST_START("q_apply_penalties_f32_avx2 - invalid inputs are rejected");
+
+    float logits[16] = {0};
+    q_token_counts tc = {0};
+    if (q_token_counts_init(&tc, 4) != Q_OK || q_token_counts_add(&tc, 20) != Q_OK) {
+        TEST_FAIL_MSG("%s", "setup failed");
+        q_token_counts_free(&tc);
+        return;
+    }
+    q_error_code r1 = q_apply_penalties_f32_avx2(logits, 16, &tc, 1.2f, 0.0f, 0.0f);   // id >= vocab
+    q_error_code r2 = q_apply_penalties_f32_avx2(logits, 32, &tc, -1.0f, 0.0f, 0.0f);  // rep < 0
+    q_error_code r3 = q_apply_penalties_f32_avx2(logits, 32, &tc, 1.0f, NAN, 0.0f);
+    q_error_code r4 = q_apply_penalties_f32_avx2(logits, 32, NULL, 1.0f, 0.0f, 0.0f);
+    q_token_counts_free(&tc);
+    if (r1 != Q_ERR_INVALID_ARG || r2 != Q_ERR_INVALID_ARG || r3 != Q_ERR_INVALID_ARG ||
+        r4 != Q_ERR_INVALID_ARG) {
+        TEST_FAIL_MSG("got %d %d %d %d", r1, r2, r3, r4);
+        return;
+    }
+    TEST_PASS();
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("  PENALTIES TEST SUITE\n");
+    printf("========================================\n\n");
+
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_counts_match_dense();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_penalties_match_reference();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_penalties_invalid_inputs();
+    } else {
+        TEST_CRASH();
+    }
+
+    printf("\n========================================\n");
+    printf("  TEST SUMMARY\n");
+    printf("========================================\n");
+    printf("Tests run:    %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_failed);
+    printf("Tests crashed: %d\n", tests_crashed);
+    printf("========================================\n");
+
+    if (tests_failed == 0 && tests_crashed == 0) {
+        printf("  ALL TESTS PASSED ✓\n");
+        printf("========================================\n");
+        return 0;
+    } else {
+        printf("  SOME TESTS FAILED ✗\n");
+        printf("========================================\n");
+        return 1;
+    }
+}
@@ -0,0 +1,381 @@
+// ============================================================================
+// TEST: Pre-tokenizer (Llama-3 split pattern)
+// ============================================================================
+// Valida q_pretokenize_next contra splits de referência do padrão Llama-3
+// (contrações, letras com prefixo, números 1-3 dígitos, pontuação, espaços e
+// quebras de linha, UTF-8 multibyte/inválido) e que BPE não cruza pré-tokens.
+// Valida q_utf8_validate (AVX2) contra um decodificador escalar de referência
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+
+// ============================================================================
+// TEST CONFIGURATION
+// ============================================================================
+
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int tests_crashed = 0;
+
+static jmp_buf crash_jmp_buf;
+static void crash_handler(int sig) {
+    (void)sig;
+    longjmp(crash_jmp_buf, 1);
+}
+
+// ============================================================================
+// TEST HELPERS
+// ============================================================================
+
+#define TEST_START(name) \
+    do { \
+        printf("Test %d: %s\n", tests_run + 1, name); \
+    } while(0)
+
+#define TEST_PASS() do { \
+    tests_run++; \
+    tests_passed++; \
+    printf("  ✓ PASSED\n"); \
+} while(0)
+
+#define TEST_FAIL(msg) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: %s\n", msg); \
+} while(0)
+
+#define TEST_FAIL_MSG(fmt, ...) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: " fmt "\n", __VA_ARGS__); \
+} while(0)
+
+#define TEST_CRASH() do { \
+    tests_run++; \
+    tests_crashed++; \
+    printf("  ✗ CRASHED\n"); \
+} while(0)
+
+// Compara split de text com pieces (terminado em NULL)
+static bool check_split(const char* text, const char* const* pieces) {
+    const size_t len = strlen(text);
+    size_t pos = 0;
+    size_t i = 0;
+    while (pos < len) {
+        const size_t end = q_pretokenize_next(text, len, pos);
+        if (pieces[i] == NULL || end <= pos ||
+            strlen(pieces[i]) != end - pos || memcmp(pieces[i], text + pos, end - pos) != 0) {
+            printf("    split mismatch at piece %zu of \"%s\": got \"%.*s\"\n",
+                   i, text, (int)(end - pos), text + pos);
+            return false;
+        }
+        pos = end;
+        i++;
+    }
+    return pieces[i] == NULL;
+}
+
+// Test 1: Palavras, contrações e números
+static void test_pretokenize_words_numbers(void) {
+    TEST_START("Words, contractions and numbers");
+
+    static const char* const s1[] = { "Hello", " world", NULL };
+    static const char* const s2[] = { "I", "'m", " here", NULL };
+    static const char* const s3[] = { "don", "'t", " we", "'LL", NULL };
+    static const char* const s4[] = { "123", "45", NULL };
+    static const char* const s5[] = { "abc", "123", "def", NULL };
+    static const char* const s6[] = { "(hello", ")", NULL };
+    static const char* const s7[] = { "'x", NULL };
+
+    if (!check_split("Hello world", s1) || !check_split("I'm here", s2) ||
+        !check_split("don't we'LL", s3) || !check_split("12345", s4) ||
+        !check_split("abc123def", s5) || !check_split("(hello)", s6) ||
+        !check_split("'x", s7)) {
+        TEST_FAIL("Unexpected split");
+        return;
+    }
+    TEST_PASS();
+}
+
+// Test 2: Espaços, quebras de linha e pontuação
+static void test_pretokenize_whitespace(void) {
+    TEST_START("Whitespace, newlines and punctuation");
+
+    static const char* const s1[] = { "a", " ", " b", NULL };
+    static const char* const s2[] = { "a", "\n\n", "b", NULL };
+    static const char* const s3[] = { "x", "   \n", " ", " y", NULL };
+    static const char* const s4[] = { " ", " leading", NULL };
+    static const char* const s5[] = { "trailing", "  ", NULL };
+    static const char* const s6[] = { "hi", "!!!", " ok", NULL };
+    static const char* const s7[] = { "end", ".\n", NULL };
+    static const char* const s8[] = { "a", " ", "1", NULL };
+    static const char* const s9[] = { "\tindent", NULL };
+
+    if (!check_split("a  b", s1) || !check_split("a\n\nb", s2) ||
+        !check_split("x   \n  y", s3) || !check_split("  leading", s4) ||
+        !check_split("trailing  ", s5) || !check_split("hi!!! ok", s6) ||
+        !check_split("end.\n", s7) || !check_split("a 1", s8) ||
+        !check_split("\tindent", s9)) {
+        TEST_FAIL("Unexpected split");
+        return;
+    }
+    TEST_PASS();
+}
+
+// Test 3: UTF-8 multibyte e bytes inválidos
+static void test_pretokenize_utf8(void) {
+    TEST_START("UTF-8 letters, emoji and invalid bytes");
+
+    static const char* const s1[] = { "caf\xC3\xA9", " na\xC3\xAFve", NULL };         // café naïve
+    static const char* const s2[] = { "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E", NULL }; // 日本語
+    static const char* const s3[] = { "hi", " \xF0\x9F\x91\x8B\xF0\x9F\x91\x8B", NULL }; // hi 👋👋
+    static const char* const s4[] = { "\xFF\xFE", "ab", NULL };                         // inválido
+    static const char* const s5[] = { "a", "\xC2\xA0", " b", NULL };                    // NBSP é \s
+    static const char* const s6[] = { "x", "\xC3", NULL };                               // truncado
+
+    if (!check_split("caf\xC3\xA9 na\xC3\xAFve", s1) ||
+        !check_split("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E", s2) ||
+        !check_split("hi \xF0\x9F\x91\x8B\xF0\x9F\x91\x8B", s3) ||
+        !check_split("\xFF\xFE" "ab", s4) ||
+        !check_split("a\xC2\xA0 b", s5) ||
+        !check_split("x\xC3", s6)) {
+        TEST_FAIL("Unexpected split");
+        return;
+    }
+    TEST_PASS();
+}
+
+// Test 4: Merges não cruzam fronteiras de pré-token
+static void test_merges_respect_pretokens(void) {
+    TEST_START("BPE merges stay inside pre-tokens");
+
+    q_tokenizer tok;
+    memset(&tok, 0, sizeof(tok));
+    tok.vocab_size = 300;
+    tok.bos_token_id = 256;
+    tok.eos_token_id = 257;
+    tok.pad_token_id = 258;
+    tok.num_merges = 2;
+    q_bpe_merge merges[2] = {
+        { .token_id1 = 'a', .token_id2 = ' ', .merged_id = 260 },  // "a " cruzaria fronteira
+        { .token_id1 = ' ', .token_id2 = 'b', .merged_id = 261 },  // " b" é um pré-token
+    };
+    tok.merges = merges;
+    tok.initialized = true;
+
+    uint32_t tokens[16];
+    uint32_t num_tokens = 0;
+    q_error_code err = q_tokenizer_encode(&tok, "a b", tokens, &num_tokens, 16, false, false);
+    if (err != Q_OK || num_tokens != 2 || tokens[0] != 'a' || tokens[1] != 261) {
+        TEST_FAIL_MSG("Expected [a, \" b\"], got %u tokens (err %d)", num_tokens, err);
+        return;
+    }
+    TEST_PASS();
+}
+
+// Test 5: Runs de letras longos (passos AVX2 de 32 bytes) com letras não-ASCII
+static void test_pretokenize_long_runs(void) {
+    TEST_START("Long letter runs across 32-byte strides");
+
+    char text[256];
+    char w1[128];
+    char w2[128];
+    // 40 'a' + é + 10 'b' + " x": é (letra) não encerra o run
+    memset(w1, 'a', 40);
+    memcpy(w1 + 40, "\xC3\xA9", 2);
+    memset(w1 + 42, 'b', 10);
+    w1[52] = '\0';
+    snprintf(text, sizeof(text), "%s x", w1);
+    const char* const s1[] = { w1, " x", NULL };
+
+    // 70 'a' + "1": dígito ASCII encerra o run no meio do bloco
+    memset(w2, 'a', 70);
+    w2[70] = '\0';
+    char text2[160];
+    snprintf(text2, sizeof(text2), "%s1", w2);
+    const char* const s2[] = { w2, "1", NULL };
+
+    // 33 'z' + 👋 + "b": emoji (pontuação) encerra o run; vira prefixo de "b"
+    char w3[64];
+    memset(w3, 'z', 33);
+    w3[33] = '\0';
+    char text3[160];
+    snprintf(text3, sizeof(text3), "%s\xF0\x9F\x91\x8B" "b", w3);
+    const char* const s3[] = { w3, "\xF0\x9F\x91\x8B" "b", NULL };
+
+    if (!check_split(text, s1) || !check_split(text2, s2) || !check_split(text3, s3)) {
+        TEST_FAIL("Unexpected split");
+        return;
+    }
+    TEST_PASS();
+}
+
+// Referência escalar (RFC 3629)
+static bool utf8_validate_scalar(const uint8_t* s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        const uint8_t c = s[i];
+        size_t need;
+        uint32_t cp;
+        if (c < 0x80) {
+            i++;
+            continue;
+        } else if (c >= 0xC2 && c <= 0xDF) {
+            need = 1;
+            cp = c & 0x1F;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            need = 2;
+            cp = c & 0x0F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            need = 3;
+            cp = c & 0x07;
+        } else {
+            return false;
+        }
+        if (i + need >= len) {
+            return false;
+        }
+        for (size_t k = 1; k <= need; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+            cp = (cp << 6) | (s[i + k] & 0x3F);
+        }
+        if ((need == 2 && cp < 0x800) || (need == 3 && (cp < 0x10000 || cp > 0x10FFFF)) ||
+            (cp >= 0xD800 && cp <= 0xDFFF)) {
+            return false;
+        }
+        i += need + 1;
+    }
+    return true;
+}
+
+static uint32_t test_rng(uint32_t* state) {
+    *state = *state * 1664525U + 1013904223U;
+    return *state >> 8;
+}
+
+// Test 6: q_utf8_validate (AVX2) vs. referência escalar
+static void test_utf8_validate(void) {
+    TEST_START("UTF-8 validation (AVX2) matches scalar reference");
+
+    static const char* const valid[] = {
+        "", "hello", "caf\xC3\xA9", "\xE6\x97\xA5\xE6\x9C\xAC", "\xF0\x9F\x91\x8B",
+        "\xF4\x8F\xBF\xBF", "\xED\x9F\xBF", "\xEF\xBB\xBF" "bom",
+    };
+    static const char* const invalid[] = {
+        "\x80", "\xC3", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF",
+        "\xED\xA0\x80", "\xF0\x80\x80\x80", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80",
+        "\xFF", "a\xE6\x97", "\xF0\x9F\x91",
+    };
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        if (!q_utf8_validate(valid[i], strlen(valid[i]))) {
+            TEST_FAIL_MSG("valid case %zu rejected", i);
+            return;
+        }
+    }
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        if (q_utf8_validate(invalid[i], strlen(invalid[i]))) {
+            TEST_FAIL_MSG("invalid case %zu accepted", i);
+            return;
+        }
+    }
+
+    // Fuzz: code points válidos (1-4 bytes) com corrupções pontuais, em todas as
+    // posições relativas a blocos de 32 bytes (inclusive sequência cruzando blocos)
+    static const uint32_t cps[] = { 'a', ' ', 0xE9, 0x3B1, 0x65E5, 0xFF0C, 0x1F44B, 0x10FFFF, 0xD7FF };
+    uint8_t buf[160];
+    uint32_t state = 12345;
+    for (uint32_t iter = 0; iter < 20000; iter++) {
+        size_t len = 0;
+        const size_t target = test_rng(&state) % 150;
+        while (len + 4 <= target) {
+            const uint32_t cp = cps[test_rng(&state) % (sizeof(cps) / sizeof(cps[0]))];
+            if (cp < 0x80) {
+                buf[len++] = (uint8_t)cp;
+            } else if (cp < 0x800) {
+                buf[len++] = (uint8_t)(0xC0 | (cp >> 6));
+                buf[len++] = (uint8_t)(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                buf[len++] = (uint8_t)(0xE0 | (cp >> 12));
+                buf[len++] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+                buf[len++] = (uint8_t)(0x80 | (cp & 0x3F));
+            } else {
+                buf[len++] = (uint8_t)(0xF0 | (cp >> 18));
+                buf[len++] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+                buf[len++] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+                buf[len++] = (uint8_t)(0x80 | (cp & 0x3F));
+            }
+        }
+        // 0-2 corrupções: byte aleatório ou truncamento no fim
+        const uint32_t n_corrupt = test_rng(&state) % 3;
+        for (uint32_t k = 0; k < n_corrupt && len > 0; k++) {
+            if (test_rng(&state) % 4 == 0) {
+                len--;
+            } else {
+                buf[test_rng(&state) % len] = (uint8_t)test_rng(&state);
+            }
+        }
+        const bool expected = utf8_validate_scalar(buf, len);
+        if (q_utf8_validate((const char*)buf, len) != expected) {
+            TEST_FAIL_MSG("mismatch at iteration %u (len %zu, expected %d)", iter, len, expected);
+            return;
+        }
+    }
+    TEST_PASS();
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstack-usage="
+int main(void) {
+    printf("========================================\n");
+    printf("  PRE-TOKENIZER TEST SUITE\n");
+    printf("========================================\n\n");
+
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    void (*tests[])(void) = {
+        test_pretokenize_words_numbers,
+        test_pretokenize_whitespace,
+        test_pretokenize_utf8,
+        test_merges_respect_pretokens,
+        test_pretokenize_long_runs,
+        test_utf8_validate,
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (setjmp(crash_jmp_buf) == 0) {
+            tests[i]();
+        } else {
+            TEST_CRASH();
+        }
+    }
+
+    printf("\n========================================\n");
+    printf("  TEST SUMMARY\n");
+    printf("========================================\n");
+    printf("Tests run:    %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_failed);
+    printf("Tests crashed: %d\n", tests_crashed);
+    printf("========================================\n");
+
+    if (tests_failed == 0 && tests_crashed == 0) {
+        printf("  ALL TESTS PASSED ✓\n");
+        printf("========================================\n");
+        return 0;
+    } else {
+        printf("  SOME TESTS FAILED ✗\n");
+        printf("========================================\n");
+        return 1;
+    }
+}
+#pragma GCC diagnostic pop
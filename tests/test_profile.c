@@ -0,0 +1,671 @@
+// ============================================================================
+// TEST: Profiling timers (q_profile_*, Q_PROFILE)
+// ============================================================================
+// Sem PROFILE=1: q_profile_enable / q_trace_enable retornam Q_ERR_INVALID_CONFIG
+// e o forward não registra nada. Com PROFILE=1 (make clean-objs && make PROFILE=1
+// test-profile): contagens por camada == número de forwards, slot global == tokens
+// amostrados, trace JSON com um evento por intervalo e uma trilha por thread;
+// enable/disable/dump seguros com forwards em voo.
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// ============================================================================
+// TEST CONFIGURATION
+// ============================================================================
+
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int tests_crashed = 0;
+
+static jmp_buf crash_jmp_buf;
+static void crash_handler(int sig) {
+    (void)sig;
+    longjmp(crash_jmp_buf, 1);
+}
+
+// ============================================================================
+// TEST HELPERS
+// ============================================================================
+
+#define TEST_START(name) \
+    do { \
+        printf("Test %d: %s\n", tests_run + 1, name); \
+    } while(0)
+
+#define TEST_PASS() do { \
+    tests_run++; \
+    tests_passed++; \
+    printf("  ✓ PASSED\n"); \
+} while(0)
+
+#define TEST_FAIL_MSG(fmt, ...) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: " fmt "\n", __VA_ARGS__); \
+} while(0)
+
+#define TEST_CRASH() do { \
+    tests_run++; \
+    tests_crashed++; \
+    printf("  ✗ CRASHED\n"); \
+} while(0)
+
+// Contexto + modelo dummy + tokenizer (gerados pelo target do Makefile)
+typedef struct {
+    q_context ctx;
+    q_llama_model model;
+    q_tokenizer tokenizer;
+} profile_fixture;
+
+static q_error_code fixture_init(profile_fixture* f) {
+    memset(f, 0, sizeof(*f));
+    q_error_code ret = q_init_memory(&f->ctx, "model_dummy.qorus");
+    if (ret != Q_OK) return ret;
+    ret = q_alloc_arena(&f->ctx, 64 * 1024 * 1024);
+    if (ret != Q_OK) return ret;
+    ret = llama_build_graph(&f->ctx, &f->model);
+    if (ret != Q_OK) return ret;
+    const q_llama_config* c = &f->model.config;
+    const size_t kv_size = (size_t)c->n_layers * c->n_kv_heads * c->max_seq_len *
+                           (c->dim / c->n_heads) * sizeof(float) * 2;
+    ret = q_alloc_kv_cache(&f->ctx, Q_ALIGN_SIZE(kv_size));
+    if (ret != Q_OK) return ret;
+    return q_tokenizer_load(&f->tokenizer, "tokenizer.bin");
+}
+
+static void fixture_free(profile_fixture* f) {
+    if (f->tokenizer.vocab != NULL) q_tokenizer_free(&f->tokenizer);
+    if (f->model.layers != NULL) llama_free_graph(&f->model);
+    q_free_memory(&f->ctx);  // Também libera ctx->profile
+}
+
+// Dump do trace em memória (string terminada em zero, NULL em erro)
+static char* trace_dump_to_string(void) {
+    FILE* tmp = tmpfile();
+    if (tmp == NULL) return NULL;
+    if (q_trace_write_json(tmp) != Q_OK) {
+        fclose(tmp);
+        return NULL;
+    }
+    const long size = ftell(tmp);
+    rewind(tmp);
+    char* json = (size > 0) ? (char*)malloc((size_t)size + 1) : NULL;
+    if (json != NULL) {
+        const size_t n = fread(json, 1, (size_t)size, tmp);
+        json[n] = '\0';
+    }
+    fclose(tmp);
+    return json;
+}
+
+static uint64_t count_occurrences(const char* haystack, const char* needle) {
+    uint64_t n = 0;
+    for (const char* p = strstr(haystack, needle); p != NULL; p = strstr(p + 1, needle)) {
+        n++;
+    }
+    return n;
+}
+
+// ============================================================================
+// TEST CASES
+// ============================================================================
+
+// Test 1: API tolera NULL e nomeia todas as ops
+static void test_profile_api_guards(void) {
+    TEST_START("q_profile_* - NULL handling and op names");
+
+    q_context ctx = {0};
+    if (q_profile_enable(NULL) != Q_ERR_INVALID_ARG || q_profile_get(NULL) != NULL ||
+        q_profile_get(&ctx) != NULL || q_profile_ticks_to_ns(NULL, 1000) > 0.0) {
+        TEST_FAIL_MSG("%s", "NULL inputs not handled");
+        return;
+    }
+    q_profile_disable(NULL);
+    q_profile_reset(NULL);
+    q_profile_reset(&ctx);
+    q_profile_print(&ctx, stdout);  // Desabilitado: não imprime nada
+
+    for (uint32_t op = 0; op < Q_PROF_OP_COUNT; op++) {
+        if (strcmp(q_profile_op_name((q_profile_op)op), "unknown") == 0) {
+            TEST_FAIL_MSG("op %u has no name", op);
+            return;
+        }
+    }
+    if (strcmp(q_profile_op_name(Q_PROF_OP_COUNT), "unknown") != 0) {
+        TEST_FAIL_MSG("%s", "Q_PROF_OP_COUNT should be unknown");
+        return;
+    }
+    TEST_PASS();
+}
+
+// Test 2: Forward - uma entrada por op x camada por forward
+static void test_profile_forward_counts(void) {
+    TEST_START("llama_forward - per-layer counts match number of forwards");
+
+    profile_fixture f;
+    q_error_code ret = fixture_init(&f);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("fixture init failed: %d", ret);
+        fixture_free(&f);
+        return;
+    }
+
+    ret = q_profile_enable(&f.ctx);
+#ifdef Q_PROFILE
+    const bool compiled = true;
+#else
+    const bool compiled = false;
+#endif
+    if (!compiled) {
+        // Build sem timers: enable recusa e o forward segue funcionando
+        if (ret != Q_ERR_INVALID_CONFIG || q_profile_get(&f.ctx) != NULL) {
+            TEST_FAIL_MSG("expected Q_ERR_INVALID_CONFIG without Q_PROFILE, got %d", ret);
+            fixture_free(&f);
+            return;
+        }
+    } else if (ret != Q_OK || q_profile_get(&f.ctx) == NULL) {
+        TEST_FAIL_MSG("q_profile_enable failed: %d", ret);
+        fixture_free(&f);
+        return;
+    }
+
+    const uint32_t vocab_size = f.model.config.vocab_size;
+    float* logits = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE((size_t)vocab_size * sizeof(float)));
+    if (logits == NULL) {
+        TEST_FAIL_MSG("%s", "logits alloc failed");
+        fixture_free(&f);
+        return;
+    }
+
+    // Prefill de 3 tokens + 2 incrementais
+    enum { N_FORWARDS = 3 };
+    const uint32_t prompt[3] = {1, 5, 9};
+    const uint32_t seq_lens[N_FORWARDS] = {3, 1, 1};
+    uint32_t pos = 0;
+    for (uint32_t i = 0; i < N_FORWARDS; i++) {
+        q_arena_reset(&f.ctx);
+        ret = llama_forward(&f.model, &f.ctx, prompt, seq_lens[i], pos, logits);
+        if (ret != Q_OK) {
+            TEST_FAIL_MSG("llama_forward %u failed: %d", i, ret);
+            free(logits);
+            fixture_free(&f);
+            return;
+        }
+        pos += seq_lens[i];
+    }
+    free(logits);
+
+    const q_profile_stats* stats = q_profile_get(&f.ctx);
+    if (!compiled) {
+        printf("  (timers não compilados: make clean-objs && make PROFILE=1 test-profile)\n");
+        fixture_free(&f);
+        TEST_PASS();
+        return;
+    }
+
+    if (stats->n_layers != f.model.config.n_layers || !(stats->ticks_per_ns > 0.0)) {
+        TEST_FAIL_MSG("n_layers = %u (expected %u), ticks_per_ns = %f",
+                      stats->n_layers, f.model.config.n_layers, stats->ticks_per_ns);
+        fixture_free(&f);
+        return;
+    }
+    for (uint32_t l = 0; l < stats->n_layers; l++) {
+        for (uint32_t op = Q_PROF_ATTN_NORM; op <= Q_PROF_MLP_DOWN; op++) {
+            const q_profile_entry* e = &stats->entries[l][op];
+            if (e->count != N_FORWARDS || e->min_ticks > e->max_ticks || e->total_ticks < e->max_ticks) {
+                TEST_FAIL_MSG("layer %u %s: count=%llu min=%llu max=%llu total=%llu",
+                              l, q_profile_op_name((q_profile_op)op), (unsigned long long)e->count,
+                              (unsigned long long)e->min_ticks, (unsigned long long)e->max_ticks,
+                              (unsigned long long)e->total_ticks);
+                fixture_free(&f);
+                return;
+            }
+        }
+    }
+    if (stats->entries[Q_PROFILE_GLOBAL][Q_PROF_LM_HEAD].count != N_FORWARDS ||
+        stats->entries[Q_PROFILE_GLOBAL][Q_PROF_SAMPLER].count != 0) {
+        TEST_FAIL_MSG("global: lm_head=%llu sampler=%llu",
+                      (unsigned long long)stats->entries[Q_PROFILE_GLOBAL][Q_PROF_LM_HEAD].count,
+                      (unsigned long long)stats->entries[Q_PROFILE_GLOBAL][Q_PROF_SAMPLER].count);
+        fixture_free(&f);
+        return;
+    }
+    q_profile_print(&f.ctx, stdout);
+
+    // Reset zera contagens sem desabilitar
+    q_profile_reset(&f.ctx);
+    if (stats->n_layers != 0 || stats->entries[0][Q_PROF_QKV_PROJ].count != 0 ||
+        q_profile_get(&f.ctx) != stats) {
+        TEST_FAIL_MSG("%s", "reset did not clear stats");
+        fixture_free(&f);
+        return;
+    }
+    fixture_free(&f);
+    if (f.ctx.profile != NULL) {
+        TEST_FAIL_MSG("%s", "q_free_memory did not release profile stats");
+        return;
+    }
+    TEST_PASS();
+}
+
+// Test 3: q_generate - penalties/sampler registrados uma vez por token amostrado
+static void test_profile_generate_counts(void) {
+    TEST_START("q_generate - global slot counts match sampled tokens");
+
+    profile_fixture f;
+    q_error_code ret = fixture_init(&f);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("fixture init failed: %d", ret);
+        fixture_free(&f);
+        return;
+    }
+    const bool enabled = (q_profile_enable(&f.ctx) == Q_OK);
+
+    uint32_t prompt[2] = {1, 7};
+    uint32_t generated[8];
+    q_rng rng;
+    q_rng_init(&rng, 1234, 0);
+    q_generation_state gen_state = {
+        .ctx = &f.ctx,
+        .model = &f.model,
+        .tokenizer = &f.tokenizer,
+        .prompt_tokens = prompt,
+        .num_prompt_tokens = 2,
+        .generated_tokens = generated,
+        .max_tokens = 8,
+        .temperature = 0.8f,
+        .top_p = 0.9f,
+        .presence_penalty = 0.5f,
+        .rng = &rng
+    };
+    ret = q_generate(&gen_state);
+    if (ret != Q_OK || gen_state.num_generated_tokens == 0) {
+        TEST_FAIL_MSG("q_generate failed: %d (%u tokens)", ret, gen_state.num_generated_tokens);
+        fixture_free(&f);
+        return;
+    }
+
+    if (enabled) {
+        const q_profile_stats* stats = q_profile_get(&f.ctx);
+        const uint64_t n = gen_state.num_generated_tokens;
+        const uint64_t lm_head = stats->entries[Q_PROFILE_GLOBAL][Q_PROF_LM_HEAD].count;
+        if (stats->entries[Q_PROFILE_GLOBAL][Q_PROF_SAMPLER].count != n ||
+            stats->entries[Q_PROFILE_GLOBAL][Q_PROF_PENALTIES].count != n ||
+            stats->entries[Q_PROFILE_GLOBAL][Q_PROF_GRAMMAR].count != 0 ||
+            lm_head < n || lm_head > n + 1 ||
+            stats->entries[0][Q_PROF_MLP_DOWN].count != lm_head) {
+            TEST_FAIL_MSG("n=%llu sampler=%llu penalties=%llu lm_head=%llu layer0=%llu",
+                          (unsigned long long)n,
+                          (unsigned long long)stats->entries[Q_PROFILE_GLOBAL][Q_PROF_SAMPLER].count,
+                          (unsigned long long)stats->entries[Q_PROFILE_GLOBAL][Q_PROF_PENALTIES].count,
+                          (unsigned long long)lm_head,
+                          (unsigned long long)stats->entries[0][Q_PROF_MLP_DOWN].count);
+            fixture_free(&f);
+            return;
+        }
+        q_profile_print(&f.ctx, stdout);
+    }
+    fixture_free(&f);
+    TEST_PASS();
+}
+
+// Test 4: Trace de q_generate - JSON com spans prefill/decode/layer e ops
+static void test_trace_generate_json(void) {
+    TEST_START("q_trace_write_json - generation timeline as Chrome trace JSON");
+
+    q_error_code ret = q_trace_enable(4096);
+#ifndef Q_PROFILE
+    if (ret != Q_ERR_INVALID_CONFIG || q_trace_write_json(stdout) != Q_ERR_INVALID_CONFIG ||
+        q_trace_event_count() != 0) {
+        TEST_FAIL_MSG("expected Q_ERR_INVALID_CONFIG without Q_PROFILE, got %d", ret);
+        return;
+    }
+    printf("  (trace não compilado: make clean-objs && make PROFILE=1 test-profile)\n");
+    TEST_PASS();
+    return;
+#endif
+    if (ret != Q_OK || q_trace_enable(Q_TRACE_MAX_CAPACITY + 1) != Q_ERR_INVALID_SIZE ||
+        q_trace_write_json(NULL) != Q_ERR_INVALID_ARG) {
+        TEST_FAIL_MSG("q_trace_enable / argument checks failed: %d", ret);
+        q_trace_disable();
+        return;
+    }
+
+    profile_fixture f;
+    ret = fixture_init(&f);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("fixture init failed: %d", ret);
+        fixture_free(&f);
+        q_trace_disable();
+        return;
+    }
+    // Trace independe dos stats por contexto (q_profile_enable não chamado)
+    uint32_t prompt[3] = {1, 7, 3};
+    uint32_t generated[4];
+    q_generation_state gen_state = {
+        .ctx = &f.ctx,
+        .model = &f.model,
+        .tokenizer = &f.tokenizer,
+        .prompt_tokens = prompt,
+        .num_prompt_tokens = 3,
+        .generated_tokens = generated,
+        .max_tokens = 4,
+        .temperature = 0.0f
+    };
+    ret = q_generate(&gen_state);
+    const uint32_t n_layers = f.model.config.n_layers;
+    const uint32_t n_heads = f.model.config.n_heads;
+    fixture_free(&f);
+    if (ret != Q_OK || gen_state.num_generated_tokens == 0) {
+        TEST_FAIL_MSG("q_generate failed: %d", ret);
+        q_trace_disable();
+        return;
+    }
+
+    char* json = trace_dump_to_string();
+    const uint64_t recorded = q_trace_event_count();
+    q_trace_disable();
+    if (json == NULL) {
+        TEST_FAIL_MSG("%s", "q_trace_write_json failed");
+        return;
+    }
+
+    // Forwards = prefill + decodes; por forward: n_layers spans "layer", 1 lm_head
+    const uint64_t prefill = count_occurrences(json, "\"name\":\"prefill\"");
+    const uint64_t decode = count_occurrences(json, "\"name\":\"decode\"");
+    const uint64_t forwards = prefill + decode;
+    const uint64_t events = count_occurrences(json, "\"ph\":\"X\"");
+    const bool ok = strncmp(json, "{\"displayTimeUnit\":\"ns\"", 22) == 0 &&
+                    strstr(json, "\"dropped_events\":0") != NULL &&
+                    strstr(json, "\"name\":\"thread_name\"") != NULL &&
+                    prefill == 1 && decode >= 1 &&
+                    events == recorded &&
+                    count_occurrences(json, "\"name\":\"layer\"") == forwards * n_layers &&
+                    count_occurrences(json, "\"name\":\"lm_head\"") == forwards &&
+                    count_occurrences(json, "\"name\":\"qkv_proj\"") == forwards * n_layers &&
+                    count_occurrences(json, "\"name\":\"attn_scores\"") == forwards * n_layers * n_heads &&
+                    strstr(json, "\"args\":{\"layer\":1}") != NULL;
+    if (!ok) {
+        TEST_FAIL_MSG("unexpected trace: %llu events (%llu recorded), prefill=%llu decode=%llu",
+                      (unsigned long long)events, (unsigned long long)recorded,
+                      (unsigned long long)prefill, (unsigned long long)decode);
+        free(json);
+        return;
+    }
+    printf("  %llu events, %llu forwards, %zu bytes of JSON\n",
+           (unsigned long long)events, (unsigned long long)forwards, strlen(json));
+    free(json);
+    TEST_PASS();
+}
+
+typedef struct {
+    profile_fixture* f;
+    q_error_code ret;
+} trace_worker_arg;
+
+static void* trace_worker(void* p) {
+    trace_worker_arg* arg = (trace_worker_arg*)p;
+    uint32_t token = 5;
+    float* logits = (float*)aligned_alloc(Q_ALIGN,
+        Q_ALIGN_SIZE((size_t)arg->f->model.config.vocab_size * sizeof(float)));
+    arg->ret = (logits != NULL) ? llama_forward(&arg->f->model, &arg->f->ctx, &token, 1, 0, logits)
+                                : Q_ERR_ALLOC_FAILED;
+    free(logits);
+    return NULL;
+}
+
+// Test 5: Duas threads (um contexto cada) em trilhas separadas + ring que dá a volta
+static void test_trace_threads_and_wraparound(void) {
+    TEST_START("q_trace - per-thread tracks and ring wraparound");
+
+#ifndef Q_PROFILE
+    printf("  (trace não compilado: nada a verificar)\n");
+    TEST_PASS();
+    return;
+#endif
+    enum { N_THREADS = 2, CAPACITY = 64 };
+    profile_fixture fixtures[N_THREADS];
+    trace_worker_arg args[N_THREADS];
+    pthread_t threads[N_THREADS];
+    q_error_code ret = Q_OK;
+    for (int i = 0; i < N_THREADS; i++) {
+        const q_error_code r = fixture_init(&fixtures[i]);
+        ret = (ret == Q_OK) ? r : ret;
+        args[i].f = &fixtures[i];
+        args[i].ret = Q_ERR_INVALID_ARG;
+    }
+    if (ret != Q_OK || q_trace_enable(0) != Q_OK) {
+        TEST_FAIL_MSG("setup failed: %d", ret);
+        for (int i = 0; i < N_THREADS; i++) fixture_free(&fixtures[i]);
+        return;
+    }
+    for (int i = 0; i < N_THREADS; i++) {
+        pthread_create(&threads[i], NULL, trace_worker, &args[i]);
+    }
+    for (int i = 0; i < N_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    char* json = trace_dump_to_string();
+    if (json == NULL || args[0].ret != Q_OK || args[1].ret != Q_OK) {
+        TEST_FAIL_MSG("forward/dump failed: %d %d", args[0].ret, args[1].ret);
+        free(json);
+        q_trace_disable();
+        for (int i = 0; i < N_THREADS; i++) fixture_free(&fixtures[i]);
+        return;
+    }
+
+    // Cada worker aparece com seu próprio tid e o mesmo número de eventos
+    uint64_t per_tid[N_THREADS];
+    uint32_t tids_seen = 0;
+    for (uint32_t tid = 1; tid <= 64 && tids_seen < N_THREADS; tid++) {
+        char needle[48];
+        snprintf(needle, sizeof(needle), "\"ph\":\"X\",\"pid\":1,\"tid\":%u,", tid);
+        const uint64_t n = count_occurrences(json, needle);
+        if (n > 0) {
+            per_tid[tids_seen++] = n;
+        }
+    }
+    free(json);
+    if (tids_seen != N_THREADS || per_tid[0] != per_tid[1] ||
+        per_tid[0] + per_tid[1] != q_trace_event_count()) {
+        TEST_FAIL_MSG("tids=%u events=%llu/%llu", tids_seen,
+                      (unsigned long long)(tids_seen > 0 ? per_tid[0] : 0),
+                      (unsigned long long)(tids_seen > 1 ? per_tid[1] : 0));
+        q_trace_disable();
+        for (int i = 0; i < N_THREADS; i++) fixture_free(&fixtures[i]);
+        return;
+    }
+
+    // Ring pequeno: só os últimos CAPACITY eventos sobrevivem
+    ret = q_trace_enable(CAPACITY - 3);  // Arredonda para 64
+    args[0].ret = Q_ERR_INVALID_ARG;
+    trace_worker(&args[0]);
+    json = trace_dump_to_string();
+    const uint64_t recorded = q_trace_event_count();
+    q_trace_disable();
+    for (int i = 0; i < N_THREADS; i++) fixture_free(&fixtures[i]);
+    if (ret != Q_OK || args[0].ret != Q_OK || json == NULL) {
+        TEST_FAIL_MSG("small ring run failed: %d %d", ret, args[0].ret);
+        free(json);
+        return;
+    }
+    char dropped[64];
+    snprintf(dropped, sizeof(dropped), "\"dropped_events\":%llu", (unsigned long long)(recorded - CAPACITY));
+    const uint64_t events = count_occurrences(json, "\"ph\":\"X\"");
+    const bool dropped_ok = strstr(json, dropped) != NULL;
+    free(json);
+    if (recorded <= CAPACITY || events != CAPACITY || !dropped_ok) {
+        TEST_FAIL_MSG("recorded=%llu kept=%llu", (unsigned long long)recorded, (unsigned long long)events);
+        return;
+    }
+    printf("  %llu events per thread; small ring kept %llu of %llu\n",
+           (unsigned long long)per_tid[0], (unsigned long long)events, (unsigned long long)recorded);
+    TEST_PASS();
+}
+
+typedef struct {
+    trace_worker_arg w;
+    atomic_bool stop;
+    atomic_bool done;  // Worker saiu (erro no forward)
+    atomic_uint forwards;
+} trace_loop_arg;
+
+static void* trace_loop_worker(void* p) {
+    trace_loop_arg* arg = (trace_loop_arg*)p;
+    while (!atomic_load(&arg->stop)) {
+        trace_worker(&arg->w);
+        if (arg->w.ret != Q_OK) break;
+        atomic_fetch_add(&arg->forwards, 1);
+    }
+    atomic_store(&arg->done, true);
+    return NULL;
+}
+
+// Test 6: Reabrir sessão zera o ring; enable/disable/dump com forward em voo não
+// libera memória em uso (o ring publicado nunca é liberado)
+static void test_trace_reenable_while_running(void) {
+    TEST_START("q_trace - re-enable resets session; toggling during forwards is safe");
+
+#ifndef Q_PROFILE
+    printf("  (trace não compilado: nada a verificar)\n");
+    TEST_PASS();
+    return;
+#endif
+    enum { MIN_TOGGLES = 100, MIN_FORWARDS = 4 };
+    profile_fixture f;
+    q_error_code ret = fixture_init(&f);
+    trace_loop_arg arg = { .w = { .f = &f, .ret = Q_ERR_INVALID_ARG } };
+    atomic_init(&arg.stop, false);
+    atomic_init(&arg.done, false);
+    atomic_init(&arg.forwards, 0);
+    if (ret == Q_OK) ret = q_trace_enable(64);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup failed: %d", ret);
+        fixture_free(&f);
+        return;
+    }
+
+    // Mesmo ring reaproveitado: a sessão nova começa vazia
+    trace_worker(&arg.w);
+    q_trace_disable();
+    ret = q_trace_enable(64);
+    char* json = trace_dump_to_string();
+    const uint64_t count = q_trace_event_count();
+    const bool empty = json != NULL && count_occurrences(json, "\"ph\":\"X\"") == 0 &&
+                       strstr(json, "\"dropped_events\":0") != NULL;
+    free(json);
+    if (arg.w.ret != Q_OK || ret != Q_OK || count != 0 || !empty) {
+        TEST_FAIL_MSG("re-enable kept events: fwd=%d enable=%d count=%llu",
+                      arg.w.ret, ret, (unsigned long long)count);
+        q_trace_disable();
+        fixture_free(&f);
+        return;
+    }
+
+    // Stress: forwards contínuos enquanto a thread principal alterna sessões e capacidades
+    pthread_t thread;
+    pthread_create(&thread, NULL, trace_loop_worker, &arg);
+    const struct timespec pause = { .tv_sec = 0, .tv_nsec = 500 * 1000 };
+    uint32_t dumps = 0;
+    uint32_t toggles = 0;
+    while (ret == Q_OK && !atomic_load(&arg.done) &&
+           (toggles < MIN_TOGGLES || atomic_load(&arg.forwards) < MIN_FORWARDS)) {
+        ret = q_trace_enable((toggles++ % 2 == 0) ? 0 : 4096);
+        nanosleep(&pause, NULL);
+        json = trace_dump_to_string();
+        dumps += (json != NULL) ? 1 : 0;
+        free(json);
+        q_trace_disable();
+        nanosleep(&pause, NULL);
+    }
+    atomic_store(&arg.stop, true);
+    pthread_join(thread, NULL);
+    q_trace_disable();
+    fixture_free(&f);
+    if (ret != Q_OK || arg.w.ret != Q_OK || dumps != toggles) {
+        TEST_FAIL_MSG("enable=%d fwd=%d dumps=%u", ret, arg.w.ret, dumps);
+        return;
+    }
+    printf("  %u toggles across %u forwards\n", toggles, atomic_load(&arg.forwards));
+    TEST_PASS();
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("  PROFILING TEST SUITE\n");
+    printf("========================================\n\n");
+
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_profile_api_guards();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_profile_forward_counts();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_profile_generate_counts();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_trace_generate_json();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_trace_threads_and_wraparound();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_trace_reenable_while_running();
+    } else {
+        TEST_CRASH();
+    }
+
+    printf("\n========================================\n");
+    printf("  TEST SUMMARY\n");
+    printf("========================================\n");
+    printf("Tests run:    %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_failed);
+    printf("Tests crashed: %d\n", tests_crashed);
+    printf("========================================\n");
+
+    if (tests_failed == 0 && tests_crashed == 0) {
+        printf("  ALL TESTS PASSED ✓\n");
+        printf("========================================\n");
+        return 0;
+    } else {
+        printf("  SOME TESTS FAILED ✗\n");
+        printf("========================================\n");
+        return 1;
+    }
+}
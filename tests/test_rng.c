@@ -0,0 +1,341 @@
+// ============================================================================
+// TEST: Philox4x32-10 RNG streams (q_rng) + q_sample_token_rng
+// ============================================================================
+// Valida vetores conhecidos (Random123 KAT), equivalência entre caminho AVX2
+// em lote e sorteios individuais, cache do bloco Philox sob reposicionamento,
+// independência de streams e reprodutibilidade do sampler por requisição.
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <math.h>
+
+// ============================================================================
+// TEST CONFIGURATION
+// ============================================================================
+
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int tests_crashed = 0;
+
+static jmp_buf crash_jmp_buf;
+static void crash_handler(int sig) {
+    (void)sig;
+    longjmp(crash_jmp_buf, 1);
+}
+
+// ============================================================================
+// TEST HELPERS
+// ============================================================================
+
+#define TEST_START(name) \
+    do { \
+        printf("Test %d: %s\n", tests_run + 1, name); \
+    } while(0)
+
+#define TEST_PASS() do { \
+    tests_run++; \
+    tests_passed++; \
+    printf("  ✓ PASSED\n"); \
+} while(0)
+
+#define TEST_FAIL_MSG(fmt, ...) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: " fmt "\n", __VA_ARGS__); \
+} while(0)
+
+#define TEST_CRASH() do { \
+    tests_run++; \
+    tests_crashed++; \
+    printf("  ✗ CRASHED\n"); \
+} while(0)
+
+// Palavra u32 de volta a partir do float (24 bits altos): u >> 8 == f * 2^24
+static uint32_t unit_to_high24(float f) {
+    return (uint32_t)(f * 16777216.0f);
+}
+
+// ============================================================================
+// TEST CASES
+// ============================================================================
+
+// Test 1: Vetores conhecidos do Philox4x32-10 (Random123 kat_vectors)
+// counter = {block_lo, block_hi, stream_lo, stream_hi}: posicionar (block, stream)
+// reproduz cada vetor (24 bits altos de cada palavra)
+static void test_philox_known_answers(void) {
+    TEST_START("Philox4x32-10 - Random123 known-answer vectors");
+
+    static const struct {
+        uint32_t ctr[4];
+        uint32_t key[2];
+        uint32_t out[4];
+    } kat[] = {
+        {{0x00000000, 0x00000000, 0x00000000, 0x00000000}, {0x00000000, 0x00000000},
+         {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+        {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff},
+         {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+        {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0},
+         {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+    };
+
+    for (size_t t = 0; t < sizeof(kat) / sizeof(kat[0]); t++) {
+        const uint64_t seed = ((uint64_t)kat[t].key[1] << 32) | kat[t].key[0];
+        const uint64_t block = ((uint64_t)kat[t].ctr[1] << 32) | kat[t].ctr[0];
+        const uint64_t stream = ((uint64_t)kat[t].ctr[3] << 32) | kat[t].ctr[2];
+        q_rng rng;
+        q_rng_init(&rng, seed, stream);
+        rng.block = block;
+        for (int w = 0; w < 4; w++) {
+            const uint32_t got = unit_to_high24(q_rng_uniform(&rng));
+            if (got != kat[t].out[w] >> 8) {
+                TEST_FAIL_MSG("vector %zu word %d: got %06x, expected %06x",
+                              t, w, got, kat[t].out[w] >> 8);
+                return;
+            }
+        }
+    }
+    TEST_PASS();
+}
+
+// Test 2: Lote AVX2 == sorteios individuais para offsets e tamanhos arbitrários
+static void test_batch_matches_sequential(void) {
+    TEST_START("q_rng_uniform_f32 - batch equals successive q_rng_uniform calls");
+
+    static const uint64_t starts[] = {0, 1, 3, 5, 31, 4ULL * 0xFFFFFFFCULL};  // em palavras; último: wrap de block_lo
+    static const size_t lengths[] = {0, 1, 7, 32, 33, 100, 257};
+    float batch[257];
+
+    for (size_t si = 0; si < sizeof(starts) / sizeof(starts[0]); si++) {
+        for (size_t li = 0; li < sizeof(lengths) / sizeof(lengths[0]); li++) {
+            q_rng a;
+            q_rng b;
+            q_rng_init(&a, 0x0123456789ABCDEFULL, 42);
+            q_rng_init(&b, 0x0123456789ABCDEFULL, 42);
+            a.block = b.block = starts[si] / 4;
+            a.word = b.word = (uint32_t)(starts[si] % 4);
+            if (q_rng_uniform_f32(&a, batch, lengths[li]) != Q_OK) {
+                TEST_FAIL_MSG("start=%llu n=%zu: q_rng_uniform_f32 failed",
+                              (unsigned long long)starts[si], lengths[li]);
+                return;
+            }
+            for (size_t i = 0; i < lengths[li]; i++) {
+                const float expected = q_rng_uniform(&b);
+                if (memcmp(&batch[i], &expected, sizeof(float)) != 0 ||
+                    !(batch[i] >= 0.0f && batch[i] < 1.0f)) {
+                    TEST_FAIL_MSG("start=%llu n=%zu: value %zu = %f, expected %f",
+                                  (unsigned long long)starts[si], lengths[li], i,
+                                  (double)batch[i], (double)expected);
+                    return;
+                }
+            }
+            if (a.block != b.block || a.word != b.word) {
+                TEST_FAIL_MSG("start=%llu n=%zu: offsets diverged",
+                              (unsigned long long)starts[si], lengths[li]);
+                return;
+            }
+        }
+    }
+
+    q_rng rng;
+    q_rng_init(&rng, 1, 0);
+    if (q_rng_uniform_f32(&rng, NULL, 4) != Q_ERR_INVALID_ARG ||
+        q_rng_uniform_f32(NULL, batch, 4) != Q_ERR_INVALID_ARG) {
+        TEST_FAIL_MSG("%s", "NULL arguments not rejected");
+        return;
+    }
+    TEST_PASS();
+}
+
+// Test 3: Bloco em cache segue block/word reposicionados à mão (inclusive o último bloco)
+static void test_cached_block_reposition(void) {
+    TEST_START("q_rng_uniform - cached block follows repositioned block/word");
+
+    static const uint64_t blocks[] = {0, 1, 7, UINT64_MAX};
+    for (size_t bi = 0; bi < sizeof(blocks) / sizeof(blocks[0]); bi++) {
+        q_rng used;
+        q_rng fresh;
+        q_rng_init(&used, 0xFEEDFACECAFEBEEFULL, 3);
+        q_rng_init(&fresh, 0xFEEDFACECAFEBEEFULL, 3);
+        for (int i = 0; i < 6; i++) {
+            (void)q_rng_uniform(&used);  // Deixa outro bloco em cache
+        }
+        used.block = fresh.block = blocks[bi];
+        used.word = 1;
+        fresh.word = 0;
+        (void)q_rng_uniform(&fresh);
+        for (int i = 0; i < 7; i++) {  // Cruza para o bloco seguinte
+            const float got = q_rng_uniform(&used);
+            const float expected = q_rng_uniform(&fresh);
+            if (memcmp(&got, &expected, sizeof(float)) != 0) {
+                TEST_FAIL_MSG("block %llu draw %d: got %f, expected %f",
+                              (unsigned long long)blocks[bi], i, (double)got, (double)expected);
+                return;
+            }
+        }
+    }
+    TEST_PASS();
+}
+
+// Test 4: Streams distintos não se sobrepõem; média ~0.5
+static void test_streams_independent(void) {
+    TEST_START("q_rng - distinct streams/seeds differ, uniform mean ~0.5");
+
+    enum { N = 4096 };
+    static float s0[N];
+    static float s1[N];
+    static float s2[N];
+    q_rng a;
+    q_rng b;
+    q_rng c;
+    q_rng_init(&a, 99, 0);
+    q_rng_init(&b, 99, 1);
+    q_rng_init(&c, 100, 0);
+    q_rng_uniform_f32(&a, s0, N);
+    q_rng_uniform_f32(&b, s1, N);
+    q_rng_uniform_f32(&c, s2, N);
+
+    uint32_t equal_ab = 0;
+    uint32_t equal_ac = 0;
+    double mean = 0.0;
+    for (int i = 0; i < N; i++) {
+        equal_ab += (memcmp(&s0[i], &s1[i], sizeof(float)) == 0);
+        equal_ac += (memcmp(&s0[i], &s2[i], sizeof(float)) == 0);
+        mean += s0[i];
+    }
+    mean /= N;
+    // Coincidências por acaso: ~N / 2^24
+    if (equal_ab > 2 || equal_ac > 2 || fabs(mean - 0.5) > 0.03) {
+        TEST_FAIL_MSG("equal(stream)=%u equal(seed)=%u mean=%.4f", equal_ab, equal_ac, mean);
+        return;
+    }
+    TEST_PASS();
+}
+
+// Test 5: q_sample_token_rng reproduzível por stream, sem interferência entre
+// streams intercalados na mesma thread
+static void test_sampler_reproducible(void) {
+    TEST_START("q_sample_token_rng - interleaved streams reproduce isolated runs");
+
+    enum { V = 1000, STEPS = 64 };
+    static float logits[V];
+    for (uint32_t i = 0; i < V; i++) {
+        logits[i] = sinf((float)i * 0.37f) * 4.0f;
+    }
+
+    uint32_t isolated[2][STEPS];
+    for (int s = 0; s < 2; s++) {
+        q_rng rng;
+        q_rng_init(&rng, 2024, (uint64_t)s);
+        for (int t = 0; t < STEPS; t++) {
+            if (q_sample_token_rng(logits, V, 0.9f, 50, 0.9f, &rng, &isolated[s][t], NULL) != Q_OK) {
+                TEST_FAIL_MSG("isolated stream %d step %d failed", s, t);
+                return;
+            }
+        }
+    }
+
+    // Intercalado + chamadas ao gerador thread-local no meio
+    q_rng rngs[2];
+    q_rng_init(&rngs[0], 2024, 0);
+    q_rng_init(&rngs[1], 2024, 1);
+    uint32_t differ = 0;
+    for (int t = 0; t < STEPS; t++) {
+        for (int s = 0; s < 2; s++) {
+            uint32_t tok = 0;
+            uint32_t noise = 0;
+            (void)q_sample_token(logits, V, 1.0f, 0, 0.0f, &noise, NULL);
+            if (q_sample_token_rng(logits, V, 0.9f, 50, 0.9f, &rngs[s], &tok, NULL) != Q_OK ||
+                tok != isolated[s][t]) {
+                TEST_FAIL_MSG("stream %d step %d: got %u, expected %u", s, t, tok, isolated[s][t]);
+                return;
+            }
+        }
+        differ += (isolated[0][t] != isolated[1][t]);
+    }
+    if (differ == 0) {
+        TEST_FAIL_MSG("%s", "streams 0 and 1 produced identical token sequences");
+        return;
+    }
+
+    // Greedy não consome o stream
+    q_rng rng;
+    q_rng_init(&rng, 5, 5);
+    uint32_t tok = 0;
+    if (q_sample_token_rng(logits, V, 0.0f, 0, 0.0f, &rng, &tok, NULL) != Q_OK ||
+        rng.block != 0 || rng.word != 0) {
+        TEST_FAIL_MSG("greedy advanced the stream (block %llu, word %u)",
+                      (unsigned long long)rng.block, rng.word);
+        return;
+    }
+    TEST_PASS();
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(void) {
+    printf("========================================\n");
+    printf("  RNG STREAMS TEST SUITE\n");
+    printf("========================================\n\n");
+
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_philox_known_answers();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_batch_matches_sequential();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_cached_block_reposition();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_streams_independent();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_sampler_reproducible();
+    } else {
+        TEST_CRASH();
+    }
+
+    printf("\n========================================\n");
+    printf("  TEST SUMMARY\n");
+    printf("========================================\n");
+    printf("Tests run:    %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_failed);
+    printf("Tests crashed: %d\n", tests_crashed);
+    printf("========================================\n");
+
+    if (tests_failed == 0 && tests_crashed == 0) {
+        printf("  ALL TESTS PASSED ✓\n");
+        printf("========================================\n");
+        return 0;
+    } else {
+        printf("  SOME TESTS FAILED ✗\n");
+        printf("========================================\n");
+        return 1;
+    }
+}
@@ -0,0 +1,518 @@
+// ============================================================================
+// TEST: Session Snapshot (q_session_save / q_session_load)
+// ============================================================================
+// Valida round-trip do KV cache usado + current_pos, rejeição de arquivos
+// inválidos (magic, geometria, truncamento, modelo diferente) e q_generate
+// retomando de uma sessão restaurada
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+// ============================================================================
+// TEST CONFIGURATION
+// ============================================================================
+
+static int tests_run = 0;
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int tests_crashed = 0;
+
+static jmp_buf crash_jmp_buf;
+static void crash_handler(int sig) {
+    (void)sig;
+    longjmp(crash_jmp_buf, 1);
+}
+
+#define SESSION_PATH "test_session.qses"
+
+// ============================================================================
+// TEST HELPERS
+// ============================================================================
+
+#define TEST_START(name) \
+    do { \
+        printf("Test %d: %s\n", tests_run + 1, name); \
+    } while(0)
+
+#define TEST_PASS() do { \
+    tests_run++; \
+    tests_passed++; \
+    printf("  ✓ PASSED\n"); \
+} while(0)
+
+#define TEST_FAIL(msg) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: %s\n", msg); \
+} while(0)
+
+#define TEST_FAIL_MSG(fmt, ...) do { \
+    tests_run++; \
+    tests_failed++; \
+    printf("  ✗ FAILED: " fmt "\n", __VA_ARGS__); \
+} while(0)
+
+#define TEST_CRASH() do { \
+    tests_run++; \
+    tests_crashed++; \
+    printf("  ✗ CRASHED\n"); \
+} while(0)
+
+#define CLEANUP_ALL(ctx, model) do { \
+    if ((model)->token_embd != NULL || (model)->layers != NULL) { \
+        llama_free_graph(model); \
+    } \
+    q_free_memory(ctx); \
+} while(0)
+
+// Helper: Ensure dummy model exists
+static bool ensure_dummy_model(void) {
+    FILE* f = fopen("model_dummy.qorus", "rb");
+    if (f != NULL) {
+        fclose(f);
+        return true;
+    }
+
+    printf("  Generating dummy model...\n");
+    int ret = system("python3 tools/convert_llama.py model_dummy.qorus 2 > /dev/null 2>&1");
+    return (ret == 0);
+}
+
+// Helper: Calculate KV cache size
+static size_t calculate_kv_cache_size(const q_llama_config* config) {
+    uint32_t head_dim = config->dim / config->n_heads;
+    size_t kv_size = (size_t)config->n_layers *
+                     (size_t)config->n_kv_heads *
+                     (size_t)config->max_seq_len *
+                     (size_t)head_dim *
+                     sizeof(float) * 2; // K + V
+    return Q_ALIGN_SIZE(kv_size);
+}
+
+// Helper: init → arena → build → KV cache
+static q_error_code setup_model(q_context* ctx, q_llama_model* model) {
+    q_error_code ret = q_init_memory(ctx, "model_dummy.qorus");
+    if (ret != Q_OK) return ret;
+
+    ret = q_alloc_arena(ctx, 64 * 1024 * 1024);  // 64MB
+    if (ret != Q_OK) return ret;
+
+    ret = llama_build_graph(ctx, model);
+    if (ret != Q_OK) return ret;
+
+    return q_alloc_kv_cache(ctx, calculate_kv_cache_size(&model->config));
+}
+
+
+// Helper: prefill de n tokens no KV cache e estado apontando para ctx/model
+static q_error_code prefill(q_context* ctx, q_llama_model* model, q_generation_state* state, uint32_t n) {
+    const uint32_t tokens[] = {1, 42, 7, 1234, 99, 5, 300, 2};
+    if (n > sizeof(tokens) / sizeof(tokens[0])) return Q_ERR_INVALID_SIZE;
+
+    float* logits = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE((size_t)model->config.vocab_size * sizeof(float)));
+    if (logits == NULL) return Q_ERR_ALLOC_FAILED;
+
+    q_error_code ret = llama_forward(model, ctx, tokens, n, 0, logits);
+    q_arena_reset(ctx);
+    free(logits);
+
+    memset(state, 0, sizeof(*state));
+    state->ctx = ctx;
+    state->model = model;
+    state->current_pos = n;
+    return ret;
+}
+
+// ============================================================================
+// TEST CASES
+// ============================================================================
+
+// Test 1: save → zera KV → load restaura bytes usados e current_pos
+static void test_session_roundtrip(void) {
+    TEST_START("Session - save/load restores used KV range and current_pos");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_generation_state state;
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret == Q_OK) ret = prefill(&ctx, &model, &state, 5);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup/prefill failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    ret = q_session_save(&state, SESSION_PATH);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("q_session_save failed: %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    void* expected = malloc(ctx.kv_size);
+    if (expected == NULL) {
+        TEST_FAIL("Failed to allocate KV copy");
+        unlink(SESSION_PATH);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+    memcpy(expected, ctx.kv_buffer, ctx.kv_size);
+    memset(ctx.kv_buffer, 0, ctx.kv_size);
+    state.current_pos = 0;
+
+    ret = q_session_load(&state, SESSION_PATH);
+    unlink(SESSION_PATH);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("q_session_load failed: %d", ret);
+        free(expected);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    if (state.current_pos != 5) {
+        TEST_FAIL_MSG("current_pos = %u, expected 5", state.current_pos);
+        free(expected);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Compara posições [0, 5) de cada (layer, kv_head)
+    const q_llama_config* config = &model.config;
+    const size_t pos_bytes = (size_t)(config->dim / config->n_heads) * 2 * sizeof(float);
+    const size_t stride = pos_bytes * config->max_seq_len;
+    const size_t n_blocks = (size_t)config->n_layers * config->n_kv_heads;
+    for (size_t b = 0; b < n_blocks; b++) {
+        if (memcmp((const uint8_t*)ctx.kv_buffer + b * stride,
+                   (const uint8_t*)expected + b * stride, pos_bytes * 5) != 0) {
+            TEST_FAIL_MSG("KV block %zu differs after load", b);
+            free(expected);
+            CLEANUP_ALL(&ctx, &model);
+            return;
+        }
+    }
+
+    free(expected);
+    CLEANUP_ALL(&ctx, &model);
+    TEST_PASS();
+}
+
+// Test 2: magic inválido, geometria diferente e arquivo truncado são rejeitados
+static void test_session_invalid_files(void) {
+    TEST_START("Session - bad magic, config mismatch and truncation are rejected");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_generation_state state;
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret == Q_OK) ret = prefill(&ctx, &model, &state, 3);
+    if (ret == Q_OK) ret = q_session_save(&state, SESSION_PATH);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup/prefill/save failed: %d", ret);
+        unlink(SESSION_PATH);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Geometria diferente: mesmo arquivo, modelo com menos layers
+    q_llama_model other = model;
+    other.config.n_layers = model.config.n_layers - 1;
+    state.model = &other;
+    ret = q_session_load(&state, SESSION_PATH);
+    state.model = &model;
+    if (ret != Q_ERR_INVALID_CONFIG) {
+        TEST_FAIL_MSG("config mismatch: expected Q_ERR_INVALID_CONFIG, got %d", ret);
+        unlink(SESSION_PATH);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Truncado: header intacto, payload incompleto
+    if (truncate(SESSION_PATH, 64 + 16) != 0) {
+        TEST_FAIL("truncate failed");
+        unlink(SESSION_PATH);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+    ret = q_session_load(&state, SESSION_PATH);
+    if (ret != Q_ERR_FILE_TOO_SMALL) {
+        TEST_FAIL_MSG("truncated: expected Q_ERR_FILE_TOO_SMALL, got %d", ret);
+        unlink(SESSION_PATH);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Magic inválido
+    FILE* f = fopen(SESSION_PATH, "wb");
+    if (f != NULL) {
+        uint8_t garbage[128];
+        memset(garbage, 0xAB, sizeof(garbage));
+        fwrite(garbage, 1, sizeof(garbage), f);
+        fclose(f);
+    }
+    ret = q_session_load(&state, SESSION_PATH);
+    unlink(SESSION_PATH);
+    if (ret != Q_ERR_INVALID_MAGIC) {
+        TEST_FAIL_MSG("bad magic: expected Q_ERR_INVALID_MAGIC, got %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Arquivo inexistente
+    ret = q_session_load(&state, SESSION_PATH);
+    if (ret != Q_ERR_FILE_OPEN) {
+        TEST_FAIL_MSG("missing file: expected Q_ERR_FILE_OPEN, got %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    CLEANUP_ALL(&ctx, &model);
+    TEST_PASS();
+}
+
+// Test 3: mesma geometria, modelo diferente (config ou pesos) → Q_ERR_MODEL_MISMATCH
+static void test_session_model_mismatch(void) {
+    TEST_START("Session - model fingerprint mismatch is rejected");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_generation_state state;
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret == Q_OK) ret = prefill(&ctx, &model, &state, 3);
+    if (ret == Q_OK) ret = q_session_save(&state, SESSION_PATH);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup/prefill/save failed: %d", ret);
+        unlink(SESSION_PATH);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Config fora da geometria do KV (RoPE) também entra no fingerprint
+    q_llama_model other = model;
+    other.config.rope_freq_base = model.config.rope_freq_base * 2.0f;
+    state.model = &other;
+    ret = q_session_load(&state, SESSION_PATH);
+    state.model = &model;
+    if (ret != Q_ERR_MODEL_MISMATCH) {
+        TEST_FAIL_MSG("config change: expected Q_ERR_MODEL_MISMATCH, got %d", ret);
+        unlink(SESSION_PATH);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Pesos diferentes: mesma config, arquivo de pesos com um bloco alterado
+    const size_t weights_size = ctx.weights_size;
+    uint8_t* weights_copy = (uint8_t*)malloc(weights_size);
+    if (weights_copy == NULL) {
+        TEST_FAIL("Failed to allocate weights copy");
+        unlink(SESSION_PATH);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+    memcpy(weights_copy, ctx.weights_mmap, weights_size);
+    for (size_t i = weights_size - 64; i < weights_size; i++) {
+        weights_copy[i] ^= 0x5A;  // Final do arquivo: sempre dentro da última janela amostrada
+    }
+    void* original_weights = ctx.weights_mmap;
+    ctx.weights_mmap = weights_copy;
+    ret = q_session_load(&state, SESSION_PATH);
+    ctx.weights_mmap = original_weights;
+    free(weights_copy);
+    if (ret != Q_ERR_MODEL_MISMATCH) {
+        TEST_FAIL_MSG("weights change: expected Q_ERR_MODEL_MISMATCH, got %d", ret);
+        unlink(SESSION_PATH);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Mesmo modelo continua carregando
+    ret = q_session_load(&state, SESSION_PATH);
+    unlink(SESSION_PATH);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("same model: expected Q_OK, got %d", ret);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    CLEANUP_ALL(&ctx, &model);
+    TEST_PASS();
+}
+
+// Test 4: q_generate com resume continua de current_pos restaurado (prefill só dos
+// tokens novos, prefixo do KV intacto) e valida que os tokens novos cabem no contexto
+static void test_session_resume_generate(void) {
+    TEST_START("Session - q_generate resumes from restored current_pos");
+
+    if (!ensure_dummy_model()) {
+        TEST_FAIL("Cannot generate dummy model");
+        return;
+    }
+
+    q_context ctx = {0};
+    q_llama_model model = {0};
+    q_tokenizer tokenizer = {0};
+    q_generation_state state;
+    enum { SAVED = 5, NEW = 2, MAX_TOKENS = 3 };
+    q_error_code ret = setup_model(&ctx, &model);
+    if (ret == Q_OK) ret = q_tokenizer_load(&tokenizer, "tokenizer.bin");
+    if (ret == Q_OK) ret = prefill(&ctx, &model, &state, SAVED);
+    if (ret == Q_OK) ret = q_session_save(&state, SESSION_PATH);
+    if (ret != Q_OK) {
+        TEST_FAIL_MSG("setup/prefill/save failed: %d", ret);
+        unlink(SESSION_PATH);
+        if (tokenizer.initialized) q_tokenizer_free(&tokenizer);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    const q_llama_config* config = &model.config;
+    const size_t pos_bytes = (size_t)(config->dim / config->n_heads) * 2 * sizeof(float);
+    const size_t stride = pos_bytes * config->max_seq_len;
+    const size_t n_blocks = (size_t)config->n_layers * config->n_kv_heads;
+    uint8_t* expected = (uint8_t*)malloc(ctx.kv_size);
+    if (expected != NULL) {
+        memcpy(expected, ctx.kv_buffer, ctx.kv_size);
+    }
+
+    // KV zerado: só o snapshot repõe o prefixo; posições novas ficam a cargo do resume
+    memset(ctx.kv_buffer, 0, ctx.kv_size);
+    state.current_pos = 0;
+    ret = q_session_load(&state, SESSION_PATH);
+    unlink(SESSION_PATH);
+
+    uint32_t new_tokens[NEW] = {17, 23};
+    uint32_t generated[MAX_TOKENS];
+    state.tokenizer = &tokenizer;
+    state.prompt_tokens = new_tokens;
+    state.num_prompt_tokens = NEW;
+    state.generated_tokens = generated;
+    state.max_tokens = MAX_TOKENS;
+    state.temperature = 0.0f;
+    state.resume = true;
+    if (ret == Q_OK && expected != NULL) ret = q_generate(&state);
+    if (ret != Q_OK || expected == NULL) {
+        TEST_FAIL_MSG("load/resume failed: %d", ret);
+        free(expected);
+        q_tokenizer_free(&tokenizer);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Prefixo restaurado intacto, tokens novos gravados a partir de SAVED
+    bool prefix_ok = true;
+    bool new_written = true;
+    for (size_t b = 0; b < n_blocks; b++) {
+        const uint8_t* block = (const uint8_t*)ctx.kv_buffer + b * stride;
+        prefix_ok = prefix_ok && memcmp(block, expected + b * stride, pos_bytes * SAVED) == 0;
+        bool any = false;
+        for (size_t i = pos_bytes * SAVED; i < pos_bytes * (SAVED + NEW) && !any; i++) {
+            any = block[i] != 0;
+        }
+        new_written = new_written && any;
+    }
+    free(expected);
+    const uint32_t end_pos = state.current_pos;
+    const uint32_t n_generated = state.num_generated_tokens;
+    if (!prefix_ok || !new_written || end_pos < SAVED + NEW ||
+        end_pos > SAVED + NEW + n_generated || n_generated == 0) {
+        TEST_FAIL_MSG("prefix_ok=%d new_written=%d current_pos=%u generated=%u",
+                      prefix_ok, new_written, end_pos, n_generated);
+        q_tokenizer_free(&tokenizer);
+        CLEANUP_ALL(&ctx, &model);
+        return;
+    }
+
+    // Tokens novos não cabem depois de current_pos
+    state.current_pos = config->max_seq_len - 1;
+    ret = q_generate(&state);
+    q_tokenizer_free(&tokenizer);
+    CLEANUP_ALL(&ctx, &model);
+    if (ret != Q_ERR_INVALID_SIZE) {
+        TEST_FAIL_MSG("overflow: expected Q_ERR_INVALID_SIZE, got %d", ret);
+        return;
+    }
+
+    printf("  resumed at %u, current_pos %u after %u generated tokens\n", SAVED, end_pos, n_generated);
+    TEST_PASS();
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstack-usage="
+int main(void) {
+    printf("========================================\n");
+    printf("  SESSION SNAPSHOT TEST SUITE\n");
+    printf("========================================\n\n");
+
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS, crash_handler);
+    signal(SIGABRT, crash_handler);
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_session_roundtrip();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_session_invalid_files();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_session_model_mismatch();
+    } else {
+        TEST_CRASH();
+    }
+
+    if (setjmp(crash_jmp_buf) == 0) {
+        test_session_resume_generate();
+    } else {
+        TEST_CRASH();
+    }
+
+    printf("\n========================================\n");
+    printf("  TEST SUMMARY\n");
+    printf("========================================\n");
+    printf("Tests run:    %d\n", tests_run);
+    printf("Tests passed: %d\n", tests_passed);
+    printf("Tests failed: %d\n", tests_failed);
+    printf("Tests crashed: %d\n", tests_crashed);
+    printf("========================================\n");
+
+    if (tests_failed == 0 && tests_crashed == 0) {
+        printf("  ALL TESTS PASSED ✓\n");
+        printf("========================================\n");
+        return 0;
+    } else {
+        printf("  SOME TESTS FAILED ✗\n");
+        printf("========================================\n");
+        return 1;
+    }
+}
+#pragma GCC diagnostic pop
@@ -77,7 +77,9 @@ static void test_strerror_all_valid_codes(void) {
         {Q_ERR_OVERFLOW, "Integer overflow detected"},
         {Q_ERR_MISALIGNED, "Pointer not properly aligned"},
         {Q_ERR_INVALID_DTYPE, "Invalid data type"},
-        {Q_ERR_INVALID_SIZE, "Invalid size"}
+        {Q_ERR_INVALID_SIZE, "Invalid size"},
+        {Q_ERR_FILE_WRITE, "Failed to write file"},
+        {Q_ERR_MODEL_MISMATCH, "Snapshot belongs to a different model"}
     };
     
     int num_cases = sizeof(test_cases) / sizeof(test_cases[0]);
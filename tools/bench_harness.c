@@ -0,0 +1,805 @@
+// ============================================================================
+// BENCH HARNESS: benchmarks de regressão com saída JSON e baseline
+// ============================================================================
+// Um harness para kernels, sampling e forward do modelo dummy:
+// - N amostras por benchmark (cada amostra = lote calibrado de chamadas)
+// - Estatísticas robustas: mediana, MAD, p99 (nearest-rank), média, mínimo
+// - JSON com CPU model, flags de CPU, governor, compilador e CFLAGS
+// - --baseline: compara com um JSON anterior via Mann-Whitney U (bilateral,
+//   aproximação normal com correção de empates); regressão = mediana acima
+//   do threshold E p < alpha. Ruído sem deslocamento real não dispara.
+//
+// Exit codes: 0 = OK, 1 = erro (setup / kernel / baseline ilegível),
+//             2 = regressão detectada
+//
+// Uso: bench_harness [--json PATH] [--baseline PATH] [--threshold PCT]
+//                    [--alpha P] [--samples N] [--filter SUBSTR]
+//                    [--label STR] [--no-model]
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+#define DEFAULT_SAMPLES 21
+#define MAX_SAMPLES 1000
+#define MIN_SAMPLE_MS 5.0               // Cada amostra cobre ao menos 5ms (resolução do relógio)
+#define MAX_CALLS_PER_SAMPLE (1U << 20)
+#define WARMUP_CALLS 3
+#define DEFAULT_THRESHOLD_PCT 5.0
+#define DEFAULT_ALPHA 0.01
+#define Q4_POOL_BYTES (64UL * 1024 * 1024)  // Pool de pesos Q4_0 rotacionado (> LLC)
+#define KERNEL_DIM 4096
+#define KERNEL_HIDDEN 14336
+#define LM_HEAD_VOCAB 32000
+#define LM_HEAD_DIM 2048
+#define PREFILL_TOKENS 16
+
+#ifndef Q_BENCH_CFLAGS
+#define Q_BENCH_CFLAGS "unknown"
+#endif
+
+#define EXIT_BENCH_ERROR 1
+#define EXIT_BENCH_REGRESSION 2
+
+// ============================================================================
+// TIMING UTILITIES
+// ============================================================================
+
+static double get_time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// ============================================================================
+// BENCHMARK STATE
+// ============================================================================
+
+typedef struct {
+    // Kernels (buffers sintéticos)
+    q_block_q4_0* q4_pool;
+    size_t q4_pool_blocks;
+    float* lm_head;             // [LM_HEAD_VOCAB, LM_HEAD_DIM]
+    float* x;
+    float* y;
+    float* out;
+    float* cos_table;
+    float* sin_table;
+    float* logits;              // [LM_HEAD_VOCAB] logits sintéticos (sampling)
+    q_context kernel_ctx;       // Só arena (sampling)
+    uint32_t rep;               // Chamada atual (rotação do pool Q4_0)
+    // Modelo dummy
+    bool has_model;
+    q_context ctx;
+    q_llama_model model;
+    float* model_logits;
+    uint32_t tokens[PREFILL_TOKENS];
+} bench_state;
+
+typedef q_error_code (*bench_fn)(bench_state* s);
+
+typedef struct {
+    const char* name;
+    bench_fn fn;
+    bool needs_model;
+} bench_case;
+
+typedef struct {
+    double median;
+    double mad;
+    double p99;
+    double mean;
+    double min;
+} bench_stats;
+
+typedef struct {
+    const bench_case* bench;
+    uint32_t calls_per_sample;
+    double* samples;            // [n_samples] us por chamada
+    uint32_t n_samples;
+    bench_stats stats;
+    q_error_code err;
+} bench_result;
+
+// ============================================================================
+// BENCHMARK CASES
+// ============================================================================
+
+static q_error_code gemv_q4(bench_state* s, uint32_t m, uint32_t n) {
+    // Fatia diferente do pool a cada chamada: pesos vindos da DRAM, como no decode
+    const size_t blocks = (size_t)m * (n / 32);
+    const size_t slices = s->q4_pool_blocks / blocks;
+    q_tensor w = {
+        .data = s->q4_pool + (s->rep % (slices > 0 ? slices : 1)) * blocks,
+        .ne = {m, n, 1, 1},
+        .nb = {(n / 32) * sizeof(q_block_q4_0), sizeof(q_block_q4_0), 0, 0},
+        .type = Q_Q4_0
+    };
+    return q_gemv_q4_f32_avx2(&w, s->x, s->out);
+}
+
+static q_error_code bench_gemv_q4_dim(bench_state* s) {
+    return gemv_q4(s, KERNEL_DIM, KERNEL_DIM);
+}
+
+static q_error_code bench_gemv_q4_hidden(bench_state* s) {
+    return gemv_q4(s, KERNEL_HIDDEN, KERNEL_DIM);
+}
+
+static q_error_code bench_lm_head_topk(bench_state* s) {
+    q_tensor w = {
+        .data = s->lm_head, .ne = {LM_HEAD_VOCAB, LM_HEAD_DIM, 1, 1},
+        .nb = {LM_HEAD_DIM * sizeof(float), sizeof(float), sizeof(float), sizeof(float)}, .type = Q_F32
+    };
+    uint32_t ids[8];
+    float top_logits[8];
+    return q_lm_head_topk_f32_avx2(s->x, &w, 8, ids, top_logits, NULL);
+}
+
+static q_error_code bench_rmsnorm(bench_state* s) {
+    return q_rmsnorm_f32_avx2(s->x, s->y, s->out, KERNEL_DIM, 1e-5f);
+}
+
+static q_error_code bench_rope(bench_state* s) {
+    return q_rope_f32_avx2(s->x, s->cos_table, s->sin_table, s->out, KERNEL_DIM);
+}
+
+static q_error_code bench_silu(bench_state* s) {
+    return q_silu_f32_avx2(s->x, s->out, KERNEL_HIDDEN);
+}
+
+static q_error_code bench_softmax(bench_state* s) {
+    return q_softmax_f32_avx2(s->logits, s->out, LM_HEAD_VOCAB);
+}
+
+static q_error_code bench_sample_greedy(bench_state* s) {
+    uint32_t token_id;
+    q_arena_reset(&s->kernel_ctx);
+    return q_sample_token(s->logits, LM_HEAD_VOCAB, 0.0f, 0, 0.0f, &token_id, &s->kernel_ctx);
+}
+
+static q_error_code bench_sample_top_k_p(bench_state* s) {
+    uint32_t token_id;
+    q_arena_reset(&s->kernel_ctx);
+    return q_sample_token(s->logits, LM_HEAD_VOCAB, 0.8f, 40, 0.9f, &token_id, &s->kernel_ctx);
+}
+
+static q_error_code bench_forward_prefill(bench_state* s) {
+    q_arena_reset(&s->ctx);
+    return llama_forward(&s->model, &s->ctx, s->tokens, PREFILL_TOKENS, 0, s->model_logits);
+}
+
+// Decode na posição PREFILL_TOKENS (reescreve o mesmo slot do KV cache a cada chamada)
+static q_error_code bench_forward_decode(bench_state* s) {
+    q_arena_reset(&s->ctx);
+    return llama_forward(&s->model, &s->ctx, s->tokens, 1, PREFILL_TOKENS, s->model_logits);
+}
+
+static q_error_code bench_forward_decode_topk(bench_state* s) {
+    uint32_t top_id;
+    float top_logit;
+    q_arena_reset(&s->ctx);
+    return llama_forward_topk(&s->model, &s->ctx, s->tokens, 1, PREFILL_TOKENS, 1, &top_id, &top_logit, NULL);
+}
+
+// Nomes são a chave do baseline: renomear um caso quebra a comparação dele
+static const bench_case BENCH_CASES[] = {
+    {"kernel/gemv_q4_4096x4096", bench_gemv_q4_dim, false},
+    {"kernel/gemv_q4_14336x4096", bench_gemv_q4_hidden, false},
+    {"kernel/lm_head_topk8_32000x2048", bench_lm_head_topk, false},
+    {"kernel/rmsnorm_4096", bench_rmsnorm, false},
+    {"kernel/rope_4096", bench_rope, false},
+    {"kernel/silu_14336", bench_silu, false},
+    {"kernel/softmax_32000", bench_softmax, false},
+    {"sampling/greedy_32000", bench_sample_greedy, false},
+    {"sampling/top_k40_top_p0.9_32000", bench_sample_top_k_p, false},
+    {"model/forward_prefill_16", bench_forward_prefill, true},
+    {"model/forward_decode", bench_forward_decode, true},
+    {"model/forward_decode_topk1", bench_forward_decode_topk, true},
+};
+
+#define N_BENCH_CASES (sizeof(BENCH_CASES) / sizeof(BENCH_CASES[0]))
+
+// ============================================================================
+// SETUP / CLEANUP
+// ============================================================================
+
+static float* alloc_floats(size_t n, float value) {
+    float* p = (float*)aligned_alloc(64, Q_ALIGN_SIZE(n * sizeof(float)));
+    if (p != NULL) {
+        for (size_t i = 0; i < n; i++) {
+            p[i] = value + (float)(i % 17) * 1e-3f;
+        }
+    }
+    return p;
+}
+
+static bool setup_kernels(bench_state* s) {
+    s->q4_pool_blocks = Q4_POOL_BYTES / sizeof(q_block_q4_0);
+    s->q4_pool = (q_block_q4_0*)aligned_alloc(64, Q_ALIGN_SIZE(s->q4_pool_blocks * sizeof(q_block_q4_0)));
+    s->lm_head = alloc_floats((size_t)LM_HEAD_VOCAB * LM_HEAD_DIM, 0.01f);
+    s->x = alloc_floats(KERNEL_HIDDEN, 0.5f);
+    s->y = alloc_floats(KERNEL_HIDDEN, 1.0f);
+    s->out = alloc_floats(LM_HEAD_VOCAB, 0.0f);
+    s->cos_table = alloc_floats(KERNEL_DIM / 2, 0.9f);
+    s->sin_table = alloc_floats(KERNEL_DIM / 2, 0.1f);
+    s->logits = alloc_floats(LM_HEAD_VOCAB, 0.0f);
+    if (s->q4_pool == NULL || s->lm_head == NULL || s->x == NULL || s->y == NULL || s->out == NULL ||
+        s->cos_table == NULL || s->sin_table == NULL || s->logits == NULL ||
+        q_alloc_arena(&s->kernel_ctx, 16 * 1024 * 1024) != Q_OK) {
+        return false;
+    }
+    for (size_t i = 0; i < s->q4_pool_blocks; i++) {
+        memset(s->q4_pool[i].qs, (int)(0x11 * (i % 15)), sizeof(s->q4_pool[i].qs));
+        s->q4_pool[i].scale = 0.01f;
+    }
+    srand(42);  // Logits reproduzíveis entre execuções (baseline comparável)
+    for (uint32_t i = 0; i < LM_HEAD_VOCAB; i++) {
+        s->logits[i] = (float)rand() / (float)RAND_MAX * 10.0f - 5.0f;
+    }
+    return true;
+}
+
+static bool ensure_dummy_model(void) {
+    if (access("model_dummy.qorus", R_OK) == 0) {
+        return true;
+    }
+    fprintf(stderr, "  Generating dummy model...\n");
+    return system("python3 tools/convert_llama.py model_dummy.qorus 2 > /dev/null 2>&1") == 0;
+}
+
+static bool setup_model(bench_state* s) {
+    if (!ensure_dummy_model() ||
+        q_init_memory(&s->ctx, "model_dummy.qorus") != Q_OK ||
+        q_alloc_arena(&s->ctx, 64 * 1024 * 1024) != Q_OK ||
+        llama_build_graph(&s->ctx, &s->model) != Q_OK) {
+        return false;
+    }
+    const q_llama_config* c = &s->model.config;
+    const size_t kv_size = (size_t)c->n_layers * c->n_kv_heads * c->max_seq_len *
+                           (c->dim / c->n_heads) * sizeof(float) * 2;
+    if (q_alloc_kv_cache(&s->ctx, Q_ALIGN_SIZE(kv_size)) != Q_OK) {
+        return false;
+    }
+    s->model_logits = alloc_floats(c->vocab_size, 0.0f);
+    for (uint32_t i = 0; i < PREFILL_TOKENS; i++) {
+        s->tokens[i] = (1 + i * 7919U) % c->vocab_size;
+    }
+    s->has_model = (s->model_logits != NULL);
+    return s->has_model;
+}
+
+static void cleanup_state(bench_state* s) {
+    free(s->q4_pool);
+    free(s->lm_head);
+    free(s->x);
+    free(s->y);
+    free(s->out);
+    free(s->cos_table);
+    free(s->sin_table);
+    free(s->logits);
+    free(s->model_logits);
+    q_free_memory(&s->kernel_ctx);
+    if (s->model.layers != NULL) {
+        llama_free_graph(&s->model);
+    }
+    q_free_memory(&s->ctx);
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+
+static int compare_doubles(const void* a, const void* b) {
+    const double da = *(const double*)a;
+    const double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static double median_sorted(const double* v, uint32_t n) {
+    return (n % 2 == 1) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+static bool compute_stats(const double* samples, uint32_t n, bench_stats* st) {
+    double* sorted = (double*)malloc(n * sizeof(double));
+    if (sorted == NULL) {
+        return false;
+    }
+    memcpy(sorted, samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    st->median = median_sorted(sorted, n);
+    st->min = sorted[0];
+    // p99 nearest-rank: menor amostra com >= 99% das amostras <= ela
+    const uint32_t rank = (uint32_t)ceil(0.99 * n);
+    st->p99 = sorted[(rank > 0 ? rank : 1) - 1];
+    double sum = 0.0;
+    for (uint32_t i = 0; i < n; i++) {
+        sum += sorted[i];
+        sorted[i] = fabs(sorted[i] - st->median);
+    }
+    st->mean = sum / n;
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    st->mad = median_sorted(sorted, n);
+    free(sorted);
+    return true;
+}
+
+typedef struct {
+    double value;
+    uint8_t group;              // 0 = baseline, 1 = atual
+} ranked_sample;
+
+static int compare_ranked(const void* a, const void* b) {
+    return compare_doubles(&((const ranked_sample*)a)->value, &((const ranked_sample*)b)->value);
+}
+
+// Mann-Whitney U bilateral (aproximação normal + correção de empates e continuidade)
+// Retorna p-value em [0, 1]; 1.0 se não há variância (todas as amostras iguais)
+static double mann_whitney_p(const double* base, uint32_t n1, const double* cur, uint32_t n2) {
+    const uint32_t n = n1 + n2;
+    ranked_sample* all = (ranked_sample*)malloc(n * sizeof(ranked_sample));
+    if (all == NULL) {
+        return 1.0;
+    }
+    for (uint32_t i = 0; i < n1; i++) {
+        all[i] = (ranked_sample){base[i], 0};
+    }
+    for (uint32_t i = 0; i < n2; i++) {
+        all[n1 + i] = (ranked_sample){cur[i], 1};
+    }
+    qsort(all, n, sizeof(ranked_sample), compare_ranked);
+
+    double rank_sum_base = 0.0;
+    double tie_term = 0.0;
+    for (uint32_t i = 0; i < n;) {
+        uint32_t j = i + 1;
+        while (j < n && !(all[j].value > all[i].value)) {
+            j++;
+        }
+        const double avg_rank = 0.5 * (double)(i + 1 + j);  // Ranks 1-based i+1 .. j
+        const double t = (double)(j - i);
+        tie_term += t * t * t - t;
+        for (uint32_t k = i; k < j; k++) {
+            if (all[k].group == 0) {
+                rank_sum_base += avg_rank;
+            }
+        }
+        i = j;
+    }
+    free(all);
+
+    const double u = rank_sum_base - 0.5 * (double)n1 * (n1 + 1);
+    const double mu = 0.5 * (double)n1 * n2;
+    const double var = (double)n1 * n2 / 12.0 * ((n + 1) - tie_term / ((double)n * (n - 1)));
+    if (!(var > 0.0)) {
+        return 1.0;
+    }
+    const double z = fmax(fabs(u - mu) - 0.5, 0.0) / sqrt(var);
+    return erfc(z / sqrt(2.0));
+}
+
+// ============================================================================
+// RUNNER
+// ============================================================================
+
+static q_error_code run_bench(bench_state* s, const bench_case* bench, uint32_t n_samples, bench_result* r) {
+    r->bench = bench;
+    r->n_samples = 0;
+    r->samples = (double*)malloc(n_samples * sizeof(double));
+    if (r->samples == NULL) {
+        return Q_ERR_ALLOC_FAILED;
+    }
+
+    // Warmup + calibração: dobra o lote até cobrir MIN_SAMPLE_MS (primeira chamada fria não distorce)
+    for (uint32_t i = 0; i < WARMUP_CALLS; i++, s->rep++) {
+        const q_error_code err = bench->fn(s);
+        if (err != Q_OK) {
+            return err;
+        }
+    }
+    r->calls_per_sample = 1;
+    for (;;) {
+        const double start = get_time_ms();
+        for (uint32_t c = 0; c < r->calls_per_sample; c++, s->rep++) {
+            const q_error_code err = bench->fn(s);
+            if (err != Q_OK) {
+                return err;
+            }
+        }
+        if (get_time_ms() - start >= MIN_SAMPLE_MS || r->calls_per_sample >= MAX_CALLS_PER_SAMPLE) {
+            break;
+        }
+        r->calls_per_sample *= 2;
+    }
+
+    for (uint32_t i = 0; i < n_samples; i++) {
+        const double start = get_time_ms();
+        for (uint32_t c = 0; c < r->calls_per_sample; c++, s->rep++) {
+            const q_error_code err = bench->fn(s);
+            if (err != Q_OK) {
+                return err;
+            }
+        }
+        r->samples[i] = (get_time_ms() - start) * 1000.0 / r->calls_per_sample;  // us por chamada
+        r->n_samples++;
+    }
+    return compute_stats(r->samples, r->n_samples, &r->stats) ? Q_OK : Q_ERR_ALLOC_FAILED;
+}
+
+// ============================================================================
+// HOST METADATA
+// ============================================================================
+
+typedef struct {
+    char cpu_model[256];
+    char cpu_flags[256];        // Subconjunto relevante para os kernels
+    char governor[64];
+    long n_cpus;
+} host_info;
+
+static void read_first_line(const char* path, char* out, size_t size) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL || fgets(out, (int)size, f) == NULL) {
+        snprintf(out, size, "unknown");
+    }
+    out[strcspn(out, "\n")] = '\0';
+    if (f != NULL) {
+        fclose(f);
+    }
+}
+
+static void collect_host_info(host_info* h) {
+    static const char* const relevant[] = {
+        "sse4_2", "avx", "avx2", "fma", "f16c", "bmi2", "avx512f", "avx512bw", "avx512vl",
+        "avx512_vnni", "avx512_bf16", "avx_vnni", "amx_tile"
+    };
+    snprintf(h->cpu_model, sizeof(h->cpu_model), "unknown");
+    h->cpu_flags[0] = '\0';
+    h->n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    read_first_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", h->governor, sizeof(h->governor));
+
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL) {
+        return;
+    }
+    char* line = NULL;
+    size_t cap = 0;
+    bool have_model = false;
+    bool have_flags = false;
+    while ((!have_model || !have_flags) && getline(&line, &cap, f) > 0) {
+        char* colon = strchr(line, ':');
+        if (colon == NULL) {
+            continue;
+        }
+        char* value = colon + 1 + strspn(colon + 1, " \t");
+        value[strcspn(value, "\n")] = '\0';
+        if (!have_model && strncmp(line, "model name", 10) == 0) {
+            snprintf(h->cpu_model, sizeof(h->cpu_model), "%s", value);
+            have_model = true;
+        } else if (!have_flags && strncmp(line, "flags", 5) == 0) {
+            // Busca por token inteiro (" avx " não casa com "avx2"); todos juntos cabem em cpu_flags
+            for (size_t i = 0; i < sizeof(relevant) / sizeof(relevant[0]); i++) {
+                const size_t flen = strlen(relevant[i]);
+                for (const char* p = value; (p = strstr(p, relevant[i])) != NULL; p += flen) {
+                    if ((p == value || p[-1] == ' ') && (p[flen] == ' ' || p[flen] == '\0')) {
+                        if (h->cpu_flags[0] != '\0') {
+                            strcat(h->cpu_flags, " ");
+                        }
+                        strcat(h->cpu_flags, relevant[i]);
+                        break;
+                    }
+                }
+            }
+            have_flags = true;
+        }
+    }
+    free(line);
+    fclose(f);
+}
+
+// ============================================================================
+// JSON OUTPUT
+// ============================================================================
+
+static void json_string(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        const unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static bool write_json(const char* path, const host_info* h, const char* label,
+                       const bench_result* results, uint32_t n_results) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        return false;
+    }
+    char timestamp[32];
+    const time_t now = time(NULL);
+    struct tm tm_utc;
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, &tm_utc));
+
+    fprintf(f, "{\n  \"schema\": 1,\n  \"timestamp\": ");
+    json_string(f, timestamp);
+    fprintf(f, ",\n  \"label\": ");
+    json_string(f, label);
+    fprintf(f, ",\n  \"host\": {\"cpu_model\": ");
+    json_string(f, h->cpu_model);
+    fprintf(f, ", \"cpu_flags\": ");
+    json_string(f, h->cpu_flags);
+    fprintf(f, ", \"governor\": ");
+    json_string(f, h->governor);
+    fprintf(f, ", \"n_cpus\": %ld},\n  \"build\": {\"compiler\": ", h->n_cpus);
+    json_string(f, __VERSION__);
+    fprintf(f, ", \"cflags\": ");
+    json_string(f, Q_BENCH_CFLAGS);
+    fprintf(f, "},\n  \"config\": {\"min_sample_ms\": %.1f, \"warmup_calls\": %d},\n", MIN_SAMPLE_MS, WARMUP_CALLS);
+    fprintf(f, "  \"benchmarks\": [\n");
+    for (uint32_t i = 0; i < n_results; i++) {
+        const bench_result* r = &results[i];
+        fprintf(f, "    {\"name\": ");
+        json_string(f, r->bench->name);
+        fprintf(f, ", \"unit\": \"us\", \"calls_per_sample\": %u, \"median\": %.6g, \"mad\": %.6g, "
+                   "\"p99\": %.6g, \"mean\": %.6g, \"min\": %.6g,\n     \"samples\": [",
+                r->calls_per_sample, r->stats.median, r->stats.mad, r->stats.p99, r->stats.mean, r->stats.min);
+        for (uint32_t k = 0; k < r->n_samples; k++) {
+            fprintf(f, "%s%.6g", k > 0 ? ", " : "", r->samples[k]);
+        }
+        fprintf(f, "]}%s\n", i + 1 < n_results ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+// ============================================================================
+// BASELINE (lê o JSON escrito por write_json; tolera reformatação/espaços)
+// ============================================================================
+
+static char* read_file(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    char* buf = NULL;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        const long size = ftell(f);
+        if (size >= 0 && fseek(f, 0, SEEK_SET) == 0 && (buf = (char*)malloc((size_t)size + 1)) != NULL) {
+            const size_t got = fread(buf, 1, (size_t)size, f);
+            buf[got] = '\0';
+        }
+    }
+    fclose(f);
+    return buf;
+}
+
+static const char* skip_ws(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+// Valor string de "key" a partir de p (sem escapes: nomes / cpu model); NULL se ausente
+static const char* find_key(const char* p, const char* key) {
+    const size_t len = strlen(key);
+    for (; (p = strchr(p, '"')) != NULL; p++) {
+        if (strncmp(p + 1, key, len) == 0 && p[len + 1] == '"') {
+            p = skip_ws(p + len + 2);
+            return (*p == ':') ? skip_ws(p + 1) : NULL;
+        }
+    }
+    return NULL;
+}
+
+static bool string_equals(const char* json_value, const char* s) {
+    const size_t len = strlen(s);
+    return json_value[0] == '"' && strncmp(json_value + 1, s, len) == 0 && json_value[len + 1] == '"';
+}
+
+// Amostras do benchmark `name` no baseline; retorna quantas leu (0 = ausente)
+static uint32_t baseline_samples(const char* json, const char* name, double* out, uint32_t max) {
+    for (const char* p = json; (p = find_key(p, "name")) != NULL;) {
+        if (!string_equals(p, name)) {
+            continue;
+        }
+        const char* next_name = find_key(p, "name");
+        const char* s = find_key(p, "samples");
+        if (s == NULL || *s != '[' || (next_name != NULL && s > next_name)) {
+            return 0;
+        }
+        uint32_t n = 0;
+        for (s = skip_ws(s + 1); *s != ']' && n < max; n++) {
+            char* end;
+            out[n] = strtod(s, &end);
+            if (end == s) {
+                return 0;
+            }
+            s = skip_ws(end);
+            s = (*s == ',') ? skip_ws(s + 1) : s;
+        }
+        return n;
+    }
+    return 0;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+static void print_usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s [--json PATH] [--baseline PATH] [--threshold PCT] [--alpha P]\n"
+                    "       [--samples N] [--filter SUBSTR] [--label STR] [--no-model]\n", argv0);
+}
+
+int main(int argc, char** argv) {
+    const char* json_path = NULL;
+    const char* baseline_path = NULL;
+    const char* filter = NULL;
+    const char* label = "";
+    double threshold_pct = DEFAULT_THRESHOLD_PCT;
+    double alpha = DEFAULT_ALPHA;
+    long n_samples = DEFAULT_SAMPLES;
+    bool use_model = true;
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = (i + 1 < argc);
+        if (strcmp(argv[i], "--json") == 0 && has_value) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && has_value) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && has_value) {
+            threshold_pct = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--alpha") == 0 && has_value) {
+            alpha = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--samples") == 0 && has_value) {
+            n_samples = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && has_value) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--label") == 0 && has_value) {
+            label = argv[++i];
+        } else if (strcmp(argv[i], "--no-model") == 0) {
+            use_model = false;
+        } else {
+            print_usage(argv[0]);
+            return EXIT_BENCH_ERROR;
+        }
+    }
+    if (n_samples < 5 || n_samples > MAX_SAMPLES || !(threshold_pct >= 0.0) || !(alpha > 0.0 && alpha < 1.0)) {
+        fprintf(stderr, "ERROR: need 5 <= samples <= %d, threshold >= 0, 0 < alpha < 1\n", MAX_SAMPLES);
+        return EXIT_BENCH_ERROR;
+    }
+
+    // Baseline lido antes de medir: erro de caminho falha rápido
+    char* baseline = NULL;
+    if (baseline_path != NULL && (baseline = read_file(baseline_path)) == NULL) {
+        fprintf(stderr, "ERROR: cannot read baseline %s\n", baseline_path);
+        return EXIT_BENCH_ERROR;
+    }
+
+    host_info host;
+    collect_host_info(&host);
+    printf("========================================\n");
+    printf("  BENCH HARNESS (%ld samples/benchmark)\n", n_samples);
+    printf("========================================\n");
+    printf("CPU: %s [%s], governor %s\n", host.cpu_model, host.cpu_flags, host.governor);
+    if (baseline != NULL) {
+        const char* base_cpu = find_key(baseline, "cpu_model");
+        if (base_cpu != NULL && !string_equals(base_cpu, host.cpu_model)) {
+            printf("WARNING: baseline was recorded on a different CPU model\n");
+        }
+    }
+    printf("\n");
+
+    bench_state state;
+    memset(&state, 0, sizeof(state));
+    int exit_code = 0;
+    bench_result* results = (bench_result*)calloc(N_BENCH_CASES, sizeof(bench_result));
+    double* base_samples = (double*)malloc(MAX_SAMPLES * sizeof(double));
+    if (results == NULL || base_samples == NULL || !setup_kernels(&state)) {
+        fprintf(stderr, "ERROR: benchmark buffer allocation failed\n");
+        exit_code = EXIT_BENCH_ERROR;
+        goto cleanup;
+    }
+    if (use_model && !setup_model(&state)) {
+        fprintf(stderr, "ERROR: dummy model setup failed (use --no-model to skip model benchmarks)\n");
+        exit_code = EXIT_BENCH_ERROR;
+        goto cleanup;
+    }
+
+    printf("%-34s %12s %10s %12s %9s", "benchmark", "median(us)", "MAD", "p99(us)", "calls");
+    if (baseline != NULL) {
+        printf(" %9s %9s  %s", "delta", "p-value", "verdict");
+    }
+    printf("\n");
+
+    uint32_t n_results = 0;
+    uint32_t regressions = 0;
+    for (size_t i = 0; i < N_BENCH_CASES; i++) {
+        const bench_case* bench = &BENCH_CASES[i];
+        if ((bench->needs_model && !state.has_model) || (filter != NULL && strstr(bench->name, filter) == NULL)) {
+            continue;
+        }
+        bench_result* r = &results[n_results];
+        r->err = run_bench(&state, bench, (uint32_t)n_samples, r);
+        if (r->err != Q_OK) {
+            printf("%-34s ERROR: %s\n", bench->name, q_strerror(r->err));
+            free(r->samples);
+            r->samples = NULL;
+            exit_code = EXIT_BENCH_ERROR;
+            continue;
+        }
+        n_results++;
+        printf("%-34s %12.3f %10.3f %12.3f %9u", bench->name, r->stats.median, r->stats.mad, r->stats.p99,
+               r->calls_per_sample);
+        if (baseline != NULL) {
+            const uint32_t nb = baseline_samples(baseline, bench->name, base_samples, MAX_SAMPLES);
+            if (nb == 0) {
+                printf(" %9s %9s  new", "-", "-");
+            } else {
+                bench_stats base_stats;
+                if (!compute_stats(base_samples, nb, &base_stats) || !(base_stats.median > 0.0)) {
+                    printf(" %9s %9s  invalid baseline\n", "-", "-");
+                    exit_code = EXIT_BENCH_ERROR;
+                    continue;
+                }
+                const double delta = r->stats.median / base_stats.median - 1.0;
+                const double p = mann_whitney_p(base_samples, nb, r->samples, r->n_samples);
+                const bool significant = (p < alpha);
+                const char* verdict = "ok";
+                if (significant && delta * 100.0 > threshold_pct) {
+                    verdict = "REGRESSION";
+                    regressions++;
+                } else if (significant && -delta * 100.0 > threshold_pct) {
+                    verdict = "improved";
+                }
+                printf(" %+8.1f%% %9.2g  %s", delta * 100.0, p, verdict);
+            }
+        }
+        printf("\n");
+    }
+
+    if (json_path != NULL) {
+        if (write_json(json_path, &host, label, results, n_results)) {
+            printf("\nJSON written to %s\n", json_path);
+        } else {
+            fprintf(stderr, "ERROR: cannot write %s\n", json_path);
+            exit_code = EXIT_BENCH_ERROR;
+        }
+    }
+    if (baseline != NULL) {
+        printf("\n%u regression(s) beyond %.1f%% at alpha %.3g vs %s\n", regressions, threshold_pct, alpha,
+               baseline_path);
+        if (regressions > 0 && exit_code == 0) {
+            exit_code = EXIT_BENCH_REGRESSION;
+        }
+    }
+
+cleanup:
+    if (results != NULL) {
+        for (size_t i = 0; i < N_BENCH_CASES; i++) {
+            free(results[i].samples);
+        }
+    }
+    free(results);
+    free(base_samples);
+    free(baseline);
+    cleanup_state(&state);
+    return exit_code;
+}
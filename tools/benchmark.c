@@ -6,6 +6,7 @@
 #include <time.h>
 #include <math.h>
 #include <immintrin.h>
+#include "perf_counters.h"
 
 // ============================================================================
 // BENCHMARK CONFIGURATION
@@ -25,10 +26,13 @@ static double get_time_ms(void) {
     return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
 }
 
+// perf != NULL: contadores de hardware em volta do loop medido (sample = total)
 static double benchmark_function(
     void (*func)(void),
     int warmup_iterations,
-    int benchmark_iterations
+    int benchmark_iterations,
+    const perf_counters* perf,
+    perf_sample* sample
 ) {
     // Warmup
     for (int i = 0; i < warmup_iterations; i++) {
@@ -36,11 +40,17 @@ static double benchmark_function(
     }
     
     // Benchmark
+    if (perf != NULL) {
+        perf_counters_start(perf);
+    }
     double start = get_time_ms();
     for (int i = 0; i < benchmark_iterations; i++) {
         func();
     }
     double end = get_time_ms();
+    if (perf != NULL) {
+        perf_counters_stop(perf, sample);
+    }
     
     return (end - start) / benchmark_iterations;
 }
@@ -268,54 +278,83 @@ static void print_result(const char* metric, double value, const char* unit) {
     printf("  %-30s: %10.4f %s\n", metric, value, unit);
 }
 
+// bytes_per_call: bytes mínimos lidos + escritos pelo kernel (base do bytes/cycle)
+static void print_perf(const perf_counters* perf, const perf_sample* sample, double bytes_per_call) {
+    if (perf != NULL) {
+        perf_sample_print(sample, BENCHMARK_ITERATIONS, "call", bytes_per_call * BENCHMARK_ITERATIONS);
+    }
+}
+
 int main(int argc, char** argv) {
-    (void)argc;
-    (void)argv;
+    // --perf: contadores de hardware (cycles, instructions, LLC/dTLB misses)
+    bool use_perf = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--perf") == 0) {
+            use_perf = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--perf]\n", argv[0]);
+            return 1;
+        }
+    }
     
     printf("Qorus-IA v2.0 Performance Benchmark Suite\n");
     printf("==========================================\n");
     printf("Warmup iterations: %d\n", WARMUP_ITERATIONS);
     printf("Benchmark iterations: %d\n", BENCHMARK_ITERATIONS);
+    
+    perf_counters counters = {{-1, -1, -1, -1}, 0, 0};
+    const perf_counters* perf = NULL;
+    perf_sample sample = {{0}, {false}};
+    if (use_perf) {
+        perf = (perf_counters_open(&counters) > 0) ? &counters : NULL;
+        perf_counters_print_status(&counters);
+    }
     printf("\n");
     
     // Benchmark 1: Dequantization Q4_0
     print_header("Dequantization Q4_0");
-    double dequant_time = benchmark_function(bench_dequantize_q4_0, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS);
+    double dequant_time = benchmark_function(bench_dequantize_q4_0, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS, perf, &sample);
     print_result("Latency", dequant_time, "ms");
     print_result("Throughput", 1000.0 / dequant_time, "ops/s");
+    print_perf(perf, &sample, sizeof(q_block_q4_0) + 32.0 * sizeof(float));
     
     // Benchmark 2: MatMul Q4_F32
     print_header("MatMul Q4_F32 (1024x1024)");
-    double matmul_time = benchmark_function(bench_matmul_q4_f32, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS);
+    double matmul_time = benchmark_function(bench_matmul_q4_f32, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS, perf, &sample);
     print_result("Latency", matmul_time, "ms");
     print_result("Throughput", 1000.0 / matmul_time, "ops/s");
     // Calculate GFLOPS: 2*M*N operations (multiply-add) / time
     double gflops = (2.0 * 1024.0 * 1024.0) / (matmul_time * 1e6);
     print_result("Performance", gflops, "GFLOPS");
+    print_perf(perf, &sample, (1024.0 * 1024.0 / 32.0) * sizeof(q_block_q4_0) + 2.0 * 1024.0 * sizeof(float));
     
     // Benchmark 3: RMSNorm
     print_header("RMSNorm (4096 elements)");
-    double rmsnorm_time = benchmark_function(bench_rmsnorm, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS);
+    double rmsnorm_time = benchmark_function(bench_rmsnorm, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS, perf, &sample);
     print_result("Latency", rmsnorm_time, "ms");
     print_result("Throughput", 1000.0 / rmsnorm_time, "ops/s");
+    print_perf(perf, &sample, 3.0 * 4096.0 * sizeof(float));
     
     // Benchmark 4: RoPE
     print_header("RoPE (4096 elements)");
-    double rope_time = benchmark_function(bench_rope, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS);
+    double rope_time = benchmark_function(bench_rope, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS, perf, &sample);
     print_result("Latency", rope_time, "ms");
     print_result("Throughput", 1000.0 / rope_time, "ops/s");
+    print_perf(perf, &sample, 3.0 * 4096.0 * sizeof(float));
     
     // Benchmark 5: SiLU
     print_header("SiLU (4096 elements)");
-    double silu_time = benchmark_function(bench_silu, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS);
+    double silu_time = benchmark_function(bench_silu, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS, perf, &sample);
     print_result("Latency", silu_time, "ms");
     print_result("Throughput", 1000.0 / silu_time, "ops/s");
+    print_perf(perf, &sample, 2.0 * 4096.0 * sizeof(float));
     
     // Benchmark 6: Softmax
     print_header("Softmax (4096 elements)");
-    double softmax_time = benchmark_function(bench_softmax, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS);
+    double softmax_time = benchmark_function(bench_softmax, WARMUP_ITERATIONS, BENCHMARK_ITERATIONS, perf, &sample);
     print_result("Latency", softmax_time, "ms");
     print_result("Throughput", 1000.0 / softmax_time, "ops/s");
+    print_perf(perf, &sample, 2.0 * 4096.0 * sizeof(float));
     
     // Summary
     printf("\n");
@@ -325,6 +364,7 @@ int main(int argc, char** argv) {
     printf("All benchmarks completed successfully.\n");
     printf("\n");
     
+    perf_counters_close(&counters);
     return 0;
 }
 
@@ -3,6 +3,7 @@
 // ============================================================================
 // Mede latência por token de geração completa
 // Métricas: prefill time, incremental generation time, throughput
+// --perf: contadores de hardware por forward (IPC, misses/token, bytes/cycle)
 // ============================================================================
 
 #include "../include/qorus.h"
@@ -15,6 +16,7 @@
 #ifdef __AVX2__
 #include <immintrin.h>  // Para SIMD argmax
 #endif
+#include "perf_counters.h"
 
 // ============================================================================
 // BENCHMARK CONFIGURATION
@@ -72,6 +74,42 @@ static size_t calculate_kv_cache_size(const q_llama_config* config) {
     return Q_ALIGN_SIZE(kv_size);
 }
 
+static size_t tensor_bytes(const q_tensor* t) {
+    if (t == NULL) {
+        return 0;
+    }
+    const size_t n = (size_t)t->ne[0] * t->ne[1] * t->ne[2] * t->ne[3];
+    return (t->type == Q_Q4_0) ? n / 32 * sizeof(q_block_q4_0) : n * sizeof(float);
+}
+
+// Bytes de pesos lidos por forward: todas as camadas + LM head (embedding: 1 linha por token)
+static double forward_weight_bytes(const q_llama_model* model) {
+    size_t bytes = tensor_bytes(model->output) + tensor_bytes(model->output_norm);
+    for (uint32_t l = 0; l < model->config.n_layers; l++) {
+        const q_llama_layer* layer = &model->layers[l];
+        bytes += tensor_bytes(layer->attn_norm) + tensor_bytes(layer->ffn_norm) +
+                 tensor_bytes(layer->wq) + tensor_bytes(layer->wk) + tensor_bytes(layer->wv) +
+                 tensor_bytes(layer->wo) + tensor_bytes(layer->w_gate) + tensor_bytes(layer->w_up) +
+                 tensor_bytes(layer->w_down);
+    }
+    return (double)bytes;
+}
+
+// Contadores em volta de uma janela medida (perf == NULL: no-op)
+static void perf_window_start(const perf_counters* perf) {
+    if (perf != NULL) {
+        perf_counters_start(perf);
+    }
+}
+
+static void perf_window_stop(const perf_counters* perf, perf_sample* total) {
+    if (perf != NULL) {
+        perf_sample sample;
+        perf_counters_stop(perf, &sample);
+        perf_sample_add(total, &sample);
+    }
+}
+
 // ============================================================================
 // BENCHMARK: Prefill Performance
 // ============================================================================
@@ -81,16 +119,20 @@ static double benchmark_prefill(
     q_context* ctx,
     const uint32_t* tokens,
     uint32_t num_tokens,
-    float* logits
+    float* logits,
+    const perf_counters* perf,
+    perf_sample* perf_total
 ) {
     double total_time = 0.0;
     
     for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
         q_arena_reset(ctx);
         
+        perf_window_start(perf);
         double start = get_time_ms();
         q_error_code ret = llama_forward(model, ctx, tokens, num_tokens, 0, logits);
         double end = get_time_ms();
+        perf_window_stop(perf, perf_total);
         
         if (ret != Q_OK) {
             return -1.0;  // Error
@@ -111,7 +153,9 @@ static double benchmark_incremental_generation(
     q_context* ctx,
     q_tokenizer* tokenizer,
     const char* prompt,
-    uint32_t num_tokens_to_generate
+    uint32_t num_tokens_to_generate,
+    const perf_counters* perf,
+    perf_sample* perf_total
 ) {
     // Setup
     uint32_t prompt_tokens[256];
@@ -211,9 +255,11 @@ static double benchmark_incremental_generation(
         // OTIMIZAÇÃO CRÍTICA: Não resetar arena dentro do loop
         // Reset apenas quando necessário (após forward pass)
         uint32_t incremental_tokens[1] = {token_id};
+        perf_window_start(perf);
         double start = get_time_ms();
         ret = llama_forward(model, ctx, incremental_tokens, 1, current_pos, logits);
         double end = get_time_ms();
+        perf_window_stop(perf, perf_total);
         
         if (ret != Q_OK) {
             return -1.0;
@@ -235,7 +281,10 @@ static double benchmark_incremental_generation(
 
 static double benchmark_full_generation(
     q_generation_state* gen_state,
-    uint32_t num_iterations
+    uint32_t num_iterations,
+    const perf_counters* perf,
+    perf_sample* perf_total,
+    uint32_t* total_tokens
 ) {
     // OTIMIZAÇÃO CRÍTICA: Warmup antes de medir
     // Primeira iteração pode ser mais lenta devido a cache misses, page faults, etc.
@@ -253,15 +302,18 @@ static double benchmark_full_generation(
         gen_state->num_generated_tokens = 0;
         gen_state->current_pos = 0;
         
+        perf_window_start(perf);
         double start = get_time_ms();
         q_error_code ret = q_generate(gen_state);
         double end = get_time_ms();
+        perf_window_stop(perf, perf_total);
         
         if (ret != Q_OK) {
             return -1.0;
         }
         
         total_time += (end - start);
+        *total_tokens += gen_state->num_generated_tokens;
     }
     
     return total_time / num_iterations;
@@ -272,12 +324,27 @@ static double benchmark_full_generation(
 // ============================================================================
 
 int main(int argc, char** argv) {
-    (void)argc;  // Unused
-    (void)argv;   // Unused
+    bool use_perf = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--perf") == 0) {
+            use_perf = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--perf]\n", argv[0]);
+            return 1;
+        }
+    }
     printf("========================================\n");
     printf("  GENERATION PERFORMANCE BENCHMARK\n");
     printf("========================================\n\n");
     
+    perf_counters counters = {{-1, -1, -1, -1}, 0, 0};
+    const perf_counters* perf = NULL;
+    if (use_perf) {
+        perf = (perf_counters_open(&counters) > 0) ? &counters : NULL;
+        perf_counters_print_status(&counters);
+        printf("\n");
+    }
+    
     if (!ensure_dummy_model() || !ensure_tokenizer()) {
         fprintf(stderr, "ERROR: Cannot generate dummy model/tokenizer\n");
         return 1;
@@ -326,8 +393,10 @@ int main(int argc, char** argv) {
         return 1;
     }
     
+    const double weight_bytes = forward_weight_bytes(&model);
     printf("Model: %u layers, %u dim, vocab_size=%u\n", 
            model.config.n_layers, model.config.dim, model.config.vocab_size);
+    printf("Weights read per forward: %.1f MB\n", weight_bytes / (1024.0 * 1024.0));
     printf("\n");
     
     // Benchmark 1: Prefill performance
@@ -341,10 +410,17 @@ int main(int argc, char** argv) {
         size_t logits_size = Q_ALIGN_SIZE((size_t)model.config.vocab_size * sizeof(float));
         float* logits = (float*)malloc(logits_size);
         
-        double prefill_time = benchmark_prefill(&model, &ctx, prompt_tokens, num_prompt_tokens, logits);
+        perf_sample prefill_perf = {{0}, {false}};
+        double prefill_time = benchmark_prefill(&model, &ctx, prompt_tokens, num_prompt_tokens, logits,
+                                                perf, &prefill_perf);
         if (prefill_time >= 0.0) {
             printf("  Prefill time: %.3f ms (seq_len=%u)\n", prefill_time, num_prompt_tokens);
             printf("  Time per token: %.3f ms\n", prefill_time / num_prompt_tokens);
+            if (perf != NULL) {
+                // Prefill lê os pesos uma vez por forward, não por token
+                perf_sample_print(&prefill_perf, (double)num_prompt_tokens * BENCHMARK_ITERATIONS, "token",
+                                  weight_bytes * BENCHMARK_ITERATIONS);
+            }
         } else {
             printf("  ERROR: Prefill benchmark failed\n");
         }
@@ -356,10 +432,16 @@ int main(int argc, char** argv) {
     // Benchmark 2: Incremental generation
     printf("Benchmark 2: Incremental Generation Performance\n");
     printf("-----------------------------------\n");
-    double incr_time = benchmark_incremental_generation(&model, &ctx, &tokenizer, prompt, 10);
+    const uint32_t incr_tokens = 10;
+    perf_sample incr_perf = {{0}, {false}};
+    double incr_time = benchmark_incremental_generation(&model, &ctx, &tokenizer, prompt, incr_tokens,
+                                                        perf, &incr_perf);
     if (incr_time >= 0.0) {
         printf("  Incremental generation time: %.3f ms/token\n", incr_time);
         printf("  Throughput: %.2f tokens/s\n", 1000.0 / incr_time);
+        if (perf != NULL) {
+            perf_sample_print(&incr_perf, incr_tokens, "token", weight_bytes * incr_tokens);
+        }
     } else {
         printf("  ERROR: Incremental generation benchmark failed\n");
     }
@@ -384,13 +466,20 @@ int main(int argc, char** argv) {
         .current_pos = 0
     };
     
-    double full_time = benchmark_full_generation(&gen_state, BENCHMARK_ITERATIONS);
+    perf_sample full_perf = {{0}, {false}};
+    uint32_t full_tokens = 0;
+    double full_time = benchmark_full_generation(&gen_state, BENCHMARK_ITERATIONS, perf, &full_perf, &full_tokens);
     if (full_time >= 0.0) {
         printf("  Full generation time: %.3f ms (avg over %d iterations)\n", full_time, BENCHMARK_ITERATIONS);
         if (gen_state.num_generated_tokens > 0) {
             printf("  Time per token: %.3f ms\n", full_time / gen_state.num_generated_tokens);
             printf("  Throughput: %.2f tokens/s\n", 1000.0 * gen_state.num_generated_tokens / full_time);
         }
+        if (perf != NULL && full_tokens > 0) {
+            // Forwards = 1 prefill + 1 por token gerado (aprox.: último pode não ocorrer)
+            const double forwards = (double)full_tokens + BENCHMARK_ITERATIONS;
+            perf_sample_print(&full_perf, full_tokens, "token", weight_bytes * forwards);
+        }
     } else {
         printf("  ERROR: Full generation benchmark failed\n");
     }
@@ -400,6 +489,7 @@ int main(int argc, char** argv) {
     q_tokenizer_free(&tokenizer);
     llama_free_graph(&model);
     q_free_memory(&ctx);
+    perf_counters_close(&counters);
     
     printf("========================================\n");
     printf("  BENCHMARK COMPLETE\n");
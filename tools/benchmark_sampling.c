@@ -20,6 +20,9 @@
 #define WARMUP_ITERATIONS 10
 #define BENCHMARK_ITERATIONS 1000
 #define VOCAB_SIZE 32000  // Typical vocabulary size
+#define LM_HEAD_DIM 512   // Hidden dim do benchmark de LM head (pesos: 64MB)
+#define LM_HEAD_ITERATIONS 50
+#define LARGE_VOCAB_SIZE 128256  // Vocabulário Llama-3 (min-p / typical)
 
 // ============================================================================
 // TIMING UTILITIES
@@ -69,6 +72,141 @@ static double benchmark_sampling(
     return total_time / BENCHMARK_ITERATIONS;  // Average time per call
 }
 
+// q_sample_token_ext: min-p / typical sobre o conjunto truncado
+static double benchmark_sampling_ext(
+    const float* logits,
+    uint32_t vocab_size,
+    uint32_t top_k,
+    float top_p,
+    float min_p,
+    float typical_p,
+    q_context* restrict ctx
+) {
+    uint32_t token_id;
+    double total_time = 0.0;
+    
+    for (int i = 0; i < WARMUP_ITERATIONS; i++) {
+        q_arena_reset(ctx);
+        q_sample_token_ext(logits, vocab_size, 1.0f, top_k, top_p, min_p, typical_p, NULL, &token_id, ctx);
+    }
+    
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        q_arena_reset(ctx);
+        
+        double start = get_time_ms();
+        q_error_code ret = q_sample_token_ext(logits, vocab_size, 1.0f, top_k, top_p, min_p, typical_p,
+                                              NULL, &token_id, ctx);
+        double end = get_time_ms();
+        
+        if (ret != Q_OK) {
+            return -1.0;
+        }
+        
+        total_time += (end - start);
+    }
+    
+    return total_time / BENCHMARK_ITERATIONS;
+}
+
+// ============================================================================
+// BENCHMARK: LM Head + Greedy (matmul + argmax vs q_lm_head_topk_f32_avx2)
+// ============================================================================
+
+// fused = false: logits [vocab] materializados e relidos pelo sampler
+static double benchmark_lm_head(const float* x, const q_tensor* head, float* logits,
+                                bool fused, q_context* restrict ctx) {
+    const uint32_t vocab_size = head->ne[0];
+    const uint32_t dim = head->ne[1];
+    q_tensor x_t = {.data = (void*)x, .ne = {1, dim, 1, 1},
+                    .nb = {dim * sizeof(float), sizeof(float), sizeof(float), sizeof(float)},
+                    .type = Q_F32};
+    q_tensor w_t = {.data = head->data, .ne = {dim, vocab_size, 1, 1},
+                    .nb = {sizeof(float), dim * sizeof(float), sizeof(float), sizeof(float)},
+                    .type = Q_F32};
+    q_tensor out_t = {.data = logits, .ne = {1, vocab_size, 1, 1},
+                      .nb = {vocab_size * sizeof(float), sizeof(float), sizeof(float), sizeof(float)},
+                      .type = Q_F32};
+    double total_time = 0.0;
+    for (int i = 0; i < WARMUP_ITERATIONS + LM_HEAD_ITERATIONS; i++) {
+        q_arena_reset(ctx);
+        uint32_t token_id = 0;
+        float token_logit = 0.0f;
+        double start = get_time_ms();
+        q_error_code ret;
+        if (fused) {
+            ret = q_lm_head_topk_f32_avx2(x, head, 1, &token_id, &token_logit, NULL);
+        } else {
+            ret = q_matmul_f32_avx2(&x_t, &w_t, &out_t, ctx);
+            if (ret == Q_OK) {
+                ret = q_sample_token(logits, vocab_size, 0.0f, 0, 0.0f, &token_id, ctx);
+            }
+        }
+        double end = get_time_ms();
+        if (ret != Q_OK) {
+            return -1.0;
+        }
+        if (i >= WARMUP_ITERATIONS) {
+            total_time += (end - start);
+        }
+    }
+    return total_time / LM_HEAD_ITERATIONS;
+}
+
+// ============================================================================
+// BENCHMARK: Constrained Decoding (q_grammar_apply overhead)
+// ============================================================================
+
+// Vocabulário sintético: 256 tokens de byte + tokens ASCII de 2-8 caracteres
+static bool build_synthetic_tokenizer(q_tokenizer* tok, uint32_t vocab_size) {
+    memset(tok, 0, sizeof(*tok));
+    tok->vocab = (char**)calloc(vocab_size, sizeof(char*));
+    if (tok->vocab == NULL) return false;
+    tok->vocab_size = vocab_size;
+
+    static const char charset[] = "abcdefghijklmnopqrstuvwxyz0123456789 {}[]\",:.-";
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        uint32_t len = (i < 256) ? 1 : 2 + (uint32_t)(rand() % 7);
+        tok->vocab[i] = (char*)malloc(len + 1);
+        if (tok->vocab[i] == NULL) return false;
+        for (uint32_t j = 0; j < len; j++) {
+            tok->vocab[i][j] = (i < 256) ? (char)(i == 0 ? ' ' : i)
+                                         : charset[rand() % (int)(sizeof(charset) - 1)];
+        }
+        tok->vocab[i][len] = '\0';
+    }
+    tok->bos_token_id = 256;
+    tok->eos_token_id = 257;
+    tok->pad_token_id = 258;
+    tok->initialized = true;
+    return true;
+}
+
+static void free_synthetic_tokenizer(q_tokenizer* tok) {
+    if (tok->vocab != NULL) {
+        for (uint32_t i = 0; i < tok->vocab_size; i++) free(tok->vocab[i]);
+        free(tok->vocab);
+    }
+    memset(tok, 0, sizeof(*tok));
+}
+
+// Tempo médio (us) de q_grammar_apply com máscara em cache (caminho quente por token)
+static double benchmark_grammar_apply(q_grammar* g, const float* logits, float* work, uint32_t vocab_size) {
+    double total_time = 0.0;
+    for (int i = 0; i < WARMUP_ITERATIONS + BENCHMARK_ITERATIONS; i++) {
+        memcpy(work, logits, vocab_size * sizeof(float));
+        double start = get_time_ms();
+        q_error_code ret = q_grammar_apply(g, work, vocab_size);
+        double end = get_time_ms();
+        if (ret != Q_OK) {
+            return -1.0;
+        }
+        if (i >= WARMUP_ITERATIONS) {
+            total_time += (end - start);
+        }
+    }
+    return total_time / BENCHMARK_ITERATIONS * 1000.0;
+}
+
 // ============================================================================
 // MAIN BENCHMARK RUNNER
 // ============================================================================
@@ -162,6 +300,142 @@ int main(void) {
     printf("  Throughput: %.2f calls/sec\n", 1000.0 / time_combined);
     printf("\n");
     
+    // Test Case 5: Constrained decoding (JSON grammar mask antes do sampling)
+    printf("Test Case 5: JSON Grammar Mask (q_grammar_apply)\n");
+    printf("-------------------------------------------------\n");
+    q_tokenizer grammar_tok;
+    q_grammar grammar;
+    float* work = (float*)malloc(VOCAB_SIZE * sizeof(float));
+    if (work == NULL || !build_synthetic_tokenizer(&grammar_tok, VOCAB_SIZE)) {
+        fprintf(stderr, "Failed to build synthetic tokenizer\n");
+        free(work);
+        free_synthetic_tokenizer(&grammar_tok);
+        free(logits);
+        q_free_memory(&ctx);
+        return 1;
+    }
+
+    double build_start = get_time_ms();
+    q_error_code grammar_err = q_grammar_init_json(&grammar, &grammar_tok);
+    double build_ms = get_time_ms() - build_start;
+    // Estados representativos: valor raiz, dentro de string, após valor em objeto
+    const char* prefixes[] = {"", "{\"", "{\"a\":1"};
+    const char* labels[] = {"root value", "inside string", "after value"};
+    double time_mask[3] = {0.0, 0.0, 0.0};
+    for (int p = 0; p < 3 && grammar_err == Q_OK; p++) {
+        q_grammar_reset(&grammar);
+        for (const char* c = prefixes[p]; *c != '\0' && grammar_err == Q_OK; c++) {
+            grammar_err = q_grammar_accept_token(&grammar, (uint32_t)(uint8_t)*c);
+        }
+        if (grammar_err == Q_OK) {
+            time_mask[p] = benchmark_grammar_apply(&grammar, logits, work, VOCAB_SIZE);
+            grammar_err = (time_mask[p] < 0) ? Q_ERR_INVALID_CONFIG : Q_OK;
+        }
+    }
+
+    // Pipeline completo: máscara + top-k (k=10) sobre logits mascarados
+    double time_constrained = -1.0;
+    if (grammar_err == Q_OK) {
+        memcpy(work, logits, VOCAB_SIZE * sizeof(float));
+        grammar_err = q_grammar_apply(&grammar, work, VOCAB_SIZE);
+        time_constrained = benchmark_sampling(work, VOCAB_SIZE, 1.0f, 10, 0.0f, &ctx);
+    }
+    if (grammar_err != Q_OK || time_constrained < 0) {
+        fprintf(stderr, "Grammar benchmark failed: %s\n", q_strerror(grammar_err));
+        q_grammar_free(&grammar);
+        free_synthetic_tokenizer(&grammar_tok);
+        free(work);
+        free(logits);
+        q_free_memory(&ctx);
+        return 1;
+    }
+    printf("  First mask build (init): %.3f ms\n", build_ms);
+    for (int p = 0; p < 3; p++) {
+        printf("  Mask apply (%-13s): %.3f us/token\n", labels[p], time_mask[p]);
+    }
+    printf("  Masks built: %llu, cache hits: %llu\n",
+           (unsigned long long)grammar.masks_built, (unsigned long long)grammar.mask_hits);
+    printf("  Top-k on masked logits: %.4f ms/call\n", time_constrained);
+    printf("\n");
+    q_grammar_free(&grammar);
+    free_synthetic_tokenizer(&grammar_tok);
+    free(work);
+
+    // Test Case 6: LM head + greedy, fundido vs não-fundido
+    printf("Test Case 6: LM Head + Greedy (dim=%u, vocab=%u)\n", LM_HEAD_DIM, VOCAB_SIZE);
+    printf("------------------------------------------------\n");
+    float* head_x = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE(LM_HEAD_DIM * sizeof(float)));
+    float* head_w = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE((size_t)VOCAB_SIZE * LM_HEAD_DIM * sizeof(float)));
+    float* head_logits = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE(VOCAB_SIZE * sizeof(float)));
+    double time_head_unfused = -1.0;
+    double time_head_fused = -1.0;
+    if (head_x != NULL && head_w != NULL && head_logits != NULL) {
+        for (uint32_t i = 0; i < LM_HEAD_DIM; i++) {
+            head_x[i] = (float)rand() / (float)RAND_MAX - 0.5f;
+        }
+        for (size_t i = 0; i < (size_t)VOCAB_SIZE * LM_HEAD_DIM; i++) {
+            head_w[i] = (float)rand() / (float)RAND_MAX - 0.5f;
+        }
+        q_tensor head = {.data = head_w, .ne = {VOCAB_SIZE, LM_HEAD_DIM, 1, 1},
+                         .nb = {LM_HEAD_DIM * sizeof(float), sizeof(float), sizeof(float), sizeof(float)},
+                         .type = Q_F32};
+        time_head_unfused = benchmark_lm_head(head_x, &head, head_logits, false, &ctx);
+        time_head_fused = benchmark_lm_head(head_x, &head, head_logits, true, &ctx);
+    }
+    printf("  matmul + argmax:     %.4f ms/token\n", time_head_unfused);
+    printf("  fused head + argmax: %.4f ms/token\n", time_head_fused);
+    printf("\n");
+    free(head_x);
+    free(head_w);
+    free(head_logits);
+
+    // Test Case 7: Min-p / typical (q_sample_token_ext) em 32k e 128k
+    printf("Test Case 7: Min-p / Typical Sampling (vocab=%u, %u)\n", VOCAB_SIZE, LARGE_VOCAB_SIZE);
+    printf("------------------------------------------------------\n");
+    static const struct {
+        const char* name;
+        uint32_t top_k;
+        float top_p;
+        float min_p;
+        float typical_p;
+    } filter_cases[] = {
+        {"top-p 0.9 (baseline)", 0, 0.9f, 0.0f, 0.0f},
+        {"min-p 0.05", 0, 0.0f, 0.05f, 0.0f},
+        {"top-k 40 + min-p 0.05", 40, 0.0f, 0.05f, 0.0f},
+        {"top-k 40 + typical 0.9", 40, 0.0f, 0.0f, 0.9f},
+        {"min-p 0.05 + typical 0.9", 0, 0.0f, 0.05f, 0.9f},
+        {"typical 0.9 (full vocab)", 0, 0.0f, 0.0f, 0.9f},
+    };
+    const uint32_t filter_vocabs[] = {VOCAB_SIZE, LARGE_VOCAB_SIZE};
+    double time_min_p[2] = {-1.0, -1.0};
+    double time_typical[2] = {-1.0, -1.0};
+    float* large_logits = (float*)aligned_alloc(Q_ALIGN, Q_ALIGN_SIZE(LARGE_VOCAB_SIZE * sizeof(float)));
+    if (large_logits != NULL) {
+        // Logits tipo LM: cauda longa + poucos tokens dominantes
+        for (uint32_t i = 0; i < LARGE_VOCAB_SIZE; i++) {
+            large_logits[i] = (float)rand() / (float)RAND_MAX * 10.0f - 5.0f;
+            if (i % 997 == 0) {
+                large_logits[i] += 6.0f;
+            }
+        }
+        for (uint32_t v = 0; v < 2; v++) {
+            printf("  vocab=%u\n", filter_vocabs[v]);
+            for (size_t c = 0; c < sizeof(filter_cases) / sizeof(filter_cases[0]); c++) {
+                double t = benchmark_sampling_ext(large_logits, filter_vocabs[v], filter_cases[c].top_k,
+                                                  filter_cases[c].top_p, filter_cases[c].min_p,
+                                                  filter_cases[c].typical_p, &ctx);
+                printf("    %-26s %.4f ms/call\n", filter_cases[c].name, t);
+                if (c == 1) {
+                    time_min_p[v] = t;
+                } else if (c == 4) {
+                    time_typical[v] = t;
+                }
+            }
+        }
+    }
+    printf("\n");
+    free(large_logits);
+
     // Summary
     printf("========================================\n");
     printf("  SUMMARY\n");
@@ -170,6 +444,10 @@ int main(void) {
     printf("Top-k:       %.4f ms/call (%.2f calls/sec)\n", time_top_k, 1000.0 / time_top_k);
     printf("Top-p:       %.4f ms/call (%.2f calls/sec)\n", time_top_p, 1000.0 / time_top_p);
     printf("Combined:    %.4f ms/call (%.2f calls/sec)\n", time_combined, 1000.0 / time_combined);
+    printf("JSON mask:   %.3f us/token (inside string, cached)\n", time_mask[1]);
+    printf("LM head:     %.4f ms unfused, %.4f ms fused (greedy)\n", time_head_unfused, time_head_fused);
+    printf("Min-p:       %.4f ms (32k), %.4f ms (128k)\n", time_min_p[0], time_min_p[1]);
+    printf("Min-p+typ:   %.4f ms (32k), %.4f ms (128k)\n", time_typical[0], time_typical[1]);
     printf("\n");
     
     // Cleanup
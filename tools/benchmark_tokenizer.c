@@ -0,0 +1,862 @@
+// ============================================================================
+// BENCHMARK: Tokenizer Throughput (BPE encode MB/s)
+// ============================================================================
+// Gera corpora sintéticos determinísticos (prosa ASCII, código, CJK, emoji),
+// treina merges BPE (por pré-token, como o encode) sobre uma amostra de cada,
+// grava um tokenizer.bin temporário (formato QTKR v1, carregado via
+// q_tokenizer_load para usar a hash table de merges) e mede q_tokenizer_encode /
+// q_tokenizer_decode em vários tamanhos de entrada.
+// Métricas: MB/s, latência p50/p99 por requisição, alocações por chamada,
+// tokens/byte, hit rate do encode cache, tempo de load v1 vs v2,
+// encode em batch (q_tokenizer_encode_batch) vs. loop por documento, encode por
+// palavra sem cache (vocab trie vs. merges)
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// ============================================================================
+// BENCHMARK CONFIGURATION
+// ============================================================================
+
+#define BENCH_NUM_MERGES     4000                // Merges treinados
+#define BENCH_TRAIN_BYTES    (64 * 1024)         // Corpus de treino (fatia igual de cada corpus)
+#define BENCH_MAX_BYTES      (512 * 1024)        // Maior entrada medida (< MAX_TEXT_BYTES)
+#define BENCH_BASE_VOCAB     259                 // 256 bytes + BOS/EOS/PAD
+#define BENCH_PAIR_TABLE     (1U << 16)          // Hash de contagem de pares (treino)
+#define BENCH_TOKENIZER_PATH "/tmp/qorus_bench_tokenizer.bin"
+#define BENCH_LOAD_VOCAB     128000              // Vocab estilo Llama-3 (teste de load)
+#define BENCH_LOAD_V1_PATH   "/tmp/qorus_bench_load_v1.bin"
+#define BENCH_LOAD_V2_PATH   "/tmp/qorus_bench_load_v2.bin"
+#define BENCH_BATCH_MIN_DOC  32                  // Documentos do batch: 32-511 bytes
+#define BENCH_BATCH_MAX_DOC  512
+#define BENCH_MIN_ITERS      20                  // Amostras de latência por tamanho
+#define BENCH_MAX_ITERS      2000
+
+// ============================================================================
+// TIMING UTILITIES
+// ============================================================================
+
+static double get_time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// ============================================================================
+// ALLOCATION COUNTING
+// ============================================================================
+// Link com -Wl,--wrap=malloc,... (ver Makefile): toda alocação do benchmark e da
+// biblioteca (objetos estáticos) passa pelos wrappers abaixo. Alocações internas
+// da libc (ex.: pthread_create) não são contadas.
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void* __real_aligned_alloc(size_t alignment, size_t size);
+void* __wrap_malloc(size_t size);
+void* __wrap_calloc(size_t n, size_t size);
+void* __wrap_realloc(void* ptr, size_t size);
+void* __wrap_aligned_alloc(size_t alignment, size_t size);
+
+static atomic_ullong g_alloc_calls;
+static atomic_ullong g_alloc_bytes;
+
+static void count_alloc(size_t size) {
+    atomic_fetch_add_explicit(&g_alloc_calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_alloc_bytes, size, memory_order_relaxed);
+}
+
+void* __wrap_malloc(size_t size) {
+    count_alloc(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    count_alloc(n * size);
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    count_alloc(size);
+    return __real_realloc(ptr, size);
+}
+
+void* __wrap_aligned_alloc(size_t alignment, size_t size) {
+    count_alloc(size);
+    return __real_aligned_alloc(alignment, size);
+}
+
+static void alloc_reset(void) {
+    atomic_store(&g_alloc_calls, 0);
+    atomic_store(&g_alloc_bytes, 0);
+}
+
+// ============================================================================
+// SYNTHETIC CORPORA
+// ============================================================================
+
+static uint32_t lcg_next(uint32_t* state) {
+    *state = *state * 1664525U + 1013904223U;
+    return *state >> 8;
+}
+
+// Prosa ASCII: palavras frequentes (distribuição enviesada) + pontuação
+static void generate_prose(char* out, size_t len, uint32_t seed) {
+    static const char* const words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it",
+        "as", "was", "with", "be", "by", "on", "not", "he", "this", "are",
+        "model", "token", "inference", "memory", "cache", "layer", "vector", "matrix",
+        "performance", "throughput", "latency", "kernel", "attention", "sequence",
+        "tokenizer", "language", "transformer", "quantization", "bandwidth", "compute",
+        "Hello", "World", "Qorus", "Llama", "system", "request", "response", "server",
+    };
+    const uint32_t n_words = (uint32_t)(sizeof(words) / sizeof(words[0]));
+    uint32_t state = seed;
+    size_t pos = 0;
+    while (pos < len) {
+        // Zipf aproximado: min de dois uniformes favorece palavras iniciais
+        uint32_t a = lcg_next(&state) % n_words;
+        uint32_t b = lcg_next(&state) % n_words;
+        const char* w = words[(a < b) ? a : b];
+        size_t wl = strlen(w);
+        for (size_t i = 0; i < wl && pos < len; i++) {
+            out[pos++] = w[i];
+        }
+        if (pos >= len) break;
+        uint32_t r = lcg_next(&state) % 16;
+        out[pos++] = (r == 0) ? '.' : (r == 1) ? ',' : (r == 2) ? '\n' : ' ';
+    }
+    out[len] = '\0';
+}
+
+// Append UTF-8 de cp em out[*pos]; false se não cabe (não trunca sequências)
+static bool put_utf8(char* out, size_t len, size_t* pos, uint32_t cp) {
+    uint8_t buf[4];
+    size_t n;
+    if (cp < 0x80) {
+        buf[0] = (uint8_t)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        buf[0] = (uint8_t)(0xC0 | (cp >> 6));
+        buf[1] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        buf[0] = (uint8_t)(0xE0 | (cp >> 12));
+        buf[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        buf[0] = (uint8_t)(0xF0 | (cp >> 18));
+        buf[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+        buf[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        buf[3] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    if (*pos + n > len) {
+        return false;
+    }
+    memcpy(out + *pos, buf, n);
+    *pos += n;
+    return true;
+}
+
+// Completa com espaços (sequência UTF-8 que não coube) e termina em '\0'
+static void pad_corpus(char* out, size_t pos, size_t len) {
+    memset(out + pos, ' ', len - pos);
+    out[len] = '\0';
+}
+
+// Código C: indentação, identificadores snake_case, operadores, números, comentários
+static void generate_code(char* out, size_t len, uint32_t seed) {
+    static const char* const names[] = {
+        "data", "len", "count", "offset", "buffer", "tokens", "scratch", "result",
+        "weight", "hidden_dim", "num_heads", "seq_len", "cache", "ctx", "layer", "state",
+    };
+    // Cada linha consome um prefixo de (nome, nome, número)
+    static const char* const lines[] = {
+        "    for (uint32_t i = 0; i < %s; i++) {\n",
+        "        %s[i] += %s[i] * 0.%u5f;\n",
+        "    if (%s == NULL) {\n        return Q_ERR_INVALID_ARG;\n    }\n",
+        "static inline float compute_%s(const float* restrict %s, size_t n) {\n",
+        "    // TODO: handle %s overflow when %s > %u\n",
+        "    %s->%s = (uint32_t)(n >> %u);\n",
+        "    }\n",
+        "    return %s;\n}\n\n",
+        "    const size_t %s = %s + %u * sizeof(float);\n",
+        "#define Q_MAX_%s_%s %u\n",
+    };
+    const uint32_t n_names = (uint32_t)(sizeof(names) / sizeof(names[0]));
+    const uint32_t n_lines = (uint32_t)(sizeof(lines) / sizeof(lines[0]));
+    uint32_t state = seed;
+    size_t pos = 0;
+    char line[256];
+    while (pos < len) {
+        const char* fmt = lines[lcg_next(&state) % n_lines];
+        const char* a = names[lcg_next(&state) % n_names];
+        const char* b = names[lcg_next(&state) % n_names];
+        const unsigned v = lcg_next(&state) % 4096;
+        const int n = snprintf(line, sizeof(line), fmt, a, b, v);
+        for (int i = 0; i < n && pos < len; i++) {
+            out[pos++] = line[i];
+        }
+    }
+    out[len] = '\0';
+}
+
+// CJK: ideogramas (Zipf sobre 2048), hiragana, pontuação de largura total e
+// números/termos ASCII ocasionais; 3 bytes por caractere
+static void generate_cjk(char* out, size_t len, uint32_t seed) {
+    uint32_t state = seed;
+    size_t pos = 0;
+    for (;;) {
+        const uint32_t r = lcg_next(&state) % 32;
+        uint32_t cp;
+        if (r < 20) {
+            uint32_t a = lcg_next(&state) % 2048;
+            uint32_t b = lcg_next(&state) % 2048;
+            cp = 0x4E00 + ((a < b) ? a : b) * 7 % 20000;
+        } else if (r < 27) {
+            cp = 0x3041 + lcg_next(&state) % 83;            // Hiragana
+        } else if (r == 27) {
+            cp = 0x3001 + lcg_next(&state) % 2;             // 、。
+        } else if (r == 28) {
+            cp = 0xFF0C;                                    // ，
+        } else if (r == 29) {
+            cp = '0' + lcg_next(&state) % 10;
+        } else if (r == 30) {
+            cp = 'A' + lcg_next(&state) % 26;
+        } else {
+            cp = (lcg_next(&state) % 4 == 0) ? '\n' : ' ';
+        }
+        if (!put_utf8(out, len, &pos, cp)) {
+            break;
+        }
+    }
+    pad_corpus(out, pos, len);
+}
+
+// Chat com muitos emojis: palavras ASCII + emoji simples, modificador de tom de
+// pele, sequências ZWJ, bandeiras (regional indicators) e ❤️ (VS16)
+static void generate_emoji(char* out, size_t len, uint32_t seed) {
+    static const char* const words[] = {
+        "lol", "omg", "this", "is", "so", "good", "love", "it", "thanks", "see",
+        "you", "soon", "great", "job", "team", "party", "tonight", "yes", "no", "wow",
+    };
+    const uint32_t n_words = (uint32_t)(sizeof(words) / sizeof(words[0]));
+    uint32_t state = seed;
+    size_t pos = 0;
+    bool fits = true;
+    while (fits) {
+        const char* w = words[lcg_next(&state) % n_words];
+        const size_t wl = strlen(w);
+        if (pos + wl + 1 > len) {
+            break;
+        }
+        memcpy(out + pos, w, wl);
+        pos += wl;
+        out[pos++] = ' ';
+
+        const uint32_t r = lcg_next(&state) % 8;
+        if (r < 3) {
+            fits = put_utf8(out, len, &pos, 0x1F600 + lcg_next(&state) % 80);
+        } else if (r == 3) {
+            fits = put_utf8(out, len, &pos, 0x1F44D + lcg_next(&state) % 4) &&
+                   put_utf8(out, len, &pos, 0x1F3FB + lcg_next(&state) % 5);
+        } else if (r == 4) {
+            fits = put_utf8(out, len, &pos, 0x1F468) && put_utf8(out, len, &pos, 0x200D) &&
+                   put_utf8(out, len, &pos, 0x1F469) && put_utf8(out, len, &pos, 0x200D) &&
+                   put_utf8(out, len, &pos, 0x1F467);
+        } else if (r == 5) {
+            fits = put_utf8(out, len, &pos, 0x1F1E6 + lcg_next(&state) % 26) &&
+                   put_utf8(out, len, &pos, 0x1F1E6 + lcg_next(&state) % 26);
+        } else if (r == 6) {
+            fits = put_utf8(out, len, &pos, 0x2764) && put_utf8(out, len, &pos, 0xFE0F);
+        }
+        if (fits && r < 7 && pos < len) {
+            out[pos++] = (lcg_next(&state) % 6 == 0) ? '\n' : ' ';
+        }
+    }
+    pad_corpus(out, pos, len);
+}
+
+typedef struct {
+    const char* name;
+    void (*generate)(char* out, size_t len, uint32_t seed);
+} bench_corpus;
+
+static const bench_corpus g_corpora[] = {
+    { "prose", generate_prose },
+    { "code",  generate_code },
+    { "cjk",   generate_cjk },
+    { "emoji", generate_emoji },
+};
+#define BENCH_NUM_CORPORA (sizeof(g_corpora) / sizeof(g_corpora[0]))
+
+// ============================================================================
+// BPE TRAINING (greedy: par mais frequente a cada passo)
+// ============================================================================
+
+typedef struct {
+    uint64_t key;
+    uint32_t count;
+} pair_count;
+
+// Treina merges e grava tokenizer no formato QTKR v1
+static int write_trained_tokenizer(const char* path, const char* corpus, size_t len) {
+    uint32_t* ids = (uint32_t*)malloc(len * sizeof(uint32_t));
+    pair_count* table = (pair_count*)malloc(BENCH_PAIR_TABLE * sizeof(pair_count));
+    q_bpe_merge* merges = (q_bpe_merge*)calloc(BENCH_NUM_MERGES, sizeof(q_bpe_merge));
+    const uint32_t vocab_size = BENCH_BASE_VOCAB + BENCH_NUM_MERGES;
+    char** vocab = (char**)calloc(vocab_size, sizeof(char*));
+    uint8_t* vocab_len = (uint8_t*)calloc(vocab_size, 1);
+    if (ids == NULL || table == NULL || merges == NULL || vocab == NULL || vocab_len == NULL) {
+        free(ids);
+        free(table);
+        free(merges);
+        free((void*)vocab);
+        free(vocab_len);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < BENCH_BASE_VOCAB; i++) {
+        vocab[i] = (char*)malloc(8);
+        vocab_len[i] = 1;
+        vocab[i][0] = (char)(i < 256 ? i : '?');
+    }
+    // piece_start[i] = 1 se ids[i] inicia um pré-token (merges não cruzam fronteiras)
+    uint8_t* piece_start = (uint8_t*)calloc(len, 1);
+    if (piece_start == NULL) {
+        free(ids);
+        free(table);
+        free(merges);
+        free((void*)vocab);
+        free(vocab_len);
+        return -1;
+    }
+    size_t n = len;
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = (uint8_t)corpus[i];
+    }
+    for (size_t pos = 0; pos < len; pos = q_pretokenize_next(corpus, len, pos)) {
+        piece_start[pos] = 1;
+    }
+
+    uint32_t num_merges = 0;
+    for (; num_merges < BENCH_NUM_MERGES; num_merges++) {
+        memset(table, 0, BENCH_PAIR_TABLE * sizeof(pair_count));
+        uint64_t best_key = 0;
+        uint32_t best_count = 0;
+        for (size_t i = 0; i + 1 < n; i++) {
+            if (piece_start[i + 1]) {
+                continue;
+            }
+            uint64_t key = ((uint64_t)ids[i] << 32) | ids[i + 1];
+            uint32_t h = (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 48) & (BENCH_PAIR_TABLE - 1);
+            while (table[h].count != 0 && table[h].key != key) {
+                h = (h + 1) & (BENCH_PAIR_TABLE - 1);
+            }
+            table[h].key = key;
+            table[h].count++;
+            // Par mais frequente; só tokens cujo merge cabe no formato (len ≤ 255)
+            if (table[h].count > best_count &&
+                vocab_len[ids[i]] + vocab_len[ids[i + 1]] <= 255) {
+                best_count = table[h].count;
+                best_key = key;
+            }
+        }
+        if (best_count < 2) {
+            break;
+        }
+
+        const uint32_t id1 = (uint32_t)(best_key >> 32);
+        const uint32_t id2 = (uint32_t)(best_key & 0xFFFFFFFFU);
+        const uint32_t merged = BENCH_BASE_VOCAB + num_merges;
+        merges[num_merges] = (q_bpe_merge){ .token_id1 = id1, .token_id2 = id2, .merged_id = merged };
+        vocab_len[merged] = (uint8_t)(vocab_len[id1] + vocab_len[id2]);
+        vocab[merged] = (char*)malloc(vocab_len[merged]);
+        memcpy(vocab[merged], vocab[id1], vocab_len[id1]);
+        memcpy(vocab[merged] + vocab_len[id1], vocab[id2], vocab_len[id2]);
+
+        // Aplica o merge no corpus de treino
+        size_t w = 0;
+        for (size_t i = 0; i < n; i++) {
+            piece_start[w] = piece_start[i];
+            if (i + 1 < n && !piece_start[i + 1] && ids[i] == id1 && ids[i + 1] == id2) {
+                ids[w++] = merged;
+                i++;
+            } else {
+                ids[w++] = ids[i];
+            }
+        }
+        n = w;
+    }
+
+    // Vocab não usado (treino parou cedo): token de 1 byte
+    for (uint32_t i = BENCH_BASE_VOCAB + num_merges; i < vocab_size; i++) {
+        vocab[i] = (char*)malloc(8);
+        vocab_len[i] = 1;
+        vocab[i][0] = '?';
+    }
+
+    int ret = -1;
+    FILE* f = fopen(path, "wb");
+    if (f != NULL) {
+        const uint32_t header[8] = { 0x51544B52U, 1, vocab_size, num_merges, 256, 257, 258, 0 };
+        fwrite(header, sizeof(uint32_t), 8, f);
+        for (uint32_t i = 0; i < vocab_size; i++) {
+            fputc(vocab_len[i], f);
+            fwrite(vocab[i], 1, vocab_len[i], f);
+        }
+        for (uint32_t i = 0; i < num_merges; i++) {
+            const uint32_t m[3] = { merges[i].token_id1, merges[i].token_id2, merges[i].merged_id };
+            fwrite(m, sizeof(uint32_t), 3, f);
+        }
+        ret = (fclose(f) == 0) ? (int)num_merges : -1;
+    }
+
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        free(vocab[i]);
+    }
+    free(ids);
+    free(piece_start);
+    free(table);
+    free(merges);
+    free((void*)vocab);
+    free(vocab_len);
+    return ret;
+}
+
+// ============================================================================
+// BENCHMARK: Encode/Decode por forma de corpus
+// ============================================================================
+
+static int compare_double(const void* a, const void* b) {
+    const double x = *(const double*)a;
+    const double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Ordena samples in-place; pct em [0, 100]
+static double percentile(double* samples, uint32_t n, double pct) {
+    qsort(samples, n, sizeof(double), compare_double);
+    return samples[(uint32_t)(pct / 100.0 * (double)(n - 1) + 0.5)];
+}
+
+typedef struct {
+    double mb_per_s;
+    double p50_ms;
+    double p99_ms;
+    double allocs_per_call;
+} bench_timing;
+
+static void summarize(double* samples, uint32_t n, size_t bytes, uint64_t allocs,
+                      bench_timing* out) {
+    double total_ms = 0.0;
+    for (uint32_t i = 0; i < n; i++) {
+        total_ms += samples[i];
+    }
+    out->mb_per_s = ((double)bytes * n / (1024.0 * 1024.0)) / (total_ms / 1000.0);
+    out->p50_ms = percentile(samples, n, 50.0);
+    out->p99_ms = percentile(samples, n, 99.0);
+    out->allocs_per_call = (double)allocs / n;
+}
+
+// Mede q_tokenizer_encode e q_tokenizer_decode (texto de len bytes) por requisição:
+// throughput agregado, latência p50/p99 e alocações por chamada; confere round-trip
+static void benchmark_encode_decode(q_tokenizer* tok, const char* name, char* text, size_t len,
+                                    uint32_t* tokens, char* decoded) {
+    static double samples[BENCH_MAX_ITERS];
+    // Trunca o corpus para o tamanho medido (restaura ao final)
+    const char saved = text[len];
+    text[len] = '\0';
+
+    uint32_t iterations = (uint32_t)((8 * 1024 * 1024) / len);
+    if (iterations < BENCH_MIN_ITERS) iterations = BENCH_MIN_ITERS;
+    if (iterations > BENCH_MAX_ITERS) iterations = BENCH_MAX_ITERS;
+
+    uint32_t num_tokens = 0;
+    q_tokenizer_encode(tok, text, tokens, &num_tokens, BENCH_MAX_BYTES + 2, false, false);  // Warmup
+    q_tokenizer_reset_stats(tok);
+
+    bench_timing enc;
+    alloc_reset();
+    for (uint32_t i = 0; i < iterations; i++) {
+        const double start = get_time_ms();
+        q_error_code ret = q_tokenizer_encode(tok, text, tokens, &num_tokens,
+                                              BENCH_MAX_BYTES + 2, false, false);
+        samples[i] = get_time_ms() - start;
+        if (ret != Q_OK) {
+            printf("  ERROR: q_tokenizer_encode failed: %s\n", q_strerror(ret));
+            text[len] = saved;
+            return;
+        }
+    }
+    summarize(samples, iterations, len, atomic_load(&g_alloc_calls), &enc);
+
+    bench_timing dec;
+    alloc_reset();
+    for (uint32_t i = 0; i < iterations; i++) {
+        const double start = get_time_ms();
+        q_error_code ret = q_tokenizer_decode(tok, tokens, num_tokens, decoded, BENCH_MAX_BYTES + 2);
+        samples[i] = get_time_ms() - start;
+        if (ret != Q_OK) {
+            printf("  ERROR: q_tokenizer_decode failed: %s\n", q_strerror(ret));
+            text[len] = saved;
+            return;
+        }
+    }
+    summarize(samples, iterations, len, atomic_load(&g_alloc_calls), &dec);
+    const bool round_trip = memcmp(decoded, text, len + 1) == 0;
+    text[len] = saved;
+
+    q_tokenizer_stats stats;
+    q_tokenizer_get_stats(tok, &stats);
+    printf("  %-5s %6zuK | %8.2f %8.3f %8.3f %6.1f | %8.2f %8.3f %8.3f %6.1f | %5.3f %5.1f%%%s\n",
+           name, len / 1024, enc.mb_per_s, enc.p50_ms, enc.p99_ms, enc.allocs_per_call,
+           dec.mb_per_s, dec.p50_ms, dec.p99_ms, dec.allocs_per_call,
+           (double)num_tokens / (double)len, stats.cache_hit_rate * 100.0,
+           round_trip ? "" : "  ROUND-TRIP MISMATCH");
+}
+
+// ============================================================================
+// BENCHMARK: Encode cache
+// ============================================================================
+
+// Prompt com template fixo e sufixo variável: cold (1ª chamada) vs. warm (cache)
+static void benchmark_template(q_tokenizer* tok, uint32_t* tokens) {
+    static const char* const questions[] = {
+        "What is the capital of France?",
+        "Summarize the following paragraph in one sentence.",
+        "Translate the sentence below into Portuguese.",
+        "List three reasons why the sky appears blue.",
+    };
+    char prompt[2048];
+    const uint32_t iterations = 20000;
+    uint32_t num_tokens = 0;
+    double cold_ms = 0.0;
+    double start = 0.0;
+    q_tokenizer_reset_stats(tok);
+    for (uint32_t i = 0; i <= iterations; i++) {
+        int n = snprintf(prompt, sizeof(prompt),
+                         "You are a helpful assistant. Answer the user's question accurately and "
+                         "concisely, citing the context when relevant. If you do not know the "
+                         "answer, say so instead of guessing.\n\nContext: request %u of the "
+                         "evaluation pipeline.\n\nQuestion: %s\n\nAnswer:",
+                         i, questions[i % 4]);
+        if (n <= 0 || (size_t)n >= sizeof(prompt)) {
+            return;
+        }
+        if (i == 0) {
+            start = get_time_ms();
+        }
+        q_tokenizer_encode(tok, prompt, tokens, &num_tokens, BENCH_MAX_BYTES + 2, true, false);
+        if (i == 0) {
+            cold_ms = get_time_ms() - start;
+            start = get_time_ms();
+        }
+    }
+    const double warm_us = (get_time_ms() - start) * 1000.0 / iterations;
+    q_tokenizer_stats stats;
+    q_tokenizer_get_stats(tok, &stats);
+    printf("  cold: %.2f us  warm: %.2f us/prompt  (%u tokens, cache hit %.1f%%, %u/%u entries)\n",
+           cold_ms * 1000.0, warm_us, num_tokens, stats.cache_hit_rate * 100.0,
+           stats.cache_entries, stats.cache_capacity);
+}
+
+// ============================================================================
+// BENCHMARK: q_tokenizer_load (v1 parse vs. v2 mmap)
+// ============================================================================
+
+// Vocab sintético de 128K (tokens de 2-12 bytes) e ~128K merges (ids válidos)
+static bool write_large_tokenizer_v1(const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    const uint32_t num_merges = BENCH_LOAD_VOCAB - BENCH_BASE_VOCAB;
+    const uint32_t header[8] = { 0x51544B52U, 1, BENCH_LOAD_VOCAB, num_merges, 256, 257, 258, 0 };
+    fwrite(header, sizeof(uint32_t), 8, f);
+    uint32_t state = 7;
+    for (uint32_t i = 0; i < BENCH_LOAD_VOCAB; i++) {
+        char token[16];
+        uint8_t len = 1;
+        token[0] = (char)((i < 256 && i > 0) ? i : 'a');
+        if (i >= 256) {
+            len = (uint8_t)(2 + lcg_next(&state) % 11);
+            for (uint8_t k = 0; k < len; k++) {
+                token[k] = (char)('a' + lcg_next(&state) % 26);
+            }
+        }
+        fputc(len, f);
+        fwrite(token, 1, len, f);
+    }
+    for (uint32_t i = 0; i < num_merges; i++) {
+        const uint32_t merged = BENCH_BASE_VOCAB + i;
+        const uint32_t m[3] = { lcg_next(&state) % merged, lcg_next(&state) % merged, merged };
+        fwrite(m, sizeof(uint32_t), 3, f);
+    }
+    return fclose(f) == 0;
+}
+
+static double time_load(const char* path, uint32_t iterations) {
+    double best = 1e30;
+    for (uint32_t i = 0; i < iterations; i++) {
+        q_tokenizer tok;
+        double start = get_time_ms();
+        q_error_code ret = q_tokenizer_load(&tok, path);
+        double elapsed = get_time_ms() - start;
+        if (ret != Q_OK) {
+            printf("  ERROR: q_tokenizer_load(%s) failed: %s\n", path, q_strerror(ret));
+            return -1.0;
+        }
+        q_tokenizer_free(&tok);
+        if (elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+static void benchmark_load(void) {
+    q_tokenizer tok;
+    if (!write_large_tokenizer_v1(BENCH_LOAD_V1_PATH) ||
+        q_tokenizer_load(&tok, BENCH_LOAD_V1_PATH) != Q_OK) {
+        printf("  ERROR: failed to build %u-token tokenizer\n", BENCH_LOAD_VOCAB);
+        unlink(BENCH_LOAD_V1_PATH);
+        return;
+    }
+    q_error_code ret = q_tokenizer_save(&tok, BENCH_LOAD_V2_PATH);
+    q_tokenizer_free(&tok);
+    if (ret == Q_OK) {
+        const double v1_ms = time_load(BENCH_LOAD_V1_PATH, 5);
+        const double v2_ms = time_load(BENCH_LOAD_V2_PATH, 5);
+        printf("  %u tokens, %u merges: v1 (parse) %.2f ms  v2 (mmap) %.2f ms  (%.1fx)\n",
+               BENCH_LOAD_VOCAB, BENCH_LOAD_VOCAB - BENCH_BASE_VOCAB, v1_ms, v2_ms,
+               (v2_ms > 0.0) ? v1_ms / v2_ms : 0.0);
+    } else {
+        printf("  ERROR: q_tokenizer_save failed: %s\n", q_strerror(ret));
+    }
+    unlink(BENCH_LOAD_V1_PATH);
+    unlink(BENCH_LOAD_V2_PATH);
+}
+
+// ============================================================================
+// BENCHMARK: q_tokenizer_encode_batch vs. loop de q_tokenizer_encode
+// ============================================================================
+
+// Corpus fatiado em prompts curtos (32-511 bytes): loop por documento (malloc por
+// chamada) vs. batch com 1 thread e com threads automáticas
+static void benchmark_batch(q_tokenizer* tok, const char* corpus, size_t corpus_len) {
+    const uint32_t max_docs = (uint32_t)(corpus_len / BENCH_BATCH_MIN_DOC);
+    q_text_span* docs = (q_text_span*)malloc(max_docs * sizeof(q_text_span));
+    size_t* offsets = (size_t*)malloc((max_docs + 1) * sizeof(size_t));
+    char* cstr = (char*)malloc(corpus_len + max_docs);  // Cópias com '\0' (loop)
+    uint32_t* tokens = (uint32_t*)malloc((corpus_len + 2 * (size_t)max_docs) * sizeof(uint32_t));
+    if (docs == NULL || offsets == NULL || cstr == NULL || tokens == NULL) {
+        printf("  ERROR: Out of memory\n");
+        free(docs);
+        free(offsets);
+        free(cstr);
+        free(tokens);
+        return;
+    }
+    
+    uint32_t num_docs = 0;
+    size_t pos = 0;
+    size_t cpos = 0;
+    uint32_t state = 7;
+    while (num_docs < max_docs) {
+        size_t len = BENCH_BATCH_MIN_DOC + lcg_next(&state) % (BENCH_BATCH_MAX_DOC - BENCH_BATCH_MIN_DOC);
+        if (pos + len > corpus_len) break;
+        docs[num_docs++] = (q_text_span){ corpus + pos, len };
+        memcpy(cstr + cpos, corpus + pos, len);
+        cstr[cpos + len] = '\0';
+        pos += len;
+        cpos += len + 1;
+    }
+    const size_t capacity = pos + 2 * (size_t)num_docs;
+    const double mb = (double)pos / (1024.0 * 1024.0);
+    const uint32_t iterations = 5;
+    
+    // Loop por documento
+    uint32_t num_tokens = 0;
+    size_t loop_tokens = 0;
+    double start = get_time_ms();
+    for (uint32_t it = 0; it < iterations; it++) {
+        loop_tokens = 0;
+        cpos = 0;
+        for (uint32_t d = 0; d < num_docs; d++) {
+            q_tokenizer_encode(tok, cstr + cpos, tokens, &num_tokens, BENCH_BATCH_MAX_DOC + 2, true, false);
+            loop_tokens += num_tokens;
+            cpos += docs[d].len + 1;
+        }
+    }
+    const double loop_ms = (get_time_ms() - start) / iterations;
+    printf("  %u docs (%.2f MB), per-doc loop:  %8.3f ms  %8.2f MB/s  (%zu tokens)\n",
+           num_docs, mb, loop_ms, mb / (loop_ms / 1000.0), loop_tokens);
+    
+    const uint32_t thread_modes[] = { 1, 0 };
+    for (size_t m = 0; m < sizeof(thread_modes) / sizeof(thread_modes[0]); m++) {
+        start = get_time_ms();
+        for (uint32_t it = 0; it < iterations; it++) {
+            q_error_code ret = q_tokenizer_encode_batch(tok, docs, num_docs, tokens, capacity,
+                                                        offsets, true, false, thread_modes[m]);
+            if (ret != Q_OK) {
+                printf("  ERROR: q_tokenizer_encode_batch failed: %s\n", q_strerror(ret));
+                break;
+            }
+        }
+        const double batch_ms = (get_time_ms() - start) / iterations;
+        printf("  %u docs (%.2f MB), batch %-7s  %8.3f ms  %8.2f MB/s  (%zu tokens%s)\n",
+               num_docs, mb, (thread_modes[m] == 1) ? "1T:" : "auto:", batch_ms,
+               mb / (batch_ms / 1000.0), offsets[num_docs],
+               (offsets[num_docs] == loop_tokens) ? "" : ", MISMATCH");
+    }
+    
+    free(docs);
+    free(offsets);
+    free(cstr);
+    free(tokens);
+}
+
+// ============================================================================
+// BENCHMARK: Vocab trie vs. merges (encode cache desligado)
+// ============================================================================
+
+// Toda palavra passa pelo encoder (cache desligado): longest-prefix no trie vs.
+// merges a partir dos bytes. Saída deve ser idêntica
+static void benchmark_trie(q_tokenizer* tok, char* text, size_t len, uint32_t* tokens) {
+    struct bpe_word_cache* cache = tok->word_cache;
+    uint32_t warm_count = 0;
+    q_tokenizer_encode(tok, "a", tokens, &warm_count, 1, false, false);  // Trie é lazy
+    struct bpe_vocab_trie* trie = tok->vocab_trie;
+    if (trie == NULL) {
+        printf("  vocab trie not built (non-canonical merges)\n");
+        return;
+    }
+    uint32_t* reference = (uint32_t*)malloc((len + 2) * sizeof(uint32_t));
+    if (reference == NULL) {
+        printf("  ERROR: Out of memory\n");
+        return;
+    }
+    const char saved = text[len];
+    text[len] = '\0';
+    tok->word_cache = NULL;
+    
+    const uint32_t iterations = 10;
+    double ms[2] = { 0.0, 0.0 };
+    uint32_t counts[2] = { 0, 0 };
+    for (int mode = 0; mode < 2; mode++) {
+        tok->vocab_trie = (mode == 0) ? NULL : trie;
+        uint32_t* out = (mode == 0) ? reference : tokens;
+        const double start = get_time_ms();
+        for (uint32_t i = 0; i < iterations; i++) {
+            q_tokenizer_encode(tok, text, out, &counts[mode], (uint32_t)len + 2, false, false);
+        }
+        ms[mode] = (get_time_ms() - start) / iterations;
+    }
+    
+    tok->vocab_trie = trie;
+    tok->word_cache = cache;
+    text[len] = saved;
+    const double mb = (double)len / (1024.0 * 1024.0);
+    const bool identical = counts[0] == counts[1] &&
+                           memcmp(reference, tokens, counts[0] * sizeof(uint32_t)) == 0;
+    printf("  %zu bytes, merges:     %8.3f ms  %8.2f MB/s\n", len, ms[0], mb / (ms[0] / 1000.0));
+    printf("  %zu bytes, vocab trie: %8.3f ms  %8.2f MB/s  (%.2fx, %s)\n", len, ms[1],
+           mb / (ms[1] / 1000.0), ms[0] / ms[1], identical ? "identical output" : "MISMATCH");
+    free(reference);
+}
+
+int main(void) {
+    printf("========================================\n");
+    printf("  TOKENIZER THROUGHPUT BENCHMARK\n");
+    printf("========================================\n\n");
+
+    char* corpora[BENCH_NUM_CORPORA] = { NULL };
+    char* train = (char*)malloc(BENCH_TRAIN_BYTES + 1);
+    char* decoded = (char*)malloc(BENCH_MAX_BYTES + 2);  // decode exige 1 byte de folga além do '\0'
+    uint32_t* tokens = (uint32_t*)malloc((BENCH_MAX_BYTES + 2) * sizeof(uint32_t));
+    bool ok = train != NULL && decoded != NULL && tokens != NULL;
+    for (size_t c = 0; c < BENCH_NUM_CORPORA; c++) {
+        corpora[c] = (char*)malloc(BENCH_MAX_BYTES + 1);
+        ok = ok && corpora[c] != NULL;
+    }
+    int num_merges = -1;
+    if (ok) {
+        // Amostra de treino: fatia igual de cada corpus (merges cobrem todas as formas)
+        const size_t slice = BENCH_TRAIN_BYTES / BENCH_NUM_CORPORA;
+        for (size_t c = 0; c < BENCH_NUM_CORPORA; c++) {
+            g_corpora[c].generate(corpora[c], BENCH_MAX_BYTES, 42 + (uint32_t)c);
+            memcpy(train + c * slice, corpora[c], slice);
+        }
+        train[BENCH_TRAIN_BYTES] = '\0';
+        const double t0 = get_time_ms();
+        num_merges = write_trained_tokenizer(BENCH_TOKENIZER_PATH, train, BENCH_TRAIN_BYTES);
+        if (num_merges >= 0) {
+            printf("Synthetic tokenizer: %d merges trained on %d KB in %.1f ms\n\n",
+                   num_merges, BENCH_TRAIN_BYTES / 1024, get_time_ms() - t0);
+        }
+    }
+
+    q_tokenizer tok;
+    q_error_code ret = Q_ERR_INVALID_ARG;
+    if (num_merges >= 0) {
+        ret = q_tokenizer_load(&tok, BENCH_TOKENIZER_PATH);
+        unlink(BENCH_TOKENIZER_PATH);
+    }
+    if (ret != Q_OK) {
+        fprintf(stderr, "ERROR: Failed to build synthetic tokenizer: %s\n",
+                ok ? q_strerror(ret) : "out of memory");
+        for (size_t c = 0; c < BENCH_NUM_CORPORA; c++) {
+            free(corpora[c]);
+        }
+        free(train);
+        free(decoded);
+        free(tokens);
+        return 1;
+    }
+    char* prose = corpora[0];
+
+    printf("Test Case 1: Encode/decode by corpus shape (per-request latency, allocations)\n");
+    printf("  %-5s %7s | %8s %8s %8s %6s | %8s %8s %8s %6s | %5s %6s\n",
+           "", "", "enc MB/s", "p50 ms", "p99 ms", "allocs", "dec MB/s", "p50 ms", "p99 ms",
+           "allocs", "tok/B", "cache");
+    const size_t sizes[] = { 1024, 16 * 1024, 128 * 1024, BENCH_MAX_BYTES };
+    for (size_t c = 0; c < BENCH_NUM_CORPORA; c++) {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            benchmark_encode_decode(&tok, g_corpora[c].name, corpora[c], sizes[i], tokens, decoded);
+        }
+    }
+
+    printf("\nTest Case 2: Repeated-template prompts (encode cache)\n");
+    benchmark_template(&tok, tokens);
+
+    printf("\nTest Case 3: Load 128K vocab (v1 parse vs. v2 mmap)\n");
+    benchmark_load();
+
+    printf("\nTest Case 4: Batch encode (many short prompts)\n");
+    benchmark_batch(&tok, prose, BENCH_MAX_BYTES);
+
+    printf("\nTest Case 5: Word encode without cache (vocab trie vs. merges)\n");
+    benchmark_trie(&tok, prose, 128 * 1024, tokens);
+
+    printf("\n========================================\n");
+    printf("  BENCHMARK COMPLETE\n");
+    printf("========================================\n");
+
+    q_tokenizer_free(&tok);
+    for (size_t c = 0; c < BENCH_NUM_CORPORA; c++) {
+        free(corpora[c]);
+    }
+    free(train);
+    free(decoded);
+    free(tokens);
+    return 0;
+}
@@ -238,8 +238,86 @@ def generate_dummy_model(output_path, n_layers=2):
     print(f"  Tensors: {file_size - Q_HEADER_SIZE:,} bytes")
     print(f"  Layers: {config['n_layers']}")
 
+TOKENIZER_MAGIC = 0x51544B52  # 'QTKR'
+TOKENIZER_VERSION_V2 = 2
+TOKENIZER_V2_HEADER_SIZE = 64
+TOKENIZER_SLOT_EMPTY = 0xFFFFFFFFFFFFFFFF
+TOKENIZER_GROUP_SLOTS = 4
+MASK64 = 0xFFFFFFFFFFFFFFFF
+
+def hash_pair(id1, id2):
+    """Mesmo hash de src/tokenizer/bpe.c (hash_pair): Knuth + fold dos bits altos."""
+    h = ((((id1 << 32) | id2) * 0x9E3779B97F4A7C15) & MASK64)
+    return h ^ (h >> 29)
+
+def next_power_of_2(n):
+    p = 1
+    while p < n:
+        p <<= 1
+    return p
+
+def build_merge_table(merges):
+    """Tabela open-addressing em grupos de 4 slots (64 bytes, layout de bpe.c).
+
+    Grupo: u64 keys[4] | u32 merged_id[4] | u32 rank[4]; slot vazio = key UINT64_MAX.
+    Probing linear por grupo; load factor <= 0.5; par duplicado mantém o menor rank.
+    """
+    if not merges:
+        return 0, b""
+    num_groups = max(1, next_power_of_2(len(merges) * 2) // TOKENIZER_GROUP_SLOTS)
+    mask = num_groups - 1
+    groups = [[] for _ in range(num_groups)]
+    for rank, (id1, id2, merged) in enumerate(merges):
+        key = (id1 << 32) | id2
+        g = hash_pair(id1, id2) & mask
+        while len(groups[g]) == TOKENIZER_GROUP_SLOTS and all(e[0] != key for e in groups[g]):
+            g = (g + 1) & mask
+        if all(e[0] != key for e in groups[g]):
+            groups[g].append((key, merged, rank))
+    out = bytearray()
+    for entries in groups:
+        entries = entries + [(TOKENIZER_SLOT_EMPTY, 0xFFFFFFFF, 0xFFFFFFFF)] * (TOKENIZER_GROUP_SLOTS - len(entries))
+        out += struct.pack('<4Q', *(e[0] for e in entries))
+        out += struct.pack('<4I', *(e[1] for e in entries))
+        out += struct.pack('<4I', *(e[2] for e in entries))
+    return num_groups * TOKENIZER_GROUP_SLOTS, bytes(out)
+
+def write_tokenizer_v2(tokenizer_path, vocab, merges, bos_id, eos_id, pad_id):
+    """Write QTKR v2 (zero-parse, mmap) - layout em src/tokenizer/bpe.c.
+
+    header[64] | index (u32 offset, u32 length)[vocab] | blob (tokens + '\\0')
+    | merges (u32 id1, id2, merged)[num_merges] | merge table (64-byte groups)
+    Seções alinhadas a 64 bytes.
+    """
+    index = bytearray()
+    blob = bytearray()
+    for token_bytes in vocab:
+        assert b"\0" not in token_bytes, "Token bytes must not contain NUL"
+        index += struct.pack('<II', len(blob), len(token_bytes))
+        blob += token_bytes + b"\0"
+    merges_bytes = b"".join(struct.pack('<III', *m) for m in merges)
+    table_slots, table_bytes = build_merge_table(merges)
+
+    index_off = TOKENIZER_V2_HEADER_SIZE
+    blob_off = align_size(index_off + len(index))
+    merges_off = align_size(blob_off + len(blob))
+    table_off = align_size(merges_off + len(merges_bytes))
+
+    header = struct.pack('<16I',
+        TOKENIZER_MAGIC, TOKENIZER_VERSION_V2, len(vocab), len(merges),
+        bos_id, eos_id, pad_id, table_slots,
+        index_off, blob_off, len(blob), merges_off, table_off, 0, 0, 0)
+    assert len(header) == TOKENIZER_V2_HEADER_SIZE, f"Header size mismatch: {len(header)}"
+
+    with open(tokenizer_path, 'wb') as f:
+        for offset, data in ((0, header), (index_off, index), (blob_off, blob),
+                             (merges_off, merges_bytes), (table_off, table_bytes)):
+            f.write(b"\0" * (offset - f.tell()))
+            f.write(data)
+    return table_slots
+
 def write_tokenizer(tokenizer_path, vocab_size=32000):
-    """Export tokenizer to binary format for Qorus-IA.
+    """Export tokenizer to binary format for Qorus-IA (QTKR v2, mmap zero-parse).
     
     Creates a minimal tokenizer with:
     - Vocab: 256 base tokens (bytes 0-255) + special tokens
@@ -250,9 +328,6 @@ def write_tokenizer(tokenizer_path, vocab_size=32000):
         tokenizer_path: Output path for tokenizer binary file
         vocab_size: Vocabulary size parameter (used for special token IDs, not actual vocab size)
     """
-    TOKENIZER_MAGIC = 0x51544B52  # 'QTKR'
-    TOKENIZER_VERSION = 1
-    
     # Base vocabulary: 256 bytes (0-255)
     BASE_VOCAB_SIZE = 256
     
@@ -261,55 +336,23 @@ def write_tokenizer(tokenizer_path, vocab_size=32000):
     EOS_TOKEN_ID = BASE_VOCAB_SIZE + 1
     PAD_TOKEN_ID = BASE_VOCAB_SIZE + 2
     
-    # Calculate actual vocab size (base + special tokens)
-    actual_vocab_size = BASE_VOCAB_SIZE + 3  # 256 base + 3 special = 259
+    # Base tokens (bytes 0-255) + special tokens
+    # Byte 0: string vazia (como v1 em runtime, onde "\0" vira "" após o terminador)
+    vocab = [bytes([i]) if i != 0 else b"" for i in range(BASE_VOCAB_SIZE)]
+    vocab += [b"<|begin_of_text|>", b"<|end_of_text|>", b"<|finetune_right_pad_id|>"]
+    merges = []  # No BPE merges for now (simplified)
     
     print(f"Writing tokenizer to {tokenizer_path}...")
     print(f"  Base vocab: {BASE_VOCAB_SIZE} tokens (bytes 0-255)")
     print(f"  Special tokens: BOS={BOS_TOKEN_ID}, EOS={EOS_TOKEN_ID}, PAD={PAD_TOKEN_ID}")
-    print(f"  Total vocab size: {actual_vocab_size}")
+    print(f"  Total vocab size: {len(vocab)}")
     
-    with open(tokenizer_path, 'wb') as f:
-        # Write header (32 bytes)
-        header = struct.pack('<IIIIIIII',
-            TOKENIZER_MAGIC,      # magic
-            TOKENIZER_VERSION,    # version
-            actual_vocab_size,    # vocab_size
-            0,                    # num_merges (simplified: no BPE merges for now)
-            BOS_TOKEN_ID,        # bos_token_id
-            EOS_TOKEN_ID,        # eos_token_id
-            PAD_TOKEN_ID,        # pad_token_id
-            0                     # reserved
-        )
-        assert len(header) == 32, f"Header size mismatch: {len(header)}"
-        f.write(header)
-        
-        # Write vocab: Base tokens (bytes 0-255)
-        for i in range(256):
-            token_bytes = bytes([i])  # Single byte token
-            length = len(token_bytes)
-            assert length == 1, f"Base token length must be 1, got {length}"
-            f.write(struct.pack('B', length))
-            f.write(token_bytes)
-        
-        # Write special tokens
-        special_tokens = [
-            (BOS_TOKEN_ID, b"<|begin_of_text|>"),
-            (EOS_TOKEN_ID, b"<|end_of_text|>"),
-            (PAD_TOKEN_ID, b"<|finetune_right_pad_id|>"),
-        ]
-        
-        for token_id, token_bytes in special_tokens:
-            length = len(token_bytes)
-            assert length > 0 and length <= 255, f"Token length invalid: {length}"
-            f.write(struct.pack('B', length))
-            f.write(token_bytes)
-        
-        # No BPE merges for now (simplified)
-        # Merges would be written here if implemented
+    table_slots = write_tokenizer_v2(tokenizer_path, vocab, merges,
+                                     BOS_TOKEN_ID, EOS_TOKEN_ID, PAD_TOKEN_ID)
         
     file_size = os.path.getsize(tokenizer_path)
-    print(f"✓ Wrote tokenizer: {tokenizer_path}")
+    print(f"✓ Wrote tokenizer (v2): {tokenizer_path}")
+    print(f"  Merges: {len(merges)} (table slots: {table_slots})")
     print(f"  Total size: {file_size:,} bytes")
 
 if __name__ == "__main__":
@@ -0,0 +1,174 @@
+// ============================================================================
+// PERF COUNTERS: perf_event_open para os benchmarks (Linux)
+// ============================================================================
+// Contadores de hardware em volta de cada kernel / forward pass:
+// cycles, instructions, LLC misses, dTLB misses (user space, thread atual).
+// Métricas derivadas: IPC, misses por unidade (token / chamada), bytes/cycle.
+//
+// Cada contador é aberto separadamente: um evento não suportado (ex.: dTLB
+// em VMs) não derruba os outros. Sem permissão (perf_event_paranoid > 2,
+// containers sem CAP_PERFMON) nenhum abre e os benchmarks seguem só com tempo.
+// Leituras são escaladas por time_enabled / time_running (multiplexação).
+// ============================================================================
+
+#ifndef QORUS_TOOLS_PERF_COUNTERS_H
+#define QORUS_TOOLS_PERF_COUNTERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+typedef enum {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_COUNTER_COUNT
+} perf_counter_id;
+
+typedef struct {
+    int fds[PERF_COUNTER_COUNT];    // -1 = não disponível
+    int n_open;
+    int open_errno;                 // errno da primeira falha (diagnóstico)
+} perf_counters;
+
+typedef struct {
+    double value[PERF_COUNTER_COUNT];  // Escalado (multiplexação)
+    bool valid[PERF_COUNTER_COUNT];
+} perf_sample;
+
+static inline const char* perf_counter_name(perf_counter_id id) {
+    switch (id) {
+        case PERF_CYCLES: return "cycles";
+        case PERF_INSTRUCTIONS: return "instructions";
+        case PERF_LLC_MISSES: return "LLC misses";
+        case PERF_DTLB_MISSES: return "dTLB misses";
+        case PERF_COUNTER_COUNT: break;
+    }
+    return "unknown";
+}
+
+static inline int perf_event_open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0 /* esta thread */, -1 /* qualquer CPU */, -1, 0);
+}
+
+// Abre os contadores disponíveis; retorna quantos abriram
+static inline int perf_counters_open(perf_counters* pc) {
+    static const uint64_t dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB |
+                                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const uint32_t types[PERF_COUNTER_COUNT] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+    };
+    const uint64_t configs[PERF_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, dtlb_read_miss
+    };
+    pc->n_open = 0;
+    pc->open_errno = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        pc->fds[i] = perf_event_open_counter(types[i], configs[i]);
+        if (pc->fds[i] >= 0) {
+            pc->n_open++;
+        } else if (pc->open_errno == 0) {
+            pc->open_errno = errno;
+        }
+    }
+    return pc->n_open;
+}
+
+static inline void perf_counters_close(perf_counters* pc) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (pc->fds[i] >= 0) {
+            close(pc->fds[i]);
+            pc->fds[i] = -1;
+        }
+    }
+    pc->n_open = 0;
+}
+
+static inline void perf_counters_start(const perf_counters* pc) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (pc->fds[i] >= 0) {
+            ioctl(pc->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static inline void perf_counters_stop(const perf_counters* pc, perf_sample* out) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        out->value[i] = 0.0;
+        out->valid[i] = false;
+        if (pc->fds[i] < 0) {
+            continue;
+        }
+        ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t buf[3];  // value, time_enabled, time_running
+        if (read(pc->fds[i], buf, sizeof(buf)) != (ssize_t)sizeof(buf) || buf[2] == 0) {
+            continue;  // Nunca agendado (multiplexação esgotada)
+        }
+        out->value[i] = (double)buf[0] * ((double)buf[1] / (double)buf[2]);
+        out->valid[i] = true;
+    }
+}
+
+// Acumula b em a (somas de várias janelas, ex.: um forward por token)
+static inline void perf_sample_add(perf_sample* a, const perf_sample* b) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        a->value[i] += b->value[i];
+        a->valid[i] = a->valid[i] || b->valid[i];
+    }
+}
+
+static inline void perf_counters_print_status(const perf_counters* pc) {
+    if (pc->n_open == 0) {
+        printf("perf counters: unavailable (%s; check /proc/sys/kernel/perf_event_paranoid)\n",
+               strerror(pc->open_errno));
+        return;
+    }
+    printf("perf counters:");
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        printf(" %s%s", perf_counter_name((perf_counter_id)i), pc->fds[i] >= 0 ? "" : " (n/a)");
+    }
+    printf("\n");
+}
+
+// Relatório: IPC, misses por unidade e bytes/cycle efetivos
+// units: nº de tokens / chamadas cobertos pela amostra; unit: "token", "call"
+// bytes: bytes mínimos movidos no total (0 = não reportar)
+// IPC alto + bytes/cycle baixo => compute-bound; IPC baixo + misses altos => memory-bound
+static inline void perf_sample_print(const perf_sample* s, double units, const char* unit, double bytes) {
+    const bool has_cycles = s->valid[PERF_CYCLES] && s->value[PERF_CYCLES] > 0.0;
+    if (has_cycles && s->valid[PERF_INSTRUCTIONS]) {
+        printf("  %-30s: %10.3f\n", "IPC", s->value[PERF_INSTRUCTIONS] / s->value[PERF_CYCLES]);
+    }
+    if (has_cycles && units > 0.0) {
+        printf("  %-30s: %10.0f per %s\n", "Cycles", s->value[PERF_CYCLES] / units, unit);
+    }
+    if (s->valid[PERF_LLC_MISSES] && units > 0.0) {
+        printf("  %-30s: %10.1f per %s\n", "LLC misses", s->value[PERF_LLC_MISSES] / units, unit);
+    }
+    if (s->valid[PERF_DTLB_MISSES] && units > 0.0) {
+        printf("  %-30s: %10.1f per %s\n", "dTLB misses", s->value[PERF_DTLB_MISSES] / units, unit);
+    }
+    if (has_cycles && bytes > 0.0) {
+        printf("  %-30s: %10.3f\n", "Effective bytes/cycle", bytes / s->value[PERF_CYCLES]);
+    }
+}
+
+#endif // QORUS_TOOLS_PERF_COUNTERS_H
@@ -0,0 +1,305 @@
+// ============================================================================
+// QORUS-LOADGEN: Gerador de carga para qorus-server
+// ============================================================================
+// N conexões concorrentes disparam requisições de geração em streaming e medem
+// TTFT (primeira linha de token) e latência total por requisição.
+// Ao final imprime throughput (req/s, tokens/s), p50/p99 e as métricas do
+// servidor ({"cmd": "metrics"}).
+//
+// Uso:
+//   qorus_loadgen [--socket PATH | --port N] [-c CONCURRENCY] [-n REQUESTS]
+//                 [--max-tokens N] [--prompt TEXT]
+// ============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOADGEN_DEFAULT_SOCKET "/tmp/qorus.sock"
+#define LOADGEN_LINE_MAX       (256 * 1024)
+
+typedef struct {
+    const char* socket_path;
+    uint16_t port;
+    uint32_t concurrency;
+    uint32_t n_requests;
+    uint32_t max_tokens;
+    const char* prompt;
+} loadgen_config;
+
+typedef struct {
+    double ttft_ms;
+    double total_ms;
+    uint32_t n_tokens;
+    bool ok;
+} request_result;
+
+typedef struct {
+    const loadgen_config* cfg;
+    request_result* results;
+    atomic_uint* next_request;
+} loadgen_shared;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static int connect_server(const loadgen_config* cfg) {
+    union {
+        struct sockaddr sa;
+        struct sockaddr_in in;
+        struct sockaddr_un un;
+    } addr;
+    socklen_t addr_len = 0;
+    memset(&addr, 0, sizeof(addr));
+
+    if (cfg->port != 0) {
+        addr.in.sin_family = AF_INET;
+        addr.in.sin_port = htons(cfg->port);
+        addr.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr_len = sizeof(addr.in);
+    } else {
+        addr.un.sun_family = AF_UNIX;
+        snprintf(addr.un.sun_path, sizeof(addr.un.sun_path), "%s", cfg->socket_path);
+        addr_len = sizeof(addr.un);
+    }
+    int fd = socket(addr.sa.sa_family, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, &addr.sa, addr_len) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static bool send_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Leitor de linhas com buffer (uma instância por conexão)
+typedef struct {
+    int fd;
+    char* buf;
+    size_t len;
+    size_t pos;
+} line_reader;
+
+// Returns ponteiro para próxima linha (sem '\n'), NULL em EOF/erro
+static char* read_line(line_reader* r) {
+    for (;;) {
+        char* start = r->buf + r->pos;
+        char* nl = memchr(start, '\n', r->len - r->pos);
+        if (nl != NULL) {
+            *nl = '\0';
+            r->pos = (size_t)(nl - r->buf) + 1;
+            return start;
+        }
+        // Compacta e lê mais
+        memmove(r->buf, start, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+        if (r->len + 1 >= LOADGEN_LINE_MAX) return NULL;
+        ssize_t n = recv(r->fd, r->buf + r->len, LOADGEN_LINE_MAX - 1 - r->len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return NULL;
+        r->len += (size_t)n;
+    }
+}
+
+static void run_request(const loadgen_config* cfg, char* buf, request_result* out) {
+    memset(out, 0, sizeof(*out));
+    const double t0 = now_ms();
+    int fd = connect_server(cfg);
+    if (fd < 0) return;
+
+    // Prompt é embutido sem escape: o CLI recusa '"' e '\\' (ver parse_args)
+    char request[1024];
+    int n = snprintf(request, sizeof(request),
+                     "{\"prompt\": \"%s\", \"max_tokens\": %u, \"temperature\": 0.0, \"stream\": true}\n",
+                     cfg->prompt, cfg->max_tokens);
+    if (n <= 0 || (size_t)n >= sizeof(request) || !send_all(fd, request, (size_t)n)) {
+        close(fd);
+        return;
+    }
+
+    line_reader r = { .fd = fd, .buf = buf };
+    char* line;
+    while ((line = read_line(&r)) != NULL) {
+        if (strncmp(line, "{\"token\"", 8) == 0) {
+            if (out->n_tokens == 0) out->ttft_ms = now_ms() - t0;
+            out->n_tokens++;
+        } else if (strncmp(line, "{\"done\"", 7) == 0) {
+            // Sem stream de tokens (ex.: EOS imediato): TTFT = latência total
+            const char* nt = strstr(line, "\"n_tokens\": ");
+            if (nt != NULL) out->n_tokens = (uint32_t)strtoul(nt + 12, NULL, 10);
+            out->total_ms = now_ms() - t0;
+            if (out->ttft_ms <= 0.0) out->ttft_ms = out->total_ms;
+            out->ok = true;
+            break;
+        } else {
+            fprintf(stderr, "server error: %s\n", line);
+            break;
+        }
+    }
+    close(fd);
+}
+
+static void* loadgen_thread(void* arg) {
+    loadgen_shared* shared = (loadgen_shared*)arg;
+    char* buf = (char*)malloc(LOADGEN_LINE_MAX);
+    if (buf == NULL) return NULL;
+    for (;;) {
+        unsigned idx = atomic_fetch_add(shared->next_request, 1U);
+        if (idx >= shared->cfg->n_requests) break;
+        run_request(shared->cfg, buf, &shared->results[idx]);
+    }
+    free(buf);
+    return NULL;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double* values, uint32_t n, double pct) {
+    if (n == 0) return 0.0;
+    qsort(values, n, sizeof(double), compare_double);
+    uint32_t rank = (uint32_t)(pct / 100.0 * (double)(n - 1) + 0.5);
+    return values[rank];
+}
+
+static void print_server_metrics(const loadgen_config* cfg) {
+    int fd = connect_server(cfg);
+    if (fd < 0) return;
+    const char* cmd = "{\"cmd\": \"metrics\"}\n";
+    char* buf = (char*)malloc(LOADGEN_LINE_MAX);
+    if (buf != NULL && send_all(fd, cmd, strlen(cmd))) {
+        line_reader r = { .fd = fd, .buf = buf };
+        char* line = read_line(&r);
+        if (line != NULL) printf("Server metrics: %s\n", line);
+    }
+    free(buf);
+    close(fd);
+}
+
+static bool parse_args(int argc, char** argv, loadgen_config* cfg) {
+    cfg->socket_path = LOADGEN_DEFAULT_SOCKET;
+    cfg->concurrency = 4;
+    cfg->n_requests = 32;
+    cfg->max_tokens = 16;
+    cfg->prompt = "Hello";
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        const char* opt = argv[i];
+        const char* val = argv[++i];
+        long v = strtol(val, NULL, 10);
+        if (strcmp(opt, "--socket") == 0) {
+            cfg->socket_path = val;
+        } else if (strcmp(opt, "--port") == 0 && v > 0 && v < 65536) {
+            cfg->port = (uint16_t)v;
+        } else if (strcmp(opt, "-c") == 0 && v > 0 && v <= 1024) {
+            cfg->concurrency = (uint32_t)v;
+        } else if (strcmp(opt, "-n") == 0 && v > 0 && v <= 1000000) {
+            cfg->n_requests = (uint32_t)v;
+        } else if (strcmp(opt, "--max-tokens") == 0 && v > 0 && v <= 4096) {
+            cfg->max_tokens = (uint32_t)v;
+        } else if (strcmp(opt, "--prompt") == 0 && strlen(val) < 512 &&
+                   strpbrk(val, "\"\\\n") == NULL) {
+            cfg->prompt = val;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    loadgen_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    if (!parse_args(argc, argv, &cfg)) {
+        fprintf(stderr,
+                "Usage: %s [--socket PATH | --port N] [-c CONCURRENCY] [-n REQUESTS]\n"
+                "          [--max-tokens N] [--prompt TEXT]\n", argv[0]);
+        return 1;
+    }
+
+    request_result* results = (request_result*)calloc(cfg.n_requests, sizeof(request_result));
+    pthread_t* threads = (pthread_t*)calloc(cfg.concurrency, sizeof(pthread_t));
+    double* samples = (double*)calloc(cfg.n_requests, sizeof(double));
+    if (results == NULL || threads == NULL || samples == NULL) {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        free(results);
+        free(threads);
+        free(samples);
+        return 1;
+    }
+
+    atomic_uint next_request = 0;
+    loadgen_shared shared = { .cfg = &cfg, .results = results, .next_request = &next_request };
+
+    printf("Load: %u requests, concurrency %u, max_tokens %u\n",
+           cfg.n_requests, cfg.concurrency, cfg.max_tokens);
+    const double t0 = now_ms();
+    uint32_t n_threads = 0;
+    for (; n_threads < cfg.concurrency; n_threads++) {
+        if (pthread_create(&threads[n_threads], NULL, loadgen_thread, &shared) != 0) break;
+    }
+    for (uint32_t i = 0; i < n_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    const double wall_s = (now_ms() - t0) / 1000.0;
+
+    uint32_t n_ok = 0;
+    uint64_t tokens = 0;
+    for (uint32_t i = 0; i < cfg.n_requests; i++) {
+        if (results[i].ok) {
+            samples[n_ok++] = results[i].total_ms;
+            tokens += results[i].n_tokens;
+        }
+    }
+    const double lat_p50 = percentile(samples, n_ok, 50.0);
+    const double lat_p99 = percentile(samples, n_ok, 99.0);
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < cfg.n_requests; i++) {
+        if (results[i].ok) samples[k++] = results[i].ttft_ms;
+    }
+    const double ttft_p50 = percentile(samples, n_ok, 50.0);
+    const double ttft_p99 = percentile(samples, n_ok, 99.0);
+
+    printf("Completed: %u/%u (errors: %u) in %.2f s\n",
+           n_ok, cfg.n_requests, cfg.n_requests - n_ok, wall_s);
+    printf("Throughput: %.2f req/s, %.2f tokens/s\n",
+           (double)n_ok / wall_s, (double)tokens / wall_s);
+    printf("Latency ms: p50 %.2f  p99 %.2f\n", lat_p50, lat_p99);
+    printf("TTFT ms:    p50 %.2f  p99 %.2f\n", ttft_p50, ttft_p99);
+    print_server_metrics(&cfg);
+
+    free(results);
+    free(threads);
+    free(samples);
+    return (n_ok == cfg.n_requests) ? 0 : 1;
+}
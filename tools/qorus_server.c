@@ -0,0 +1,1226 @@
+// ============================================================================
+// QORUS-SERVER: Servidor local de inferência (Unix socket / TCP localhost)
+// ============================================================================
+// Modelo carregado uma vez: mmap dos pesos + grafo compartilhados (somente
+// leitura). Cada worker do pool tem seu próprio q_context (arena + KV cache),
+// buffers de tokens e gramática JSON - nenhum lock no caminho de inferência.
+//
+// Protocolo: uma requisição JSON por conexão, terminada em '\n'
+//   {"prompt": "...", "max_tokens": 32, "temperature": 0.8, "top_k": 40,
+//    "top_p": 0.9, "stream": true, "json": false, "seed": 42}
+//   "seed" (opcional): stream Philox próprio -> mesma requisição, mesmos tokens
+//   "repetition_penalty", "frequency_penalty", "presence_penalty" (opcionais, 0 = off)
+//   "min_p", "typical_p" (opcionais, 0 = off)
+//   {"cmd": "metrics"}  |  {"cmd": "health"}
+// Resposta: JSON por linha (NDJSON)
+//   {"token": 42, "text": "..."}                           (stream, por token)
+//   {"done": true, "n_tokens": N, "text": "...", "queue_ms": q,
+//    "ttft_ms": f, "total_ms": t}
+//   {"error": "...", "code": "QUEUE_FULL"}
+//
+// Uso:
+//   qorus_server <model.qorus> <tokenizer.bin> [--socket PATH | --port N]
+//                [--workers N] [--queue N] [--arena-mb N]
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+#define SERVER_DEFAULT_SOCKET     "/tmp/qorus.sock"
+#define SERVER_DEFAULT_WORKERS    2
+#define SERVER_DEFAULT_QUEUE      64
+#define SERVER_DEFAULT_ARENA_MB   64
+#define SERVER_MAX_REQUEST        (64 * 1024)   // Linha de requisição (bytes)
+#define SERVER_MAX_PROMPT_TOKENS  4096
+#define SERVER_MAX_GEN_TOKENS     4096
+#define SERVER_DEFAULT_GEN_TOKENS 32
+#define SERVER_LATENCY_WINDOW     1024          // Janela para p50/p99
+#define SERVER_RECV_TIMEOUT_S     5             // Prazo total da linha de requisição (anti-slowloris)
+#define SERVER_MAX_PENDING        128           // Conexões lendo a requisição ao mesmo tempo
+#define SERVER_TOKEN_TEXT_MAX     1024          // Texto decodificado de 1 token
+#define SERVER_LINE_HEADER_MAX    2048          // Campos numéricos de uma linha de resposta
+#define SERVER_SEND_TIMEOUT_S     10            // send() bloqueado por cliente que não lê
+// Linha de 1 token: prefixo + texto sanitizado (*3: byte inválido -> U+FFFD, 3 bytes)
+// escapado (*6: pior caso \u00XX por byte) + "\"}\n"
+#define SERVER_TOKEN_LINE_MAX     (64 + (SERVER_TOKEN_TEXT_MAX + 4) * 3 * 6 + 3)
+
+typedef struct {
+    const char* model_path;
+    const char* tokenizer_path;
+    const char* socket_path;   // Usado se port == 0
+    uint16_t port;             // TCP em 127.0.0.1 (0 = Unix socket)
+    uint32_t n_workers;
+    uint32_t queue_capacity;
+    uint32_t arena_mb;
+} server_config;
+
+typedef struct {
+    char* prompt;              // malloc (NULL para comandos); pode conter NUL (\u0000)
+    size_t prompt_len;         // Bytes decodificados de prompt
+    uint32_t max_tokens;
+    float temperature;
+    uint32_t top_k;
+    float top_p;
+    float min_p;
+    float typical_p;
+    float repetition_penalty;
+    float frequency_penalty;
+    float presence_penalty;
+    bool stream;
+    bool json;
+    bool has_seed;             // "seed" presente: sampling reproduzível
+    uint64_t seed;
+    char cmd[16];              // "" = geração, "metrics", "health"
+} server_request;
+
+typedef struct {
+    int fd;
+    server_request req;
+    double t_enqueue_ms;
+    uint64_t request_id;       // Stream RNG de requisições sem "seed"
+} server_job;
+
+// Fila bounded (ring buffer) protegida por mutex + condvar
+typedef struct {
+    server_job* jobs;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+} server_queue;
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t requests_total;
+    uint64_t requests_completed;
+    uint64_t requests_rejected;
+    uint64_t requests_failed;
+    uint64_t tokens_generated;
+    uint32_t busy_workers;
+    double total_ms[SERVER_LATENCY_WINDOW];
+    double queue_ms[SERVER_LATENCY_WINDOW];
+    double ttft_ms[SERVER_LATENCY_WINDOW];
+    uint32_t window_pos;
+    uint32_t window_count;
+    double start_ms;
+} server_metrics;
+
+typedef struct {
+    server_config config;
+    q_context model_ctx;       // mmap + arena do grafo (compartilhado, read-only)
+    q_llama_model model;
+    q_tokenizer tokenizer;
+    size_t kv_size;
+    server_queue queue;
+    server_metrics metrics;
+    uint64_t rng_seed;         // Seed base (por processo) para requisições sem "seed"
+} server_state;
+
+typedef struct {
+    uint32_t id;
+    pthread_t thread;
+    server_state* srv;
+    q_context ctx;             // Arena + KV cache privados do worker
+    q_grammar grammar;
+    bool grammar_ready;
+    uint32_t* prompt_buf;      // [SERVER_MAX_PROMPT_TOKENS]
+    uint32_t* gen_buf;         // [SERVER_MAX_GEN_TOKENS]
+} server_worker;
+
+// Estado de streaming de uma requisição (user_data do on_token)
+typedef struct {
+    server_worker* worker;
+    int fd;
+    bool stream;
+    bool client_alive;
+    q_detokenizer detok;       // Decode incremental (retém UTF-8 incompleto entre tokens)
+    char* text;                // Texto completo gerado (malloc, cresce)
+    size_t text_len;
+    size_t text_cap;
+    uint32_t n_tokens;
+    double t_start_ms;
+    double ttft_ms;
+    char* line;                // Buffer de saída [SERVER_TOKEN_LINE_MAX]
+} stream_state;
+
+// Conexão aceita cuja linha de requisição ainda está chegando (socket não-bloqueante)
+typedef struct {
+    int fd;
+    char* buf;                 // [SERVER_MAX_REQUEST]
+    size_t len;
+    double deadline_ms;        // Prazo total desde o accept (não renovado a cada byte)
+} pending_conn;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+// ============================================================================
+// I/O HELPERS
+// ============================================================================
+
+static bool send_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool send_error(int fd, const char* message, const char* code) {
+    char line[256];
+    int n = snprintf(line, sizeof(line), "{\"error\": \"%s\", \"code\": \"%s\"}\n", message, code);
+    return n > 0 && send_all(fd, line, (size_t)n);
+}
+
+// ============================================================================
+// JSON (subset: objeto plano na requisição, escape na resposta)
+// ============================================================================
+
+static const char* json_skip_ws(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    return p;
+}
+
+static int json_hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool json_parse_hex4(const char* p, uint32_t* out) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = json_hex_value(p[i]);
+        if (h < 0) return false;
+        v = (v << 4) | (uint32_t)h;
+    }
+    *out = v;
+    return true;
+}
+
+static size_t utf8_encode(uint32_t cp, char* out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Decodifica string JSON (p em '"'). out precisa de strlen(p) + 1 bytes
+// (string decodificada nunca é maior que a escapada). Returns fim ou NULL
+static const char* json_parse_string(const char* p, char* out, size_t* out_len) {
+    if (*p != '"') return NULL;
+    p++;
+    size_t len = 0;
+    while (*p != '"') {
+        if (*p == '\0' || (unsigned char)*p < 0x20) return NULL;
+        if (*p != '\\') {
+            if (out != NULL) out[len] = *p;
+            len++;
+            p++;
+            continue;
+        }
+        p++;
+        char decoded = 0;
+        switch (*p) {
+            case '"': decoded = '"'; break;
+            case '\\': decoded = '\\'; break;
+            case '/': decoded = '/'; break;
+            case 'b': decoded = '\b'; break;
+            case 'f': decoded = '\f'; break;
+            case 'n': decoded = '\n'; break;
+            case 'r': decoded = '\r'; break;
+            case 't': decoded = '\t'; break;
+            case 'u': {
+                uint32_t cp = 0;
+                if (!json_parse_hex4(p + 1, &cp)) return NULL;
+                p += 5;
+                // Par surrogate -> code point suplementar; surrogate isolado -> U+FFFD
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    uint32_t lo = 0;
+                    if (p[0] == '\\' && p[1] == 'u' && json_parse_hex4(p + 2, &lo) &&
+                        lo >= 0xDC00 && lo <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        p += 6;
+                    } else {
+                        cp = 0xFFFD;
+                    }
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    cp = 0xFFFD;
+                }
+                char tmp[4];
+                size_t n = utf8_encode(cp, tmp);
+                if (out != NULL) memcpy(out + len, tmp, n);
+                len += n;
+                continue;
+            }
+            default:
+                return NULL;
+        }
+        if (out != NULL) out[len] = decoded;
+        len++;
+        p++;
+    }
+    if (out != NULL) out[len] = '\0';
+    if (out_len != NULL) *out_len = len;
+    return p + 1;
+}
+
+// Pula qualquer valor JSON (chaves desconhecidas). Returns fim ou NULL
+static const char* json_skip_value(const char* p) {
+    p = json_skip_ws(p);
+    if (*p == '"') return json_parse_string(p, NULL, NULL);
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        do {
+            if (*p == '"') {
+                p = json_parse_string(p, NULL, NULL);
+                if (p == NULL) return NULL;
+                continue;
+            }
+            if (*p == '{' || *p == '[') depth++;
+            else if (*p == '}' || *p == ']') depth--;
+            else if (*p == '\0') return NULL;
+            p++;
+        } while (depth > 0);
+        return p;
+    }
+    const char* start = p;
+    while (*p != '\0' && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' &&
+           *p != '\n' && *p != '\r') {
+        p++;
+    }
+    return (p > start) ? p : NULL;
+}
+
+// strtod aceita "nan"/"inf" (não são JSON): não-finitos são rejeitados e *out
+// fica intacto (o chamador converte para inteiro antes de checar NULL)
+static const char* json_parse_number(const char* p, double* out) {
+    char* end = NULL;
+    const double v = strtod(p, &end);
+    if (end == p || !isfinite(v)) return NULL;
+    *out = v;
+    return end;
+}
+
+static const char* json_parse_bool(const char* p, bool* out) {
+    if (strncmp(p, "true", 4) == 0) { *out = true; return p + 4; }
+    if (strncmp(p, "false", 5) == 0) { *out = false; return p + 5; }
+    return NULL;
+}
+
+// Parse da requisição. Returns NULL em sucesso, mensagem de erro caso contrário
+static const char* parse_request(const char* line, server_request* req) {
+    memset(req, 0, sizeof(*req));
+    req->max_tokens = SERVER_DEFAULT_GEN_TOKENS;
+    req->stream = true;
+
+    const char* p = json_skip_ws(line);
+    if (*p != '{') return "request must be a JSON object";
+    p = json_skip_ws(p + 1);
+
+    char key[32];
+    while (*p != '}') {
+        // Chave (limitada: chaves longas são desconhecidas de qualquer forma)
+        const char* key_end = json_parse_string(p, NULL, NULL);
+        if (key_end == NULL) return "invalid key";
+        size_t key_len = (size_t)(key_end - p) - 2;
+        if (key_len < sizeof(key)) {
+            memcpy(key, p + 1, key_len);
+            key[key_len] = '\0';
+        } else {
+            key[0] = '\0';
+        }
+        p = json_skip_ws(key_end);
+        if (*p != ':') return "expected ':'";
+        p = json_skip_ws(p + 1);
+
+        double num = 0.0;
+        if (strcmp(key, "prompt") == 0) {
+            if (*p != '"') return "prompt must be a string";
+            free(req->prompt);
+            req->prompt = (char*)malloc(strlen(p) + 1);
+            if (req->prompt == NULL) return "out of memory";
+            p = json_parse_string(p, req->prompt, &req->prompt_len);
+        } else if (strcmp(key, "cmd") == 0) {
+            char* cmd = (char*)malloc(strlen(p) + 1);
+            if (cmd == NULL) return "out of memory";
+            p = json_parse_string(p, cmd, NULL);
+            snprintf(req->cmd, sizeof(req->cmd), "%s", (p != NULL) ? cmd : "");
+            free(cmd);
+        } else if (strcmp(key, "max_tokens") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= 1.0 && num <= (double)SERVER_MAX_GEN_TOKENS)) return "max_tokens out of range";
+            req->max_tokens = (uint32_t)num;
+        } else if (strcmp(key, "temperature") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= 0.0 && num <= 100.0)) return "temperature out of range";
+            req->temperature = (float)num;
+        } else if (strcmp(key, "top_k") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= 0.0 && num <= 1e6)) return "top_k out of range";
+            req->top_k = (uint32_t)num;
+        } else if (strcmp(key, "top_p") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= 0.0 && num <= 1.0)) return "top_p out of range";
+            req->top_p = (float)num;
+        } else if (strcmp(key, "min_p") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= 0.0 && num <= 1.0)) return "min_p out of range";
+            req->min_p = (float)num;
+        } else if (strcmp(key, "typical_p") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= 0.0 && num <= 1.0)) return "typical_p out of range";
+            req->typical_p = (float)num;
+        } else if (strcmp(key, "repetition_penalty") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= 0.0 && num <= 100.0)) return "repetition_penalty out of range";
+            req->repetition_penalty = (float)num;
+        } else if (strcmp(key, "frequency_penalty") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= -100.0 && num <= 100.0)) return "frequency_penalty out of range";
+            req->frequency_penalty = (float)num;
+        } else if (strcmp(key, "presence_penalty") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= -100.0 && num <= 100.0)) return "presence_penalty out of range";
+            req->presence_penalty = (float)num;
+        } else if (strcmp(key, "seed") == 0) {
+            p = json_parse_number(p, &num);
+            if (p != NULL && !(num >= 0.0 && num <= 9007199254740992.0)) return "seed out of range";
+            req->seed = (uint64_t)num;
+            req->has_seed = true;
+        } else if (strcmp(key, "stream") == 0) {
+            p = json_parse_bool(p, &req->stream);
+        } else if (strcmp(key, "json") == 0) {
+            p = json_parse_bool(p, &req->json);
+        } else {
+            p = json_skip_value(p);
+        }
+        if (p == NULL) return "invalid value";
+
+        p = json_skip_ws(p);
+        if (*p == ',') {
+            p = json_skip_ws(p + 1);
+            if (*p != '"') return "expected key after ','";
+        } else if (*p != '}') {
+            return "expected ',' or '}'";
+        }
+    }
+
+    if (req->cmd[0] == '\0' && req->prompt == NULL) return "missing prompt";
+    return NULL;
+}
+
+// Escape JSON de texto UTF-8 válido. out precisa de 6 * len + 1 bytes
+static size_t json_escape(const char* in, size_t len, char* out) {
+    static const char hex[] = "0123456789abcdef";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)in[i];
+        if (c == '"' || c == '\\') {
+            out[o++] = '\\';
+            out[o++] = (char)c;
+        } else if (c == '\n') {
+            out[o++] = '\\';
+            out[o++] = 'n';
+        } else if (c < 0x20 || c == 0x7F) {
+            out[o++] = '\\';
+            out[o++] = 'u';
+            out[o++] = '0';
+            out[o++] = '0';
+            out[o++] = hex[c >> 4];
+            out[o++] = hex[c & 0xF];
+        } else {
+            out[o++] = (char)c;
+        }
+    }
+    out[o] = '\0';
+    return o;
+}
+
+// ============================================================================
+// UTF-8 STREAMING (tokens de byte podem dividir caracteres multibyte)
+// ============================================================================
+
+// Emite prefixo UTF-8 válido de in[0..len); bytes inválidos viram U+FFFD.
+// Sequência incompleta no final é mantida em *held (não emitida).
+// out precisa de 3 * len bytes. Returns bytes escritos em out
+static size_t utf8_sanitize(const uint8_t* in, size_t len, char* out, size_t* held) {
+    size_t i = 0;
+    size_t o = 0;
+    *held = 0;
+    while (i < len) {
+        uint8_t c = in[i];
+        size_t need = 0;
+        if (c < 0x80) {
+            out[o++] = (char)c;
+            i++;
+            continue;
+        } else if (c >= 0xC2 && c <= 0xDF) {
+            need = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            need = 2;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            need = 3;
+        }
+
+        size_t k = 1;
+        while (need > 0 && k <= need && i + k < len && (in[i + k] & 0xC0) == 0x80) k++;
+
+        if (need > 0 && k == need + 1) {
+            memcpy(out + o, in + i, k);
+            o += k;
+            i += k;
+        } else if (need > 0 && i + k == len) {
+            *held = len - i;  // Incompleta no fim: aguardar próximo token
+            break;
+        } else {
+            o += utf8_encode(0xFFFD, out + o);
+            i++;
+        }
+    }
+    return o;
+}
+
+static bool stream_append_text(stream_state* st, const char* s, size_t n) {
+    if (st->text_len + n + 1 > st->text_cap) {
+        size_t cap = st->text_cap * 2;
+        while (cap < st->text_len + n + 1) cap *= 2;
+        char* grown = (char*)realloc(st->text, cap);
+        if (grown == NULL) return false;
+        st->text = grown;
+        st->text_cap = cap;
+    }
+    memcpy(st->text + st->text_len, s, n);
+    st->text_len += n;
+    st->text[st->text_len] = '\0';
+    return true;
+}
+
+// Callback de q_generate: decodifica, sanitiza UTF-8 e envia linha NDJSON
+static bool stream_on_token(uint32_t token_id, void* user_data) {
+    stream_state* st = (stream_state*)user_data;
+    server_state* srv = st->worker->srv;
+
+    if (st->n_tokens == 0) {
+        st->ttft_ms = now_ms() - st->t_start_ms;
+    }
+    st->n_tokens++;
+    if (token_id == srv->tokenizer.eos_token_id) {
+        return true;  // q_generate para no EOS
+    }
+
+    // Bytes completos (sequências UTF-8 incompletas ficam retidas no detokenizer)
+    char raw[SERVER_TOKEN_TEXT_MAX + 4];
+    size_t raw_len = 0;
+    if (q_detokenizer_push(&st->detok, token_id, raw, sizeof(raw), &raw_len) != Q_OK) {
+        raw_len = 0;
+    }
+
+    // Sanitiza bytes inválidos (U+FFFD); nada fica retido após o detokenizer
+    char clean[(SERVER_TOKEN_TEXT_MAX + 4) * 3];
+    size_t held = 0;
+    size_t clean_len = utf8_sanitize((const uint8_t*)raw, raw_len, clean, &held);
+
+    if (!stream_append_text(st, clean, clean_len)) {
+        return false;
+    }
+
+    if (st->stream && st->client_alive) {
+        int n = snprintf(st->line, 64, "{\"token\": %u, \"text\": \"", token_id);
+        size_t len = (size_t)n + json_escape(clean, clean_len, st->line + n);
+        memcpy(st->line + len, "\"}\n", 3);
+        st->client_alive = send_all(st->fd, st->line, len + 3);
+    }
+    return st->client_alive;  // Cliente desconectou: parar geração
+}
+
+// ============================================================================
+// METRICS
+// ============================================================================
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Percentil (nearest-rank) de values[0..n) - ordena in-place
+static double percentile(double* values, uint32_t n, double pct) {
+    if (n == 0) return 0.0;
+    qsort(values, n, sizeof(double), compare_double);
+    uint32_t rank = (uint32_t)(pct / 100.0 * (double)(n - 1) + 0.5);
+    return values[rank];
+}
+
+static void metrics_record(server_metrics* m, bool ok, uint32_t n_tokens,
+                           double queue_ms, double ttft_ms, double total_ms) {
+    pthread_mutex_lock(&m->lock);
+    if (ok) {
+        m->requests_completed++;
+        m->tokens_generated += n_tokens;
+        m->total_ms[m->window_pos] = total_ms;
+        m->queue_ms[m->window_pos] = queue_ms;
+        m->ttft_ms[m->window_pos] = ttft_ms;
+        m->window_pos = (m->window_pos + 1) % SERVER_LATENCY_WINDOW;
+        if (m->window_count < SERVER_LATENCY_WINDOW) m->window_count++;
+    } else {
+        m->requests_failed++;
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+static void send_metrics(server_state* srv, int fd) {
+    server_metrics* m = &srv->metrics;
+    const size_t line_cap = 4 * SERVER_LINE_HEADER_MAX;
+    double* scratch = (double*)malloc(3 * SERVER_LATENCY_WINDOW * sizeof(double) + line_cap);
+    if (scratch == NULL) {
+        send_error(fd, "out of memory", "INTERNAL");
+        return;
+    }
+    double* total = scratch;
+    double* queue = scratch + SERVER_LATENCY_WINDOW;
+    double* ttft = scratch + 2 * SERVER_LATENCY_WINDOW;
+    char* line = (char*)(scratch + 3 * SERVER_LATENCY_WINDOW);
+
+    pthread_mutex_lock(&srv->queue.lock);
+    const uint32_t depth = srv->queue.count;
+    pthread_mutex_unlock(&srv->queue.lock);
+
+    pthread_mutex_lock(&m->lock);
+    const unsigned long long req_total = m->requests_total;
+    const unsigned long long req_completed = m->requests_completed;
+    const unsigned long long req_rejected = m->requests_rejected;
+    const unsigned long long req_failed = m->requests_failed;
+    const unsigned long long tokens = m->tokens_generated;
+    const uint32_t busy = m->busy_workers;
+    const uint32_t n = m->window_count;
+    memcpy(total, m->total_ms, n * sizeof(double));
+    memcpy(queue, m->queue_ms, n * sizeof(double));
+    memcpy(ttft, m->ttft_ms, n * sizeof(double));
+    pthread_mutex_unlock(&m->lock);
+
+    const double uptime_s = (now_ms() - m->start_ms) / 1000.0;
+    int len = snprintf(line, line_cap,
+        "{\"queue_depth\": %u, \"queue_capacity\": %u, \"workers\": %u, \"busy_workers\": %u, "
+        "\"requests_total\": %llu, \"requests_completed\": %llu, \"requests_rejected\": %llu, "
+        "\"requests_failed\": %llu, \"tokens_generated\": %llu, \"uptime_s\": %.1f, "
+        "\"latency_ms\": {\"p50\": %.2f, \"p99\": %.2f}, "
+        "\"queue_wait_ms\": {\"p50\": %.2f, \"p99\": %.2f}, "
+        "\"ttft_ms\": {\"p50\": %.2f, \"p99\": %.2f}}\n",
+        depth, srv->queue.capacity, srv->config.n_workers, busy,
+        req_total, req_completed, req_rejected, req_failed, tokens, uptime_s,
+        percentile(total, n, 50.0), percentile(total, n, 99.0),
+        percentile(queue, n, 50.0), percentile(queue, n, 99.0),
+        percentile(ttft, n, 50.0), percentile(ttft, n, 99.0));
+    if (len > 0 && (size_t)len < line_cap) {
+        send_all(fd, line, (size_t)len);
+    }
+    free(scratch);
+}
+
+// ============================================================================
+// WORKER POOL
+// ============================================================================
+
+static void worker_handle(server_worker* w, server_job* job) {
+    server_state* srv = w->srv;
+    const server_request* req = &job->req;
+    const double t_start = now_ms();
+    const double queue_ms = t_start - job->t_enqueue_ms;
+
+    if (req->json && !w->grammar_ready) {
+        send_error(job->fd, "JSON grammar unavailable for this vocabulary", "GRAMMAR_UNAVAILABLE");
+        metrics_record(&srv->metrics, false, 0, 0.0, 0.0, 0.0);
+        return;
+    }
+
+    uint32_t n_prompt = 0;
+    // Comprimento decodificado: \u0000 no prompt não trunca o texto (sem strlen)
+    q_error_code err = q_tokenizer_encode_len(&srv->tokenizer, req->prompt, req->prompt_len, w->prompt_buf,
+                                              &n_prompt, SERVER_MAX_PROMPT_TOKENS, true, false);
+    const uint32_t max_seq_len = srv->model.config.max_seq_len;
+    if (err != Q_OK || n_prompt == 0 || n_prompt >= max_seq_len) {
+        send_error(job->fd, "prompt could not be encoded or is too long", "PROMPT_TOO_LONG");
+        metrics_record(&srv->metrics, false, 0, 0.0, 0.0, 0.0);
+        return;
+    }
+
+    stream_state st = {
+        .worker = w,
+        .fd = job->fd,
+        .stream = req->stream,
+        .client_alive = true,
+        .text_cap = 256,
+        .t_start_ms = t_start,
+    };
+    st.text = (char*)malloc(st.text_cap);
+    st.line = (char*)malloc(SERVER_TOKEN_LINE_MAX);
+    if (st.text == NULL || st.line == NULL) {
+        free(st.text);
+        free(st.line);
+        send_error(job->fd, "out of memory", "INTERNAL");
+        metrics_record(&srv->metrics, false, 0, 0.0, 0.0, 0.0);
+        return;
+    }
+    st.text[0] = '\0';
+    q_detokenizer_init(&st.detok, &srv->tokenizer);
+
+    uint32_t max_tokens = req->max_tokens;
+    if (max_tokens > max_seq_len - n_prompt) {
+        max_tokens = max_seq_len - n_prompt;
+    }
+
+    // Stream por requisição: sem estado compartilhado entre workers/requisições
+    q_rng rng;
+    if (req->has_seed) {
+        q_rng_init(&rng, req->seed, 0);
+    } else {
+        q_rng_init(&rng, srv->rng_seed, job->request_id);
+    }
+
+    q_generation_state state = {
+        .ctx = &w->ctx,
+        .model = &srv->model,
+        .tokenizer = &srv->tokenizer,
+        .prompt_tokens = w->prompt_buf,
+        .num_prompt_tokens = n_prompt,
+        .generated_tokens = w->gen_buf,
+        .max_tokens = max_tokens,
+        .temperature = req->temperature,
+        .top_k = req->top_k,
+        .top_p = req->top_p,
+        .min_p = req->min_p,
+        .typical_p = req->typical_p,
+        .repetition_penalty = req->repetition_penalty,
+        .frequency_penalty = req->frequency_penalty,
+        .presence_penalty = req->presence_penalty,
+        .grammar = req->json ? &w->grammar : NULL,
+        .on_token = stream_on_token,
+        .user_data = &st,
+        .rng = &rng,
+    };
+    err = q_generate(&state);
+
+    // Bytes retidos no fim (sequência UTF-8 truncada) -> U+FFFD
+    char tail[8];
+    size_t tail_len = 0;
+    if (q_detokenizer_flush(&st.detok, tail, sizeof(tail), &tail_len) == Q_OK) {
+        for (size_t i = 0; i < tail_len; i++) {
+            char rep[4];
+            stream_append_text(&st, rep, utf8_encode(0xFFFD, rep));
+        }
+    }
+
+    const double total_ms = now_ms() - t_start;
+    if (err != Q_OK) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "generation failed: %s", q_strerror(err));
+        if (st.client_alive) send_error(job->fd, msg, "GENERATION_FAILED");
+        metrics_record(&srv->metrics, false, 0, 0.0, 0.0, 0.0);
+    } else {
+        // Métricas antes da resposta final: cliente que consulta logo após "done" as vê
+        metrics_record(&srv->metrics, true, st.n_tokens, queue_ms, st.ttft_ms, total_ms);
+        if (st.client_alive) {
+            char* final_line = (char*)malloc(st.text_len * 6 + SERVER_LINE_HEADER_MAX);
+            if (final_line != NULL) {
+                int n = snprintf(final_line, SERVER_LINE_HEADER_MAX,
+                                 "{\"done\": true, \"n_tokens\": %u, \"queue_ms\": %.2f, "
+                                 "\"ttft_ms\": %.2f, \"total_ms\": %.2f, \"text\": \"",
+                                 st.n_tokens, queue_ms, st.ttft_ms, total_ms);
+                size_t len = (size_t)n + json_escape(st.text, st.text_len, final_line + n);
+                memcpy(final_line + len, "\"}\n", 3);
+                send_all(job->fd, final_line, len + 3);
+                free(final_line);
+            }
+        }
+    }
+
+    free(st.text);
+    free(st.line);
+}
+
+static void* worker_main(void* arg) {
+    server_worker* w = (server_worker*)arg;
+    server_queue* q = &w->srv->queue;
+
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        while (q->count == 0 && !q->stop) {
+            pthread_cond_wait(&q->not_empty, &q->lock);
+        }
+        if (q->count == 0 && q->stop) {
+            pthread_mutex_unlock(&q->lock);
+            break;
+        }
+        server_job job = q->jobs[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        pthread_mutex_unlock(&q->lock);
+
+        pthread_mutex_lock(&w->srv->metrics.lock);
+        w->srv->metrics.busy_workers++;
+        pthread_mutex_unlock(&w->srv->metrics.lock);
+
+        worker_handle(w, &job);
+        close(job.fd);
+        free(job.req.prompt);
+
+        pthread_mutex_lock(&w->srv->metrics.lock);
+        w->srv->metrics.busy_workers--;
+        pthread_mutex_unlock(&w->srv->metrics.lock);
+    }
+    return NULL;
+}
+
+// Enfileira job. Returns false se a fila está cheia (backpressure)
+static bool queue_push(server_queue* q, const server_job* job) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->capacity) {
+        pthread_mutex_unlock(&q->lock);
+        return false;
+    }
+    q->jobs[(q->head + q->count) % q->capacity] = *job;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return true;
+}
+
+static q_error_code worker_init(server_worker* w, server_state* srv, uint32_t id) {
+    memset(w, 0, sizeof(*w));
+    w->id = id;
+    w->srv = srv;
+
+    q_error_code err = q_alloc_arena(&w->ctx, (size_t)srv->config.arena_mb * 1024 * 1024);
+    if (err != Q_OK) return err;
+    err = q_alloc_kv_cache(&w->ctx, srv->kv_size);
+    if (err != Q_OK) return err;
+
+    w->prompt_buf = (uint32_t*)malloc(SERVER_MAX_PROMPT_TOKENS * sizeof(uint32_t));
+    w->gen_buf = (uint32_t*)malloc(SERVER_MAX_GEN_TOKENS * sizeof(uint32_t));
+    if (w->prompt_buf == NULL || w->gen_buf == NULL) return Q_ERR_ALLOC_FAILED;
+
+    // Vocabulário sem caracteres estruturais JSON: requisições "json" são recusadas
+    w->grammar_ready = (q_grammar_init_json(&w->grammar, &srv->tokenizer) == Q_OK);
+    return Q_OK;
+}
+
+static void worker_free(server_worker* w) {
+    q_grammar_free(&w->grammar);
+    free(w->prompt_buf);
+    free(w->gen_buf);
+    q_free_memory(&w->ctx);  // Sem mmap: apenas arena + KV
+}
+
+// ============================================================================
+// LISTENER
+// ============================================================================
+
+static int server_listen(const server_config* cfg) {
+    union {
+        struct sockaddr sa;
+        struct sockaddr_in in;
+        struct sockaddr_un un;
+    } addr;
+    socklen_t addr_len = 0;
+    memset(&addr, 0, sizeof(addr));
+
+    int fd = -1;
+    if (cfg->port != 0) {
+        addr.in.sin_family = AF_INET;
+        addr.in.sin_port = htons(cfg->port);
+        addr.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // Somente localhost
+        addr_len = sizeof(addr.in);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    } else {
+        if (strlen(cfg->socket_path) >= sizeof(addr.un.sun_path)) return -1;
+        addr.un.sun_family = AF_UNIX;
+        strcpy(addr.un.sun_path, cfg->socket_path);
+        addr_len = sizeof(addr.un);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        unlink(cfg->socket_path);
+    }
+    if (bind(fd, &addr.sa, addr_len) < 0 || listen(fd, 128) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (cfg->port == 0) {
+        chmod(cfg->socket_path, 0600);  // Apenas o usuário dono
+    }
+    // Não-bloqueante: conexão abortada entre poll() e accept() não trava o loop
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+// Despacha uma requisição completa: comandos respondidos inline, geração vai para a fila
+// fd já em modo bloqueante (o worker faz streaming com send_all); SO_SNDTIMEO limita
+// o send() de um cliente que parou de ler: send_all falha e on_token aborta a geração
+static void server_dispatch(server_state* srv, int fd, const char* line_buf) {
+    const struct timeval send_timeout = { .tv_sec = SERVER_SEND_TIMEOUT_S, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    server_job job = { .fd = fd, .t_enqueue_ms = now_ms() };
+    const char* parse_err = parse_request(line_buf, &job.req);
+    if (parse_err != NULL) {
+        send_error(fd, parse_err, "BAD_REQUEST");
+        free(job.req.prompt);
+        close(fd);
+        return;
+    }
+
+    if (strcmp(job.req.cmd, "metrics") == 0) {
+        send_metrics(srv, fd);
+    } else if (strcmp(job.req.cmd, "health") == 0) {
+        char line[128];
+        int n = snprintf(line, sizeof(line),
+                         "{\"status\": \"healthy\", \"model_loaded\": true, \"uptime\": %llu}\n",
+                         (unsigned long long)((now_ms() - srv->metrics.start_ms) / 1000.0));
+        send_all(fd, line, (size_t)n);
+    } else if (job.req.cmd[0] != '\0') {
+        send_error(fd, "unknown cmd", "BAD_REQUEST");
+    } else {
+        pthread_mutex_lock(&srv->metrics.lock);
+        job.request_id = ++srv->metrics.requests_total;
+        pthread_mutex_unlock(&srv->metrics.lock);
+
+        if (queue_push(&srv->queue, &job)) {
+            return;  // Worker fecha fd e libera prompt
+        }
+        pthread_mutex_lock(&srv->metrics.lock);
+        srv->metrics.requests_rejected++;
+        pthread_mutex_unlock(&srv->metrics.lock);
+        send_error(fd, "queue full", "QUEUE_FULL");
+    }
+    free(job.req.prompt);
+    close(fd);
+}
+
+// Lê o que estiver disponível sem bloquear. Returns true quando a conexão saiu
+// de pending (linha completa despachada, erro, EOF ou overflow)
+static bool pending_read(server_state* srv, pending_conn* c) {
+    for (;;) {
+        ssize_t n = recv(c->fd, c->buf + c->len, SERVER_MAX_REQUEST - 1 - c->len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return false;  // EWOULDBLOCK == EAGAIN no Linux
+            close(c->fd);
+            return true;
+        }
+        // EOF: a requisição é o que chegou até aqui (cliente sem '\n' final)
+        char* nl = (n > 0) ? memchr(c->buf + c->len, '\n', (size_t)n) : NULL;
+        c->len += (size_t)n;
+        if (n == 0 || nl != NULL) {
+            c->len = (nl != NULL) ? (size_t)(nl - c->buf) : c->len;
+            c->buf[c->len] = '\0';
+            fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) & ~O_NONBLOCK);
+            server_dispatch(srv, c->fd, c->buf);
+            return true;
+        }
+        if (c->len + 1 >= SERVER_MAX_REQUEST) {
+            send_error(c->fd, "request too large", "BAD_REQUEST");
+            close(c->fd);
+            return true;
+        }
+    }
+}
+
+// Loop do listener: poll() sobre o socket de escuta + conexões pendentes.
+// Clientes lentos/ociosos só ocupam um slot de pending até o prazo; nunca
+// bloqueiam o accept nem as outras conexões
+static void server_accept_loop(server_state* srv, int listen_fd, pending_conn* pending) {
+    struct pollfd pfds[SERVER_MAX_PENDING + 1];
+    uint32_t n_pending = 0;
+
+    while (!g_stop) {
+        const double now = now_ms();
+        double next_deadline = now + 1000.0;
+        for (uint32_t i = 0; i < n_pending; i++) {
+            pfds[i + 1] = (struct pollfd){ .fd = pending[i].fd, .events = POLLIN };
+            next_deadline = (pending[i].deadline_ms < next_deadline) ? pending[i].deadline_ms : next_deadline;
+        }
+        // Pending cheio: novas conexões esperam no backlog do kernel
+        pfds[0] = (struct pollfd){ .fd = (n_pending < SERVER_MAX_PENDING) ? listen_fd : -1, .events = POLLIN };
+
+        const int timeout_ms = (next_deadline > now) ? (int)(next_deadline - now) + 1 : 0;
+        if (poll(pfds, n_pending + 1, timeout_ms) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "WARNING: poll failed: %s\n", strerror(errno));
+            continue;
+        }
+
+        // Ordem reversa: remover i (swap com o último) não afeta índices ainda não vistos
+        const double t = now_ms();
+        for (uint32_t i = n_pending; i-- > 0;) {
+            bool done;
+            if (pfds[i + 1].revents != 0) {
+                done = pending_read(srv, &pending[i]);
+            } else {
+                done = (t >= pending[i].deadline_ms);
+                if (done) {
+                    send_error(pending[i].fd, "request timed out", "BAD_REQUEST");
+                    close(pending[i].fd);
+                }
+            }
+            if (done) {
+                char* buf = pending[i].buf;
+                pending[i] = pending[--n_pending];
+                pending[n_pending].buf = buf;  // Buffers ficam com o slot (sem malloc por conexão)
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+                    fprintf(stderr, "WARNING: accept failed: %s\n", strerror(errno));
+                }
+                continue;
+            }
+            pending_conn* c = &pending[n_pending++];
+            c->fd = fd;
+            c->len = 0;
+            c->deadline_ms = now_ms() + SERVER_RECV_TIMEOUT_S * 1000.0;
+            // Dados podem já estar no socket: tenta ler sem esperar o próximo poll
+            if (pending_read(srv, c)) {
+                char* buf = c->buf;
+                *c = pending[--n_pending];
+                pending[n_pending].buf = buf;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < n_pending; i++) {
+        close(pending[i].fd);
+    }
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+static void print_usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s <model.qorus> <tokenizer.bin> [--socket PATH | --port N]\n"
+            "          [--workers N] [--queue N] [--arena-mb N]\n"
+            "Defaults: --socket %s --workers %d --queue %d --arena-mb %d\n",
+            prog, SERVER_DEFAULT_SOCKET, SERVER_DEFAULT_WORKERS, SERVER_DEFAULT_QUEUE,
+            SERVER_DEFAULT_ARENA_MB);
+}
+
+static bool parse_args(int argc, char** argv, server_config* cfg) {
+    if (argc < 3) return false;
+    cfg->model_path = argv[1];
+    cfg->tokenizer_path = argv[2];
+    cfg->socket_path = SERVER_DEFAULT_SOCKET;
+    cfg->n_workers = SERVER_DEFAULT_WORKERS;
+    cfg->queue_capacity = SERVER_DEFAULT_QUEUE;
+    cfg->arena_mb = SERVER_DEFAULT_ARENA_MB;
+
+    for (int i = 3; i < argc; i++) {
+        if (i + 1 >= argc) return false;
+        const char* opt = argv[i];
+        const char* val = argv[++i];
+        long v = strtol(val, NULL, 10);
+        if (strcmp(opt, "--socket") == 0) {
+            cfg->socket_path = val;
+        } else if (strcmp(opt, "--port") == 0 && v > 0 && v < 65536) {
+            cfg->port = (uint16_t)v;
+        } else if (strcmp(opt, "--workers") == 0 && v > 0 && v <= 256) {
+            cfg->n_workers = (uint32_t)v;
+        } else if (strcmp(opt, "--queue") == 0 && v > 0 && v <= 65536) {
+            cfg->queue_capacity = (uint32_t)v;
+        } else if (strcmp(opt, "--arena-mb") == 0 && v > 0 && v <= 65536) {
+            cfg->arena_mb = (uint32_t)v;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Carrega modelo uma vez (mmap + grafo) e tokenizer
+static q_error_code server_load_model(server_state* srv) {
+    q_error_code err = q_init_memory(&srv->model_ctx, srv->config.model_path);
+    if (err != Q_OK) return err;
+    err = q_alloc_arena(&srv->model_ctx, (size_t)srv->config.arena_mb * 1024 * 1024);
+    if (err != Q_OK) return err;
+    err = llama_build_graph(&srv->model_ctx, &srv->model);
+    if (err != Q_OK) return err;
+    err = q_tokenizer_load(&srv->tokenizer, srv->config.tokenizer_path);
+    if (err != Q_OK) return err;
+
+    const q_llama_config* c = &srv->model.config;
+    const size_t head_dim = c->dim / c->n_heads;
+    srv->kv_size = Q_ALIGN_SIZE((size_t)c->n_layers * c->n_kv_heads * c->max_seq_len *
+                                head_dim * 2 * sizeof(float));
+    return Q_OK;
+}
+
+int main(int argc, char** argv) {
+    server_state* srv = (server_state*)calloc(1, sizeof(server_state));
+    if (srv == NULL) return 1;
+    if (!parse_args(argc, argv, &srv->config)) {
+        print_usage(argv[0]);
+        free(srv);
+        return 1;
+    }
+
+    int exit_code = 1;
+    server_worker* workers = NULL;
+    pending_conn* pending = NULL;
+    char* pending_bufs = NULL;
+    uint32_t n_started = 0;
+    int listen_fd = -1;
+
+    pthread_mutex_init(&srv->queue.lock, NULL);
+    pthread_cond_init(&srv->queue.not_empty, NULL);
+    pthread_mutex_init(&srv->metrics.lock, NULL);
+    srv->metrics.start_ms = now_ms();
+    srv->rng_seed = (uint64_t)(srv->metrics.start_ms * 1000.0) ^ ((uint64_t)getpid() << 32);
+
+    q_error_code err = server_load_model(srv);
+    if (err != Q_OK) {
+        fprintf(stderr, "ERROR: Failed to load model/tokenizer: %s\n", q_strerror(err));
+        goto cleanup;
+    }
+    printf("✓ Model loaded (%u layers, vocab %u, max_seq_len %u)\n",
+           srv->model.config.n_layers, srv->model.config.vocab_size, srv->model.config.max_seq_len);
+
+    srv->queue.capacity = srv->config.queue_capacity;
+    srv->queue.jobs = (server_job*)calloc(srv->queue.capacity, sizeof(server_job));
+    workers = (server_worker*)calloc(srv->config.n_workers, sizeof(server_worker));
+    pending = (pending_conn*)calloc(SERVER_MAX_PENDING, sizeof(pending_conn));
+    pending_bufs = (char*)malloc((size_t)SERVER_MAX_PENDING * SERVER_MAX_REQUEST);
+    if (srv->queue.jobs == NULL || workers == NULL || pending == NULL || pending_bufs == NULL) {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        goto cleanup;
+    }
+
+    for (; n_started < srv->config.n_workers; n_started++) {
+        server_worker* w = &workers[n_started];
+        err = worker_init(w, srv, n_started);
+        if (err != Q_OK || pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            fprintf(stderr, "ERROR: Failed to start worker %u: %s\n", n_started, q_strerror(err));
+            worker_free(w);
+            goto cleanup;
+        }
+    }
+    for (uint32_t i = 0; i < SERVER_MAX_PENDING; i++) {
+        pending[i].buf = pending_bufs + (size_t)i * SERVER_MAX_REQUEST;
+    }
+    printf("✓ %u workers ready (KV cache %.1f MB each)\n",
+           n_started, (double)srv->kv_size / (1024.0 * 1024.0));
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop_signal;  // Sem SA_RESTART: poll() retorna EINTR
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    listen_fd = server_listen(&srv->config);
+    if (listen_fd < 0) {
+        fprintf(stderr, "ERROR: Failed to listen: %s\n", strerror(errno));
+        goto cleanup;
+    }
+    if (srv->config.port != 0) {
+        printf("✓ Listening on 127.0.0.1:%u\n", srv->config.port);
+    } else {
+        printf("✓ Listening on %s\n", srv->config.socket_path);
+    }
+    fflush(stdout);
+
+    server_accept_loop(srv, listen_fd, pending);
+    printf("Shutting down (draining %u queued requests)...\n", srv->queue.count);
+    exit_code = 0;
+
+cleanup:
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        if (srv->config.port == 0) unlink(srv->config.socket_path);
+    }
+
+    // Workers drenam a fila antes de sair
+    pthread_mutex_lock(&srv->queue.lock);
+    srv->queue.stop = true;
+    pthread_cond_broadcast(&srv->queue.not_empty);
+    pthread_mutex_unlock(&srv->queue.lock);
+    for (uint32_t i = 0; i < n_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        worker_free(&workers[i]);
+    }
+
+    free(pending);
+    free(pending_bufs);
+    free(workers);
+    free(srv->queue.jobs);
+    q_tokenizer_free(&srv->tokenizer);
+    if (srv->model.token_embd != NULL || srv->model.layers != NULL) {
+        llama_free_graph(&srv->model);
+    }
+    q_free_memory(&srv->model_ctx);
+    pthread_mutex_destroy(&srv->queue.lock);
+    pthread_cond_destroy(&srv->queue.not_empty);
+    pthread_mutex_destroy(&srv->metrics.lock);
+    free(srv);
+    return exit_code;
+}
@@ -0,0 +1,411 @@
+// ============================================================================
+// ROOFLINE: GB/s e GFLOP/s por kernel vs picos medidos na máquina
+// ============================================================================
+// 1. Picos single-core (o runtime é single-thread por contexto):
+//    - banda de streaming: leitura pura (soma) e triad a = b + s * c
+//    - throughput FMA: cadeias independentes de _mm256_fmadd_ps
+// 2. Cada kernel em shapes Llama reais:
+//    - Llama-3.2-1B: dim 2048, hidden 8192, head_dim 64
+//    - Llama-3-8B:   dim 4096, hidden 14336, head_dim 128
+//    - vocab 128256 (LM head / softmax)
+// 3. Bytes movidos e FLOPs analíticos -> GB/s, GFLOP/s, % do pico e % do
+//    teto roofline min(P_peak, AI * B_peak)
+//
+// Pesos Q4_0 rodam por um pool maior que o LLC (cada chamada lê da DRAM, como
+// no decode). Ativações ficam quentes em cache, como no forward real: kernels
+// elementwise podem passar de 100% da banda DRAM (teto de L1/L2).
+// Convenção de FLOPs: exp/rsqrt/div contam como 1 FLOP.
+//
+// Uso: roofline [--quick]   (--quick: só shapes 1B, ~1.5GB a menos de RAM)
+// ============================================================================
+
+#include "../include/qorus.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <immintrin.h>
+
+// ============================================================================
+// CONFIGURATION
+// ============================================================================
+
+#define PEAK_BW_BYTES (512UL * 1024 * 1024)     // Buffer do teste de banda (>> LLC)
+#define PEAK_BW_REPS 5
+#define PEAK_FMA_CHAINS 12                      // >= latência FMA x portas (4-5 ciclos x 2)
+#define PEAK_FMA_ITERATIONS 50000000UL
+#define Q4_POOL_BYTES (256UL * 1024 * 1024)     // Pool de pesos Q4_0 rotacionado
+#define MIN_KERNEL_TIME_MS 200.0
+#define MIN_KERNEL_REPS 3
+#define LLAMA_VOCAB_SIZE 128256
+#define DECODE_CONTEXT 4096                     // Posições no KV cache (decode)
+#define PREFILL_TOKENS 512
+
+// ============================================================================
+// TIMING UTILITIES
+// ============================================================================
+
+static double get_time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static float* alloc_floats(size_t n, float value) {
+    float* p = (float*)aligned_alloc(64, Q_ALIGN_SIZE(n * sizeof(float)));
+    if (p != NULL) {
+        for (size_t i = 0; i < n; i++) {
+            p[i] = value + (float)(i % 17) * 1e-3f;
+        }
+    }
+    return p;
+}
+
+// ============================================================================
+// MACHINE PEAKS
+// ============================================================================
+
+static double measure_peak_read_gbs(const float* buf, size_t n) {
+    double best_ms = INFINITY;
+    float sink = 0.0f;
+    for (int rep = 0; rep < PEAK_BW_REPS; rep++) {
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+        const double start = get_time_ms();
+        for (size_t i = 0; i < n; i += 32) {
+            acc0 = _mm256_add_ps(acc0, _mm256_load_ps(buf + i));
+            acc1 = _mm256_add_ps(acc1, _mm256_load_ps(buf + i + 8));
+            acc2 = _mm256_add_ps(acc2, _mm256_load_ps(buf + i + 16));
+            acc3 = _mm256_add_ps(acc3, _mm256_load_ps(buf + i + 24));
+        }
+        const double ms = get_time_ms() - start;
+        float lanes[8] __attribute__((aligned(32)));
+        _mm256_store_ps(lanes, _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+        sink += lanes[0];
+        best_ms = (ms < best_ms) ? ms : best_ms;
+    }
+    if (sink < -1.0f) {
+        printf("(sink %f)\n", (double)sink);  // Impede eliminação do loop
+    }
+    return (double)(n * sizeof(float)) / (best_ms * 1e6);
+}
+
+// STREAM triad: 2 leituras + 1 escrita por elemento (write-allocate não contado)
+static double measure_peak_triad_gbs(float* a, const float* b, const float* c, size_t n) {
+    const __m256 s = _mm256_set1_ps(0.5f);
+    double best_ms = INFINITY;
+    for (int rep = 0; rep < PEAK_BW_REPS; rep++) {
+        const double start = get_time_ms();
+        for (size_t i = 0; i < n; i += 8) {
+            _mm256_store_ps(a + i, _mm256_fmadd_ps(s, _mm256_load_ps(c + i), _mm256_load_ps(b + i)));
+        }
+        const double ms = get_time_ms() - start;
+        best_ms = (ms < best_ms) ? ms : best_ms;
+    }
+    return (double)(3 * n * sizeof(float)) / (best_ms * 1e6);
+}
+
+static double measure_peak_gflops(void) {
+    __m256 acc[PEAK_FMA_CHAINS];
+    for (int j = 0; j < PEAK_FMA_CHAINS; j++) {
+        acc[j] = _mm256_set1_ps((float)j);
+    }
+    // Ponto fixo b / (1 - a) = 1000: sem overflow nem denormais
+    const __m256 a = _mm256_set1_ps(0.999999f);
+    const __m256 b = _mm256_set1_ps(1e-3f);
+    const double start = get_time_ms();
+    for (size_t i = 0; i < PEAK_FMA_ITERATIONS; i++) {
+        for (int j = 0; j < PEAK_FMA_CHAINS; j++) {
+            acc[j] = _mm256_fmadd_ps(acc[j], a, b);
+        }
+    }
+    const double ms = get_time_ms() - start;
+    __m256 sum = _mm256_setzero_ps();
+    for (int j = 0; j < PEAK_FMA_CHAINS; j++) {
+        sum = _mm256_add_ps(sum, acc[j]);
+    }
+    float lanes[8] __attribute__((aligned(32)));
+    _mm256_store_ps(lanes, sum);
+    if (lanes[0] < 0.0f) {
+        printf("(sink %f)\n", (double)lanes[0]);
+    }
+    const double flops = (double)PEAK_FMA_ITERATIONS * PEAK_FMA_CHAINS * 8 * 2;
+    return flops / (ms * 1e6);
+}
+
+// ============================================================================
+// KERNEL CASES
+// ============================================================================
+
+typedef enum {
+    KERNEL_GEMV_Q4,
+    KERNEL_MATMUL_F32,
+    KERNEL_LM_HEAD_TOPK,
+    KERNEL_RMSNORM,
+    KERNEL_ROPE,
+    KERNEL_SILU,
+    KERNEL_MUL,
+    KERNEL_ADD,
+    KERNEL_SOFTMAX
+} kernel_kind;
+
+typedef struct {
+    const char* name;
+    kernel_kind kind;
+    uint32_t m, n, k;           // GEMV: [m, n]; MatMul: [m, k] @ [k, n]; elementwise: n
+    double bytes;               // Bytes mínimos lidos + escritos por chamada
+    double flops;               // FLOPs por chamada
+} kernel_case;
+
+// Buffers compartilhados por todos os casos (dimensionados para o maior shape)
+typedef struct {
+    q_block_q4_0* q4_pool;      // Pool rotacionado de pesos Q4_0
+    size_t q4_pool_blocks;
+    float* lm_head;             // [vocab, max_dim] FP32
+    float* kv;                  // [DECODE_CONTEXT, head_dim] / [PREFILL_TOKENS, head_dim]
+    float* x;                   // Ativações (entrada)
+    float* y;                   // Ativações (segunda entrada)
+    float* out;                 // Saída
+    float* cos_table;
+    float* sin_table;
+    q_context* ctx;
+} kernel_buffers;
+
+static q_error_code run_case(const kernel_case* c, const kernel_buffers* b, uint32_t rep) {
+    switch (c->kind) {
+        case KERNEL_GEMV_Q4: {
+            // Fatia diferente do pool a cada chamada: pesos sempre vindos da DRAM
+            const size_t blocks = (size_t)c->m * (c->n / 32);
+            const size_t slices = b->q4_pool_blocks / blocks;
+            q_tensor w = {
+                .data = b->q4_pool + (rep % (slices > 0 ? slices : 1)) * blocks,
+                .ne = {c->m, c->n, 1, 1},
+                .nb = {(c->n / 32) * sizeof(q_block_q4_0), sizeof(q_block_q4_0), 0, 0},
+                .type = Q_Q4_0
+            };
+            return q_gemv_q4_f32_avx2(&w, b->x, b->out);
+        }
+        case KERNEL_MATMUL_F32: {
+            // A [m, k] @ B^T view sobre linhas contíguas [n, k] (K cache / LM head)
+            const float* rows = (c->n >= LLAMA_VOCAB_SIZE) ? b->lm_head : b->kv;
+            q_tensor A = {
+                .data = b->x, .ne = {c->m, c->k, 1, 1},
+                .nb = {c->k * sizeof(float), sizeof(float), sizeof(float), sizeof(float)}, .type = Q_F32
+            };
+            q_tensor B = {
+                .data = (void*)rows, .ne = {c->k, c->n, 1, 1},
+                .nb = {sizeof(float), c->k * sizeof(float), sizeof(float), sizeof(float)}, .type = Q_F32
+            };
+            q_tensor C = {
+                .data = b->out, .ne = {c->m, c->n, 1, 1},
+                .nb = {c->n * sizeof(float), sizeof(float), sizeof(float), sizeof(float)}, .type = Q_F32
+            };
+            q_arena_reset(b->ctx);
+            return q_matmul_f32_avx2(&A, &B, &C, b->ctx);
+        }
+        case KERNEL_LM_HEAD_TOPK: {
+            q_tensor w = {
+                .data = b->lm_head, .ne = {c->m, c->n, 1, 1},
+                .nb = {c->n * sizeof(float), sizeof(float), sizeof(float), sizeof(float)}, .type = Q_F32
+            };
+            uint32_t top_id;
+            float top_logit;
+            return q_lm_head_topk_f32_avx2(b->x, &w, 1, &top_id, &top_logit, NULL);
+        }
+        case KERNEL_RMSNORM:
+            return q_rmsnorm_f32_avx2(b->x, b->y, b->out, c->n, 1e-5f);
+        case KERNEL_ROPE:
+            return q_rope_f32_avx2(b->x, b->cos_table, b->sin_table, b->out, c->n);
+        case KERNEL_SILU:
+            return q_silu_f32_avx2(b->x, b->out, c->n);
+        case KERNEL_MUL:
+        case KERNEL_ADD: {
+            q_tensor ta = {.data = b->x, .ne = {c->n, 1, 1, 1},
+                           .nb = {c->n * sizeof(float), sizeof(float), sizeof(float), sizeof(float)}, .type = Q_F32};
+            q_tensor tb = ta;
+            tb.data = b->y;
+            q_tensor to = ta;
+            to.data = b->out;
+            return (c->kind == KERNEL_MUL) ? q_mul_f32_avx2(&ta, &tb, &to) : q_add_f32_avx2(&ta, &tb, &to);
+        }
+        case KERNEL_SOFTMAX:
+            return q_softmax_f32_avx2(b->x, b->out, c->n);
+    }
+    return Q_ERR_INVALID_ARG;
+}
+
+// Melhor tempo por chamada (ms): repete até MIN_KERNEL_TIME_MS e MIN_KERNEL_REPS
+static double time_case(const kernel_case* c, const kernel_buffers* b, q_error_code* err) {
+    *err = run_case(c, b, 0);  // Warmup (page faults, caches)
+    double best = INFINITY;
+    double elapsed = 0.0;
+    for (uint32_t rep = 1; *err == Q_OK && (elapsed < MIN_KERNEL_TIME_MS || rep <= MIN_KERNEL_REPS); rep++) {
+        const double start = get_time_ms();
+        *err = run_case(c, b, rep);
+        const double ms = get_time_ms() - start;
+        elapsed += ms;
+        best = (ms < best) ? ms : best;
+    }
+    return best;
+}
+
+static void print_case(const kernel_case* c, double ms, double peak_gbs, double peak_gflops) {
+    const double gbs = c->bytes / (ms * 1e6);
+    const double gflops = c->flops / (ms * 1e6);
+    const double ai = c->flops / c->bytes;
+    const double roof = fmin(peak_gflops, ai * peak_gbs);
+    const char* bound = (ai * peak_gbs < peak_gflops) ? "memory" : "compute";
+    char shape[48];
+    if (c->kind == KERNEL_GEMV_Q4 || c->kind == KERNEL_LM_HEAD_TOPK) {
+        snprintf(shape, sizeof(shape), "%ux%u", c->m, c->n);
+    } else if (c->kind == KERNEL_MATMUL_F32) {
+        snprintf(shape, sizeof(shape), "%ux%u@%ux%u", c->m, c->k, c->k, c->n);
+    } else {
+        snprintf(shape, sizeof(shape), "%u", c->n);
+    }
+    printf("  %-22s %-18s %10.1f %8.2f %6.1f%% %9.2f %6.1f%% %7.3f  %-7s %6.1f%%\n",
+           c->name, shape, ms * 1e3, gbs, 100.0 * gbs / peak_gbs, gflops, 100.0 * gflops / peak_gflops,
+           ai, bound, 100.0 * gflops / roof);
+}
+
+// Casos de uma configuração Llama
+static uint32_t build_cases(kernel_case* cases, uint32_t dim, uint32_t hidden, uint32_t head_dim) {
+    const double f = sizeof(float);
+    const double q4_row = sizeof(q_block_q4_0) / 32.0;  // Bytes por peso Q4_0
+    const uint32_t v = LLAMA_VOCAB_SIZE;
+    uint32_t n = 0;
+    cases[n++] = (kernel_case){"gemv_q4 wq/wo", KERNEL_GEMV_Q4, dim, dim, 0,
+                               (double)dim * dim * q4_row + 2.0 * dim * f, 2.0 * dim * dim};
+    cases[n++] = (kernel_case){"gemv_q4 gate/up", KERNEL_GEMV_Q4, hidden, dim, 0,
+                               (double)hidden * dim * q4_row + (double)(dim + hidden) * f, 2.0 * hidden * dim};
+    cases[n++] = (kernel_case){"gemv_q4 down", KERNEL_GEMV_Q4, dim, hidden, 0,
+                               (double)hidden * dim * q4_row + (double)(dim + hidden) * f, 2.0 * hidden * dim};
+    cases[n++] = (kernel_case){"matmul_f32 qk decode", KERNEL_MATMUL_F32, 1, DECODE_CONTEXT, head_dim,
+                               ((double)DECODE_CONTEXT * head_dim + head_dim + DECODE_CONTEXT) * f,
+                               2.0 * DECODE_CONTEXT * head_dim};
+    cases[n++] = (kernel_case){"matmul_f32 qk prefill", KERNEL_MATMUL_F32, PREFILL_TOKENS, PREFILL_TOKENS, head_dim,
+                               (2.0 * PREFILL_TOKENS * head_dim + (double)PREFILL_TOKENS * PREFILL_TOKENS) * f,
+                               2.0 * PREFILL_TOKENS * PREFILL_TOKENS * head_dim};
+    cases[n++] = (kernel_case){"matmul_f32 lm_head", KERNEL_MATMUL_F32, 1, v, dim,
+                               ((double)v * dim + dim + v) * f, 2.0 * v * dim};
+    cases[n++] = (kernel_case){"lm_head_topk k=1", KERNEL_LM_HEAD_TOPK, v, dim, 0,
+                               ((double)v * dim + dim) * f, 2.0 * v * dim};
+    cases[n++] = (kernel_case){"rmsnorm", KERNEL_RMSNORM, 0, dim, 0, 3.0 * dim * f, 4.0 * dim};
+    cases[n++] = (kernel_case){"rope", KERNEL_ROPE, 0, dim, 0, 3.0 * dim * f, 3.0 * dim};
+    cases[n++] = (kernel_case){"silu", KERNEL_SILU, 0, hidden, 0, 2.0 * hidden * f, 4.0 * hidden};
+    cases[n++] = (kernel_case){"mul (swiglu)", KERNEL_MUL, 0, hidden, 0, 3.0 * hidden * f, 1.0 * hidden};
+    cases[n++] = (kernel_case){"add (residual)", KERNEL_ADD, 0, dim, 0, 3.0 * dim * f, 1.0 * dim};
+    cases[n++] = (kernel_case){"softmax vocab", KERNEL_SOFTMAX, 0, v, 0, 2.0 * v * f, 4.0 * v};
+    return n;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--quick]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("========================================\n");
+    printf("  ROOFLINE REPORT (single core)\n");
+    printf("========================================\n\n");
+
+    // Step 1: Picos da máquina
+    const size_t bw_floats = PEAK_BW_BYTES / sizeof(float);
+    float* bw_buf = alloc_floats(bw_floats, 1.0f);
+    if (bw_buf == NULL) {
+        fprintf(stderr, "ERROR: cannot allocate %lu MB for the bandwidth test\n", PEAK_BW_BYTES >> 20);
+        return 1;
+    }
+    const double read_gbs = measure_peak_read_gbs(bw_buf, bw_floats);
+    const size_t triad_n = bw_floats / 3 & ~(size_t)7;
+    const double triad_gbs = measure_peak_triad_gbs(bw_buf, bw_buf + triad_n, bw_buf + 2 * triad_n, triad_n);
+    free(bw_buf);
+    const double peak_gflops = measure_peak_gflops();
+    // Kernels de inferência são dominados por leitura: teto de banda = max(read, triad)
+    const double peak_gbs = fmax(read_gbs, triad_gbs);
+    printf("Peak streaming read:  %8.2f GB/s\n", read_gbs);
+    printf("Peak STREAM triad:    %8.2f GB/s\n", triad_gbs);
+    printf("Peak FMA throughput:  %8.2f GFLOP/s (AVX2, %d chains)\n", peak_gflops, PEAK_FMA_CHAINS);
+    printf("Ridge point:          %8.3f FLOP/byte\n\n", peak_gflops / peak_gbs);
+
+    // Step 2: Buffers (dimensionados para o maior shape)
+    const uint32_t max_dim = quick ? 2048 : 4096;
+    const uint32_t max_hidden = quick ? 8192 : 14336;
+    const uint32_t max_head_dim = quick ? 64 : 128;
+    const size_t max_act = (size_t)(LLAMA_VOCAB_SIZE > max_hidden ? LLAMA_VOCAB_SIZE : max_hidden);
+    q_context ctx = {0};
+    kernel_buffers b = {0};
+    b.q4_pool_blocks = Q4_POOL_BYTES / sizeof(q_block_q4_0);
+    b.q4_pool = (q_block_q4_0*)aligned_alloc(64, Q_ALIGN_SIZE(b.q4_pool_blocks * sizeof(q_block_q4_0)));
+    b.lm_head = alloc_floats((size_t)LLAMA_VOCAB_SIZE * max_dim, 0.01f);
+    b.kv = alloc_floats((size_t)(DECODE_CONTEXT > PREFILL_TOKENS ? DECODE_CONTEXT : PREFILL_TOKENS) * max_head_dim, 0.02f);
+    b.x = alloc_floats((size_t)PREFILL_TOKENS * max_head_dim > max_act ? (size_t)PREFILL_TOKENS * max_head_dim : max_act, 0.5f);
+    b.y = alloc_floats(max_act, 1.0f);
+    b.out = alloc_floats((size_t)PREFILL_TOKENS * PREFILL_TOKENS > max_act ? (size_t)PREFILL_TOKENS * PREFILL_TOKENS : max_act, 0.0f);
+    b.cos_table = alloc_floats(max_dim / 2, 0.9f);
+    b.sin_table = alloc_floats(max_dim / 2, 0.1f);
+    b.ctx = &ctx;
+    if (b.q4_pool == NULL || b.lm_head == NULL || b.kv == NULL || b.x == NULL || b.y == NULL ||
+        b.out == NULL || b.cos_table == NULL || b.sin_table == NULL ||
+        q_alloc_arena(&ctx, 16 * 1024 * 1024) != Q_OK) {
+        fprintf(stderr, "ERROR: buffer allocation failed (try --quick)\n");
+        return 1;
+    }
+    for (size_t i = 0; i < b.q4_pool_blocks; i++) {
+        memset(b.q4_pool[i].qs, (int)(0x11 * (i % 15)), sizeof(b.q4_pool[i].qs));
+        b.q4_pool[i].scale = 0.01f;
+    }
+
+    // Step 3: Kernels por configuração
+    static const struct { const char* name; uint32_t dim, hidden, head_dim; } configs[] = {
+        {"Llama-3.2-1B", 2048, 8192, 64},
+        {"Llama-3-8B", 4096, 14336, 128},
+    };
+    int failures = 0;
+    const size_t n_configs = quick ? 1 : sizeof(configs) / sizeof(configs[0]);
+    for (size_t ci = 0; ci < n_configs; ci++) {
+        kernel_case cases[16];
+        const uint32_t n_cases = build_cases(cases, configs[ci].dim, configs[ci].hidden, configs[ci].head_dim);
+        printf("%s (dim %u, hidden %u, head_dim %u, vocab %u)\n", configs[ci].name, configs[ci].dim,
+               configs[ci].hidden, configs[ci].head_dim, LLAMA_VOCAB_SIZE);
+        printf("  %-22s %-18s %10s %8s %7s %9s %7s %7s  %-7s %7s\n", "kernel", "shape", "time(us)",
+               "GB/s", "%BW", "GFLOP/s", "%FLOP", "AI", "bound", "%roof");
+        for (uint32_t i = 0; i < n_cases; i++) {
+            q_error_code err;
+            const double ms = time_case(&cases[i], &b, &err);
+            if (err != Q_OK) {
+                printf("  %-22s ERROR: %s\n", cases[i].name, q_strerror(err));
+                failures++;
+                continue;
+            }
+            print_case(&cases[i], ms, peak_gbs, peak_gflops);
+        }
+        printf("\n");
+    }
+
+    free(b.q4_pool);
+    free(b.lm_head);
+    free(b.kv);
+    free(b.x);
+    free(b.y);
+    free(b.out);
+    free(b.cos_table);
+    free(b.sin_table);
+    q_free_memory(&ctx);
+
+    printf("========================================\n");
+    printf("  ROOFLINE %s\n", failures == 0 ? "COMPLETE" : "FINISHED WITH ERRORS");
+    printf("========================================\n");
+    return failures == 0 ? 0 : 1;
+}